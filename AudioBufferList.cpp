@@ -75,6 +75,14 @@ bool SFB::Audio::BufferList::Deallocate()
 	return true;
 }
 
+size_t SFB::Audio::BufferList::GetAllocatedByteCount() const
+{
+	if(!mBufferList)
+		return 0;
+
+	return offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) + mFormat.FrameCountToByteCount(mCapacityFrames)) * mBufferList->mNumberBuffers;
+}
+
 bool SFB::Audio::BufferList::Reset()
 {
 	if(!mBufferList)
@@ -78,6 +78,9 @@ namespace SFB {
 			/*! @brief Get the format of this \c BufferList */
 			inline const AudioFormat& GetFormat() const		{ return mFormat; }
 
+			/*! @brief Get the number of bytes allocated by this \c BufferList */
+			size_t GetAllocatedByteCount() const;
+
 			//@}
 
 
@@ -118,6 +118,14 @@ void SFB::Audio::RingBuffer::Deallocate()
 	}
 }
 
+size_t SFB::Audio::RingBuffer::GetAllocatedByteCount() const
+{
+	if(!mBuffers)
+		return 0;
+
+	return (mFormat.FrameCountToByteCount(mCapacityFrames) + sizeof(uint8_t *)) * mFormat.mChannelsPerFrame;
+}
+
 
 void SFB::Audio::RingBuffer::Reset()
 {
@@ -93,6 +93,9 @@ namespace SFB {
 			/*! @brief Get the format of this \c BufferList */
 			inline const AudioFormat& GetFormat() const					{ return mFormat; }
 
+			/*! @brief Get the number of bytes allocated by this \c RingBuffer */
+			size_t GetAllocatedByteCount() const;
+
 			/*! @brief  Get the number of frames available for reading */
 			size_t GetFramesAvailableToRead() const;
 
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include <libkern/OSByteOrder.h>
+
+#include "ContentHash.h"
+
+namespace {
+
+	const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+	const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+	const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+	inline uint64_t RotateLeft(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t Read64(const uint8_t *p)
+	{
+		uint64_t value;
+		memcpy(&value, p, sizeof(value));
+		return OSSwapLittleToHostInt64(value);
+	}
+
+	inline uint32_t Read32(const uint8_t *p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return OSSwapLittleToHostInt32(value);
+	}
+
+	inline uint64_t Round(uint64_t accumulator, uint64_t input)
+	{
+		accumulator += input * kPrime2;
+		accumulator = RotateLeft(accumulator, 31);
+		return accumulator * kPrime1;
+	}
+
+	inline uint64_t MergeRound(uint64_t accumulator, uint64_t value)
+	{
+		accumulator ^= Round(0, value);
+		return accumulator * kPrime1 + kPrime4;
+	}
+
+}
+
+SFB::ContentHash::ContentHash(uint64_t seed)
+{
+	Reset(seed);
+}
+
+void SFB::ContentHash::Reset(uint64_t seed)
+{
+	mAccumulators[0] = seed + kPrime1 + kPrime2;
+	mAccumulators[1] = seed + kPrime2;
+	mAccumulators[2] = seed;
+	mAccumulators[3] = seed - kPrime1;
+
+	mSeed = seed;
+	mTotalLength = 0;
+	mBufferSize = 0;
+}
+
+void SFB::ContentHash::Update(const void *data, size_t length)
+{
+	if(nullptr == data || 0 == length)
+		return;
+
+	auto p = static_cast<const uint8_t *>(data);
+	auto end = p + length;
+
+	mTotalLength += length;
+
+	// Complete a partially filled stripe
+	if(mBufferSize) {
+		auto count = std::min(sizeof(mBuffer) - mBufferSize, length);
+		memcpy(mBuffer + mBufferSize, p, count);
+		mBufferSize += count;
+		p += count;
+
+		if(sizeof(mBuffer) != mBufferSize)
+			return;
+
+		for(int i = 0; i < 4; ++i)
+			mAccumulators[i] = Round(mAccumulators[i], Read64(mBuffer + 8 * i));
+		mBufferSize = 0;
+	}
+
+	// Process whole stripes directly from the input
+	if(p + 32 <= end) {
+		uint64_t v1 = mAccumulators[0];
+		uint64_t v2 = mAccumulators[1];
+		uint64_t v3 = mAccumulators[2];
+		uint64_t v4 = mAccumulators[3];
+
+		const uint8_t *limit = end - 32;
+		do {
+			v1 = Round(v1, Read64(p));
+			v2 = Round(v2, Read64(p + 8));
+			v3 = Round(v3, Read64(p + 16));
+			v4 = Round(v4, Read64(p + 24));
+			p += 32;
+		} while(p <= limit);
+
+		mAccumulators[0] = v1;
+		mAccumulators[1] = v2;
+		mAccumulators[2] = v3;
+		mAccumulators[3] = v4;
+	}
+
+	// Save any leftover bytes for the next update
+	if(p < end) {
+		mBufferSize = (size_t)(end - p);
+		memcpy(mBuffer, p, mBufferSize);
+	}
+}
+
+uint64_t SFB::ContentHash::Final() const
+{
+	uint64_t h;
+
+	if(32 <= mTotalLength) {
+		h = RotateLeft(mAccumulators[0], 1) + RotateLeft(mAccumulators[1], 7) + RotateLeft(mAccumulators[2], 12) + RotateLeft(mAccumulators[3], 18);
+		for(int i = 0; i < 4; ++i)
+			h = MergeRound(h, mAccumulators[i]);
+	}
+	else
+		h = mSeed + kPrime5;
+
+	h += mTotalLength;
+
+	const uint8_t *p = mBuffer;
+	const uint8_t *end = mBuffer + mBufferSize;
+
+	while(p + 8 <= end) {
+		h ^= Round(0, Read64(p));
+		h = RotateLeft(h, 27) * kPrime1 + kPrime4;
+		p += 8;
+	}
+
+	if(p + 4 <= end) {
+		h ^= (uint64_t)Read32(p) * kPrime1;
+		h = RotateLeft(h, 23) * kPrime2 + kPrime3;
+		p += 4;
+	}
+
+	while(p < end) {
+		h ^= (*p) * kPrime5;
+		h = RotateLeft(h, 11) * kPrime1;
+		++p;
+	}
+
+	// Avalanche
+	h ^= h >> 33;
+	h *= kPrime2;
+	h ^= h >> 29;
+	h *= kPrime3;
+	h ^= h >> 32;
+
+	return h;
+}
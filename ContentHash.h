@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*! @file ContentHash.h @brief A fast non-cryptographic hash for content identity */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*!
+	 * @brief A streaming implementation of the XXH64 hash
+	 *
+	 * XXH64 is a non-cryptographic hash that runs at memory bandwidth, making it suitable
+	 * for fingerprinting large files as they are read.  The result is identical to the
+	 * reference XXH64 implementation for the same input and seed.
+	 */
+	class ContentHash
+	{
+	public:
+		// ========================================
+		/*! @name Creation and Destruction */
+		//@{
+
+		/*!
+		 * @brief Create a new \c ContentHash
+		 * @param seed The seed value
+		 */
+		explicit ContentHash(uint64_t seed = 0);
+
+		//@}
+
+
+		// ========================================
+		/*! @name Hashing */
+		//@{
+
+		/*!
+		 * @brief Reset the hash state
+		 * @param seed The seed value
+		 */
+		void Reset(uint64_t seed = 0);
+
+		/*!
+		 * @brief Add data to the hash
+		 * @param data The data to add
+		 * @param length The number of bytes in \c data
+		 */
+		void Update(const void *data, size_t length);
+
+		/*!
+		 * @brief Get the hash of the data added since the last reset
+		 * @note The hash state is not modified, so more data may be added afterwards
+		 */
+		uint64_t Final() const;
+
+		//@}
+
+	private:
+
+		// Data members
+		uint64_t	mAccumulators [4];
+		uint64_t	mSeed;
+		uint64_t	mTotalLength;
+		uint8_t		mBuffer [32];
+		size_t		mBufferSize;
+	};
+
+}
@@ -3,6 +3,8 @@
  * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
  */
 
+#include <cstring>
+
 #include <AudioToolbox/AudioFormat.h>
 #include <CoreFoundation/CoreFoundation.h>
 
@@ -13,6 +15,8 @@
 #include "CFErrorUtilities.h"
 #include "CreateStringForOSType.h"
 #include "LoopableRegionDecoder.h"
+#include "ContentHash.h"
+#include "SubclassDispatchTable.h"
 
 // ========================================
 // Error Codes
@@ -23,29 +27,33 @@ const CFStringRef SFB::Audio::Decoder::ErrorDomain = CFSTR("org.sbooth.AudioEngi
 
 std::atomic_bool SFB::Audio::Decoder::sAutomaticallyOpenDecoders = ATOMIC_VAR_INIT(false);
 std::vector<SFB::Audio::Decoder::SubclassInfo> SFB::Audio::Decoder::sRegisteredSubclasses;
+std::shared_ptr<const SFB::SubclassDispatchTable> SFB::Audio::Decoder::sDispatchTable;
 
-CFArrayRef SFB::Audio::Decoder::CreateSupportedFileExtensions()
+std::shared_ptr<const SFB::SubclassDispatchTable> SFB::Audio::Decoder::GetDispatchTable()
 {
-	CFMutableArrayRef supportedFileExtensions = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
-
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		SFB::CFArray decoderFileExtensions(subclassInfo.mCreateSupportedFileExtensions());
-		CFArrayAppendArray(supportedFileExtensions, decoderFileExtensions, CFRangeMake(0, CFArrayGetCount(decoderFileExtensions)));
+	auto dispatchTable = std::atomic_load(&sDispatchTable);
+	if(!dispatchTable) {
+		// Concurrent callers may each build a table; they are identical so the last one stored wins
+		dispatchTable = SubclassDispatchTable::Create(sRegisteredSubclasses);
+		std::atomic_store(&sDispatchTable, dispatchTable);
 	}
 
-	return supportedFileExtensions;
+	return dispatchTable;
 }
 
-CFArrayRef SFB::Audio::Decoder::CreateSupportedMIMETypes()
+void SFB::Audio::Decoder::InvalidateDispatchTable()
 {
-	CFMutableArrayRef supportedMIMETypes = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+	std::atomic_store(&sDispatchTable, std::shared_ptr<const SubclassDispatchTable>());
+}
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		SFB::CFArray decoderMIMETypes(subclassInfo.mCreateSupportedMIMETypes());
-		CFArrayAppendArray(supportedMIMETypes, decoderMIMETypes, CFRangeMake(0, CFArrayGetCount(decoderMIMETypes)));
-	}
+CFArrayRef SFB::Audio::Decoder::CreateSupportedFileExtensions()
+{
+	return (CFArrayRef)CFRetain(GetDispatchTable()->GetSupportedFileExtensions());
+}
 
-	return supportedMIMETypes;
+CFArrayRef SFB::Audio::Decoder::CreateSupportedMIMETypes()
+{
+	return (CFArrayRef)CFRetain(GetDispatchTable()->GetSupportedMIMETypes());
 }
 
 bool SFB::Audio::Decoder::HandlesFilesWithExtension(CFStringRef extension)
@@ -53,12 +61,7 @@ bool SFB::Audio::Decoder::HandlesFilesWithExtension(CFStringRef extension)
 	if(nullptr == extension)
 		return false;
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		if(subclassInfo.mHandlesFilesWithExtension(extension))
-			return true;
-	}
-
-	return false;
+	return nullptr != GetDispatchTable()->SubclassesForExtension(extension);
 }
 
 bool SFB::Audio::Decoder::HandlesMIMEType(CFStringRef mimeType)
@@ -66,12 +69,7 @@ bool SFB::Audio::Decoder::HandlesMIMEType(CFStringRef mimeType)
 	if(nullptr == mimeType)
 		return false;
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		if(subclassInfo.mHandlesMIMEType(mimeType))
-			return true;
-	}
-
-	return false;
+	return nullptr != GetDispatchTable()->SubclassesForMIMEType(mimeType);
 }
 
 SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::CreateForURL(CFURLRef url, CFErrorRef *error)
@@ -110,20 +108,21 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::CreateForInputSource(InputS
 	}
 #endif
 
+	auto dispatchTable = GetDispatchTable();
+
 	// The MIME type takes precedence over the file extension
-	if(mimeType) {
-		for(auto subclassInfo : sRegisteredSubclasses) {
-			if(subclassInfo.mHandlesMIMEType(mimeType)) {
-				unique_ptr decoder(subclassInfo.mCreateDecoder(std::move(inputSource)));
-				if(!AutomaticallyOpenDecoders())
-					return decoder;
-				else {
-					 if(decoder->Open(error))
-						 return decoder;
-					// Take back the input source for reuse if opening fails
-					else
-						 inputSource = std::move(decoder->mInputSource);
-				}
+	const std::vector<size_t> *mimeTypeSubclasses = mimeType ? dispatchTable->SubclassesForMIMEType(mimeType) : nullptr;
+	if(mimeTypeSubclasses) {
+		for(auto index : *mimeTypeSubclasses) {
+			unique_ptr decoder(sRegisteredSubclasses[index].mCreateDecoder(std::move(inputSource)));
+			if(!AutomaticallyOpenDecoders())
+				return decoder;
+			else {
+				 if(decoder->Open(error))
+					 return decoder;
+				// Take back the input source for reuse if opening fails
+				else
+					 inputSource = std::move(decoder->mInputSource);
 			}
 		}
 
@@ -156,18 +155,21 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::CreateForInputSource(InputS
 	// and if openDecoder is false the wrong decoder type may be returned, since the file isn't analyzed
 	// until Open() is called
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		if(subclassInfo.mHandlesFilesWithExtension(pathExtension)) {
-			unique_ptr decoder(subclassInfo.mCreateDecoder(std::move(inputSource)));
-			if(!AutomaticallyOpenDecoders())
+	// Unsupported extensions are rejected with a single lookup
+	auto extensionSubclasses = dispatchTable->SubclassesForExtension(pathExtension);
+	if(!extensionSubclasses)
+		return nullptr;
+
+	for(auto index : *extensionSubclasses) {
+		unique_ptr decoder(sRegisteredSubclasses[index].mCreateDecoder(std::move(inputSource)));
+		if(!AutomaticallyOpenDecoders())
+			return decoder;
+		else {
+			if(decoder->Open(error))
 				return decoder;
-			else {
-				if(decoder->Open(error))
-					return decoder;
-				// Take back the input source for reuse if opening fails
-				else
-					inputSource = std::move(decoder->mInputSource);
-			}
+			// Take back the input source for reuse if opening fails
+			else
+				inputSource = std::move(decoder->mInputSource);
 		}
 	}
 
@@ -177,14 +179,14 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::CreateForInputSource(InputS
 #pragma mark Creation and Destruction
 
 SFB::Audio::Decoder::Decoder()
-	: mInputSource(nullptr), mRepresentedObject(nullptr), mRepresentedObjectCleanupBlock(nullptr), mIsOpen(false)
+	: mInputSource(nullptr), mPreferredSampleFormat(SampleFormat::Default), mRepresentedObject(nullptr), mRepresentedObjectCleanupBlock(nullptr), mIsOpen(false)
 {
 	memset(&mFormat, 0, sizeof(mFormat));
 	memset(&mSourceFormat, 0, sizeof(mSourceFormat));
 }
 
 SFB::Audio::Decoder::Decoder(InputSource::unique_ptr inputSource)
-	: mInputSource(std::move(inputSource)), mRepresentedObject(nullptr), mRepresentedObjectCleanupBlock(nullptr), mIsOpen(false)
+	: mInputSource(std::move(inputSource)), mPreferredSampleFormat(SampleFormat::Default), mRepresentedObject(nullptr), mRepresentedObjectCleanupBlock(nullptr), mIsOpen(false)
 {
 	assert(nullptr != mInputSource);
 
@@ -225,6 +227,17 @@ void SFB::Audio::Decoder::SetRepresentedObjectCleanupBlock(RepresentedObjectClea
 
 #pragma mark Base Functionality
 
+bool SFB::Audio::Decoder::SetPreferredSampleFormat(SampleFormat format)
+{
+	if(IsOpen()) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "SetPreferredSampleFormat() called on a Decoder that is already open");
+		return false;
+	}
+
+	mPreferredSampleFormat = format;
+	return true;
+}
+
 bool SFB::Audio::Decoder::Open(CFErrorRef *error)
 {
 	if(IsOpen()) {
@@ -325,7 +338,21 @@ UInt32 SFB::Audio::Decoder::ReadAudio(AudioBufferList *bufferList, UInt32 frameC
 		return 0;
 	}
 
-	return _ReadAudio(bufferList, frameCount);
+	UInt32 framesRead = _ReadAudio(bufferList, frameCount);
+
+	// A decoder may stop at the length it saw when opened although more audio has since been appended
+	while(0 == framesRead && mInputSource && mInputSource->IsGrowing()) {
+		SInt64 length = mInputSource->GetLength();
+		if(_RefreshTotalFrames() > _GetCurrentFrame()) {
+			framesRead = _ReadAudio(bufferList, frameCount);
+			break;
+		}
+
+		if(!mInputSource->WaitForGrowth(length))
+			break;
+	}
+
+	return framesRead;
 }
 
 SInt64 SFB::Audio::Decoder::GetTotalFrames() const
@@ -338,6 +365,16 @@ SInt64 SFB::Audio::Decoder::GetTotalFrames() const
 	return _GetTotalFrames();
 }
 
+SInt64 SFB::Audio::Decoder::RefreshTotalFrames()
+{
+	if(!IsOpen()) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "RefreshTotalFrames() called on a Decoder that hasn't been opened");
+		return -1;
+	}
+
+	return _RefreshTotalFrames();
+}
+
 SInt64 SFB::Audio::Decoder::GetCurrentFrame() const
 {
 	if(!IsOpen()) {
@@ -358,7 +395,7 @@ bool SFB::Audio::Decoder::SupportsSeeking() const
 	return _SupportsSeeking();
 }
 
-SInt64 SFB::Audio::Decoder::SeekToFrame(SInt64 frame)
+SInt64 SFB::Audio::Decoder::SeekToFrame(SInt64 frame, SeekMode mode)
 {
 	if(!IsOpen()) {
 		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "SeekToFrame() called on a Decoder that hasn't been opened");
@@ -370,5 +407,124 @@ SInt64 SFB::Audio::Decoder::SeekToFrame(SInt64 frame)
 		return -1;
 	}
 
-	return _SeekToFrame(frame);
+	switch(mode) {
+		case SeekMode::Exact:			return _SeekToFrame(frame);
+		case SeekMode::Fast:			return _FastSeekToFrame(frame);
+		case SeekMode::Approximate:		return _ApproximateSeekToFrame(frame);
+	}
+
+	return -1;
+}
+
+bool SFB::Audio::Decoder::ComputeAudioPayloadHash(uint64_t& hash)
+{
+	if(!IsOpen()) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "ComputeAudioPayloadHash() called on a Decoder that hasn't been opened");
+		return false;
+	}
+
+	auto& inputSource = GetInputSource();
+	if(!inputSource.SupportsSeeking()) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "ComputeAudioPayloadHash() requires an InputSource that supports seeking");
+		return false;
+	}
+
+	// Locating and reading the payload moves the input source's offset, which the subclass expects to be unchanged
+	SInt64 savedOffset = inputSource.GetOffset();
+
+	SInt64 offset, length;
+	if(!_GetAudioPayloadRange(offset, length) || 0 > offset || 0 >= length) {
+		inputSource.SeekToOffset(savedOffset);
+		return false;
+	}
+
+	if(!inputSource.SeekToOffset(offset)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder", "Unable to seek to audio payload at offset " << offset);
+		inputSource.SeekToOffset(savedOffset);
+		return false;
+	}
+
+	ContentHash contentHash;
+	std::vector<uint8_t> buffer(1024 * 1024);
+
+	bool success = true;
+	while(0 < length) {
+		auto bytesRead = inputSource.Read(buffer.data(), std::min(length, (SInt64)buffer.size()));
+		if(0 >= bytesRead) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder", "Unable to read audio payload: " << length << " bytes remaining");
+			success = false;
+			break;
+		}
+
+		contentHash.Update(buffer.data(), (size_t)bytesRead);
+		length -= bytesRead;
+	}
+
+	if(!inputSource.SeekToOffset(savedOffset))
+		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder", "Unable to restore InputSource offset " << savedOffset);
+
+	if(success)
+		hash = contentHash.Final();
+
+	return success;
+}
+
+bool SFB::Audio::Decoder::GetUntaggedRange(SInt64& offset, SInt64& length) const
+{
+	auto& inputSource = GetInputSource();
+
+	SInt64 start = 0;
+	SInt64 end = inputSource.GetLength();
+	if(0 >= end)
+		return false;
+
+	// Skip any leading ID3v2 tags
+	for(;;) {
+		uint8_t header [10];
+		if(!inputSource.SeekToOffset(start) || 10 != inputSource.Read(header, 10))
+			break;
+
+		// The tag size is a 28-bit synchsafe integer
+		if(memcmp(header, "ID3", 3) || ((header[6] | header[7] | header[8] | header[9]) & 0x80))
+			break;
+
+		SInt64 tagSize = 10 + ((header[6] << 21) | (header[7] << 14) | (header[8] << 7) | header[9]);
+		// Footer present
+		if(header[5] & 0x10)
+			tagSize += 10;
+
+		if(start + tagSize > end)
+			break;
+
+		start += tagSize;
+	}
+
+	// Strip any trailing ID3v1 and APEv2 tags, which may appear in either order
+	bool foundTag;
+	do {
+		foundTag = false;
+
+		uint8_t footer [32];
+		if(128 <= end - start && inputSource.SeekToOffset(end - 128) && 3 == inputSource.Read(footer, 3) && !memcmp(footer, "TAG", 3)) {
+			end -= 128;
+			foundTag = true;
+		}
+
+		if(32 <= end - start && inputSource.SeekToOffset(end - 32) && 32 == inputSource.Read(footer, 32) && !memcmp(footer, "APETAGEX", 8)) {
+			// The tag size includes the footer but not the optional header
+			SInt64 tagSize = OSReadLittleInt32(footer, 12);
+			if(OSReadLittleInt32(footer, 20) & 0x80000000)
+				tagSize += 32;
+
+			if(32 <= tagSize && tagSize <= end - start) {
+				end -= tagSize;
+				foundTag = true;
+			}
+		}
+	} while(foundTag);
+
+	offset = start;
+	length = end - start;
+
+	return 0 < length;
 }
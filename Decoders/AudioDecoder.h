@@ -21,6 +21,8 @@
 /*! @brief \c SFBAudioEngine's encompassing namespace */
 namespace SFB {
 
+	class SubclassDispatchTable;
+
 	/*! @brief %Audio functionality */
 	namespace Audio {
 
@@ -205,6 +207,26 @@ namespace SFB {
 			/*! @name File access */
 			//@{
 
+			/*! @brief Possible sample formats a decoder may be asked to produce */
+			enum class SampleFormat {
+				Default,		/*!< The decoder's usual output format */
+				Float,			/*!< 32-bit floating point */
+				Int16,			/*!< 16-bit signed integer */
+				Int32			/*!< 32-bit signed integer */
+			};
+
+			/*!
+			 * @brief Set the preferred sample format for PCM data provided by this decoder
+			 * @note The preference is a hint; decoders that cannot natively produce \c format ignore it.
+			 * Use \c GetFormat() after opening to determine the actual format.
+			 * @param format The preferred sample format
+			 * @return \c true on success, \c false if the decoder is already open
+			 */
+			bool SetPreferredSampleFormat(SampleFormat format);
+
+			/*! @brief Get the preferred sample format for PCM data provided by this decoder */
+			inline SampleFormat GetPreferredSampleFormat() const		{ return mPreferredSampleFormat; }
+
 			/*!
 			 * @brief Open the decoder's \c InputSource
 			 * @param error An optional pointer to a \c CFErrorRef to receive error information
@@ -266,6 +288,9 @@ namespace SFB {
 
 			/*!
 			 * @brief Decode audio into the specified buffer
+			 *
+			 * If the input source is growing, at the end of the known audio this waits for more audio to
+			 * be appended and refreshes the total number of frames before returning \c 0
 			 * @param bufferList A buffer to receive the decoded audio
 			 * @param frameCount The requested number of audio frames
 			 * @return The actual number of frames read, or \c 0 on error
@@ -276,6 +301,13 @@ namespace SFB {
 			/*! @brief Get the total number of audio frames */
 			SInt64 GetTotalFrames() const ;
 
+			/*!
+			 * @brief Update the total number of audio frames after the input source has grown
+			 * @note Formats whose length is only read when opened may reparse the input; for other formats this is equivalent to \c GetTotalFrames()
+			 * @return The total number of audio frames
+			 */
+			SInt64 RefreshTotalFrames();
+
 			/*! @brief Get the current audio frame */
 			SInt64 GetCurrentFrame() const;
 
@@ -286,12 +318,53 @@ namespace SFB {
 			/*! @brief Query whether the audio format and input source support seeking */
 			bool SupportsSeeking() const;
 
+			/*! @brief Possible seek precision modes */
+			enum class SeekMode {
+				Exact,			/*!< Seek to exactly the requested frame */
+				Fast,			/*!< Seek to the nearest sync point (page, frame, or keyframe) at or before the requested frame */
+				Approximate		/*!< Seek to an estimated position obtained by interpolating byte offsets */
+			};
+
 			/*!
 			 * @brief Seek to the specified audio frame
+			 * @note Modes other than \c SeekMode::Exact may land on a frame other than \c frame; the return value is the frame actually reached
 			 * @param frame The desired audio frame
+			 * @param mode The desired seek precision
 			 * @return The current frame after seeking
 			 */
-			SInt64 SeekToFrame(SInt64 frame);
+			SInt64 SeekToFrame(SInt64 frame, SeekMode mode = SeekMode::Exact);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Content identity */
+			//@{
+
+			/*!
+			 * @brief Compute a hash of the encoded audio, excluding any metadata
+			 *
+			 * Only the region of the input containing encoded audio is hashed, so the result is unchanged
+			 * by tag edits and is identical for files containing the same audio with different tags.
+			 * @note Not all formats support payload hashing, and the input source must support seeking
+			 * @param hash A \c uint64_t to receive the XXH64 hash of the audio payload
+			 * @return \c true on success, \c false otherwise
+			 * @see ContentHash
+			 */
+			bool ComputeAudioPayloadHash(uint64_t& hash);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Memory usage */
+			//@{
+
+			/*!
+			 * @brief Get the approximate number of bytes this decoder has allocated to hold audio
+			 * @note Memory allocated internally by codec libraries is included only when it can be determined
+			 */
+			inline size_t GetMemoryUsage() const						{ return _GetMemoryUsage(); }
 
 			//@}
 
@@ -304,6 +377,18 @@ namespace SFB {
 
 			AudioFormat						mSourceFormat;		/*!< @brief The native format of the source file */
 
+			SampleFormat					mPreferredSampleFormat;	/*!< @brief The sample format subclasses should produce in \c _Open() if possible */
+
+
+			/*!
+			 * @brief Locate the bytes between any leading ID3v2 tags and trailing ID3v1 or APEv2 tags
+			 * @note The input source's offset is not preserved
+			 * @param offset The offset of the first byte following any leading tags
+			 * @param length The number of bytes preceding any trailing tags
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool GetUntaggedRange(SInt64& offset, SInt64& length) const;
+
 
 			/*! @brief Create a new \c Decoder and initialize \c Decoder::mInputSource to \c nullptr */
 			Decoder();
@@ -328,10 +413,23 @@ namespace SFB {
 			virtual SInt64 _GetTotalFrames() const = 0;
 			virtual SInt64 _GetCurrentFrame() const = 0;
 
+			// Optional support for inputs that grow after opening
+			virtual SInt64 _RefreshTotalFrames()						{ return _GetTotalFrames(); }
+
 			// Optional seeking support
 			virtual bool _SupportsSeeking() const						{ return false; }
 			virtual SInt64 _SeekToFrame(SInt64 /*frame*/)				{ return -1; }
 
+			// Optional inexact seeking support; by default fast seeks are exact and approximate seeks are fast
+			inline virtual SInt64 _FastSeekToFrame(SInt64 frame)		{ return _SeekToFrame(frame); }
+			inline virtual SInt64 _ApproximateSeekToFrame(SInt64 frame)	{ return _FastSeekToFrame(frame); }
+
+			// Optional content identity support; the returned range must exclude all metadata
+			virtual bool _GetAudioPayloadRange(SInt64& /*offset*/, SInt64& /*length*/) const	{ return false; }
+
+			// Optional memory accounting
+			virtual size_t _GetMemoryUsage() const						{ return 0; }
+
 			// Data members
 			void							*mRepresentedObject;
 			RepresentedObjectCleanupBlock	mRepresentedObjectCleanupBlock;
@@ -349,9 +447,6 @@ namespace SFB {
 				CFArrayRef (*mCreateSupportedFileExtensions)();
 				CFArrayRef (*mCreateSupportedMIMETypes)();
 
-				bool (*mHandlesFilesWithExtension)(CFStringRef);
-				bool (*mHandlesMIMEType)(CFStringRef);
-
 				Decoder::unique_ptr (*mCreateDecoder)(InputSource::unique_ptr);
 
 				int mPriority;
@@ -359,6 +454,12 @@ namespace SFB {
 
 			static std::vector <SubclassInfo> sRegisteredSubclasses;
 
+			// Extension and MIME type lookup tables, built from sRegisteredSubclasses on first use
+			static std::shared_ptr<const SubclassDispatchTable> sDispatchTable;
+
+			static std::shared_ptr<const SubclassDispatchTable> GetDispatchTable();
+			static void InvalidateDispatchTable();
+
 		public:
 
 			/*!
@@ -378,9 +479,6 @@ namespace SFB {
 				.mCreateSupportedFileExtensions = T::CreateSupportedFileExtensions,
 				.mCreateSupportedMIMETypes = T::CreateSupportedMIMETypes,
 
-				.mHandlesFilesWithExtension = T::HandlesFilesWithExtension,
-				.mHandlesMIMEType = T::HandlesMIMEType,
-
 				.mCreateDecoder = T::CreateDecoder,
 
 				.mPriority = priority
@@ -392,6 +490,8 @@ namespace SFB {
 			std::sort(sRegisteredSubclasses.begin(), sRegisteredSubclasses.end(), [](const SubclassInfo& a, const SubclassInfo& b) {
 				return a.mPriority > b.mPriority;
 			});
+
+			InvalidateDispatchTable();
 		}
 
 	}
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <sys/mman.h>
+
+#include "BatchDecoder.h"
+#include "AudioConverter.h"
+#include "AudioDecoder.h"
+#include "CFErrorUtilities.h"
+#include "Logger.h"
+
+namespace {
+
+	// The number of frames read at a time
+	const UInt32 kReadChunkFrames = 16384;
+
+	// The number of samples read when checking for audio beyond the expected length
+	const UInt32 kProbeSampleCount = 1024;
+
+	// Interleaved 32-bit native float PCM
+	AudioStreamBasicDescription ArenaFormat(Float64 sampleRate, UInt32 channelsPerFrame)
+	{
+		AudioStreamBasicDescription format;
+		memset(&format, 0, sizeof(format));
+
+		format.mFormatID			= kAudioFormatLinearPCM;
+		format.mFormatFlags			= kAudioFormatFlagsNativeFloatPacked;
+		format.mSampleRate			= sampleRate;
+		format.mChannelsPerFrame	= channelsPerFrame;
+		format.mBitsPerChannel		= 32;
+		format.mBytesPerPacket		= (format.mBitsPerChannel / 8) * format.mChannelsPerFrame;
+		format.mFramesPerPacket		= 1;
+		format.mBytesPerFrame		= format.mBytesPerPacket * format.mFramesPerPacket;
+
+		return format;
+	}
+
+	bool IsArenaFormat(const SFB::Audio::AudioFormat& format)
+	{
+		return format.IsPCM() && (kAudioFormatFlagIsFloat & format.mFormatFlags) && format.IsInterleaved() && 32 == format.mBitsPerChannel && format.IsNativeEndian();
+	}
+
+	CFErrorRef CreateArenaFullError(CFURLRef url)
+	{
+		SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” could not be decoded."), ""));
+		SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Insufficient space"), ""));
+		SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The arena receiving the decoded audio is full."), ""));
+
+		return SFB::CreateErrorForURL(SFB::Audio::Decoder::ErrorDomain, SFB::Audio::Decoder::InputOutputError, description, url, failureReason, recoverySuggestion);
+	}
+
+	// Decode url into its own region of arena
+	bool DecodeURL(CFURLRef url, SFB::Audio::BatchDecoder::Arena& arena, SFB::Audio::BatchDecoder::Entry& entry, CFErrorRef *error)
+	{
+		auto decoder = SFB::Audio::Decoder::CreateForURL(url, error);
+		if(!decoder)
+			return false;
+
+		decoder->SetPreferredSampleFormat(SFB::Audio::Decoder::SampleFormat::Float);
+		if(!decoder->IsOpen() && !decoder->Open(error))
+			return false;
+
+		SFB::Audio::Decoder *source = decoder.get();
+		auto format = ArenaFormat(source->GetFormat().mSampleRate, source->GetFormat().mChannelsPerFrame);
+		UInt32 channels = format.mChannelsPerFrame;
+
+		// Read directly from the decoder when it produces the arena's format
+		std::unique_ptr<SFB::Audio::Converter> converter;
+		if(!IsArenaFormat(source->GetFormat())) {
+			converter = std::unique_ptr<SFB::Audio::Converter>(new SFB::Audio::Converter(std::move(decoder), format));
+			if(!converter->Open(error))
+				return false;
+		}
+
+		auto read = [&](float *buffer, UInt32 frameCount) -> UInt32 {
+			AudioBufferList bufferList;
+			bufferList.mNumberBuffers = 1;
+			bufferList.mBuffers[0].mNumberChannels = channels;
+			bufferList.mBuffers[0].mDataByteSize = frameCount * format.mBytesPerFrame;
+			bufferList.mBuffers[0].mData = buffer;
+
+			return converter ? converter->ConvertAudio(&bufferList, frameCount) : source->ReadAudio(&bufferList, frameCount);
+		};
+
+		// When the length is known decode in place
+		SInt64 totalFrames = source->GetTotalFrames();
+		size_t reservedFrames = 0;
+		size_t offset = 0;
+		if(0 < totalFrames) {
+			if(!arena.Allocate((size_t)totalFrames * channels, offset)) {
+				if(error)
+					*error = CreateArenaFullError(url);
+				return false;
+			}
+			reservedFrames = (size_t)totalFrames;
+		}
+
+		size_t framesDecoded = 0;
+		while(framesDecoded < reservedFrames) {
+			UInt32 frameCount = (UInt32)std::min(reservedFrames - framesDecoded, (size_t)kReadChunkFrames);
+			UInt32 framesRead = read(arena.GetData() + offset + framesDecoded * channels, frameCount);
+			if(0 == framesRead)
+				break;
+			framesDecoded += framesRead;
+		}
+
+		// Audio beyond the expected length, or from a file of unknown length, is collected separately
+		// Usually there is none, so it is first probed for without allocating
+		std::vector<float> overflow;
+		if(framesDecoded == reservedFrames) {
+			float probe [kProbeSampleCount];
+			UInt32 probeFrames = kProbeSampleCount / channels;
+			UInt32 framesRead = probeFrames ? read(probe, probeFrames) : 0;
+
+			if(0 == probeFrames || 0 != framesRead) {
+				overflow.assign(probe, probe + framesRead * channels);
+				size_t overflowFrames = framesRead;
+				for(;;) {
+					overflow.resize((overflowFrames + kReadChunkFrames) * channels);
+					framesRead = read(overflow.data() + overflowFrames * channels, kReadChunkFrames);
+					if(0 == framesRead)
+						break;
+					overflowFrames += framesRead;
+				}
+				overflow.resize(overflowFrames * channels);
+			}
+		}
+
+		// Move the in-place audio and the overflow into a new region; the original region is abandoned
+		if(!overflow.empty()) {
+			size_t newOffset;
+			if(!arena.Allocate(framesDecoded * channels + overflow.size(), newOffset)) {
+				if(error)
+					*error = CreateArenaFullError(url);
+				return false;
+			}
+
+			if(framesDecoded)
+				memcpy(arena.GetData() + newOffset, arena.GetData() + offset, framesDecoded * channels * sizeof(float));
+			memcpy(arena.GetData() + newOffset + framesDecoded * channels, overflow.data(), overflow.size() * sizeof(float));
+
+			offset = newOffset;
+			framesDecoded += overflow.size() / channels;
+		}
+
+		entry.mOffset = offset;
+		entry.mFrameCount = framesDecoded;
+		entry.mChannelsPerFrame = channels;
+		entry.mSampleRate = format.mSampleRate;
+
+		return true;
+	}
+
+}
+
+#pragma mark Arena
+
+SFB::Audio::BatchDecoder::Arena::Arena(size_t capacity)
+	: mData(nullptr), mCapacity(capacity), mSize(0)
+{
+	// Anonymous mappings are zero-filled on first touch, so untouched capacity costs only address space
+	void *data = mmap(nullptr, std::max(capacity, (size_t)1) * sizeof(float), PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	if(MAP_FAILED == data) {
+		LOGGER_ERR("org.sbooth.AudioEngine.BatchDecoder", "mmap failed: " << strerror(errno));
+		throw std::bad_alloc();
+	}
+
+	mData = (float *)data;
+}
+
+SFB::Audio::BatchDecoder::Arena::~Arena()
+{
+	if(-1 == munmap(mData, std::max(mCapacity, (size_t)1) * sizeof(float)))
+		LOGGER_WARNING("org.sbooth.AudioEngine.BatchDecoder", "munmap failed: " << strerror(errno));
+}
+
+void SFB::Audio::BatchDecoder::Arena::Reset()
+{
+	size_t size = mSize.exchange(0);
+
+	// Return the pages to the system
+	if(size && -1 == madvise(mData, size * sizeof(float), MADV_FREE))
+		LOGGER_INFO("org.sbooth.AudioEngine.BatchDecoder", "madvise failed: " << strerror(errno));
+}
+
+bool SFB::Audio::BatchDecoder::Arena::Allocate(size_t count, size_t& offset)
+{
+	size_t size = mSize.load();
+	do {
+		if(count > mCapacity - size)
+			return false;
+	} while(!mSize.compare_exchange_weak(size, size + count));
+
+	offset = size;
+	return true;
+}
+
+#pragma mark Decoding
+
+SFB::Audio::BatchDecoder::BatchDecoder()
+	: mTaskClass(TaskExecutor::TaskClass::Analysis)
+{}
+
+bool SFB::Audio::BatchDecoder::Decode(CFArrayRef urls, Arena& arena, std::vector<Entry>& entries, TaskExecutor::CancellationToken cancellationToken) const
+{
+	entries.clear();
+
+	if(nullptr == urls)
+		return false;
+
+	CFIndex count = CFArrayGetCount(urls);
+	entries.resize((size_t)count);
+
+	dispatch_group_t group = dispatch_group_create();
+	if(nullptr == group) {
+		LOGGER_ERR("org.sbooth.AudioEngine.BatchDecoder", "dispatch_group_create failed");
+		return false;
+	}
+
+	Entry *entriesData = entries.data();
+	Arena *arenaPointer = &arena;
+	std::atomic_bool succeeded(true);
+	std::atomic_bool *succeededPointer = &succeeded;
+
+	// The token is checked in the task rather than passed to the executor, which would discard cancelled tasks without leaving the group
+	auto& executor = TaskExecutor::GetSharedExecutor();
+	for(CFIndex i = 0; i < count; ++i) {
+		auto url = (CFURLRef)CFArrayGetValueAtIndex(urls, i);
+
+		dispatch_group_enter(group);
+		executor.Submit(mTaskClass, ^{
+			Entry& entry = entriesData[i];
+
+			if(cancellationToken.IsCancelled()) {
+				entry.mError = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ECANCELED, nullptr);
+				succeededPointer->store(false);
+			}
+			else {
+				CFErrorRef error = nullptr;
+				if(!DecodeURL(url, *arenaPointer, entry, &error)) {
+					LOGGER_NOTICE("org.sbooth.AudioEngine.BatchDecoder", "Error decoding " << url);
+					entry.mError = error;
+					succeededPointer->store(false);
+				}
+			}
+
+			dispatch_group_leave(group);
+		});
+	}
+
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	dispatch_release(group);
+
+	return succeeded.load();
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include "CFWrapper.h"
+#include "TaskExecutor.h"
+
+/*! @file BatchDecoder.h @brief Decoding many short files into a single buffer */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A class that decodes many files, such as a library of one-shot samples, into one \c Arena
+		 *
+		 * Files are decoded concurrently using the shared \c TaskExecutor, so opening and reading
+		 * one file overlaps with decoding others.  Each file is decoded directly into its own
+		 * contiguous region of the arena as interleaved 32-bit native float PCM at the file's sample
+		 * rate and channel count.  Decoders that can produce this format natively are read without
+		 * an intermediate conversion.
+		 */
+		class BatchDecoder
+		{
+
+		public:
+
+			/*!
+			 * @brief A fixed-capacity buffer receiving decoded audio
+			 *
+			 * The arena's address space is reserved when it is created but memory is only committed
+			 * as it is written, so generous capacities are inexpensive.  Regions are allocated
+			 * atomically and are never moved, so pointers into the arena remain valid for its lifetime.
+			 */
+			class Arena
+			{
+
+			public:
+
+				// ========================================
+				/*! @name Creation and Destruction */
+				//@{
+
+				/*!
+				 * @brief Create a new \c Arena
+				 * @throws std::bad_alloc if the address space could not be reserved
+				 * @param capacity The capacity of the arena in samples
+				 */
+				explicit Arena(size_t capacity);
+
+				/*! @brief Destroy this \c Arena */
+				~Arena();
+
+				/*! @cond */
+
+				/*! @internal This class is non-copyable */
+				Arena(const Arena& rhs) = delete;
+
+				/*! @internal This class is non-assignable */
+				Arena& operator=(const Arena& rhs) = delete;
+
+				/*! @endcond */
+				//@}
+
+
+				// ========================================
+				/*! @name Contents */
+				//@{
+
+				/*! @brief Get the arena's samples */
+				inline float * GetData()								{ return mData; }
+
+				/*! @brief Get the arena's samples */
+				inline const float * GetData() const					{ return mData; }
+
+				/*! @brief Get the capacity of the arena in samples */
+				inline size_t GetCapacity() const						{ return mCapacity; }
+
+				/*! @brief Get the number of samples allocated from the arena */
+				inline size_t GetSize() const							{ return mSize.load(); }
+
+				/*!
+				 * @brief Discard all allocations
+				 * @note Offsets previously returned by \c BatchDecoder::Decode() are invalidated
+				 */
+				void Reset();
+
+				//@}
+
+			private:
+
+				friend class BatchDecoder;
+
+				// Allocate count samples, returning the offset of the region in offset
+				bool Allocate(size_t count, size_t& offset);
+
+				float							*mData;
+				size_t							mCapacity;
+				std::atomic_size_t				mSize;
+			};
+
+			/*! @brief The result of decoding a single file */
+			struct Entry
+			{
+				size_t			mOffset;				/*!< The offset of the file's first sample in the arena */
+				size_t			mFrameCount;			/*!< The number of frames decoded */
+				UInt32			mChannelsPerFrame;		/*!< The number of interleaved channels */
+				Float64			mSampleRate;			/*!< The sample rate */
+				SFB::CFError	mError;					/*!< The reason decoding failed, or \c nullptr on success */
+			};
+
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*! @brief Create a new \c BatchDecoder */
+			BatchDecoder();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			BatchDecoder(const BatchDecoder& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			BatchDecoder& operator=(const BatchDecoder& rhs) = delete;
+
+			/*! @endcond */
+			//@}
+
+
+			// ========================================
+			/*! @name Configuration */
+			//@{
+
+			/*! @brief Get the class of work used for decoding tasks */
+			inline TaskExecutor::TaskClass GetTaskClass() const				{ return mTaskClass; }
+
+			/*!
+			 * @brief Set the class of work used for decoding tasks
+			 * @note The class's concurrency limit determines how many files are decoded at once
+			 */
+			inline void SetTaskClass(TaskExecutor::TaskClass taskClass)		{ mTaskClass = taskClass; }
+
+			//@}
+
+
+			// ========================================
+			/*! @name Decoding */
+			//@{
+
+			/*!
+			 * @brief Decode files into an arena
+			 * @note Regions are allocated in the order decoding completes, not the order of \c urls
+			 * @param urls An array of \c CFURLRef objects to decode
+			 * @param arena The arena to receive the decoded audio
+			 * @param entries A vector to receive one \c Entry for each URL, in the order of \c urls
+			 * @param cancellationToken An optional token used to stop decoding files that have not yet started
+			 * @return \c true if every file was decoded, \c false otherwise
+			 */
+			bool Decode(CFArrayRef urls, Arena& arena, std::vector<Entry>& entries, TaskExecutor::CancellationToken cancellationToken = TaskExecutor::CancellationToken()) const;
+
+			//@}
+
+		private:
+
+			TaskExecutor::TaskClass			mTaskClass;
+		};
+
+	}
+}
@@ -150,7 +150,7 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::CoreAudioDecoder::CreateDecoder(Inpu
 #pragma mark Creation and Destruction
 
 SFB::Audio::CoreAudioDecoder::CoreAudioDecoder(InputSource::unique_ptr inputSource)
-	: Decoder(std::move(inputSource)), mAudioFile(nullptr), mExtAudioFile(nullptr)
+	: Decoder(std::move(inputSource)), mAudioFile(nullptr), mExtAudioFile(nullptr), mInputSourceLength(0)
 {}
 
 SFB::Audio::CoreAudioDecoder::~CoreAudioDecoder()
@@ -364,6 +364,8 @@ bool SFB::Audio::CoreAudioDecoder::_Open(CFErrorRef *error)
 		return false;
 	}
 
+	mInputSourceLength = mInputSource->GetLength();
+
 	return true;
 }
 
@@ -428,6 +430,67 @@ SInt64 SFB::Audio::CoreAudioDecoder::_GetTotalFrames() const
 	return totalFrames;
 }
 
+SInt64 SFB::Audio::CoreAudioDecoder::_RefreshTotalFrames()
+{
+	// AudioFile reads the size of the audio data when opened, so audio appended later is only visible after reopening
+	SInt64 length = mInputSource->GetLength();
+	if(length == mInputSourceLength)
+		return _GetTotalFrames();
+
+	SInt64 currentFrame = _GetCurrentFrame();
+	if(-1 == currentFrame)
+		return _GetTotalFrames();
+
+	AudioFileID audioFile = nullptr;
+	OSStatus result = AudioFileOpenWithCallbacks(this, myAudioFile_ReadProc, nullptr, myAudioFile_GetSizeProc, nullptr, 0, &audioFile);
+	if(noErr != result) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.CoreAudio", "AudioFileOpenWithCallbacks failed: " << result);
+		return _GetTotalFrames();
+	}
+
+	ExtAudioFileRef extAudioFile = nullptr;
+	result = ExtAudioFileWrapAudioFileID(audioFile, false, &extAudioFile);
+	if(noErr != result) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.CoreAudio", "ExtAudioFileWrapAudioFileID failed: " << result);
+
+		result = AudioFileClose(audioFile);
+		if(noErr != result)
+			LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.CoreAudio", "AudioFileClose failed: " << result);
+
+		return _GetTotalFrames();
+	}
+
+	result = ExtAudioFileSetProperty(extAudioFile, kExtAudioFileProperty_ClientDataFormat, sizeof(mFormat), &mFormat);
+	if(noErr != result)
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.CoreAudio", "ExtAudioFileSetProperty (kExtAudioFileProperty_ClientDataFormat) failed: " << result);
+	else {
+		result = ExtAudioFileSeek(extAudioFile, currentFrame);
+		if(noErr != result)
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.CoreAudio", "ExtAudioFileSeek failed: " << result);
+	}
+
+	// Continue using the existing file if the new one couldn't be positioned
+	if(noErr != result) {
+		result = ExtAudioFileDispose(extAudioFile);
+		if(noErr != result)
+			LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.CoreAudio", "ExtAudioFileDispose failed: " << result);
+
+		result = AudioFileClose(audioFile);
+		if(noErr != result)
+			LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.CoreAudio", "AudioFileClose failed: " << result);
+
+		return _GetTotalFrames();
+	}
+
+	_Close(nullptr);
+
+	mAudioFile = audioFile;
+	mExtAudioFile = extAudioFile;
+	mInputSourceLength = length;
+
+	return _GetTotalFrames();
+}
+
 SInt64 SFB::Audio::CoreAudioDecoder::_GetCurrentFrame() const
 {
 	SInt64 currentFrame = -1;
@@ -451,3 +514,27 @@ SInt64 SFB::Audio::CoreAudioDecoder::_SeekToFrame(SInt64 frame)
 
 	return _GetCurrentFrame();
 }
+
+bool SFB::Audio::CoreAudioDecoder::_GetAudioPayloadRange(SInt64& offset, SInt64& length) const
+{
+	SInt64 dataOffset;
+	UInt32 dataSize = sizeof(dataOffset);
+	OSStatus result = AudioFileGetProperty(mAudioFile, kAudioFilePropertyDataOffset, &dataSize, &dataOffset);
+	if(noErr != result) {
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.CoreAudio", "AudioFileGetProperty (kAudioFilePropertyDataOffset) failed: " << result);
+		return false;
+	}
+
+	UInt64 audioDataByteCount;
+	dataSize = sizeof(audioDataByteCount);
+	result = AudioFileGetProperty(mAudioFile, kAudioFilePropertyAudioDataByteCount, &dataSize, &audioDataByteCount);
+	if(noErr != result) {
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.CoreAudio", "AudioFileGetProperty (kAudioFilePropertyAudioDataByteCount) failed: " << result);
+		return false;
+	}
+
+	offset = dataOffset;
+	length = (SInt64)audioDataByteCount;
+
+	return true;
+}
@@ -50,14 +50,19 @@ namespace SFB {
 			// Source audio information
 			virtual SInt64 _GetTotalFrames() const;
 			virtual SInt64 _GetCurrentFrame() const;
+			virtual SInt64 _RefreshTotalFrames();
 
 			// Seeking support
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Content identity support
+			virtual bool _GetAudioPayloadRange(SInt64& offset, SInt64& length) const;
+
 			// Data members
 			AudioFileID			mAudioFile;
 			ExtAudioFileRef		mExtAudioFile;
+			SInt64				mInputSourceLength;		// The length of the input when mAudioFile was opened
 		};
 
 	}
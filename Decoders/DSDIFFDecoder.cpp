@@ -11,6 +11,12 @@
 #include <string>
 #include <cctype>
 
+#if __SSSE3__
+# include <immintrin.h>
+#elif __ARM_NEON__ || __ARM_NEON
+# include <arm_neon.h>
+#endif
+
 #include "DSDIFFDecoder.h"
 #include "CFErrorUtilities.h"
 #include "Logger.h"
@@ -94,6 +100,145 @@ namespace {
 		return kAudioChannelLabel_Unknown;
 	}
 
+#pragma mark Deinterleaving
+
+	// DSDIFF stores sound data as clustered frames: one channel byte (8 one bit samples) per channel.
+	// The functions below split clusterCount clustered frames into per-channel buffers while touching
+	// each input byte only once.  Stereo, 5.0 and 5.1 use byte shuffles when available.
+
+	// Split clustered frames using a compile-time stride
+	template <UInt32 C>
+	inline void DeinterleaveClusteredFramesScalar(const uint8_t *src, uint8_t * const *dst, size_t clusterIndex, size_t clusterCount)
+	{
+		for(size_t i = clusterIndex; i < clusterCount; ++i) {
+			for(UInt32 c = 0; c < C; ++c)
+				dst[c][i] = src[C * i + c];
+		}
+	}
+
+	void DeinterleaveStereo(const uint8_t *src, uint8_t * const *dst, size_t clusterCount)
+	{
+		uint8_t *left = dst[0];
+		uint8_t *right = dst[1];
+		size_t i = 0;
+
+#if __AVX2__
+		// Gather the even bytes into the low half of each lane and the odd bytes into the high half,
+		// then reorder the 64-bit words so the left channel ends up in the low lane
+		const __m256i mask = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+											  0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+		for(; i + 16 <= clusterCount; i += 16) {
+			__m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + 2 * i)), mask);
+			v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i *)(left + i), _mm256_castsi256_si128(v));
+			_mm_storeu_si128((__m128i *)(right + i), _mm256_extracti128_si256(v, 1));
+		}
+#elif __SSSE3__
+		const __m128i mask = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+		for(; i + 16 <= clusterCount; i += 16) {
+			__m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 2 * i)), mask);
+			__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 2 * i + 16)), mask);
+			_mm_storeu_si128((__m128i *)(left + i), _mm_unpacklo_epi64(a, b));
+			_mm_storeu_si128((__m128i *)(right + i), _mm_unpackhi_epi64(a, b));
+		}
+#elif __ARM_NEON__ || __ARM_NEON
+		for(; i + 16 <= clusterCount; i += 16) {
+			uint8x16x2_t v = vld2q_u8(src + 2 * i);
+			vst1q_u8(left + i, v.val[0]);
+			vst1q_u8(right + i, v.val[1]);
+		}
+#endif
+
+		for(; i < clusterCount; ++i) {
+			left[i] = src[2 * i];
+			right[i] = src[2 * i + 1];
+		}
+	}
+
+#if __SSSE3__
+	// Shuffle masks for transposing 16 clustered frames held in C vectors
+	// mMasks[c][v] moves the bytes for channel c contained in input vector v to their output position and zeroes the rest
+	template <UInt32 C>
+	struct ShuffleMasks
+	{
+		ShuffleMasks()
+		{
+			for(UInt32 c = 0; c < C; ++c) {
+				for(UInt32 v = 0; v < C; ++v) {
+					for(UInt32 i = 0; i < 16; ++i) {
+						UInt32 sourceIndex = C * i + c;
+						mMasks[c][v][i] = (sourceIndex / 16 == v) ? (uint8_t)(sourceIndex % 16) : 0x80;
+					}
+				}
+			}
+		}
+
+		alignas(16) uint8_t mMasks [C][C][16];
+	};
+#endif
+
+	template <UInt32 C>
+	void DeinterleaveMultichannel(const uint8_t *src, uint8_t * const *dst, size_t clusterCount)
+	{
+		size_t i = 0;
+
+#if __SSSE3__
+		static const ShuffleMasks<C> sShuffleMasks;
+
+		for(; i + 16 <= clusterCount; i += 16) {
+			__m128i in [C];
+			for(UInt32 v = 0; v < C; ++v)
+				in[v] = _mm_loadu_si128((const __m128i *)(src + C * i + 16 * v));
+
+			for(UInt32 c = 0; c < C; ++c) {
+				__m128i out = _mm_shuffle_epi8(in[0], _mm_load_si128((const __m128i *)sShuffleMasks.mMasks[c][0]));
+				for(UInt32 v = 1; v < C; ++v)
+					out = _mm_or_si128(out, _mm_shuffle_epi8(in[v], _mm_load_si128((const __m128i *)sShuffleMasks.mMasks[c][v])));
+				_mm_storeu_si128((__m128i *)(dst[c] + i), out);
+			}
+		}
+#endif
+
+		DeinterleaveClusteredFramesScalar<C>(src, dst, i, clusterCount);
+	}
+
+#if !__SSSE3__ && (__ARM_NEON__ || __ARM_NEON)
+	// A 3-way structure load leaves channel pairs (0,3), (1,4) and (2,5) interleaved, which an unzip separates
+	template <>
+	void DeinterleaveMultichannel<6>(const uint8_t *src, uint8_t * const *dst, size_t clusterCount)
+	{
+		size_t i = 0;
+
+		for(; i + 16 <= clusterCount; i += 16) {
+			uint8x16x3_t a = vld3q_u8(src + 6 * i);
+			uint8x16x3_t b = vld3q_u8(src + 6 * i + 48);
+			for(UInt32 c = 0; c < 3; ++c) {
+				uint8x16x2_t v = vuzpq_u8(a.val[c], b.val[c]);
+				vst1q_u8(dst[c] + i, v.val[0]);
+				vst1q_u8(dst[c + 3] + i, v.val[1]);
+			}
+		}
+
+		DeinterleaveClusteredFramesScalar<6>(src, dst, i, clusterCount);
+	}
+#endif
+
+	void DeinterleaveClusteredFrames(const uint8_t *src, uint8_t * const *dst, size_t clusterCount, UInt32 channelCount)
+	{
+		switch(channelCount) {
+			case 1:		memcpy(dst[0], src, clusterCount);						break;
+			case 2:		DeinterleaveStereo(src, dst, clusterCount);				break;
+			case 5:		DeinterleaveMultichannel<5>(src, dst, clusterCount);	break;
+			case 6:		DeinterleaveMultichannel<6>(src, dst, clusterCount);	break;
+			default:
+				for(size_t i = 0; i < clusterCount; ++i) {
+					for(UInt32 c = 0; c < channelCount; ++c)
+						dst[c][i] = *src++;
+				}
+				break;
+		}
+	}
+
 #pragma mark DSDIFF chunks
 
 	// Base class for DSDIFF chunks
@@ -661,7 +806,7 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::DSDIFFDecoder::CreateDecoder(InputSo
 #pragma mark Creation and Destruction
 
 SFB::Audio::DSDIFFDecoder::DSDIFFDecoder(InputSource::unique_ptr inputSource)
-	: Decoder(std::move(inputSource)), mTotalFrames(-1), mCurrentFrame(0), mAudioOffset(0)
+	: Decoder(std::move(inputSource)), mTotalFrames(-1), mCurrentFrame(0), mAudioOffset(0), mAudioLength(0)
 {}
 
 SFB::Audio::DSDIFFDecoder::~DSDIFFDecoder()
@@ -743,6 +888,7 @@ bool SFB::Audio::DSDIFFDecoder::_Open(CFErrorRef *error)
 	}
 
 	mAudioOffset = soundDataChunk->mDataOffset;
+	mAudioLength = (SInt64)soundDataChunk->mDataSize;
 	mTotalFrames = (SInt64)mFormat.ByteCountToFrameCount(soundDataChunk->mDataSize - 12) / mFormat.mChannelsPerFrame;
 
 	GetInputSource().SeekToOffset(mAudioOffset);
@@ -797,22 +943,26 @@ UInt32 SFB::Audio::DSDIFFDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32
 			break;
 
 		// Deinterleave the clustered frames and copy to output
-		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
-			uint8_t *dst = (uint8_t *)bufferList->mBuffers[i].mData + bufferList->mBuffers[i].mDataByteSize;
-			for(SInt64 byteIndex = i; byteIndex < bytesRead; byteIndex += mFormat.mChannelsPerFrame)
-				*dst++ = buffer[byteIndex];
+		auto clusterCount = (UInt32)bytesRead / mFormat.mChannelsPerFrame;
+
+		uint8_t *dst [bufferList->mNumberBuffers];
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+			dst[i] = (uint8_t *)bufferList->mBuffers[i].mData + bufferList->mBuffers[i].mDataByteSize;
 
+		DeinterleaveClusteredFrames(buffer, dst, clusterCount, mFormat.mChannelsPerFrame);
+
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
 			bufferList->mBuffers[i].mNumberChannels	= 1;
-			bufferList->mBuffers[i].mDataByteSize	+= bytesRead / mFormat.mChannelsPerFrame;
+			bufferList->mBuffers[i].mDataByteSize	+= clusterCount;
 		}
 
-		framesRead += (bytesRead / mFormat.mChannelsPerFrame) * 8;
+		framesRead += clusterCount * 8;
 
 		// All requested frames were read
 		if(framesRead == frameCount)
 			break;
 
-		framesToRead -= framesRead;
+		framesToRead -= clusterCount * 8;
 	}
 
 	mCurrentFrame += framesRead;
@@ -53,10 +53,14 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Content identity support
+			inline virtual bool _GetAudioPayloadRange(SInt64& offset, SInt64& length) const	{ offset = mAudioOffset; length = mAudioLength; return true; }
+
 			// Data members
 			SInt64		mTotalFrames;
 			SInt64		mCurrentFrame;
 			SInt64		mAudioOffset;
+			SInt64		mAudioLength;
 		};
 
 	}
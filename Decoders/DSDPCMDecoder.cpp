@@ -501,3 +501,8 @@ SInt64 SFB::Audio::DSDPCMDecoder::_SeekToFrame(SInt64 frame)
 
 	return _GetCurrentFrame();
 }
+
+size_t SFB::Audio::DSDPCMDecoder::_GetMemoryUsage() const
+{
+	return mBufferList.GetAllocatedByteCount() + mContext.capacity() * sizeof(DXD) + mDecoder->GetMemoryUsage();
+}
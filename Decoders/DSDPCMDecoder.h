@@ -117,6 +117,9 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mDecoder->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Memory accounting
+			virtual size_t _GetMemoryUsage() const;
+
 			// Data members
 			Decoder::unique_ptr		mDecoder;
 			BufferList				mBufferList;
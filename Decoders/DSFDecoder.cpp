@@ -87,7 +87,7 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::DSFDecoder::CreateDecoder(InputSourc
 #pragma mark Creation and Destruction
 
 SFB::Audio::DSFDecoder::DSFDecoder(InputSource::unique_ptr inputSource)
-	: Decoder(std::move(inputSource)), mTotalFrames(-1), mCurrentFrame(0), mBlockByteSizePerChannel(0)
+	: Decoder(std::move(inputSource)), mTotalFrames(-1), mCurrentFrame(0), mAudioOffset(0), mAudioLength(0), mBlockByteSizePerChannel(0)
 {}
 
 SFB::Audio::DSFDecoder::~DSFDecoder()
@@ -235,6 +235,8 @@ bool SFB::Audio::DSFDecoder::_Open(CFErrorRef *error)
 	mBlockByteSizePerChannel = blockSizePerChannel;
 
 	mAudioOffset = GetInputSource().GetOffset();
+	// Unlike normal IFF, the chunkSize includes the size of the chunk ID and size
+	mAudioLength = (SInt64)chunkSize - 12;
 	mTotalFrames = (SInt64)sampleCount;
 
 	// Set up the source format
@@ -54,12 +54,19 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mBufferList.GetAllocatedByteCount(); }
+
+			// Content identity support
+			inline virtual bool _GetAudioPayloadRange(SInt64& offset, SInt64& length) const	{ offset = mAudioOffset; length = mAudioLength; return true; }
+
 			bool ReadAndDeinterleaveDSDBlock();
 
 			// Data members
 			SInt64		mTotalFrames;
 			SInt64		mCurrentFrame;
 			SInt64		mAudioOffset;
+			SInt64		mAudioLength;
 
 			uint32_t	mBlockByteSizePerChannel;
 			BufferList	mBufferList;
@@ -103,6 +103,9 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mDecoder->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mBufferList.GetAllocatedByteCount() + mDecoder->GetMemoryUsage(); }
+
 
 			// Data members
 			Decoder::unique_ptr		mDecoder;
@@ -163,7 +163,7 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::FLACDecoder::CreateDecoder(InputSour
 #pragma mark Creation and Destruction
 
 SFB::Audio::FLACDecoder::FLACDecoder(InputSource::unique_ptr inputSource)
-	: Decoder(std::move(inputSource)), mFLAC(nullptr, nullptr), mCurrentFrame(0)
+	: Decoder(std::move(inputSource)), mFLAC(nullptr, nullptr), mCurrentFrame(0), mAudioOffset(-1)
 {
 	memset(&mStreamInfo, 0, sizeof(mStreamInfo));
 }
@@ -246,6 +246,11 @@ bool SFB::Audio::FLACDecoder::_Open(CFErrorRef *error)
 		return false;
 	}
 
+	// The first audio frame immediately follows the metadata blocks; the position isn't available for Ogg FLAC
+	FLAC__uint64 decodePosition;
+	if(FLAC__stream_decoder_get_decode_position(mFLAC.get(), &decodePosition))
+		mAudioOffset = (SInt64)decodePosition;
+
 	// Canonical Core Audio format
 	mFormat.mFormatID			= kAudioFormatLinearPCM;
 	mFormat.mFormatFlags		= kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsNonInterleaved;
@@ -334,6 +339,7 @@ bool SFB::Audio::FLACDecoder::_Close(CFErrorRef */*error*/)
 	mFLAC.reset();
 	mBufferList.Deallocate();
 	memset(&mStreamInfo, 0, sizeof(mStreamInfo));
+	mAudioOffset = -1;
 
 	return true;
 }
@@ -418,6 +424,21 @@ SInt64 SFB::Audio::FLACDecoder::_SeekToFrame(SInt64 frame)
 	return (result ? frame : -1);
 }
 
+bool SFB::Audio::FLACDecoder::_GetAudioPayloadRange(SInt64& offset, SInt64& length) const
+{
+	if(-1 == mAudioOffset)
+		return false;
+
+	// FLAC files may also carry ID3 or APE tags
+	if(!GetUntaggedRange(offset, length) || mAudioOffset < offset || mAudioOffset >= offset + length)
+		return false;
+
+	length -= mAudioOffset - offset;
+	offset = mAudioOffset;
+
+	return true;
+}
+
 #pragma mark Callbacks
 
 FLAC__StreamDecoderWriteStatus SFB::Audio::FLACDecoder::Write(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[])
@@ -54,12 +54,19 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mBufferList.GetAllocatedByteCount(); }
+
+			// Content identity support
+			virtual bool _GetAudioPayloadRange(SInt64& offset, SInt64& length) const;
+
 			using unique_FLAC_ptr = std::unique_ptr<FLAC__StreamDecoder, void(*)(FLAC__StreamDecoder *)>;
 
 			// Data members
 			unique_FLAC_ptr						mFLAC;
 			FLAC__StreamMetadata_StreamInfo		mStreamInfo;
 			SInt64								mCurrentFrame;
+			SInt64								mAudioOffset;
 
 			// For converting push to pull
 			BufferList							mBufferList;
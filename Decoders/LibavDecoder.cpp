@@ -283,6 +283,14 @@ bool SFB::Audio::LibavDecoder::_Open(CFErrorRef *error)
 
 	result = avcodec_parameters_to_context(codecContext.get(), formatContext->streams[mStreamIndex]->codecpar);
 
+	// Ask for planar integer output if preferred; codecs that cannot produce it natively ignore the request
+	switch(mPreferredSampleFormat) {
+		case SampleFormat::Int16:	codecContext->request_sample_fmt = AV_SAMPLE_FMT_S16P;	break;
+		case SampleFormat::Int32:	codecContext->request_sample_fmt = AV_SAMPLE_FMT_S32P;	break;
+		case SampleFormat::Float:	codecContext->request_sample_fmt = AV_SAMPLE_FMT_FLTP;	break;
+		default:																			break;
+	}
+
 	result = avcodec_open2(codecContext.get(), decoder, nullptr);
 	if(0 != result) {
 		char errbuf [ERRBUF_SIZE];
@@ -309,7 +317,8 @@ bool SFB::Audio::LibavDecoder::_Open(CFErrorRef *error)
 	mFormat.mSampleRate			= formatContext->streams[mStreamIndex]->codecpar->sample_rate;
 	mFormat.mChannelsPerFrame	= (UInt32)formatContext->streams[mStreamIndex]->codecpar->channels;
 
-	switch(formatContext->streams[mStreamIndex]->codecpar->format) {
+	// The opened codec's sample format reflects any honored format request
+	switch(codecContext->sample_fmt) {
 
 		case AV_SAMPLE_FMT_U8P:
 			mFormat.mFormatFlags		= kAudioFormatFlagIsPacked | kAudioFormatFlagIsNonInterleaved;
@@ -559,20 +568,7 @@ UInt32 SFB::Audio::LibavDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32
 			if(AVERROR(EAGAIN) == result || AVERROR_EOF == result)
 				break;
 
-			// Planar formats are not interleaved
-			if(av_sample_fmt_is_planar(mCodecContext->sample_fmt)) {
-				for(UInt32 bufferIndex = 0; bufferIndex < mBufferList->mNumberBuffers; ++bufferIndex) {
-					memcpy(mBufferList->mBuffers[bufferIndex].mData, mFrame->extended_data[bufferIndex], (size_t)mFrame->linesize[0]);
-					mBufferList->mBuffers[bufferIndex].mDataByteSize = (UInt32)mFrame->linesize[0];
-					mBufferList->mBuffers[bufferIndex].mNumberChannels = 1;
-				}
-			}
-			else {
-				memcpy(mBufferList->mBuffers[0].mData, mFrame->extended_data[0], (size_t)mFrame->linesize[0]);
-				mBufferList->mBuffers[0].mDataByteSize = (UInt32)mFrame->linesize[0];
-				mBufferList->mBuffers[0].mNumberChannels = mFormat.mChannelsPerFrame;
-			}
-
+			CopyFrameToBufferList();
 		}
 
 		av_packet_unref(&packet);
@@ -585,7 +581,7 @@ UInt32 SFB::Audio::LibavDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32
 
 SInt64 SFB::Audio::LibavDecoder::_SeekToFrame(SInt64 frame)
 {
-	int64_t timestamp = av_rescale(frame / (SInt64)mFormat.mSampleRate, mFormatContext->streams[mStreamIndex]->time_base.den, mFormatContext->streams[mStreamIndex]->time_base.num);
+	int64_t timestamp = av_rescale_q(frame, AVRational{1, (int)mFormat.mSampleRate}, mFormatContext->streams[mStreamIndex]->time_base);
 	int result = av_seek_frame(mFormatContext.get(), mStreamIndex, timestamp, 0);
 	if(0 > result) {
 		char errbuf [ERRBUF_SIZE];
@@ -600,6 +596,90 @@ SInt64 SFB::Audio::LibavDecoder::_SeekToFrame(SInt64 frame)
 
 	avcodec_flush_buffers(mCodecContext.get());
 
+	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+		mBufferList->mBuffers[i].mDataByteSize = 0;
+
 	mCurrentFrame = frame;
 	return mCurrentFrame;
 }
+
+SInt64 SFB::Audio::LibavDecoder::_ApproximateSeekToFrame(SInt64 frame)
+{
+	SInt64 totalFrames = _GetTotalFrames();
+	int64_t totalBytes = avio_size(mFormatContext->pb);
+	if((AVFMT_NO_BYTE_SEEK & mFormatContext->iformat->flags) || 0 >= totalFrames || 0 >= totalBytes)
+		return _SeekToFrame(frame);
+
+	// Interpolate the byte offset assuming a constant bitrate
+	int64_t offset = (int64_t)(((double)frame / totalFrames) * totalBytes);
+	int result = av_seek_frame(mFormatContext.get(), mStreamIndex, offset, AVSEEK_FLAG_BYTE);
+	if(0 > result) {
+		LOGGER_INFO("org.sbooth.AudioEngine.AudioDecoder.Libav", "Byte seek failed, falling back to timestamp seek");
+		return _SeekToFrame(frame);
+	}
+
+	avcodec_flush_buffers(mCodecContext.get());
+
+	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+		mBufferList->mBuffers[i].mDataByteSize = 0;
+
+	// The bitrate of a VBR stream varies, so the frame reached is determined from the timestamp
+	// of the first packet after the seek, which is decoded so its audio isn't lost
+	for(;;) {
+		AVPacket packet;
+		av_init_packet(&packet);
+		packet.data = nullptr;
+		packet.size = 0;
+
+		result = av_read_frame(mFormatContext.get(), &packet);
+		if(0 > result)
+			break;
+
+		if(packet.stream_index != mStreamIndex) {
+			av_packet_unref(&packet);
+			continue;
+		}
+
+		int64_t timestamp = AV_NOPTS_VALUE != packet.pts ? packet.pts : packet.dts;
+		if(AV_NOPTS_VALUE == timestamp) {
+			av_packet_unref(&packet);
+			break;
+		}
+
+		result = avcodec_send_packet(mCodecContext.get(), &packet);
+		av_packet_unref(&packet);
+		if(0 != result)
+			break;
+
+		while(0 <= result) {
+			result = avcodec_receive_frame(mCodecContext.get(), mFrame.get());
+			if(AVERROR(EAGAIN) == result || AVERROR_EOF == result)
+				break;
+
+			CopyFrameToBufferList();
+		}
+
+		mCurrentFrame = av_rescale_q(timestamp, mFormatContext->streams[mStreamIndex]->time_base, AVRational{1, (int)mFormat.mSampleRate});
+		return mCurrentFrame;
+	}
+
+	LOGGER_INFO("org.sbooth.AudioEngine.AudioDecoder.Libav", "Unable to determine the position reached by a byte seek, falling back to timestamp seek");
+	return _SeekToFrame(frame);
+}
+
+void SFB::Audio::LibavDecoder::CopyFrameToBufferList()
+{
+	// Planar formats are not interleaved
+	if(av_sample_fmt_is_planar(mCodecContext->sample_fmt)) {
+		for(UInt32 bufferIndex = 0; bufferIndex < mBufferList->mNumberBuffers; ++bufferIndex) {
+			memcpy(mBufferList->mBuffers[bufferIndex].mData, mFrame->extended_data[bufferIndex], (size_t)mFrame->linesize[0]);
+			mBufferList->mBuffers[bufferIndex].mDataByteSize = (UInt32)mFrame->linesize[0];
+			mBufferList->mBuffers[bufferIndex].mNumberChannels = 1;
+		}
+	}
+	else {
+		memcpy(mBufferList->mBuffers[0].mData, mFrame->extended_data[0], (size_t)mFrame->linesize[0]);
+		mBufferList->mBuffers[0].mDataByteSize = (UInt32)mFrame->linesize[0];
+		mBufferList->mBuffers[0].mNumberChannels = mFormat.mChannelsPerFrame;
+	}
+}
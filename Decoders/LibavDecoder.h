@@ -58,6 +58,13 @@ namespace SFB {
 			// Seeking support
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
+			virtual SInt64 _ApproximateSeekToFrame(SInt64 frame);
+
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mBufferList.GetAllocatedByteCount(); }
+
+			// Copy the audio in mFrame to mBufferList
+			void CopyFrameToBufferList();
 
 			using unique_AVFrame_ptr = std::unique_ptr<AVFrame, std::function<void (AVFrame *)>>;
 			using unique_AVIOContext_ptr = std::unique_ptr<AVIOContext, std::function<void (AVIOContext *)>>;
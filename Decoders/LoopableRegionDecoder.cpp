@@ -13,17 +13,17 @@
 
 SFB::Audio::Decoder::unique_ptr SFB::Audio::LoopableRegionDecoder::CreateForURLRegion(CFURLRef url, SInt64 startingFrame, CFErrorRef *error)
 {
-	return CreateForInputSourceRegion(InputSource::CreateForURL(url, 0, error), startingFrame, error);
+	return CreateForInputSourceRegion(InputSource::CreateForURL(url, InputSource::RandomAccess, error), startingFrame, error);
 }
 
 SFB::Audio::Decoder::unique_ptr SFB::Audio::LoopableRegionDecoder::CreateForURLRegion(CFURLRef url, SInt64 startingFrame, UInt32 frameCount, CFErrorRef *error)
 {
-	return CreateForInputSourceRegion(InputSource::CreateForURL(url, 0, error), startingFrame, frameCount, error);
+	return CreateForInputSourceRegion(InputSource::CreateForURL(url, InputSource::RandomAccess, error), startingFrame, frameCount, error);
 }
 
 SFB::Audio::Decoder::unique_ptr SFB::Audio::LoopableRegionDecoder::CreateForURLRegion(CFURLRef url, SInt64 startingFrame, UInt32 frameCount, UInt32 repeatCount, CFErrorRef *error)
 {
-	return CreateForInputSourceRegion(InputSource::CreateForURL(url, 0, error), startingFrame, frameCount, repeatCount, error);
+	return CreateForInputSourceRegion(InputSource::CreateForURL(url, InputSource::RandomAccess, error), startingFrame, frameCount, repeatCount, error);
 }
 
 SFB::Audio::Decoder::unique_ptr SFB::Audio::LoopableRegionDecoder::CreateForInputSourceRegion(InputSource::unique_ptr inputSource, SInt64 startingFrame, CFErrorRef *error)
@@ -97,8 +97,11 @@ SFB::Audio::LoopableRegionDecoder::LoopableRegionDecoder(Decoder::unique_ptr dec
 
 bool SFB::Audio::LoopableRegionDecoder::_Open(CFErrorRef *error)
 {
-	if(!mDecoder->IsOpen() && !mDecoder->Open(error))
-		return false;
+	if(!mDecoder->IsOpen()) {
+		mDecoder->SetPreferredSampleFormat(GetPreferredSampleFormat());
+		if(!mDecoder->Open(error))
+			return false;
+	}
 
 	if(!mDecoder->SupportsSeeking() || !SetupDecoder(false)) {
 		mDecoder->Close(error);
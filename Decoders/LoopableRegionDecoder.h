@@ -169,6 +169,9 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mDecoder->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mDecoder->GetMemoryUsage(); }
+
 
 			// The starting frame for this audio file region
 			inline SInt64 GetStartingFrame() const					{ return mStartingFrame; }
@@ -12,6 +12,9 @@
 #define DUMB_CHANNELS		2
 #define DUMB_BIT_DEPTH		16
 
+// DUMB records a checkpoint every 30 seconds while loading a module
+#define DUMB_CHECKPOINT_INTERVAL	(30 * DUMB_SAMPLE_RATE)
+
 namespace {
 
 	void RegisterMODDecoder() __attribute__ ((constructor));
@@ -239,14 +242,20 @@ UInt32 SFB::Audio::MODDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 fr
 
 SInt64 SFB::Audio::MODDecoder::_SeekToFrame(SInt64 frame)
 {
-	// DUMB cannot seek backwards, so the decoder must be reset
-	if(frame < mCurrentFrame) {
-		if(!_Close(nullptr) || !mInputSource->SeekToOffset(0) || !_Open(nullptr)) {
-			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.MOD", "Error reseting DUMB decoder");
+	// DUMB cannot seek backwards, so the sigrenderer must be restarted
+	// Starting a sigrenderer at a position resumes from the nearest checkpoint built when the module was loaded,
+	// which is much cheaper than reloading the module or rendering forward across long distances
+	if(frame < mCurrentFrame || frame - mCurrentFrame > DUMB_CHECKPOINT_INTERVAL) {
+		auto renderer = unique_DUH_SIGRENDERER_ptr(duh_start_sigrenderer(duh.get(), 0, 2, (long)frame), duh_end_sigrenderer);
+		if(!renderer) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.MOD", "Error restarting DUMB sigrenderer");
 			return -1;
 		}
 
-		mCurrentFrame = 0;
+		dsr = std::move(renderer);
+		mCurrentFrame = frame;
+
+		return mCurrentFrame;
 	}
 
 	long framesToSkip = frame - mCurrentFrame;
@@ -80,6 +80,27 @@ namespace {
 		return offset;
 	}
 
+#pragma mark Sample Formats
+
+	// Determine whether the linked mpg123 can produce samples using the specified encoding
+	bool mpg123_supports_encoding(int encoding)
+	{
+		const int *encodings = nullptr;
+		size_t encodingCount = 0;
+		mpg123_encodings(&encodings, &encodingCount);
+
+		return std::find(encodings, encodings + encodingCount, encoding) != encodings + encodingCount;
+	}
+
+	// Copy one channel of interleaved samples to a non-interleaved buffer
+	template <typename T>
+	void DeinterleaveChannel(const T *input, T *output, UInt32 channel, UInt32 channelCount, UInt32 frameCount)
+	{
+		input += channel;
+		for(UInt32 frame = 0; frame < frameCount; ++frame, input += channelCount)
+			output[frame] = *input;
+	}
+
 }
 
 #pragma mark Static Methods
@@ -150,10 +171,37 @@ bool SFB::Audio::MPEGDecoder::_Open(CFErrorRef *error)
 		return false;
 	}
 
-	// Force decode to floating point instead of 16-bit signed integer
-	mpg123_param(decoder.get(), MPG123_FLAGS, MPG123_FORCE_FLOAT | MPG123_SKIP_ID3V2 | MPG123_GAPLESS | MPG123_QUIET, 0);
+	// Decode to floating point unless the preferred integer format is natively supported
+	int outputEncoding = MPG123_ENC_FLOAT_32;
+	switch(mPreferredSampleFormat) {
+		case SampleFormat::Int16:	outputEncoding = MPG123_ENC_SIGNED_16;	break;
+		case SampleFormat::Int32:	outputEncoding = MPG123_ENC_SIGNED_32;	break;
+		default:															break;
+	}
+
+	if(MPG123_ENC_FLOAT_32 != outputEncoding && !mpg123_supports_encoding(outputEncoding)) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder.MPEG", "mpg123 does not support encoding " << outputEncoding << ", using floating point");
+		outputEncoding = MPG123_ENC_FLOAT_32;
+	}
+
+	long flags = MPG123_SKIP_ID3V2 | MPG123_GAPLESS | MPG123_QUIET;
+	if(MPG123_ENC_FLOAT_32 == outputEncoding)
+		flags |= MPG123_FORCE_FLOAT;
+
+	mpg123_param(decoder.get(), MPG123_FLAGS, flags, 0);
 	mpg123_param(decoder.get(), MPG123_RESYNC_LIMIT, 2048, 0);
 
+	// Restrict the output to the chosen encoding at all sample rates
+	if(MPG123_ENC_FLOAT_32 != outputEncoding) {
+		const long *rates = nullptr;
+		size_t rateCount = 0;
+		mpg123_rates(&rates, &rateCount);
+
+		mpg123_format_none(decoder.get());
+		for(size_t i = 0; i < rateCount; ++i)
+			mpg123_format(decoder.get(), rates[i], MPG123_MONO | MPG123_STEREO, outputEncoding);
+	}
+
 	if(MPG123_OK != mpg123_replace_reader_handle(decoder.get(), read_callback, lseek_callback, nullptr)) {
 		if(error) {
 			SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” is not a valid MP3 file."), ""));
@@ -180,7 +228,7 @@ bool SFB::Audio::MPEGDecoder::_Open(CFErrorRef *error)
 
 	long rate;
 	int channels, encoding;
-	if(MPG123_OK != mpg123_getformat(decoder.get(), &rate, &channels, &encoding) || MPG123_ENC_FLOAT_32 != encoding || 0 >= channels) {
+	if(MPG123_OK != mpg123_getformat(decoder.get(), &rate, &channels, &encoding) || outputEncoding != encoding || 0 >= channels) {
 		if(error) {
 			SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” is not a valid MP3 file."), ""));
 			SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Not an MP3 file"), ""));
@@ -192,13 +240,20 @@ bool SFB::Audio::MPEGDecoder::_Open(CFErrorRef *error)
 		return false;
 	}
 
-	// Canonical Core Audio format
 	mFormat.mFormatID			= kAudioFormatLinearPCM;
-	mFormat.mFormatFlags		= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+
+	// Canonical Core Audio format, or native-endian signed integers
+	if(MPG123_ENC_FLOAT_32 == encoding) {
+		mFormat.mFormatFlags	= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+		mFormat.mBitsPerChannel	= 8 * sizeof(float);
+	}
+	else {
+		mFormat.mFormatFlags	= kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked | kAudioFormatFlagIsNonInterleaved;
+		mFormat.mBitsPerChannel	= (UInt32)(8 * mpg123_encsize(encoding));
+	}
 
 	mFormat.mSampleRate			= rate;
 	mFormat.mChannelsPerFrame	= (UInt32)channels;
-	mFormat.mBitsPerChannel		= 8 * sizeof(float);
 
 	mFormat.mBytesPerPacket		= (mFormat.mBitsPerChannel / 8);
 	mFormat.mFramesPerPacket	= 1;
@@ -207,7 +262,7 @@ bool SFB::Audio::MPEGDecoder::_Open(CFErrorRef *error)
 	mFormat.mReserved			= 0;
 
 	size_t bufferSizeBytes = mpg123_outblock(decoder.get());
-	UInt32 framesPerMPEGFrame = (UInt32)(bufferSizeBytes / ((size_t)channels * sizeof(float)));
+	UInt32 framesPerMPEGFrame = (UInt32)(bufferSizeBytes / ((size_t)channels * mFormat.mBytesPerFrame));
 
 	// Set up the source format
 	mSourceFormat.mFormatID				= 'MPEG';
@@ -299,6 +354,7 @@ UInt32 SFB::Audio::MPEGDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 	}
 
 	UInt32 framesRead = 0;
+	UInt32 bytesPerSample = mFormat.mBytesPerFrame;
 
 	// Reset output buffer data size
 	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
@@ -307,23 +363,23 @@ UInt32 SFB::Audio::MPEGDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 	for(;;) {
 
 		UInt32	framesRemaining	= frameCount - framesRead;
-		UInt32	framesToSkip	= (UInt32)(bufferList->mBuffers[0].mDataByteSize / sizeof(float));
-		UInt32	framesInBuffer	= (UInt32)(mBufferList->mBuffers[0].mDataByteSize / sizeof(float));
+		UInt32	framesToSkip	= bufferList->mBuffers[0].mDataByteSize / bytesPerSample;
+		UInt32	framesInBuffer	= mBufferList->mBuffers[0].mDataByteSize / bytesPerSample;
 		UInt32	framesToCopy	= std::min(framesInBuffer, framesRemaining);
 
 		// Copy data from the buffer to output
 		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
-			float *floatBuffer = (float *)bufferList->mBuffers[i].mData;
-			memcpy(floatBuffer + framesToSkip, mBufferList->mBuffers[i].mData, framesToCopy * sizeof(float));
-			bufferList->mBuffers[i].mDataByteSize += framesToCopy * sizeof(float);
+			unsigned char *buffer = (unsigned char *)bufferList->mBuffers[i].mData;
+			memcpy(buffer + (framesToSkip * bytesPerSample), mBufferList->mBuffers[i].mData, framesToCopy * bytesPerSample);
+			bufferList->mBuffers[i].mDataByteSize += framesToCopy * bytesPerSample;
 
 			// Move remaining data in buffer to beginning
 			if(framesToCopy != framesInBuffer) {
-				floatBuffer = (float *)mBufferList->mBuffers[i].mData;
-				memmove(floatBuffer, floatBuffer + framesToCopy, (framesInBuffer - framesToCopy) * sizeof(float));
+				buffer = (unsigned char *)mBufferList->mBuffers[i].mData;
+				memmove(buffer, buffer + (framesToCopy * bytesPerSample), (framesInBuffer - framesToCopy) * bytesPerSample);
 			}
 
-			mBufferList->mBuffers[i].mDataByteSize -= framesToCopy * sizeof(float);
+			mBufferList->mBuffers[i].mDataByteSize -= framesToCopy * bytesPerSample;
 		}
 
 		framesRead += framesToCopy;
@@ -346,19 +402,25 @@ UInt32 SFB::Audio::MPEGDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 		}
 
 		// The analyzer error about division by zero may be safely ignored, because mChannelsPerFrame is verified > 0 in Open()
-		UInt32 framesDecoded = (UInt32)(bytesDecoded / (sizeof(float) * mFormat.mChannelsPerFrame));
+		UInt32 framesDecoded = (UInt32)(bytesDecoded / (bytesPerSample * mFormat.mChannelsPerFrame));
 
 		// Deinterleave the samples
-		// In my experiments adding zero using Accelerate.framework is faster than looping through the buffer and copying each sample
-		float zero = 0;
 		for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
-			float *inputBuffer = (float *)audioData + channel;
-			float *outputBuffer = (float *)mBufferList->mBuffers[channel].mData;
+			if(kAudioFormatFlagIsFloat & mFormat.mFormatFlags) {
+				// In my experiments adding zero using Accelerate.framework is faster than looping through the buffer and copying each sample
+				float zero = 0;
+				float *inputBuffer = (float *)audioData + channel;
+				float *outputBuffer = (float *)mBufferList->mBuffers[channel].mData;
 
-			vDSP_vsadd(inputBuffer, (vDSP_Stride)mFormat.mChannelsPerFrame, &zero, outputBuffer, 1, framesDecoded);
+				vDSP_vsadd(inputBuffer, (vDSP_Stride)mFormat.mChannelsPerFrame, &zero, outputBuffer, 1, framesDecoded);
+			}
+			else if(sizeof(int16_t) == bytesPerSample)
+				DeinterleaveChannel((const int16_t *)audioData, (int16_t *)mBufferList->mBuffers[channel].mData, channel, mFormat.mChannelsPerFrame, framesDecoded);
+			else
+				DeinterleaveChannel((const int32_t *)audioData, (int32_t *)mBufferList->mBuffers[channel].mData, channel, mFormat.mChannelsPerFrame, framesDecoded);
 
 			mBufferList->mBuffers[channel].mNumberChannels	= 1;
-			mBufferList->mBuffers[channel].mDataByteSize	= framesDecoded * sizeof(float);
+			mBufferList->mBuffers[channel].mDataByteSize	= framesDecoded * bytesPerSample;
 		}
 	}
 
@@ -375,8 +437,34 @@ SInt64 SFB::Audio::MPEGDecoder::_GetTotalFrames() const
 SInt64 SFB::Audio::MPEGDecoder::_SeekToFrame(SInt64 frame)
 {
 	frame = mpg123_seek(mDecoder.get(), frame, SEEK_SET);
-	if(0 <= frame)
+	if(0 <= frame) {
 		mCurrentFrame = frame;
+		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+			mBufferList->mBuffers[i].mDataByteSize = 0;
+	}
 
 	return ((0 <= frame) ? mCurrentFrame : -1);
 }
+
+SInt64 SFB::Audio::MPEGDecoder::_FastSeekToFrame(SInt64 frame)
+{
+	// Seek to the start of the MPEG frame containing the desired sample, skipping the decoder pre-roll
+	int samplesPerFrame = mpg123_spf(mDecoder.get());
+	if(0 >= samplesPerFrame)
+		return _SeekToFrame(frame);
+
+	if(0 > mpg123_seek_frame(mDecoder.get(), (off_t)(frame / samplesPerFrame), SEEK_SET)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.MPEG", "mpg123_seek_frame failed: " << mpg123_strerror(mDecoder.get()));
+		return -1;
+	}
+
+	off_t currentFrame = mpg123_tell(mDecoder.get());
+	if(0 > currentFrame)
+		return -1;
+
+	mCurrentFrame = currentFrame;
+	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+		mBufferList->mBuffers[i].mDataByteSize = 0;
+
+	return mCurrentFrame;
+}
@@ -53,6 +53,13 @@ namespace SFB {
 			// Seeking support
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
+			virtual SInt64 _FastSeekToFrame(SInt64 frame);
+
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mBufferList.GetAllocatedByteCount(); }
+
+			// Content identity support
+			inline virtual bool _GetAudioPayloadRange(SInt64& offset, SInt64& length) const	{ return GetUntaggedRange(offset, length); }
 
 			using unique_mpg123_ptr = std::unique_ptr<mpg123_handle, std::function<void (mpg123_handle *)>>;
 
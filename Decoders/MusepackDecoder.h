@@ -55,6 +55,12 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mBufferList.GetAllocatedByteCount(); }
+
+			// Content identity support
+			inline virtual bool _GetAudioPayloadRange(SInt64& offset, SInt64& length) const	{ return GetUntaggedRange(offset, length); }
+
 			// Data members
 			mpc_reader			mReader;
 			mpc_demux			*mDemux;
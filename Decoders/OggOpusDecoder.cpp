@@ -148,9 +148,17 @@ bool SFB::Audio::OggOpusDecoder::_Open(CFErrorRef *error)
 
 	// Output interleaved floating point data
 	mFormat.mFormatID			= kAudioFormatLinearPCM;
-	mFormat.mFormatFlags		= kAudioFormatFlagsNativeFloatPacked;
 
-	mFormat.mBitsPerChannel		= 8 * sizeof(float);
+	// op_read() produces 16-bit integers directly, avoiding a round trip through floating point
+	if(SampleFormat::Int16 == mPreferredSampleFormat) {
+		mFormat.mFormatFlags	= kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+		mFormat.mBitsPerChannel	= 8 * sizeof(opus_int16);
+	}
+	else {
+		mFormat.mFormatFlags	= kAudioFormatFlagsNativeFloatPacked;
+		mFormat.mBitsPerChannel	= 8 * sizeof(float);
+	}
+
 	mFormat.mSampleRate			= OPUS_SAMPLE_RATE;
 	mFormat.mChannelsPerFrame	= (UInt32)header->channel_count;
 
@@ -216,12 +224,19 @@ UInt32 SFB::Audio::OggOpusDecoder::_ReadAudio(AudioBufferList *bufferList, UInt3
 		return 0;
 	}
 
-	float		*buffer				= (float *)bufferList->mBuffers[0].mData;
+	bool		isFloat				= (kAudioFormatFlagIsFloat & mFormat.mFormatFlags);
 	UInt32		framesRemaining		= frameCount;
 	UInt32		totalFramesRead		= 0;
 
 	while(0 < framesRemaining) {
-		int framesRead = op_read_float(mOpusFile.get(), buffer, (int)(framesRemaining * mFormat.mChannelsPerFrame), nullptr);
+		void *buffer = (unsigned char *)bufferList->mBuffers[0].mData + (totalFramesRead * mFormat.mBytesPerFrame);
+		int bufferSize = (int)(framesRemaining * mFormat.mChannelsPerFrame);
+
+		int framesRead;
+		if(isFloat)
+			framesRead = op_read_float(mOpusFile.get(), (float *)buffer, bufferSize, nullptr);
+		else
+			framesRead = op_read(mOpusFile.get(), (opus_int16 *)buffer, bufferSize, nullptr);
 
 		if(0 > framesRead) {
 			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggOpus", "Ogg Opus decoding error: " << framesRead);
@@ -232,8 +247,6 @@ UInt32 SFB::Audio::OggOpusDecoder::_ReadAudio(AudioBufferList *bufferList, UInt3
 		if(0 == framesRead)
 			break;
 
-		buffer += (UInt32)framesRead * mFormat.mChannelsPerFrame;
-
 		totalFramesRead += (UInt32)framesRead;
 		framesRemaining -= (UInt32)framesRead;
 	}
@@ -253,3 +266,20 @@ SInt64 SFB::Audio::OggOpusDecoder::_SeekToFrame(SInt64 frame)
 
 	return this->GetCurrentFrame();
 }
+
+SInt64 SFB::Audio::OggOpusDecoder::_ApproximateSeekToFrame(SInt64 frame)
+{
+	opus_int64 totalBytes = op_raw_total(mOpusFile.get(), -1);
+	ogg_int64_t totalFrames = op_pcm_total(mOpusFile.get(), -1);
+	if(0 >= totalBytes || 0 >= totalFrames)
+		return _SeekToFrame(frame);
+
+	// Interpolate the byte offset assuming a constant bitrate; decoding resumes at the next page
+	opus_int64 offset = (opus_int64)(((double)frame / totalFrames) * totalBytes);
+	if(0 != op_raw_seek(mOpusFile.get(), offset)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggOpus", "op_raw_seek() failed");
+		return -1;
+	}
+
+	return this->GetCurrentFrame();
+}
@@ -51,6 +51,7 @@ namespace SFB {
 			// Seeking support
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
+			virtual SInt64 _ApproximateSeekToFrame(SInt64 frame);
 
 			using unique_op_ptr = std::unique_ptr<OggOpusFile, std::function<void(OggOpusFile *)>>;
 
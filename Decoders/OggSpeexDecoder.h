@@ -53,6 +53,9 @@ namespace SFB {
 			inline virtual SInt64 _GetTotalFrames() const			{ return mTotalFrames; }
 			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
 
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mBufferList.GetAllocatedByteCount(); }
+
 			// Data members
 			BufferList			mBufferList;
 			SInt64				mCurrentFrame;
@@ -167,13 +167,21 @@ bool SFB::Audio::OggVorbisDecoder::_Open(CFErrorRef *error)
 
 	// Canonical Core Audio format
 	mFormat.mFormatID			= kAudioFormatLinearPCM;
-	mFormat.mFormatFlags		= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
 
-	mFormat.mBitsPerChannel		= 8 * sizeof(float);
+	// ov_read() produces interleaved 16-bit integers directly, avoiding a round trip through floating point
+	if(SampleFormat::Int16 == mPreferredSampleFormat) {
+		mFormat.mFormatFlags	= kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+		mFormat.mBitsPerChannel	= 8 * sizeof(int16_t);
+	}
+	else {
+		mFormat.mFormatFlags	= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+		mFormat.mBitsPerChannel	= 8 * sizeof(float);
+	}
+
 	mFormat.mSampleRate			= ovInfo->rate;
 	mFormat.mChannelsPerFrame	= (UInt32)ovInfo->channels;
 
-	mFormat.mBytesPerPacket		= (mFormat.mBitsPerChannel / 8);
+	mFormat.mBytesPerPacket		= (mFormat.mBitsPerChannel / 8) * (mFormat.IsInterleaved() ? mFormat.mChannelsPerFrame : 1);
 	mFormat.mFramesPerPacket	= 1;
 	mFormat.mBytesPerFrame		= mFormat.mBytesPerPacket * mFormat.mFramesPerPacket;
 
@@ -232,11 +240,14 @@ SFB::CFString SFB::Audio::OggVorbisDecoder::_GetSourceFormatDescription() const
 
 UInt32 SFB::Audio::OggVorbisDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
 {
-	if(bufferList->mNumberBuffers != mFormat.mChannelsPerFrame) {
+	if(bufferList->mNumberBuffers != (mFormat.IsInterleaved() ? 1 : mFormat.mChannelsPerFrame)) {
 		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.OggVorbis", "_ReadAudio() called with invalid parameters");
 		return 0;
 	}
 
+	if(mFormat.IsInterleaved())
+		return ReadInterleavedAudio(bufferList, frameCount);
+
 	float		**buffer			= nullptr;
 	UInt32		framesRemaining		= frameCount;
 	UInt32		totalFramesRead		= 0;
@@ -278,6 +289,36 @@ UInt32 SFB::Audio::OggVorbisDecoder::_ReadAudio(AudioBufferList *bufferList, UIn
 	return totalFramesRead;
 }
 
+UInt32 SFB::Audio::OggVorbisDecoder::ReadInterleavedAudio(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	char		*buffer				= (char *)bufferList->mBuffers[0].mData;
+	UInt32		bytesRemaining		= frameCount * mFormat.mBytesPerFrame;
+	UInt32		totalBytesRead		= 0;
+	int			currentSection		= 0;
+
+	while(0 < bytesRemaining) {
+		// Decode a chunk of native-endian signed 16-bit samples from the file
+		long bytesRead = ov_read(&mVorbisFile, buffer + totalBytesRead, (int)bytesRemaining, (kAudioFormatFlagIsBigEndian == kAudioFormatFlagsNativeEndian), 2, 1, &currentSection);
+
+		if(0 > bytesRead) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggVorbis", "Ogg Vorbis decoding error");
+			return 0;
+		}
+
+		// 0 bytes indicates EOS
+		if(0 == bytesRead)
+			break;
+
+		totalBytesRead += (UInt32)bytesRead;
+		bytesRemaining -= (UInt32)bytesRead;
+	}
+
+	bufferList->mBuffers[0].mDataByteSize = totalBytesRead;
+	bufferList->mBuffers[0].mNumberChannels = mFormat.mChannelsPerFrame;
+
+	return totalBytesRead / mFormat.mBytesPerFrame;
+}
+
 SInt64 SFB::Audio::OggVorbisDecoder::_SeekToFrame(SInt64 frame)
 {
 	if(0 != ov_pcm_seek(&mVorbisFile, frame)) {
@@ -287,3 +328,31 @@ SInt64 SFB::Audio::OggVorbisDecoder::_SeekToFrame(SInt64 frame)
 
 	return _GetCurrentFrame();
 }
+
+SInt64 SFB::Audio::OggVorbisDecoder::_FastSeekToFrame(SInt64 frame)
+{
+	// Seek to the page containing the desired frame without pre-rolling
+	if(0 != ov_pcm_seek_page(&mVorbisFile, frame)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggVorbis", "Ogg Vorbis seek error");
+		return -1;
+	}
+
+	return _GetCurrentFrame();
+}
+
+SInt64 SFB::Audio::OggVorbisDecoder::_ApproximateSeekToFrame(SInt64 frame)
+{
+	ogg_int64_t totalBytes = ov_raw_total(&mVorbisFile, -1);
+	ogg_int64_t totalFrames = ov_pcm_total(&mVorbisFile, -1);
+	if(0 >= totalBytes || 0 >= totalFrames)
+		return _FastSeekToFrame(frame);
+
+	// Interpolate the byte offset assuming a constant bitrate
+	ogg_int64_t offset = (ogg_int64_t)(((double)frame / totalFrames) * totalBytes);
+	if(0 != ov_raw_seek(&mVorbisFile, offset)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggVorbis", "Ogg Vorbis seek error");
+		return -1;
+	}
+
+	return _GetCurrentFrame();
+}
@@ -51,6 +51,9 @@ namespace SFB {
 			// Attempt to read frameCount frames of audio, returning the actual number of frames read
 			virtual UInt32 _ReadAudio(AudioBufferList *bufferList, UInt32 frameCount);
 
+			// Read interleaved 16-bit integer audio using ov_read()
+			UInt32 ReadInterleavedAudio(AudioBufferList *bufferList, UInt32 frameCount);
+
 			// Source audio information
 			inline virtual SInt64 _GetTotalFrames() const			{ return ov_pcm_total(const_cast<OggVorbis_File *>(&mVorbisFile), -1); }
 			inline virtual SInt64 _GetCurrentFrame() const			{ return ov_pcm_tell(const_cast<OggVorbis_File *>(&mVorbisFile)); }
@@ -58,6 +61,8 @@ namespace SFB {
 			// Seeking support
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
+			virtual SInt64 _FastSeekToFrame(SInt64 frame);
+			virtual SInt64 _ApproximateSeekToFrame(SInt64 frame);
 
 			// Data members
 			OggVorbis_File		mVorbisFile;
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "PrerolledDecoder.h"
+#include "CFErrorUtilities.h"
+#include "Logger.h"
+
+#pragma mark Factory Methods
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::PrerolledDecoder::CreateForURL(CFURLRef url, SInt64 startingFrame, UInt32 prerollFrameCount, CFErrorRef *error)
+{
+	// Starting at an arbitrary frame begins with a seek
+	return CreateForDecoder(Decoder::CreateForInputSource(InputSource::CreateForURL(url, InputSource::RandomAccess, error), error), startingFrame, prerollFrameCount, error);
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::PrerolledDecoder::CreateForDecoder(unique_ptr decoder, SInt64 startingFrame, UInt32 prerollFrameCount, CFErrorRef *error)
+{
+#pragma unused(error)
+
+	if(!decoder || 0 > startingFrame)
+		return nullptr;
+
+	return unique_ptr(new PrerolledDecoder(std::move(decoder), startingFrame, prerollFrameCount));
+}
+
+SFB::Audio::PrerolledDecoder::PrerolledDecoder(Decoder::unique_ptr decoder, SInt64 startingFrame, UInt32 prerollFrameCount)
+	: mDecoder(std::move(decoder)), mStartingFrame(startingFrame), mPrerollFrameCount(prerollFrameCount), mPrerolledFrameCount(0), mCurrentFrame(0)
+{
+	assert(nullptr != mDecoder);
+}
+
+bool SFB::Audio::PrerolledDecoder::_Open(CFErrorRef *error)
+{
+	if(!mDecoder->IsOpen()) {
+		mDecoder->SetPreferredSampleFormat(GetPreferredSampleFormat());
+		if(!mDecoder->Open(error))
+			return false;
+	}
+
+	if(mStartingFrame != mDecoder->GetCurrentFrame() && (!mDecoder->SupportsSeeking() || mStartingFrame != mDecoder->SeekToFrame(mStartingFrame))) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.Prerolled", "Unable to seek to frame " << mStartingFrame << " in " << GetURL());
+
+		if(error) {
+			SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” could not be positioned at the requested frame."), ""));
+			SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Seek failed"), ""));
+			SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The file's format may not support seeking."), ""));
+
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, GetURL(), failureReason, recoverySuggestion);
+		}
+
+		mDecoder->Close(nullptr);
+		return false;
+	}
+
+	mFormat = mDecoder->GetFormat();
+	mSourceFormat = mDecoder->GetSourceFormat();
+	mChannelLayout = mDecoder->GetChannelLayout();
+
+	mCurrentFrame = mStartingFrame;
+	mPrerolledFrameCount = 0;
+
+	// Only PCM can be divided at arbitrary frames
+	if(0 == mPrerollFrameCount || !mFormat.IsPCM())
+		return true;
+
+	if(!mBufferList.Allocate(mFormat, mPrerollFrameCount)) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.Prerolled", "Unable to allocate memory for preroll");
+		return true;
+	}
+
+	// A short preroll is not an error; the remaining audio is read from the decoder as usual
+	while(mPrerolledFrameCount < mPrerollFrameCount) {
+		size_t byteOffset = mFormat.FrameCountToByteCount(mPrerolledFrameCount);
+		UInt32 framesToRead = mPrerollFrameCount - mPrerolledFrameCount;
+
+		AudioBufferList *bufferListAlias = (AudioBufferList *)alloca(offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) * mBufferList->mNumberBuffers));
+		bufferListAlias->mNumberBuffers = mBufferList->mNumberBuffers;
+		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
+			bufferListAlias->mBuffers[i].mData				= (uint8_t *)mBufferList->mBuffers[i].mData + byteOffset;
+			bufferListAlias->mBuffers[i].mDataByteSize		= (UInt32)mFormat.FrameCountToByteCount(framesToRead);
+			bufferListAlias->mBuffers[i].mNumberChannels	= mBufferList->mBuffers[i].mNumberChannels;
+		}
+
+		UInt32 framesRead = mDecoder->ReadAudio(bufferListAlias, framesToRead);
+		if(0 == framesRead)
+			break;
+
+		mPrerolledFrameCount += framesRead;
+	}
+
+	LOGGER_DEBUG("org.sbooth.AudioEngine.Decoder.Prerolled", "Prerolled " << mPrerolledFrameCount << " frames at frame " << mStartingFrame << " of " << GetURL());
+
+	return true;
+}
+
+bool SFB::Audio::PrerolledDecoder::_Close(CFErrorRef *error)
+{
+	if(!mDecoder->Close(error))
+		return false;
+
+	mBufferList.Deallocate();
+	mPrerolledFrameCount = 0;
+
+	return true;
+}
+
+SFB::CFString SFB::Audio::PrerolledDecoder::_GetSourceFormatDescription() const
+{
+	return CFString(mDecoder->CreateSourceFormatDescription());
+}
+
+#pragma mark Functionality
+
+bool SFB::Audio::PrerolledDecoder::IsPrerolled(SInt64 frame) const
+{
+	SInt64 prerollEnd = mStartingFrame + mPrerolledFrameCount;
+	return frame >= mStartingFrame && frame < prerollEnd && mDecoder->GetCurrentFrame() == prerollEnd;
+}
+
+UInt32 SFB::Audio::PrerolledDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	if(!IsPrerolled(mCurrentFrame)) {
+		UInt32 framesRead = mDecoder->ReadAudio(bufferList, frameCount);
+		mCurrentFrame = mDecoder->GetCurrentFrame();
+		return framesRead;
+	}
+
+	// Copy the prerolled audio
+	UInt32 framesToCopy = (UInt32)std::min((SInt64)frameCount, mStartingFrame + mPrerolledFrameCount - mCurrentFrame);
+	size_t byteOffset = mFormat.FrameCountToByteCount((size_t)(mCurrentFrame - mStartingFrame));
+	UInt32 byteCount = (UInt32)mFormat.FrameCountToByteCount(framesToCopy);
+
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers && i < mBufferList->mNumberBuffers; ++i) {
+		memcpy(bufferList->mBuffers[i].mData, (const uint8_t *)mBufferList->mBuffers[i].mData + byteOffset, byteCount);
+		bufferList->mBuffers[i].mDataByteSize = byteCount;
+	}
+
+	mCurrentFrame += framesToCopy;
+
+	// Continue from the wrapped decoder, which is positioned where the prerolled audio ends
+	if(framesToCopy < frameCount) {
+		AudioBufferList *bufferListAlias = (AudioBufferList *)alloca(offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) * bufferList->mNumberBuffers));
+		bufferListAlias->mNumberBuffers = bufferList->mNumberBuffers;
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
+			bufferListAlias->mBuffers[i].mData				= (uint8_t *)bufferList->mBuffers[i].mData + byteCount;
+			bufferListAlias->mBuffers[i].mDataByteSize		= (UInt32)mFormat.FrameCountToByteCount(frameCount - framesToCopy);
+			bufferListAlias->mBuffers[i].mNumberChannels	= bufferList->mBuffers[i].mNumberChannels;
+		}
+
+		UInt32 framesRead = mDecoder->ReadAudio(bufferListAlias, frameCount - framesToCopy);
+
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+			bufferList->mBuffers[i].mDataByteSize += bufferListAlias->mBuffers[i].mDataByteSize;
+
+		framesToCopy += framesRead;
+		mCurrentFrame += framesRead;
+	}
+
+	return framesToCopy;
+}
+
+SInt64 SFB::Audio::PrerolledDecoder::_SeekToFrame(SInt64 frame)
+{
+	// Seeking within the prerolled audio doesn't require the wrapped decoder
+	if(IsPrerolled(frame)) {
+		mCurrentFrame = frame;
+		return mCurrentFrame;
+	}
+
+	SInt64 newFrame = mDecoder->SeekToFrame(frame);
+	if(-1 != newFrame)
+		mCurrentFrame = newFrame;
+
+	return newFrame;
+}
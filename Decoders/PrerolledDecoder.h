@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include "AudioDecoder.h"
+#include "AudioBufferList.h"
+
+/*! @file PrerolledDecoder.h @brief Support for starting playback at a position decoded ahead of time */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A wrapper around a Decoder that starts at a specific frame with audio decoded ahead of time
+		 *
+		 * Opening a \c PrerolledDecoder seeks the wrapped decoder to the starting frame and decodes
+		 * up to the requested number of frames into memory.  Reads are satisfied from memory until
+		 * the prerolled audio is exhausted and then continue from the wrapped decoder, which is already
+		 * positioned where the prerolled audio ends.  Opening the decoder in advance, for example on a
+		 * background thread, moves the cost of seeking and the first reads out of the path to playback.
+		 * @note Only PCM audio is prerolled; for other formats the decoder is positioned but no audio is decoded
+		 */
+		class PrerolledDecoder : public Decoder
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Factory Methods */
+			//@{
+
+			/*!
+			 * @brief Create a \c PrerolledDecoder object for the specified URL
+			 * @param url The URL
+			 * @param startingFrame The first frame to decode
+			 * @param prerollFrameCount The number of frames to decode when the decoder is opened
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c PrerolledDecoder object, or \c nullptr on failure
+			 */
+			static unique_ptr CreateForURL(CFURLRef url, SInt64 startingFrame, UInt32 prerollFrameCount, CFErrorRef *error = nullptr);
+
+			/*!
+			 * @brief Create a \c PrerolledDecoder object for the specified \c Decoder
+			 * @note The decoder may already be open
+			 * @param decoder The decoder
+			 * @param startingFrame The first frame to decode
+			 * @param prerollFrameCount The number of frames to decode when the decoder is opened
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c PrerolledDecoder object, or \c nullptr on failure
+			 */
+			static unique_ptr CreateForDecoder(unique_ptr decoder, SInt64 startingFrame, UInt32 prerollFrameCount, CFErrorRef *error = nullptr);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*! @brief Destroy this \c PrerolledDecoder */
+			virtual ~PrerolledDecoder() = default;
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			PrerolledDecoder(const PrerolledDecoder& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			PrerolledDecoder& operator=(const PrerolledDecoder& rhs) = delete;
+
+			/*! @endcond */
+			//@}
+
+
+			// ========================================
+			/*! @name Preroll */
+			//@{
+
+			/*! @brief Get the first frame decoded */
+			inline SInt64 GetStartingFrame() const					{ return mStartingFrame; }
+
+			/*! @brief Get the number of frames decoded when the decoder was opened */
+			inline UInt32 GetPrerolledFrameCount() const			{ return mPrerolledFrameCount; }
+
+			//@}
+
+		private:
+
+			PrerolledDecoder() = delete;
+			PrerolledDecoder(Decoder::unique_ptr decoder, SInt64 startingFrame, UInt32 prerollFrameCount);
+
+			// Source access
+			inline virtual CFURLRef _GetURL() const					{ return mDecoder->GetURL(); }
+			inline virtual InputSource& _GetInputSource() const		{ return mDecoder->GetInputSource(); }
+
+			// Audio access
+			virtual bool _Open(CFErrorRef *error);
+			virtual bool _Close(CFErrorRef *error);
+
+			// The native format of the source audio
+			virtual SFB::CFString _GetSourceFormatDescription() const;
+
+			// Attempt to read frameCount frames of audio, returning the actual number of frames read
+			virtual UInt32 _ReadAudio(AudioBufferList *bufferList, UInt32 frameCount);
+
+			// Source audio information
+			inline virtual SInt64 _GetTotalFrames() const			{ return mDecoder->GetTotalFrames(); }
+			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
+
+			// Seeking support
+			inline virtual bool _SupportsSeeking() const			{ return mDecoder->SupportsSeeking(); }
+			virtual SInt64 _SeekToFrame(SInt64 frame);
+
+			// Memory accounting
+			inline virtual size_t _GetMemoryUsage() const			{ return mBufferList.GetAllocatedByteCount() + mDecoder->GetMemoryUsage(); }
+
+			// Whether frame is held in the prerolled audio and the wrapped decoder is positioned after it
+			bool IsPrerolled(SInt64 frame) const;
+
+			// Data members
+			Decoder::unique_ptr		mDecoder;
+			BufferList				mBufferList;
+			SInt64					mStartingFrame;
+			UInt32					mPrerollFrameCount;
+			UInt32					mPrerolledFrameCount;
+			SInt64					mCurrentFrame;
+		};
+
+	}
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "SharedStreamDecoder.h"
+#include "AudioBufferList.h"
+#include "CFErrorUtilities.h"
+#include "Logger.h"
+
+namespace {
+
+	// The number of frames decoded at a time for a stream
+	const UInt32 kDecodeChunkFrames = 4096;
+
+	// ========================================
+	// An InputSource carrying the URL of a shared stream, whose audio is read from the stream instead
+	class StreamURLInputSource : public SFB::InputSource
+	{
+
+	public:
+
+		explicit StreamURLInputSource(CFURLRef url)
+			: InputSource(url)
+		{}
+
+	private:
+
+		virtual bool _Open(CFErrorRef */*error*/)				{ return true; }
+		virtual bool _Close(CFErrorRef */*error*/)				{ return true; }
+		virtual SInt64 _Read(void */*buffer*/, SInt64 /*byteCount*/)	{ return 0; }
+		virtual bool _AtEOF() const								{ return true; }
+		virtual SInt64 _GetOffset() const						{ return 0; }
+		virtual SInt64 _GetLength() const						{ return 0; }
+	};
+
+	// ========================================
+	// Create an open decoder positioned at startingFrame
+	SFB::Audio::Decoder::unique_ptr CreateOpenDecoder(CFURLRef url, SInt64 startingFrame, CFErrorRef *error)
+	{
+		auto decoder = SFB::Audio::Decoder::CreateForURL(url, error);
+		if(!decoder || (!decoder->IsOpen() && !decoder->Open(error)))
+			return nullptr;
+
+		if(startingFrame != decoder->GetCurrentFrame() && (!decoder->SupportsSeeking() || startingFrame != decoder->SeekToFrame(startingFrame))) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.SharedStream", "Unable to seek to frame " << startingFrame << " in " << url);
+
+			if(error) {
+				SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” could not be positioned at the requested frame."), ""));
+				SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Seek failed"), ""));
+				SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The file's format may not support seeking."), ""));
+
+				*error = SFB::CreateErrorForURL(SFB::Audio::Decoder::ErrorDomain, SFB::Audio::Decoder::InputOutputError, description, url, failureReason, recoverySuggestion);
+			}
+
+			return nullptr;
+		}
+
+		return decoder;
+	}
+
+}
+
+// ========================================
+// A decoder's output and the most recently decoded audio, shared by the decoders reading it
+// ========================================
+class SFB::Audio::SharedStreamDecoder::Stream
+{
+
+public:
+
+	// Find a registered stream for url that retains frame
+	static std::shared_ptr<Stream> Find(CFURLRef url, SInt64 frame)
+	{
+		std::lock_guard<std::mutex> lock(sStreamsMutex);
+
+		sStreams.erase(std::remove_if(sStreams.begin(), sStreams.end(), [](const std::weak_ptr<Stream>& stream) { return stream.expired(); }), sStreams.end());
+
+		for(const auto& weakStream : sStreams) {
+			auto stream = weakStream.lock();
+			if(stream && stream->Contains(url, frame))
+				return stream;
+		}
+
+		return nullptr;
+	}
+
+	// Create and register a stream for an open decoder
+	static std::shared_ptr<Stream> Create(Decoder::unique_ptr decoder, double maximumSkew)
+	{
+		try {
+			auto stream = std::make_shared<Stream>(std::move(decoder), maximumSkew);
+
+			std::lock_guard<std::mutex> lock(sStreamsMutex);
+			sStreams.push_back(stream);
+
+			return stream;
+		}
+
+		catch(const std::exception& e) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.SharedStream", "Unable to create stream: " << e.what());
+			return nullptr;
+		}
+	}
+
+	static size_t GetCount()
+	{
+		std::lock_guard<std::mutex> lock(sStreamsMutex);
+		return (size_t)std::count_if(sStreams.begin(), sStreams.end(), [](const std::weak_ptr<Stream>& stream) { return !stream.expired(); });
+	}
+
+	Stream(Decoder::unique_ptr decoder, double maximumSkew)
+		: mDecoder(std::move(decoder)), mFirstFrame(0), mFrameCount(0), mEndOfStream(false), mTotalFrames(0)
+	{
+		const auto& format = mDecoder->GetFormat();
+
+		mRetainedFrames = (UInt32)std::ceil(maximumSkew * format.mSampleRate);
+		if(!mBufferList.Allocate(format, (2 * mRetainedFrames) + kDecodeChunkFrames))
+			throw std::bad_alloc();
+
+		mFirstFrame = mDecoder->GetCurrentFrame();
+		mTotalFrames.store(mDecoder->GetTotalFrames());
+		mSupportsSeeking = mDecoder->SupportsSeeking();
+
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder.SharedStream", "Created stream for " << mDecoder->GetURL() << " at frame " << mFirstFrame);
+	}
+
+	Stream(const Stream& rhs) = delete;
+	Stream& operator=(const Stream& rhs) = delete;
+
+	// The decoder's formats don't change once it is open and may be read without locking
+	inline const Decoder& GetDecoder() const				{ return *mDecoder; }
+
+	inline SInt64 GetTotalFrames() const					{ return mTotalFrames.load(); }
+	inline bool SupportsSeeking() const						{ return mSupportsSeeking; }
+
+	// Copy audio starting at frame, returning the number of frames copied or -1 if frame is not retained
+	SInt64 Read(AudioBufferList *bufferList, SInt64 frame, UInt32 frameCount)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		if(frame < mFirstFrame || frame > mFirstFrame + mFrameCount)
+			return -1;
+
+		// The listener furthest ahead decodes for the stream
+		while(frame == mFirstFrame + mFrameCount && !mEndOfStream)
+			Decode();
+
+		const auto& format = mDecoder->GetFormat();
+
+		UInt32 framesToCopy = (UInt32)std::min((SInt64)frameCount, mFirstFrame + mFrameCount - frame);
+		size_t byteOffset = format.FrameCountToByteCount((size_t)(frame - mFirstFrame));
+		UInt32 byteCount = (UInt32)format.FrameCountToByteCount(framesToCopy);
+
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers && i < mBufferList->mNumberBuffers; ++i) {
+			memcpy(bufferList->mBuffers[i].mData, (const uint8_t *)mBufferList->mBuffers[i].mData + byteOffset, byteCount);
+			bufferList->mBuffers[i].mDataByteSize = byteCount;
+		}
+
+		return framesToCopy;
+	}
+
+private:
+
+	bool Contains(CFURLRef url, SInt64 frame)
+	{
+		if(!CFEqual(url, mDecoder->GetURL()))
+			return false;
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		return frame >= mFirstFrame && frame <= mFirstFrame + mFrameCount;
+	}
+
+	// Decode the next chunk of audio; must be called with mMutex held
+	void Decode()
+	{
+		const auto& format = mDecoder->GetFormat();
+
+		// When full, discard all but the most recent mRetainedFrames frames
+		// Since the buffer holds twice that many frames each frame is moved at most once
+		if(mFrameCount + kDecodeChunkFrames > mBufferList.GetCapacityFrames()) {
+			UInt32 discardFrames = mFrameCount - std::min(mFrameCount, mRetainedFrames);
+			size_t discardBytes = format.FrameCountToByteCount(discardFrames);
+			size_t retainedBytes = format.FrameCountToByteCount(mFrameCount - discardFrames);
+
+			for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
+				auto data = (uint8_t *)mBufferList->mBuffers[i].mData;
+				memmove(data, data + discardBytes, retainedBytes);
+			}
+
+			mFirstFrame += discardFrames;
+			mFrameCount -= discardFrames;
+		}
+
+		// Decode into the space following the retained audio
+		auto bufferListAlias = (AudioBufferList *)alloca(offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) * mBufferList->mNumberBuffers));
+		bufferListAlias->mNumberBuffers = mBufferList->mNumberBuffers;
+
+		size_t byteOffset = format.FrameCountToByteCount(mFrameCount);
+		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
+			bufferListAlias->mBuffers[i].mNumberChannels = mBufferList->mBuffers[i].mNumberChannels;
+			bufferListAlias->mBuffers[i].mData = (uint8_t *)mBufferList->mBuffers[i].mData + byteOffset;
+			bufferListAlias->mBuffers[i].mDataByteSize = (UInt32)format.FrameCountToByteCount(kDecodeChunkFrames);
+		}
+
+		UInt32 framesRead = mDecoder->ReadAudio(bufferListAlias, kDecodeChunkFrames);
+		mFrameCount += framesRead;
+
+		if(0 == framesRead) {
+			mEndOfStream = true;
+			mTotalFrames.store(mFirstFrame + mFrameCount);
+		}
+		else
+			mTotalFrames.store(std::max(mDecoder->GetTotalFrames(), mFirstFrame + mFrameCount));
+	}
+
+	Decoder::unique_ptr		mDecoder;
+	std::mutex				mMutex;
+	BufferList				mBufferList;
+	UInt32					mRetainedFrames;	// The number of frames kept for listeners behind the furthest ahead
+	SInt64					mFirstFrame;		// The frame number of the oldest audio in mBufferList
+	UInt32					mFrameCount;		// The number of frames in mBufferList
+	bool					mEndOfStream;
+	bool					mSupportsSeeking;
+	std::atomic_llong		mTotalFrames;
+
+	static std::mutex							sStreamsMutex;
+	static std::vector<std::weak_ptr<Stream>>	sStreams;
+};
+
+std::mutex SFB::Audio::SharedStreamDecoder::Stream::sStreamsMutex;
+std::vector<std::weak_ptr<SFB::Audio::SharedStreamDecoder::Stream>> SFB::Audio::SharedStreamDecoder::Stream::sStreams;
+
+std::atomic<double> SFB::Audio::SharedStreamDecoder::sMaximumSkew(5);
+
+#pragma mark Factory Methods
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::SharedStreamDecoder::CreateForURL(CFURLRef url, SInt64 startingFrame, CFErrorRef *error)
+{
+	if(nullptr == url || 0 > startingFrame)
+		return nullptr;
+
+	auto stream = Stream::Find(url, startingFrame);
+	if(stream)
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder.SharedStream", "Sharing stream for " << url << " at frame " << startingFrame);
+	else {
+		auto decoder = CreateOpenDecoder(url, startingFrame, error);
+		if(!decoder)
+			return nullptr;
+
+		// Only PCM can be divided at arbitrary frames
+		if(!decoder->GetFormat().IsPCM())
+			return decoder;
+
+		stream = Stream::Create(std::move(decoder), sMaximumSkew.load());
+		if(!stream)
+			return nullptr;
+	}
+
+	auto decoder = unique_ptr(new SharedStreamDecoder(url, stream, startingFrame));
+	if(!decoder->Open(error))
+		return nullptr;
+
+	return decoder;
+}
+
+#pragma mark Stream Sharing
+
+double SFB::Audio::SharedStreamDecoder::GetMaximumSkew()
+{
+	return sMaximumSkew.load();
+}
+
+bool SFB::Audio::SharedStreamDecoder::SetMaximumSkew(double maximumSkew)
+{
+	if(0 >= maximumSkew)
+		return false;
+
+	sMaximumSkew.store(maximumSkew);
+	return true;
+}
+
+size_t SFB::Audio::SharedStreamDecoder::GetStreamCount()
+{
+	return Stream::GetCount();
+}
+
+long SFB::Audio::SharedStreamDecoder::GetListenerCount() const
+{
+	return mStream.use_count();
+}
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::SharedStreamDecoder::SharedStreamDecoder(CFURLRef url, std::shared_ptr<Stream> stream, SInt64 startingFrame)
+	: Decoder(InputSource::unique_ptr(new StreamURLInputSource(url))), mStream(stream), mCurrentFrame(startingFrame)
+{}
+
+SFB::Audio::SharedStreamDecoder::~SharedStreamDecoder()
+{
+	if(IsOpen())
+		Close();
+}
+
+#pragma mark Functionality
+
+bool SFB::Audio::SharedStreamDecoder::_Open(CFErrorRef *error)
+{
+	if(!mStream && !Attach(mCurrentFrame)) {
+		if(error) {
+			SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” could not be decoded."), ""));
+			SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Decoding failed"), ""));
+			SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The file may have been moved or modified."), ""));
+
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, GetURL(), failureReason, recoverySuggestion);
+		}
+
+		return false;
+	}
+
+	const auto& decoder = mStream->GetDecoder();
+
+	mFormat = decoder.GetFormat();
+	mSourceFormat = decoder.GetSourceFormat();
+	mChannelLayout = decoder.GetChannelLayout();
+
+	return true;
+}
+
+bool SFB::Audio::SharedStreamDecoder::_Close(CFErrorRef */*error*/)
+{
+	mStream.reset();
+	return true;
+}
+
+SFB::CFString SFB::Audio::SharedStreamDecoder::_GetSourceFormatDescription() const
+{
+	return CFString(mStream->GetDecoder().CreateSourceFormatDescription());
+}
+
+UInt32 SFB::Audio::SharedStreamDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	SInt64 framesRead = mStream->Read(bufferList, mCurrentFrame, frameCount);
+
+	// This listener fell more than the maximum skew behind the stream
+	if(-1 == framesRead) {
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.SharedStream", "Frame " << mCurrentFrame << " of " << GetURL() << " is no longer retained; changing streams");
+
+		if(Attach(mCurrentFrame))
+			framesRead = mStream->Read(bufferList, mCurrentFrame, frameCount);
+
+		if(-1 == framesRead) {
+			for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+				bufferList->mBuffers[i].mDataByteSize = 0;
+			return 0;
+		}
+	}
+
+	mCurrentFrame += framesRead;
+
+	return (UInt32)framesRead;
+}
+
+SInt64 SFB::Audio::SharedStreamDecoder::_GetTotalFrames() const
+{
+	return mStream->GetTotalFrames();
+}
+
+bool SFB::Audio::SharedStreamDecoder::_SupportsSeeking() const
+{
+	return mStream->SupportsSeeking();
+}
+
+SInt64 SFB::Audio::SharedStreamDecoder::_SeekToFrame(SInt64 frame)
+{
+	// Seeking within the audio retained by a stream doesn't require decoding
+	if(!Attach(frame))
+		return -1;
+
+	return mCurrentFrame;
+}
+
+bool SFB::Audio::SharedStreamDecoder::Attach(SInt64 frame)
+{
+	auto stream = Stream::Find(GetURL(), frame);
+	if(stream && stream->GetDecoder().GetFormat() != mFormat)
+		stream = nullptr;
+
+	if(!stream) {
+		auto decoder = CreateOpenDecoder(GetURL(), frame, nullptr);
+		if(!decoder || decoder->GetFormat() != mFormat) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.SharedStream", "Unable to create stream for " << GetURL() << " at frame " << frame);
+			return false;
+		}
+
+		stream = Stream::Create(std::move(decoder), sMaximumSkew.load());
+		if(!stream)
+			return false;
+	}
+
+	mStream = stream;
+	mCurrentFrame = frame;
+
+	return true;
+}
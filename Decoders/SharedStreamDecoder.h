@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "AudioDecoder.h"
+
+/*! @file SharedStreamDecoder.h @brief Support for sharing decoded audio between players */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A decoder that shares decoded audio with other decoders reading the same URL
+		 *
+		 * A \c SharedStreamDecoder created for a URL and position that another \c SharedStreamDecoder
+		 * is already decoding attaches to that decoder's reference-counted stream instead of decoding
+		 * the URL again, so the cost of decoding scales with the number of distinct streams rather
+		 * than the number of listeners.
+		 *
+		 * The listener furthest ahead decodes for the stream, and decoded audio is retained for
+		 * \c GetMaximumSkew() seconds for listeners that are behind.  A listener that falls further
+		 * behind, or seeks outside the retained audio, attaches to another stream at its position,
+		 * creating one if necessary.
+		 * @note Only PCM audio is shared; for other formats the factory method returns an ordinary decoder
+		 */
+		class SharedStreamDecoder : public Decoder
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Factory Methods */
+			//@{
+
+			/*!
+			 * @brief Create an open \c Decoder for the specified URL, sharing a stream already decoding the URL if possible
+			 * @param url The URL
+			 * @param startingFrame The first frame to decode
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c Decoder object, or \c nullptr on failure
+			 */
+			static unique_ptr CreateForURL(CFURLRef url, SInt64 startingFrame = 0, CFErrorRef *error = nullptr);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Stream Sharing */
+			//@{
+
+			/*! @brief Get the duration of decoded audio, in seconds, retained for listeners behind the furthest ahead */
+			static double GetMaximumSkew();
+
+			/*!
+			 * @brief Set the duration of decoded audio, in seconds, retained for listeners behind the furthest ahead
+			 * @note The setting applies to streams created after it is changed
+			 * @param maximumSkew The duration in seconds
+			 * @return \c true on success, \c false otherwise
+			 */
+			static bool SetMaximumSkew(double maximumSkew);
+
+			/*! @brief Get the number of distinct streams currently being decoded */
+			static size_t GetStreamCount();
+
+			/*! @brief Get the number of decoders sharing this decoder's stream, including this one */
+			long GetListenerCount() const;
+
+			//@}
+
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*! @brief Destroy this \c SharedStreamDecoder */
+			virtual ~SharedStreamDecoder();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			SharedStreamDecoder(const SharedStreamDecoder& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			SharedStreamDecoder& operator=(const SharedStreamDecoder& rhs) = delete;
+
+			/*! @endcond */
+			//@}
+
+		private:
+
+			// A decoded stream shared between decoders
+			class Stream;
+
+			// Creation
+			SharedStreamDecoder() = delete;
+			SharedStreamDecoder(CFURLRef url, std::shared_ptr<Stream> stream, SInt64 startingFrame);
+
+			// Audio access
+			virtual bool _Open(CFErrorRef *error);
+			virtual bool _Close(CFErrorRef *error);
+
+			// The native format of the source audio
+			virtual SFB::CFString _GetSourceFormatDescription() const;
+
+			// Attempt to read frameCount frames of audio, returning the actual number of frames read
+			virtual UInt32 _ReadAudio(AudioBufferList *bufferList, UInt32 frameCount);
+
+			// Source audio information
+			virtual SInt64 _GetTotalFrames() const;
+			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
+
+			// Seeking support
+			virtual bool _SupportsSeeking() const;
+			virtual SInt64 _SeekToFrame(SInt64 frame);
+
+			// Attach to a stream containing frame, creating one if necessary
+			bool Attach(SInt64 frame);
+
+			// Data members
+			std::shared_ptr<Stream>		mStream;
+			SInt64						mCurrentFrame;
+
+			static std::atomic<double>	sMaximumSkew;
+		};
+
+	}
+}
@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <libkern/OSByteOrder.h>
+#include <mach/mach_time.h>
+
+#include "SignalGeneratorDecoder.h"
+#include "CFWrapper.h"
+#include "CFErrorUtilities.h"
+#include "Logger.h"
+
+namespace {
+
+#if SFB_SIGNAL_GENERATOR_DECODER
+	void RegisterSignalGeneratorDecoder() __attribute__ ((constructor));
+	void RegisterSignalGeneratorDecoder()
+	{
+		SFB::Audio::Decoder::RegisterSubclass<SFB::Audio::SignalGeneratorDecoder>();
+	}
+#endif
+
+	// Parameter files are small property lists
+	const SInt64 kMaximumParametersFileSize = 64 * 1024;
+
+	// ========================================
+	// An InputSource for decoders created directly from parameters
+	class ParametersInputSource : public SFB::InputSource
+	{
+
+	public:
+
+		ParametersInputSource()
+			: InputSource(SFB::CFURL(CFURLCreateWithString(kCFAllocatorDefault, CFSTR("x-sfb-signal:"), nullptr)))
+		{}
+
+	private:
+
+		virtual bool _Open(CFErrorRef */*error*/)				{ return true; }
+		virtual bool _Close(CFErrorRef */*error*/)				{ return true; }
+		virtual SInt64 _Read(void */*buffer*/, SInt64 /*byteCount*/)	{ return 0; }
+		virtual bool _AtEOF() const								{ return true; }
+		virtual SInt64 _GetOffset() const						{ return 0; }
+		virtual SInt64 _GetLength() const						{ return 0; }
+	};
+
+	CFErrorRef CreateInvalidParametersError(CFURLRef url) CF_RETURNS_RETAINED
+	{
+		SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” is not a valid signal description."), ""));
+		SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Not a signal description"), ""));
+		SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), ""));
+
+		return SFB::CreateErrorForURL(SFB::Audio::Decoder::ErrorDomain, SFB::Audio::Decoder::FileFormatNotRecognizedError, description, url, failureReason, recoverySuggestion);
+	}
+
+	// ========================================
+	// Dictionary accessors leaving value unchanged if key is absent
+	void GetDouble(CFDictionaryRef dictionary, CFStringRef key, double& value)
+	{
+		auto number = (CFNumberRef)CFDictionaryGetValue(dictionary, key);
+		if(number && CFNumberGetTypeID() == CFGetTypeID(number))
+			CFNumberGetValue(number, kCFNumberDoubleType, &value);
+	}
+
+	template <typename T>
+	void GetInteger(CFDictionaryRef dictionary, CFStringRef key, T& value)
+	{
+		auto number = (CFNumberRef)CFDictionaryGetValue(dictionary, key);
+		long long integer;
+		if(number && CFNumberGetTypeID() == CFGetTypeID(number) && CFNumberGetValue(number, kCFNumberLongLongType, &integer))
+			value = (T)integer;
+	}
+
+	void GetBoolean(CFDictionaryRef dictionary, CFStringRef key, bool& value)
+	{
+		auto boolean = (CFBooleanRef)CFDictionaryGetValue(dictionary, key);
+		if(boolean && CFBooleanGetTypeID() == CFGetTypeID(boolean))
+			value = CFBooleanGetValue(boolean);
+	}
+
+	// ========================================
+	// Fill in the derived fields of a packed linear PCM format
+	void SetPCMFormat(SFB::Audio::AudioFormat& format, Float64 sampleRate, UInt32 channelsPerFrame, UInt32 bitsPerChannel, bool isFloat, bool isInterleaved, bool isBigEndian)
+	{
+		format.mFormatID			= kAudioFormatLinearPCM;
+		format.mFormatFlags			= kAudioFormatFlagIsPacked | (isFloat ? kAudioFormatFlagIsFloat : kAudioFormatFlagIsSignedInteger);
+		if(!isInterleaved)
+			format.mFormatFlags		|= kAudioFormatFlagIsNonInterleaved;
+		if(isBigEndian)
+			format.mFormatFlags		|= kAudioFormatFlagIsBigEndian;
+
+		format.mSampleRate			= sampleRate;
+		format.mChannelsPerFrame	= channelsPerFrame;
+		format.mBitsPerChannel		= bitsPerChannel;
+
+		format.mBytesPerPacket		= ((bitsPerChannel + 7) / 8) * (isInterleaved ? channelsPerFrame : 1);
+		format.mFramesPerPacket		= 1;
+		format.mBytesPerFrame		= format.mBytesPerPacket;
+
+		format.mReserved			= 0;
+	}
+
+	// ========================================
+	// A counter-based generator so noise is a pure function of the frame and channel
+	inline uint64_t SplitMix64(uint64_t x)
+	{
+		x += 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+
+	// ========================================
+	// Store sample, from -1 to 1, in the format's representation
+	void StoreSample(double sample, const SFB::Audio::AudioFormat& format, size_t bytesPerSample, uint8_t *destination)
+	{
+		if(kAudioFormatFlagIsFloat & format.mFormatFlags) {
+			bool swap = !format.IsNativeEndian();
+			if(64 == format.mBitsPerChannel) {
+				uint64_t bits;
+				memcpy(&bits, &sample, sizeof(bits));
+				if(swap)
+					bits = OSSwapInt64(bits);
+				memcpy(destination, &bits, sizeof(bits));
+			}
+			else {
+				float value = (float)sample;
+				uint32_t bits;
+				memcpy(&bits, &value, sizeof(bits));
+				if(swap)
+					bits = OSSwapInt32(bits);
+				memcpy(destination, &bits, sizeof(bits));
+			}
+			return;
+		}
+
+		// Scale to the valid bits, then align within the sample's bytes
+		UInt32 bits = format.mBitsPerChannel;
+		double scale = (double)(1ULL << (bits - 1));
+		int64_t value = (int64_t)std::min(std::max(std::round(sample * scale), -scale), scale - 1);
+		if(kAudioFormatFlagIsAlignedHigh & format.mFormatFlags)
+			value *= (int64_t)1 << (8 * bytesPerSample - bits);
+
+		// Write the bytes least significant first, reversing for big-endian formats
+		auto unsignedValue = (uint64_t)value;
+		bool bigEndian = kAudioFormatFlagIsBigEndian & format.mFormatFlags;
+		for(size_t i = 0; i < bytesPerSample; ++i) {
+			uint8_t byte = (uint8_t)(unsignedValue >> (8 * i));
+			destination[bigEndian ? bytesPerSample - 1 - i : i] = byte;
+		}
+	}
+
+	// ========================================
+	// Simulated decoding costs
+	uint64_t NanosecondsToTicks(uint64_t nanoseconds)
+	{
+		mach_timebase_info_data_t timebaseInfo;
+		mach_timebase_info(&timebaseInfo);
+		return nanoseconds * timebaseInfo.denom / timebaseInfo.numer;
+	}
+
+	void BurnCPU(uint64_t nanoseconds)
+	{
+		if(0 == nanoseconds)
+			return;
+
+		auto deadline = mach_absolute_time() + NanosecondsToTicks(nanoseconds);
+		while(mach_absolute_time() < deadline)
+			;
+	}
+
+	void Block(uint64_t nanoseconds)
+	{
+		if(0 == nanoseconds)
+			return;
+
+		struct timespec duration = { (time_t)(nanoseconds / NSEC_PER_SEC), (long)(nanoseconds % NSEC_PER_SEC) };
+		while(-1 == nanosleep(&duration, &duration) && EINTR == errno)
+			;
+	}
+
+}
+
+#pragma mark Static Methods
+
+CFArrayRef SFB::Audio::SignalGeneratorDecoder::CreateSupportedFileExtensions()
+{
+	CFStringRef supportedExtensions [] = { CFSTR("sfbsignal") };
+	return CFArrayCreate(kCFAllocatorDefault, (const void **)supportedExtensions, 1, &kCFTypeArrayCallBacks);
+}
+
+CFArrayRef SFB::Audio::SignalGeneratorDecoder::CreateSupportedMIMETypes()
+{
+	CFStringRef supportedMIMETypes [] = { CFSTR("audio/x-sfb-signal") };
+	return CFArrayCreate(kCFAllocatorDefault, (const void **)supportedMIMETypes, 1, &kCFTypeArrayCallBacks);
+}
+
+bool SFB::Audio::SignalGeneratorDecoder::HandlesFilesWithExtension(CFStringRef extension)
+{
+	if(nullptr == extension)
+		return false;
+
+	if(kCFCompareEqualTo == CFStringCompare(extension, CFSTR("sfbsignal"), kCFCompareCaseInsensitive))
+		return true;
+
+	return false;
+}
+
+bool SFB::Audio::SignalGeneratorDecoder::HandlesMIMEType(CFStringRef mimeType)
+{
+	if(nullptr == mimeType)
+		return false;
+
+	if(kCFCompareEqualTo == CFStringCompare(mimeType, CFSTR("audio/x-sfb-signal"), kCFCompareCaseInsensitive))
+		return true;
+
+	return false;
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::SignalGeneratorDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
+{
+	return unique_ptr(new SignalGeneratorDecoder(std::move(inputSource)));
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::SignalGeneratorDecoder::CreateWithParameters(const Parameters& parameters)
+{
+	return unique_ptr(new SignalGeneratorDecoder(InputSource::unique_ptr(new ParametersInputSource), parameters));
+}
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::SignalGeneratorDecoder::Parameters::Parameters()
+	: mSignal(Signal::Sine), mFrequency(440), mAmplitude(0.5), mSeed(0), mImpulseInterval(44100), mTotalFrames(10 * 44100), mCPUNanosecondsPerRead(0), mCPUNanosecondsPerFrame(0), mLatencyNanosecondsPerRead(0), mSeekLatencyNanoseconds(0), mSupportsSeeking(true)
+{
+	SetPCMFormat(mFormat, 44100, 2, 32, true, false, false);
+}
+
+SFB::Audio::SignalGeneratorDecoder::SignalGeneratorDecoder(InputSource::unique_ptr inputSource)
+	: Decoder(std::move(inputSource)), mHasParameters(false), mCurrentFrame(0)
+{}
+
+SFB::Audio::SignalGeneratorDecoder::SignalGeneratorDecoder(InputSource::unique_ptr inputSource, const Parameters& parameters)
+	: Decoder(std::move(inputSource)), mParameters(parameters), mHasParameters(true), mCurrentFrame(0)
+{}
+
+SFB::Audio::SignalGeneratorDecoder::~SignalGeneratorDecoder()
+{
+	if(IsOpen())
+		Close();
+}
+
+#pragma mark Functionality
+
+bool SFB::Audio::SignalGeneratorDecoder::_Open(CFErrorRef *error)
+{
+	if(!mHasParameters && !ReadParameters(error))
+		return false;
+
+	const auto& format = mParameters.mFormat;
+	bool isFloat = kAudioFormatFlagIsFloat & format.mFormatFlags;
+	bool validBits = isFloat ? (32 == format.mBitsPerChannel || 64 == format.mBitsPerChannel) : (8 <= format.mBitsPerChannel && 32 >= format.mBitsPerChannel);
+
+	if(!format.IsPCM() || 0 == format.mChannelsPerFrame || 0 >= format.mSampleRate || !validBits || 0 == format.mBytesPerFrame) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.SignalGenerator", "Unsupported format: " << format);
+
+		if(error) {
+			SFB::CFString description(CFCopyLocalizedString(CFSTR("The format of the file “%@” is not supported."), ""));
+			SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Unsupported signal format"), ""));
+			SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("Only linear PCM signals can be generated."), ""));
+
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::FileFormatNotSupportedError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
+		}
+
+		return false;
+	}
+
+	mFormat = format;
+	mSourceFormat = format;
+
+	switch(format.mChannelsPerFrame) {
+		case 1:		mChannelLayout = ChannelLayout::Mono;		break;
+		case 2:		mChannelLayout = ChannelLayout::Stereo;		break;
+	}
+
+	mCurrentFrame = 0;
+
+	return true;
+}
+
+bool SFB::Audio::SignalGeneratorDecoder::_Close(CFErrorRef */*error*/)
+{
+	return true;
+}
+
+SFB::CFString SFB::Audio::SignalGeneratorDecoder::_GetSourceFormatDescription() const
+{
+	CFStringRef signal = CFSTR("Silence");
+	switch(mParameters.mSignal) {
+		case Signal::Sine:		signal = CFSTR("Sine");		break;
+		case Signal::Noise:		signal = CFSTR("Noise");	break;
+		case Signal::Impulse:	signal = CFSTR("Impulse");	break;
+		case Signal::Silence:								break;
+	}
+
+	return CFString(nullptr,
+					CFSTR("Signal Generator (%@), %u channels, %u Hz"),
+					signal,
+					(unsigned int)mSourceFormat.mChannelsPerFrame,
+					(unsigned int)mSourceFormat.mSampleRate);
+}
+
+UInt32 SFB::Audio::SignalGeneratorDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	Block(mParameters.mLatencyNanosecondsPerRead);
+
+	auto startTicks = mach_absolute_time();
+
+	if(-1 != mParameters.mTotalFrames)
+		frameCount = (UInt32)std::min((SInt64)frameCount, std::max(mParameters.mTotalFrames - mCurrentFrame, (SInt64)0));
+
+	bool interleaved = mFormat.IsInterleaved();
+	size_t bytesPerSample = interleaved ? mFormat.mBytesPerFrame / mFormat.mChannelsPerFrame : mFormat.mBytesPerFrame;
+
+	for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
+		auto buffer = &bufferList->mBuffers[interleaved ? 0 : channel];
+		auto data = (uint8_t *)buffer->mData + (interleaved ? channel * bytesPerSample : 0);
+		size_t stride = interleaved ? mFormat.mBytesPerFrame : bytesPerSample;
+
+		for(UInt32 i = 0; i < frameCount; ++i)
+			StoreSample(GenerateSample(mCurrentFrame + i, channel), mFormat, bytesPerSample, data + i * stride);
+	}
+
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+		bufferList->mBuffers[i].mDataByteSize = frameCount * mFormat.mBytesPerFrame;
+
+	mCurrentFrame += frameCount;
+
+	// Burn whatever CPU time generation didn't use
+	uint64_t elapsedTicks = mach_absolute_time() - startTicks;
+	uint64_t costTicks = NanosecondsToTicks(mParameters.mCPUNanosecondsPerRead + mParameters.mCPUNanosecondsPerFrame * frameCount);
+	if(costTicks > elapsedTicks) {
+		mach_timebase_info_data_t timebaseInfo;
+		mach_timebase_info(&timebaseInfo);
+		BurnCPU((costTicks - elapsedTicks) * timebaseInfo.numer / timebaseInfo.denom);
+	}
+
+	return frameCount;
+}
+
+SInt64 SFB::Audio::SignalGeneratorDecoder::_SeekToFrame(SInt64 frame)
+{
+	Block(mParameters.mSeekLatencyNanoseconds);
+
+	if(-1 != mParameters.mTotalFrames && frame > mParameters.mTotalFrames)
+		return -1;
+
+	mCurrentFrame = frame;
+	return mCurrentFrame;
+}
+
+bool SFB::Audio::SignalGeneratorDecoder::ReadParameters(CFErrorRef *error)
+{
+	SInt64 length = GetInputSource().GetLength();
+	if(0 >= length || kMaximumParametersFileSize < length) {
+		if(error)
+			*error = CreateInvalidParametersError(mInputSource->GetURL());
+		return false;
+	}
+
+	std::vector<UInt8> bytes((size_t)length);
+	if(length != GetInputSource().Read(bytes.data(), length)) {
+		if(error)
+			*error = CreateInvalidParametersError(mInputSource->GetURL());
+		return false;
+	}
+
+	SFB::CFData data(CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, bytes.data(), (CFIndex)bytes.size(), kCFAllocatorNull));
+	SFB::CFPropertyList propertyList(CFPropertyListCreateWithData(kCFAllocatorDefault, data, kCFPropertyListImmutable, nullptr, nullptr));
+	if(!propertyList || CFDictionaryGetTypeID() != CFGetTypeID(propertyList)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.SignalGenerator", "The signal description is not a dictionary");
+		if(error)
+			*error = CreateInvalidParametersError(mInputSource->GetURL());
+		return false;
+	}
+
+	auto dictionary = (CFDictionaryRef)(CFPropertyListRef)propertyList;
+
+	auto signal = (CFStringRef)CFDictionaryGetValue(dictionary, CFSTR("signal"));
+	if(signal && CFStringGetTypeID() == CFGetTypeID(signal)) {
+		if(kCFCompareEqualTo == CFStringCompare(signal, CFSTR("sine"), kCFCompareCaseInsensitive))
+			mParameters.mSignal = Signal::Sine;
+		else if(kCFCompareEqualTo == CFStringCompare(signal, CFSTR("noise"), kCFCompareCaseInsensitive))
+			mParameters.mSignal = Signal::Noise;
+		else if(kCFCompareEqualTo == CFStringCompare(signal, CFSTR("impulse"), kCFCompareCaseInsensitive))
+			mParameters.mSignal = Signal::Impulse;
+		else if(kCFCompareEqualTo == CFStringCompare(signal, CFSTR("silence"), kCFCompareCaseInsensitive))
+			mParameters.mSignal = Signal::Silence;
+		else {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.SignalGenerator", "Unknown signal: " << signal);
+			if(error)
+				*error = CreateInvalidParametersError(mInputSource->GetURL());
+			return false;
+		}
+	}
+
+	GetDouble(dictionary, CFSTR("frequency"), mParameters.mFrequency);
+	GetDouble(dictionary, CFSTR("amplitude"), mParameters.mAmplitude);
+	GetInteger(dictionary, CFSTR("seed"), mParameters.mSeed);
+	GetInteger(dictionary, CFSTR("impulseInterval"), mParameters.mImpulseInterval);
+
+	// The format is described by its components rather than an AudioStreamBasicDescription
+	double sampleRate = mParameters.mFormat.mSampleRate;
+	UInt32 channelsPerFrame = mParameters.mFormat.mChannelsPerFrame;
+	UInt32 bitsPerChannel = mParameters.mFormat.mBitsPerChannel;
+	bool isFloat = true, isInterleaved = false, isBigEndian = false;
+
+	GetDouble(dictionary, CFSTR("sampleRate"), sampleRate);
+	GetInteger(dictionary, CFSTR("channelsPerFrame"), channelsPerFrame);
+	GetInteger(dictionary, CFSTR("bitsPerChannel"), bitsPerChannel);
+	GetBoolean(dictionary, CFSTR("isFloat"), isFloat);
+	GetBoolean(dictionary, CFSTR("isInterleaved"), isInterleaved);
+	GetBoolean(dictionary, CFSTR("isBigEndian"), isBigEndian);
+
+	SetPCMFormat(mParameters.mFormat, sampleRate, channelsPerFrame, bitsPerChannel, isFloat, isInterleaved, isBigEndian);
+
+	// The length may be given in frames or seconds
+	mParameters.mTotalFrames = (SInt64)(10 * sampleRate);
+	double duration = -1;
+	GetDouble(dictionary, CFSTR("duration"), duration);
+	if(0 <= duration)
+		mParameters.mTotalFrames = (SInt64)(duration * sampleRate);
+	GetInteger(dictionary, CFSTR("totalFrames"), mParameters.mTotalFrames);
+
+	GetInteger(dictionary, CFSTR("cpuNanosecondsPerRead"), mParameters.mCPUNanosecondsPerRead);
+	GetInteger(dictionary, CFSTR("cpuNanosecondsPerFrame"), mParameters.mCPUNanosecondsPerFrame);
+	GetInteger(dictionary, CFSTR("latencyNanosecondsPerRead"), mParameters.mLatencyNanosecondsPerRead);
+	GetInteger(dictionary, CFSTR("seekLatencyNanoseconds"), mParameters.mSeekLatencyNanoseconds);
+	GetBoolean(dictionary, CFSTR("supportsSeeking"), mParameters.mSupportsSeeking);
+
+	mHasParameters = true;
+
+	return true;
+}
+
+double SFB::Audio::SignalGeneratorDecoder::GenerateSample(SInt64 frame, UInt32 channel) const
+{
+	switch(mParameters.mSignal) {
+		case Signal::Sine:
+			return mParameters.mAmplitude * sin(2 * M_PI * mParameters.mFrequency * (double)frame / mFormat.mSampleRate);
+
+		case Signal::Noise: {
+			uint64_t counter = ((uint64_t)frame * mFormat.mChannelsPerFrame + channel) ^ SplitMix64(mParameters.mSeed);
+			// The top 53 bits give a uniform double in [0, 1)
+			double uniform = (double)(SplitMix64(counter) >> 11) / (double)(1ULL << 53);
+			return mParameters.mAmplitude * (2 * uniform - 1);
+		}
+
+		case Signal::Impulse:
+			return (0 == frame % std::max(mParameters.mImpulseInterval, (UInt32)1)) ? mParameters.mAmplitude : 0;
+
+		case Signal::Silence:
+			return 0;
+	}
+
+	return 0;
+}
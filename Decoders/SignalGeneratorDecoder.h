@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include "AudioDecoder.h"
+
+/*! @file SignalGeneratorDecoder.h @brief A decoder producing synthetic test signals */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A decoder that generates deterministic test signals for benchmarking the engine
+		 *
+		 * The generated audio depends only on the parameters and the frame position, so runs are
+		 * reproducible and seeking is exact.  To isolate the engine's own overhead from codec
+		 * variance, or to reproduce a pathological decoder, each read can be made to burn a fixed
+		 * amount of CPU time or to block, and seeks can be made to block.
+		 *
+		 * Decoders may be created directly using \c CreateWithParameters().  When the engine is built
+		 * with \c SFB_SIGNAL_GENERATOR_DECODER defined to a nonzero value the class is also registered
+		 * for files with the extension \c sfbsignal, which contain a property list dictionary whose
+		 * keys match the names of the \c Parameters members without the \c m prefix, for example
+		 * \c signal, \c frequency, and \c sampleRate.
+		 */
+		class SignalGeneratorDecoder : public Decoder
+		{
+
+		public:
+
+			/*! @brief Generated signals */
+			enum class Signal {
+				Sine,			/*!< A sine wave at \c Parameters::mFrequency */
+				Noise,			/*!< Uniform white noise determined by \c Parameters::mSeed */
+				Impulse,		/*!< A full-scale sample every \c Parameters::mImpulseInterval frames */
+				Silence			/*!< Digital silence */
+			};
+
+			/*! @brief Parameters describing the generated audio and the simulated decoding cost */
+			struct Parameters
+			{
+				/*! @brief Create \c Parameters for ten seconds of a 440 Hz sine as stereo 32-bit float at 44.1 kHz */
+				Parameters();
+
+				Signal			mSignal;						/*!< @brief The signal to generate */
+				double			mFrequency;						/*!< @brief The frequency of a sine, in Hz */
+				double			mAmplitude;						/*!< @brief The peak amplitude, from \c 0 to \c 1 */
+				uint64_t		mSeed;							/*!< @brief The seed for noise */
+				UInt32			mImpulseInterval;				/*!< @brief The number of frames between impulses */
+
+				AudioFormat		mFormat;						/*!< @brief The PCM format to generate */
+				SInt64			mTotalFrames;					/*!< @brief The length in frames, or \c -1 for an endless signal */
+
+				uint64_t		mCPUNanosecondsPerRead;			/*!< @brief CPU time burned by each read */
+				uint64_t		mCPUNanosecondsPerFrame;		/*!< @brief CPU time burned for each frame read */
+				uint64_t		mLatencyNanosecondsPerRead;		/*!< @brief Time each read blocks without using the CPU */
+				uint64_t		mSeekLatencyNanoseconds;		/*!< @brief Time each seek blocks without using the CPU */
+				bool			mSupportsSeeking;				/*!< @brief Whether seeking is supported */
+			};
+
+			// ========================================
+			/*! @name Factory Methods */
+			//@{
+
+			/*!
+			 * @brief Create a \c SignalGeneratorDecoder
+			 * @param parameters The parameters of the generated audio
+			 * @return A \c Decoder object
+			 */
+			static unique_ptr CreateWithParameters(const Parameters& parameters);
+
+			//@}
+
+
+			/*! @cond */
+
+			// Data types handled by this class
+			static CFArrayRef CreateSupportedFileExtensions();
+			static CFArrayRef CreateSupportedMIMETypes();
+
+			static bool HandlesFilesWithExtension(CFStringRef extension);
+			static bool HandlesMIMEType(CFStringRef mimeType);
+
+			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
+
+			// Creation and destruction
+			explicit SignalGeneratorDecoder(InputSource::unique_ptr inputSource);
+			SignalGeneratorDecoder(InputSource::unique_ptr inputSource, const Parameters& parameters);
+			virtual ~SignalGeneratorDecoder();
+
+			/*! @endcond */
+
+		private:
+
+			// Audio access
+			virtual bool _Open(CFErrorRef *error);
+			virtual bool _Close(CFErrorRef *error);
+
+			// The native format of the source audio
+			virtual SFB::CFString _GetSourceFormatDescription() const;
+
+			// Attempt to read frameCount frames of audio, returning the actual number of frames read
+			virtual UInt32 _ReadAudio(AudioBufferList *bufferList, UInt32 frameCount);
+
+			// Source audio information
+			inline virtual SInt64 _GetTotalFrames() const			{ return mParameters.mTotalFrames; }
+			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
+
+			// Seeking support
+			inline virtual bool _SupportsSeeking() const			{ return mParameters.mSupportsSeeking; }
+			virtual SInt64 _SeekToFrame(SInt64 frame);
+
+			// Read the parameters from the input source
+			bool ReadParameters(CFErrorRef *error);
+
+			// The value of the signal at frame, from -1 to 1
+			double GenerateSample(SInt64 frame, UInt32 channel) const;
+
+			// Data members
+			Parameters		mParameters;
+			bool			mHasParameters;
+			SInt64			mCurrentFrame;
+		};
+
+	}
+}
@@ -52,6 +52,9 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Content identity support
+			inline virtual bool _GetAudioPayloadRange(SInt64& offset, SInt64& length) const	{ return GetUntaggedRange(offset, length); }
+
 		public:
 
 			struct TTA_io_callback_wrapper;
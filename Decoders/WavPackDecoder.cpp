@@ -358,3 +358,11 @@ SInt64 SFB::Audio::WavPackDecoder::_SeekToFrame(SInt64 frame)
 
 	return (result ? mCurrentFrame : -1);
 }
+
+size_t SFB::Audio::WavPackDecoder::_GetMemoryUsage() const
+{
+	if(!mBuffer)
+		return 0;
+
+	return sizeof(int32_t) * BUFFER_SIZE_FRAMES * mFormat.mChannelsPerFrame;
+}
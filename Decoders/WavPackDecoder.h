@@ -52,6 +52,12 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Memory accounting
+			virtual size_t _GetMemoryUsage() const;
+
+			// Content identity support
+			inline virtual bool _GetAudioPayloadRange(SInt64& offset, SInt64& length) const	{ return GetUntaggedRange(offset, length); }
+
 			using unique_WavpackContext_ptr = std::unique_ptr<WavpackContext, std::function<WavpackContext *(WavpackContext *)>>;
 
 			// Data members
@@ -3,15 +3,19 @@
  * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
  */
 
+#include <cerrno>
+#include <cstring>
+
 #include <fcntl.h>
 #include <unistd.h>
 
 #include "FileInputSource.h"
+#include "Logger.h"
 
 #pragma mark Creation and Destruction
 
-SFB::FileInputSource::FileInputSource(CFURLRef url)
-	: InputSource(url), mFile(nullptr, nullptr)
+SFB::FileInputSource::FileInputSource(CFURLRef url, size_t bufferSize, bool readAhead)
+	: InputSource(url), mFile(nullptr, nullptr), mBufferSize(bufferSize), mReadAhead(readAhead)
 {
 	memset(&mFilestats, 0, sizeof(mFilestats));
 }
@@ -42,6 +46,14 @@ bool SFB::FileInputSource::_Open(CFErrorRef *error)
 		return false;
 	}
 
+	// Larger buffers reduce the number of round trips on high-latency volumes
+	if(mBufferSize && 0 != setvbuf(mFile.get(), nullptr, _IOFBF, mBufferSize))
+		LOGGER_NOTICE("org.sbooth.AudioEngine.InputSource.File", "setvbuf failed: " << strerror(errno));
+
+	// Speculative read-ahead is wasted when reads are not sequential
+	if(!mReadAhead && -1 == fcntl(fileno(mFile.get()), F_RDAHEAD, 0))
+		LOGGER_NOTICE("org.sbooth.AudioEngine.InputSource.File", "fcntl(F_RDAHEAD) failed: " << strerror(errno));
+
 	return true;
 }
 
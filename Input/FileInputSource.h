@@ -19,7 +19,8 @@ namespace SFB {
 	public:
 
 		// Creation
-		explicit FileInputSource(CFURLRef url);
+		// A bufferSize of 0 uses the stdio default; readAhead controls the kernel's speculative read-ahead
+		explicit FileInputSource(CFURLRef url, size_t bufferSize = 0, bool readAhead = true);
 
 	private:
 
@@ -43,6 +44,8 @@ namespace SFB {
 		// Data members
 		struct stat						mFilestats;
 		unique_FILE_ptr					mFile;
+		size_t							mBufferSize;
+		bool							mReadAhead;
 	};
 
 }
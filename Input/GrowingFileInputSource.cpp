@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/event.h>
+#include <sys/stat.h>
+
+#include "GrowingFileInputSource.h"
+#include "Logger.h"
+
+namespace {
+
+	// The identifier of the user event used to interrupt waits
+	const uintptr_t kStopFollowingEventIdentifier = 1;
+
+	// The longest wait between checks of the file's size, for volumes that don't deliver vnode events
+	const std::chrono::milliseconds kPollInterval(50);
+
+}
+
+#pragma mark Creation and Destruction
+
+SFB::GrowingFileInputSource::GrowingFileInputSource(CFURLRef url, double idleTimeout)
+	: InputSource(url), mFileDescriptor(-1), mKQueue(-1), mOffset(0), mAtEOF(false), mIdleTimeout(std::max(idleTimeout, 0.)), mIsFollowing(false), mWaitInterrupted(false)
+{}
+
+bool SFB::GrowingFileInputSource::_Open(CFErrorRef *error)
+{
+	UInt8 buf [PATH_MAX];
+	Boolean success = CFURLGetFileSystemRepresentation(GetURL(), FALSE, buf, PATH_MAX);
+	if(!success) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EIO, nullptr);
+		return false;
+	}
+
+	mFileDescriptor = ::open((const char *)buf, O_RDONLY);
+	if(-1 == mFileDescriptor) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, errno, nullptr);
+		return false;
+	}
+
+	// Without kqueue appends are detected by polling
+	mKQueue = kqueue();
+	if(-1 != mKQueue) {
+		struct kevent changes [2];
+		EV_SET(&changes[0], (uintptr_t)mFileDescriptor, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_EXTEND | NOTE_DELETE, 0, nullptr);
+		EV_SET(&changes[1], kStopFollowingEventIdentifier, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+
+		if(-1 == kevent(mKQueue, changes, 2, nullptr, 0, nullptr)) {
+			LOGGER_NOTICE("org.sbooth.AudioEngine.InputSource.GrowingFile", "kevent failed: " << strerror(errno));
+			::close(mKQueue);
+			mKQueue = -1;
+		}
+	}
+	else
+		LOGGER_NOTICE("org.sbooth.AudioEngine.InputSource.GrowingFile", "kqueue failed: " << strerror(errno));
+
+	mOffset = 0;
+	mAtEOF = false;
+	mIsFollowing.store(true);
+	mWaitInterrupted.store(false);
+
+	return true;
+}
+
+bool SFB::GrowingFileInputSource::_Close(CFErrorRef *error)
+{
+#pragma unused(error)
+
+	mIsFollowing.store(false);
+
+	if(-1 != mKQueue) {
+		::close(mKQueue);
+		mKQueue = -1;
+	}
+
+	if(-1 != mFileDescriptor) {
+		::close(mFileDescriptor);
+		mFileDescriptor = -1;
+	}
+
+	return true;
+}
+
+void SFB::GrowingFileInputSource::StopFollowing()
+{
+	mIsFollowing.store(false);
+	WakeWaiter();
+}
+
+void SFB::GrowingFileInputSource::_InterruptWaitForGrowth()
+{
+	mWaitInterrupted.store(true);
+	WakeWaiter();
+}
+
+void SFB::GrowingFileInputSource::WakeWaiter()
+{
+	if(-1 != mKQueue) {
+		struct kevent event;
+		EV_SET(&event, kStopFollowingEventIdentifier, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+		kevent(mKQueue, &event, 1, nullptr, 0, nullptr);
+	}
+}
+
+#pragma mark Functionality
+
+SInt64 SFB::GrowingFileInputSource::_Read(void *buffer, SInt64 byteCount)
+{
+	SInt64 bytesRead = 0;
+	while(bytesRead < byteCount) {
+		auto result = ::pread(mFileDescriptor, (uint8_t *)buffer + bytesRead, (size_t)(byteCount - bytesRead), mOffset);
+		if(-1 == result) {
+			if(EINTR == errno)
+				continue;
+
+			LOGGER_ERR("org.sbooth.AudioEngine.InputSource.GrowingFile", "pread failed: " << strerror(errno));
+			break;
+		}
+
+		if(0 < result) {
+			bytesRead += result;
+			mOffset += result;
+			continue;
+		}
+
+		// At the live edge wait for the writer instead of returning a short read
+		if(!_WaitForGrowth(mOffset)) {
+			// An interrupted wait returns a short read without reaching the end of the input
+			if(!mIsFollowing.load())
+				mAtEOF = true;
+			break;
+		}
+	}
+
+	return bytesRead;
+}
+
+SInt64 SFB::GrowingFileInputSource::_GetLength() const
+{
+	// The length is not cached since the file may have grown since the last call
+	struct stat sb;
+	if(-1 == fstat(mFileDescriptor, &sb)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.InputSource.GrowingFile", "fstat failed: " << strerror(errno));
+		return 0;
+	}
+
+	return sb.st_size;
+}
+
+bool SFB::GrowingFileInputSource::_SeekToOffset(SInt64 offset)
+{
+	if(0 > offset)
+		return false;
+
+	mOffset = offset;
+	mAtEOF = false;
+
+	// An interruption requested for a seek has served its purpose
+	mWaitInterrupted.store(false);
+
+	return true;
+}
+
+bool SFB::GrowingFileInputSource::_WaitForGrowth(SInt64 length)
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(mIdleTimeout);
+
+	while(mIsFollowing.load()) {
+		if(mWaitInterrupted.exchange(false))
+			return false;
+
+		struct stat sb;
+		if(-1 == fstat(mFileDescriptor, &sb)) {
+			LOGGER_ERR("org.sbooth.AudioEngine.InputSource.GrowingFile", "fstat failed: " << strerror(errno));
+			return false;
+		}
+
+		if(sb.st_size > length)
+			return true;
+
+		// The writer won't append to a deleted file
+		if(0 == sb.st_nlink) {
+			LOGGER_INFO("org.sbooth.AudioEngine.InputSource.GrowingFile", "Stopped following deleted file " << GetURL());
+			mIsFollowing.store(false);
+			return false;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if(now >= deadline) {
+			LOGGER_INFO("org.sbooth.AudioEngine.InputSource.GrowingFile", "Stopped following " << GetURL() << " after " << mIdleTimeout << " sec without appended data");
+			mIsFollowing.store(false);
+			return false;
+		}
+
+		auto wait = std::min(std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now), std::chrono::duration_cast<std::chrono::nanoseconds>(kPollInterval));
+		struct timespec timeout = {
+			.tv_sec		= (time_t)(wait.count() / 1000000000),
+			.tv_nsec	= (long)(wait.count() % 1000000000)
+		};
+
+		if(-1 != mKQueue) {
+			struct kevent event;
+			if(-1 == kevent(mKQueue, nullptr, 0, &event, 1, &timeout) && EINTR != errno)
+				LOGGER_NOTICE("org.sbooth.AudioEngine.InputSource.GrowingFile", "kevent failed: " << strerror(errno));
+		}
+		else
+			nanosleep(&timeout, nullptr);
+	}
+
+	return false;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "InputSource.h"
+
+namespace SFB {
+
+	// ========================================
+	// InputSource following a file that is still being written
+	// Reads at the end of the file wait for the writer to append more data, and the writer is
+	// assumed to have finished once nothing has been appended for the idle timeout.  Appends are
+	// detected with kqueue vnode events, falling back to polling on volumes that don't deliver them.
+	// ========================================
+	class GrowingFileInputSource : public InputSource
+	{
+
+	public:
+
+		// Creation
+		explicit GrowingFileInputSource(CFURLRef url, double idleTimeout = 3);
+
+		// The time in seconds without appended data after which the writer is assumed to have finished
+		inline double GetIdleTimeout() const					{ return mIdleTimeout; }
+
+		// Stop waiting for appended data; may be called from any thread while the input is open
+		void StopFollowing();
+
+	private:
+
+		// Bytestream access
+		virtual bool _Open(CFErrorRef *error);
+		virtual bool _Close(CFErrorRef *error);
+
+		// Functionality
+		virtual SInt64 _Read(void *buffer, SInt64 byteCount);
+		inline virtual bool _AtEOF() const						{ return mAtEOF; }
+
+		inline virtual SInt64 _GetOffset() const				{ return mOffset; }
+		virtual SInt64 _GetLength() const;
+
+		// Seeking support
+		inline virtual bool _SupportsSeeking() const			{ return true; }
+		virtual bool _SeekToOffset(SInt64 offset);
+
+		// Growth support
+		inline virtual bool _IsGrowing() const					{ return mIsFollowing.load(); }
+		virtual bool _WaitForGrowth(SInt64 length);
+		virtual void _InterruptWaitForGrowth();
+
+		// Wake a reader waiting for data
+		void WakeWaiter();
+
+		// Data members
+		int								mFileDescriptor;
+		int								mKQueue;
+		SInt64							mOffset;
+		bool							mAtEOF;
+		double							mIdleTimeout;
+		std::atomic_bool				mIsFollowing;
+		std::atomic_bool				mWaitInterrupted;
+	};
+
+}
@@ -3,12 +3,19 @@
  * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
  */
 
+#include <sys/mount.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <mach/mach.h>
+
 #include "InputSource.h"
 #include "FileInputSource.h"
 #include "MemoryInputSource.h"
 #include "MemoryMappedFileInputSource.h"
 #include "InMemoryFileInputSource.h"
 #include "HTTPInputSource.h"
+#include "GrowingFileInputSource.h"
 #include "Logger.h"
 
 // ========================================
@@ -16,6 +23,64 @@
 // ========================================
 const CFStringRef SFB::InputSource::ErrorDomain = CFSTR("org.sbooth.AudioEngine.ErrorDomain.InputSource");
 
+namespace {
+
+	// Files no larger than this are mapped when local and mapping is allowed, or loaded in memory when remote
+	const off_t kSmallLocalFileSize		= 16 * 1024 * 1024;
+	const off_t kSmallRemoteFileSize	= 64 * 1024 * 1024;
+
+	// stdio buffer sizes used for read-ahead
+	const size_t kLocalBufferSize		= 256 * 1024;
+	const size_t kRemoteBufferSize		= 1024 * 1024;
+	const size_t kRandomAccessBufferSize	= 64 * 1024;
+
+	// ========================================
+	// Determine the amount of memory that can be used without paging
+	uint64_t GetAvailableMemory()
+	{
+		vm_statistics64_data_t vmStatistics;
+		mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+		if(KERN_SUCCESS != host_statistics64(mach_host_self(), HOST_VM_INFO64, (host_info64_t)&vmStatistics, &count))
+			return 0;
+
+		return ((uint64_t)vmStatistics.free_count + (uint64_t)vmStatistics.inactive_count) * (uint64_t)vm_page_size;
+	}
+
+	// ========================================
+	// Create an InputSource for a file using a strategy suited to the file and its volume
+	SFB::InputSource::unique_ptr CreateInputSourceForFile(CFURLRef url, int flags)
+	{
+		UInt8 buf [PATH_MAX];
+		struct stat sb;
+		struct statfs sfsb;
+		if(!CFURLGetFileSystemRepresentation(url, FALSE, buf, PATH_MAX) || 0 != stat((const char *)buf, &sb) || 0 != statfs((const char *)buf, &sfsb))
+			return SFB::InputSource::unique_ptr(new SFB::FileInputSource(url));
+
+		bool randomAccess = SFB::InputSource::RandomAccess & flags;
+
+		// Network volumes have high and variable latency, and a mapped file faults if the server becomes unreachable
+		if(!(MNT_LOCAL & sfsb.f_flags)) {
+			if(sb.st_size <= kSmallRemoteFileSize && (uint64_t)sb.st_size < GetAvailableMemory() / 4) {
+				LOGGER_INFO("org.sbooth.AudioEngine.InputSource", "Loading " << url << " in memory from " << sfsb.f_fstypename << " volume");
+				return SFB::InputSource::unique_ptr(new SFB::InMemoryFileInputSource(url));
+			}
+
+			return SFB::InputSource::unique_ptr(new SFB::FileInputSource(url, randomAccess ? kRandomAccessBufferSize : kRemoteBufferSize, !randomAccess));
+		}
+
+		// Mapping avoids copying and lets the buffer cache serve random reads, but faults if the file
+		// is truncated or its volume is removed, so it requires consent and a fixed volume
+		bool allowMapping = (SFB::InputSource::AllowMemoryMapping & flags) && !(MNT_REMOVABLE & sfsb.f_flags);
+		if(allowMapping && (randomAccess || sb.st_size <= kSmallLocalFileSize)) {
+			LOGGER_INFO("org.sbooth.AudioEngine.InputSource", "Mapping " << url << " in memory");
+			return SFB::InputSource::unique_ptr(new SFB::MemoryMappedFileInputSource(url));
+		}
+
+		return SFB::InputSource::unique_ptr(new SFB::FileInputSource(url, randomAccess ? kRandomAccessBufferSize : kLocalBufferSize));
+	}
+
+}
+
 #pragma mark Static Methods
 
 SFB::InputSource::unique_ptr SFB::InputSource::CreateForURL(CFURLRef url, int flags, CFErrorRef *error)
@@ -32,10 +97,16 @@ SFB::InputSource::unique_ptr SFB::InputSource::CreateForURL(CFURLRef url, int fl
 	}
 
 	if(kCFCompareEqualTo == CFStringCompare(CFSTR("file"), scheme, kCFCompareCaseInsensitive)) {
-		if(InputSource::MemoryMapFiles & flags)
+		if(InputSource::FollowGrowingFiles & flags)
+			return unique_ptr(new GrowingFileInputSource(url));
+		else if(InputSource::MemoryMapFiles & flags)
 			return unique_ptr(new MemoryMappedFileInputSource(url));
 		else if(InputSource::LoadFilesInMemory & flags)
 			return unique_ptr(new InMemoryFileInputSource(url));
+		else if(InputSource::SelectFileAccessAutomatically & flags)
+			return CreateInputSourceForFile(url, flags);
+		else if(InputSource::RandomAccess & flags)
+			return unique_ptr(new FileInputSource(url, kRandomAccessBufferSize));
 		else
 			return unique_ptr(new FileInputSource(url));
 	}
@@ -153,3 +224,29 @@ bool SFB::InputSource::SeekToOffset(SInt64 offset)
 
 	return _SeekToOffset(offset);
 }
+
+bool SFB::InputSource::IsGrowing() const
+{
+	if(!IsOpen()) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.InputSource", "IsGrowing() called on an InputSource that hasn't been opened");
+		return false;
+	}
+
+	return _IsGrowing();
+}
+
+bool SFB::InputSource::WaitForGrowth(SInt64 length)
+{
+	if(!IsOpen()) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.InputSource", "WaitForGrowth() called on an InputSource that hasn't been opened");
+		return false;
+	}
+
+	return _WaitForGrowth(length);
+}
+
+void SFB::InputSource::InterruptWaitForGrowth()
+{
+	if(IsOpen())
+		_InterruptWaitForGrowth();
+}
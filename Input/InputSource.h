@@ -33,8 +33,12 @@ namespace SFB {
 
 		/*! Flags used in \c InputSource::CreateForURL */
 		enum InputSourceFlags {
-			MemoryMapFiles			= 1 << 0,	/*!< Files should be mapped in memory using \c mmap() */
-			LoadFilesInMemory		= 1 << 1	/*!< Files should be fully loaded in memory */
+			MemoryMapFiles					= 1 << 0,	/*!< Files should be mapped in memory using \c mmap() */
+			LoadFilesInMemory				= 1 << 1,	/*!< Files should be fully loaded in memory */
+			SelectFileAccessAutomatically	= 1 << 2,	/*!< The file access strategy and read-ahead should be chosen based on the file's size, its volume, and available memory */
+			RandomAccess					= 1 << 3,	/*!< Files will be read non-sequentially; a smaller read buffer is used and the hint is considered by \c SelectFileAccessAutomatically */
+			FollowGrowingFiles				= 1 << 4,	/*!< Files may still be being written; reads at the end of a file wait for appended data */
+			AllowMemoryMapping				= 1 << 5	/*!< \c SelectFileAccessAutomatically may map files on local, non-removable volumes */
 		};
 
 
@@ -47,6 +51,9 @@ namespace SFB {
 
 		/*!
 		 * Create a new \c InputSource for the given URL
+		 * @note \c FollowGrowingFiles takes precedence over all other flags, and \c MemoryMapFiles and \c LoadFilesInMemory take precedence over \c SelectFileAccessAutomatically
+		 * @note Reading a mapped file that is truncated, or whose volume is removed, raises \c SIGBUS instead of returning an error,
+		 * so files are only mapped when \c MemoryMapFiles or \c AllowMemoryMapping is specified
 		 * @param url The URL
 		 * @param flags Optional flags affecting how \c url is handled
 		 * @param error An optional pointer to a \c CFErrorRef to receive error information
@@ -227,6 +234,26 @@ namespace SFB {
 		SInt64 GetLength() const;
 
 
+		/*! @brief Query whether the input may grow while it is read, such as a file that is still being written */
+		bool IsGrowing() const;
+
+		/*!
+		 * @brief Wait for the input to grow beyond the specified length
+		 * @param length The length, in bytes, the input must exceed
+		 * @return \c true if the input is longer than \c length, \c false if it stopped growing first
+		 */
+		bool WaitForGrowth(SInt64 length);
+
+		/*!
+		 * @brief Interrupt a wait for growth in progress
+		 *
+		 * The interrupted wait returns \c false but the input continues to grow, so a read that
+		 * returned less data than requested may be retried.
+		 * @note This method may be called from any thread
+		 */
+		void InterruptWaitForGrowth();
+
+
 		/*! @brief Query whether this \c InputSource is seekable */
 		bool SupportsSeeking() const;
 
@@ -261,6 +288,11 @@ namespace SFB {
 		virtual bool _SupportsSeeking() const					{ return false; }
 		virtual bool _SeekToOffset(SInt64 /*offset*/)			{ return false; }
 
+		// Optional growth support
+		virtual bool _IsGrowing() const							{ return false; }
+		virtual bool _WaitForGrowth(SInt64 length)				{ return _GetLength() > length; }
+		virtual void _InterruptWaitForGrowth()					{}
+
 		// Data members
 		SFB::CFURL mURL;	/*!< @brief The location of the bytes to be read */
 		bool mIsOpen;		/*!< @brief Indicates if input is open */
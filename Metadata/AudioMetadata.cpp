@@ -3,14 +3,27 @@
  * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
  */
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <copyfile.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
 #include <CoreFoundation/CoreFoundation.h>
 #if !TARGET_OS_IPHONE
 # include <CoreServices/CoreServices.h>
 #endif
 
 #include "AudioMetadata.h"
+#include "AudioDecoder.h"
 #include "CFErrorUtilities.h"
 #include "Logger.h"
+#include "SubclassDispatchTable.h"
 
 // ========================================
 // Error Codes
@@ -70,29 +83,57 @@ const CFStringRef SFB::Audio::Metadata::kAttachedPicturesKey			= CFSTR("Attached
 #pragma mark Static Methods
 
 std::vector<SFB::Audio::Metadata::SubclassInfo> SFB::Audio::Metadata::sRegisteredSubclasses;
+std::shared_ptr<const SFB::SubclassDispatchTable> SFB::Audio::Metadata::sDispatchTable;
 
-CFArrayRef SFB::Audio::Metadata::CreateSupportedFileExtensions()
-{
-	CFMutableArrayRef supportedFileExtensions = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+// ========================================
+// Safe saving
+// ========================================
+std::atomic_bool SFB::Audio::Metadata::sUsesSafeSave = ATOMIC_VAR_INIT(false);
+
+namespace {
+
+	// ========================================
+	// Flush a file's data to permanent storage
+	// fsync() only pushes data to the drive, which may cache it, so prefer F_FULLFSYNC where supported
+	bool FlushFile(const char *path)
+	{
+		int fd = open(path, O_RDONLY);
+		if(-1 == fd)
+			return false;
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		SFB::CFArray decoderFileExtensions(subclassInfo.mCreateSupportedFileExtensions());
-		CFArrayAppendArray(supportedFileExtensions, decoderFileExtensions, CFRangeMake(0, CFArrayGetCount(decoderFileExtensions)));
+		bool result = (-1 != fcntl(fd, F_FULLFSYNC) || 0 == fsync(fd));
+		close(fd);
+
+		return result;
 	}
 
-	return supportedFileExtensions;
 }
 
-CFArrayRef SFB::Audio::Metadata::CreateSupportedMIMETypes()
+std::shared_ptr<const SFB::SubclassDispatchTable> SFB::Audio::Metadata::GetDispatchTable()
 {
-	CFMutableArrayRef supportedMIMETypes = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
-
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		SFB::CFArray decoderMIMETypes(subclassInfo.mCreateSupportedMIMETypes());
-		CFArrayAppendArray(supportedMIMETypes, decoderMIMETypes, CFRangeMake(0, CFArrayGetCount(decoderMIMETypes)));
+	auto dispatchTable = std::atomic_load(&sDispatchTable);
+	if(!dispatchTable) {
+		// Concurrent callers may each build a table; they are identical so the last one stored wins
+		dispatchTable = SubclassDispatchTable::Create(sRegisteredSubclasses);
+		std::atomic_store(&sDispatchTable, dispatchTable);
 	}
 
-	return supportedMIMETypes;
+	return dispatchTable;
+}
+
+void SFB::Audio::Metadata::InvalidateDispatchTable()
+{
+	std::atomic_store(&sDispatchTable, std::shared_ptr<const SubclassDispatchTable>());
+}
+
+CFArrayRef SFB::Audio::Metadata::CreateSupportedFileExtensions()
+{
+	return (CFArrayRef)CFRetain(GetDispatchTable()->GetSupportedFileExtensions());
+}
+
+CFArrayRef SFB::Audio::Metadata::CreateSupportedMIMETypes()
+{
+	return (CFArrayRef)CFRetain(GetDispatchTable()->GetSupportedMIMETypes());
 }
 
 bool SFB::Audio::Metadata::HandlesFilesWithExtension(CFStringRef extension)
@@ -100,12 +141,7 @@ bool SFB::Audio::Metadata::HandlesFilesWithExtension(CFStringRef extension)
 	if(nullptr == extension)
 		return false;
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		if(subclassInfo.mHandlesFilesWithExtension(extension))
-			return true;
-	}
-
-	return false;
+	return nullptr != GetDispatchTable()->SubclassesForExtension(extension);
 }
 
 bool SFB::Audio::Metadata::HandlesMIMEType(CFStringRef mimeType)
@@ -113,12 +149,7 @@ bool SFB::Audio::Metadata::HandlesMIMEType(CFStringRef mimeType)
 	if(nullptr == mimeType)
 		return false;
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		if(subclassInfo.mHandlesMIMEType(mimeType))
-			return true;
-	}
-
-	return false;
+	return nullptr != GetDispatchTable()->SubclassesForMIMEType(mimeType);
 }
 
 SFB::Audio::Metadata::unique_ptr SFB::Audio::Metadata::CreateMetadataForURL(CFURLRef url, CFErrorRef *error)
@@ -140,15 +171,14 @@ SFB::Audio::Metadata::unique_ptr SFB::Audio::Metadata::CreateMetadataForURL(CFUR
 		// Verify the file exists
 		if(CFURLResourceIsReachable(url, error)) {
 			SFB::CFString pathExtension(CFURLCopyPathExtension(url));
-			if(pathExtension) {
+			auto subclasses = pathExtension ? GetDispatchTable()->SubclassesForExtension(pathExtension) : nullptr;
+			if(subclasses) {
 				// Some extensions (.oga for example) support multiple audio codecs (Vorbis, FLAC, Speex)
 
-				for(auto subclassInfo : sRegisteredSubclasses) {
-					if(subclassInfo.mHandlesFilesWithExtension(pathExtension)) {
-						unique_ptr metadata(subclassInfo.mCreateMetadata(url));
-						if(metadata->ReadMetadata(error))
-							return metadata;
-					}
+				for(auto index : *subclasses) {
+					unique_ptr metadata(sRegisteredSubclasses[index].mCreateMetadata(url));
+					if(metadata->ReadMetadata(error))
+						return metadata;
 				}
 			}
 		}
@@ -171,7 +201,7 @@ SFB::Audio::Metadata::unique_ptr SFB::Audio::Metadata::CreateMetadataForURL(CFUR
 #pragma mark Creation and Destruction
 
 SFB::Audio::Metadata::Metadata()
-	: mURL(nullptr), mMetadata(0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks), mChangedMetadata(0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks)
+	: mURL(nullptr), mMetadata(0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks), mChangedMetadata(0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks), mPicturesSnapshotIsValid(false)
 {}
 
 SFB::Audio::Metadata::Metadata(CFURLRef url)
@@ -188,54 +218,154 @@ void SFB::Audio::Metadata::SetURL(CFURLRef URL)
 bool SFB::Audio::Metadata::ReadMetadata(CFErrorRef *error)
 {
 	ClearAllMetadata();
-	return _ReadMetadata(error);
+	bool result = _ReadMetadata(error);
+	InvalidateSnapshotCache();
+	return result;
 }
 
 bool SFB::Audio::Metadata::WriteMetadata(CFErrorRef *error)
 {
-	bool result = _WriteMetadata(error);
+	bool result = UsesSafeSave() ? SafeWriteMetadata(error) : _WriteMetadata(error);
 	if(result)
 		MergeChangedMetadataIntoMetadata();
 	return result;
 }
 
-#pragma mark External Representations
-
-CFDictionaryRef SFB::Audio::Metadata::CreateDictionaryRepresentation() const
+bool SFB::Audio::Metadata::SafeWriteMetadata(CFErrorRef *error)
 {
-	CFMutableDictionaryRef dictionaryRepresentation = CFDictionaryCreateMutableCopy(kCFAllocatorDefault, 0, mMetadata);
+	UInt8 buf [PATH_MAX];
+	if(!CFURLGetFileSystemRepresentation(mURL, false, buf, PATH_MAX))
+		return _WriteMetadata(error);
 
-	CFIndex count = CFDictionaryGetCount(mChangedMetadata);
+	// Resolve symbolic links so the link target, not the link, is replaced
+	char path [PATH_MAX];
+	if(nullptr == realpath((const char *)buf, path))
+		return _WriteMetadata(error);
 
-	CFTypeRef *keys = (CFTypeRef *)malloc(sizeof(CFTypeRef) * (size_t)count);
-	CFTypeRef *values = (CFTypeRef *)malloc(sizeof(CFTypeRef) * (size_t)count);
+	// Replacing the file would break hard links, and the clone can't be given another user's ownership,
+	// so fall back to writing in place in those cases
+	struct stat sb;
+	if(0 != stat(path, &sb) || !S_ISREG(sb.st_mode) || 1 < sb.st_nlink || geteuid() != sb.st_uid) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Metadata", "Writing metadata in place for " << mURL);
+		return _WriteMetadata(error);
+	}
 
-	CFDictionaryGetKeysAndValues(mChangedMetadata, keys, values);
+	// The clone must live in the same directory so rename() is atomic
+	// dirname() and basename() may modify their arguments or return internal storage, so copy the results
+	char directory [PATH_MAX];
+	char filename [PATH_MAX];
+	char scratch [PATH_MAX];
+	strlcpy(scratch, path, PATH_MAX);
+	strlcpy(directory, dirname(scratch), PATH_MAX);
+	strlcpy(scratch, path, PATH_MAX);
+	strlcpy(filename, basename(scratch), PATH_MAX);
+
+	char clonePath [PATH_MAX];
+	snprintf(clonePath, PATH_MAX, "%s/.%s.XXXXXX", directory, filename);
+
+	// Reserve a unique name; copyfile() won't overwrite an existing file when cloning
+	int fd = mkstemp(clonePath);
+	if(-1 == fd) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.Metadata", "mkstemp failed: " << strerror(errno));
+		return _WriteMetadata(error);
+	}
 
-	for(CFIndex i = 0; i < count; ++i) {
-		if(kCFNull == values[i])
-			CFDictionaryRemoveValue(dictionaryRepresentation, keys[i]);
+	close(fd);
+	unlink(clonePath);
+
+	// COPYFILE_CLONE_FORCE fails rather than copying the data when the file system doesn't support
+	// copy-on-write clones; a full copy of the file for each edit costs more than writing in place
+	if(0 != copyfile(path, clonePath, nullptr, COPYFILE_CLONE_FORCE)) {
+		if(ENOTSUP == errno)
+			LOGGER_INFO("org.sbooth.AudioEngine.Metadata", "Cloning not supported, writing metadata in place for " << mURL);
 		else
-			CFDictionarySetValue(dictionaryRepresentation, keys[i], values[i]);
+			LOGGER_WARNING("org.sbooth.AudioEngine.Metadata", "copyfile failed: " << strerror(errno));
+		unlink(clonePath);
+		return _WriteMetadata(error);
 	}
 
-	free(keys);
-	keys = nullptr;
-	free(values);
-	values = nullptr;
+	mWriteURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault, (const UInt8 *)clonePath, (CFIndex)strlen(clonePath), false);
+	if(!mWriteURL) {
+		unlink(clonePath);
+		return _WriteMetadata(error);
+	}
 
-	CFMutableArray pictureArray(0, &kCFTypeArrayCallBacks);
+	bool result = _WriteMetadata(error);
+	mWriteURL = nullptr;
 
-	for(auto picture : GetAttachedPictures()) {
-		CFDictionary pictureRepresentation(picture->CreateDictionaryRepresentation());
-		CFArrayAppendValue(pictureArray, pictureRepresentation);
+	if(!result) {
+		unlink(clonePath);
+		return false;
 	}
 
-	if(0 < CFArrayGetCount(pictureArray)) {
-		CFDictionarySetValue(dictionaryRepresentation, kAttachedPicturesKey, pictureArray);
+	if(!FlushFile(clonePath) || 0 != rename(clonePath, path)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Metadata", "Unable to replace " << mURL << ": " << strerror(errno));
+		unlink(clonePath);
+
+		if(error) {
+			SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” could not be saved."), ""));
+			SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Input/output error"), ""));
+			SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The file may have been renamed, moved, deleted, or you may not have appropriate permissions."), ""));
+
+			*error = CreateErrorForURL(Metadata::ErrorDomain, Metadata::InputOutputError, description, mURL, failureReason, recoverySuggestion);
+		}
+
+		return false;
 	}
 
-	return dictionaryRepresentation;
+	// Persist the rename itself
+	if(!FlushFile(directory))
+		LOGGER_WARNING("org.sbooth.AudioEngine.Metadata", "Unable to flush directory containing " << mURL);
+
+	return true;
+}
+
+#pragma mark Content Identity
+
+bool SFB::Audio::Metadata::ComputeAudioPayloadHash(uint64_t& hash, CFErrorRef *error) const
+{
+	auto decoder = Decoder::CreateForURL(mURL, error);
+	if(!decoder)
+		return false;
+
+	if(!decoder->IsOpen() && !decoder->Open(error))
+		return false;
+
+	if(!decoder->ComputeAudioPayloadHash(hash)) {
+		if(error) {
+			SFB::CFString description(CFCopyLocalizedString(CFSTR("The audio in the file “%@” could not be hashed."), ""));
+			SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Content hashing not supported"), ""));
+			SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The file's format does not support locating the audio independently of its metadata."), ""));
+
+			*error = CreateErrorForURL(Metadata::ErrorDomain, Metadata::FileFormatNotSupportedError, description, mURL, failureReason, recoverySuggestion);
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+#pragma mark External Representations
+
+CFDictionaryRef SFB::Audio::Metadata::CreateDictionaryRepresentation() const
+{
+	return CreateSnapshot()->CreateDictionaryRepresentation();
+}
+
+SFB::Audio::MetadataSnapshot::shared_ptr SFB::Audio::Metadata::CreateSnapshot() const
+{
+	std::lock_guard<std::mutex> lock(mSnapshotCacheMutex);
+
+	if(!mMetadataSnapshot)
+		mMetadataSnapshot = CFDictionaryCreateCopy(kCFAllocatorDefault, mMetadata);
+
+	// Only unsaved changes are copied
+	SFB::CFDictionary changedMetadata;
+	if(CFDictionaryGetCount(mChangedMetadata))
+		changedMetadata = CFDictionaryCreateCopy(kCFAllocatorDefault, mChangedMetadata);
+
+	return MetadataSnapshot::shared_ptr(new MetadataSnapshot(mURL, mMetadataSnapshot, std::move(changedMetadata), GetPicturesSnapshot()));
 }
 
 bool SFB::Audio::Metadata::SetFromDictionaryRepresentation(CFDictionaryRef dictionary)
@@ -305,9 +435,11 @@ bool SFB::Audio::Metadata::SetFromDictionaryRepresentation(CFDictionaryRef dicti
 
 bool SFB::Audio::Metadata::HasUnsavedChanges() const
 {
-	if(CFDictionaryGetCount(mChangedMetadata))
-		return true;
+	return CFDictionaryGetCount(mChangedMetadata) || HasUnsavedPictureChanges();
+}
 
+bool SFB::Audio::Metadata::HasUnsavedPictureChanges() const
+{
 	for(auto picture : mPictures) {
 		if(AttachedPicture::ChangeState::Saved != picture->mState || picture->HasUnsavedChanges())
 			return true;
@@ -319,6 +451,7 @@ bool SFB::Audio::Metadata::HasUnsavedChanges() const
 void SFB::Audio::Metadata::RevertUnsavedChanges()
 {
 	CFDictionaryRemoveAllValues(mChangedMetadata);
+	InvalidateSnapshotCache();
 
 	for(auto picture : mPictures) {
 		if(AttachedPicture::ChangeState::Removed == picture->mState)
@@ -858,6 +991,8 @@ void SFB::Audio::Metadata::AttachPicture(AttachedPicture::shared_ptr picture)
 			picture->mState = AttachedPicture::ChangeState::Added;
 			mPictures.push_back(AttachedPicture::shared_ptr(picture));
 		}
+
+		InvalidateSnapshotCache();
 	}
 }
 
@@ -870,6 +1005,8 @@ void SFB::Audio::Metadata::RemoveAttachedPicture(AttachedPicture::shared_ptr pic
 				mPictures.erase(match);
 			else
 				(*match)->mState = AttachedPicture::ChangeState::Removed;
+
+			InvalidateSnapshotCache();
 		}
 	}
 }
@@ -885,6 +1022,8 @@ void SFB::Audio::Metadata::RemoveAttachedPicturesOfType(AttachedPicture::Type ty
 				picture->mState = AttachedPicture::ChangeState::Removed;
 		}
 	}
+
+	InvalidateSnapshotCache();
 }
 
 void SFB::Audio::Metadata::RemoveAllAttachedPictures()
@@ -892,6 +1031,8 @@ void SFB::Audio::Metadata::RemoveAllAttachedPictures()
 	std::for_each(std::begin(mPictures), std::end(mPictures), [](const AttachedPicture::shared_ptr& picture){
 		picture->mState = AttachedPicture::ChangeState::Removed;
 	});
+
+	InvalidateSnapshotCache();
 }
 
 #pragma mark Type-Specific Access
@@ -971,6 +1112,8 @@ void SFB::Audio::Metadata::ClearAllMetadata()
 	CFDictionaryRemoveAllValues(mMetadata);
 	CFDictionaryRemoveAllValues(mChangedMetadata);
 	mPictures.clear();
+
+	InvalidateSnapshotCache();
 }
 
 void SFB::Audio::Metadata::MergeChangedMetadataIntoMetadata()
@@ -1007,4 +1150,47 @@ void SFB::Audio::Metadata::MergeChangedMetadataIntoMetadata()
 			++iter;
 		}
 	}
+
+	InvalidateSnapshotCache();
+}
+
+void SFB::Audio::Metadata::InvalidateSnapshotCache()
+{
+	std::lock_guard<std::mutex> lock(mSnapshotCacheMutex);
+
+	mMetadataSnapshot = nullptr;
+	mPicturesSnapshot = nullptr;
+	mPicturesSnapshotIsValid = false;
+}
+
+SFB::CFArray SFB::Audio::Metadata::GetPicturesSnapshot() const
+{
+	// Changes made directly to a picture aren't visible here, so the cache can't be used while any are pending
+	bool picturesHaveUnsavedChanges = std::any_of(std::begin(mPictures), std::end(mPictures), [](const AttachedPicture::shared_ptr& picture) {
+		return picture->HasUnsavedChanges();
+	});
+
+	if(mPicturesSnapshotIsValid && !picturesHaveUnsavedChanges)
+		return mPicturesSnapshot;
+
+	SFB::CFArray pictures;
+
+	auto attachedPictures = GetAttachedPictures();
+	if(!attachedPictures.empty()) {
+		CFMutableArray pictureArray(0, &kCFTypeArrayCallBacks);
+
+		for(auto picture : attachedPictures) {
+			CFDictionary pictureRepresentation(picture->CreateDictionaryRepresentation());
+			CFArrayAppendValue(pictureArray, pictureRepresentation);
+		}
+
+		pictures = CFArrayCreateCopy(kCFAllocatorDefault, pictureArray);
+	}
+
+	if(!picturesHaveUnsavedChanges) {
+		mPicturesSnapshot = pictures;
+		mPicturesSnapshotIsValid = true;
+	}
+
+	return pictures;
 }
@@ -6,23 +6,33 @@
 #pragma once
 
 #include <CoreFoundation/CoreFoundation.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "CFWrapper.h"
 #include "AttachedPicture.h"
+#include "MetadataSnapshot.h"
 
 /*! @file AudioMetadata.h @brief Support for metadata reading and writing */
 
 /*! @brief \c SFBAudioEngine's encompassing namespace */
 namespace SFB {
 
+	class SubclassDispatchTable;
+
 	/*! @brief %Audio functionality */
 	namespace Audio {
 
+		class MetadataWriteQueue;
+
 		/*! @brief Base class for all audio metadata reader/writer classes */
 		class Metadata
 		{
 
+			friend class MetadataWriteQueue;
+
 		public:
 
 			/*! @brief The \c CFErrorRef error domain used by \c Metadata and subclasses */
@@ -199,11 +209,45 @@ namespace SFB {
 
 			/*!
 			 * @brief Write the metadata
+			 * @note If \c UsesSafeSave() returns \c true the metadata is written to a clone of the file which atomically replaces the original
 			 * @param error An optional pointer to a \c CFErrorRef to receive error information
 			 * @return \c true on success, \c false otherwise
 			 */
 			bool WriteMetadata(CFErrorRef *error = nullptr);
 
+			/*!
+			 * @brief Compute a hash of the file's encoded audio, excluding any metadata
+			 * @note The hash is unaffected by writing metadata, making it suitable for keying caches on content identity
+			 * @param hash A \c uint64_t to receive the hash
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return \c true on success, \c false otherwise
+			 * @see Decoder::ComputeAudioPayloadHash()
+			 */
+			bool ComputeAudioPayloadHash(uint64_t& hash, CFErrorRef *error = nullptr) const;
+
+			//@}
+
+
+			// ========================================
+			/*!
+			 * @name Safe saving behavior
+			 * If \c UsesSafeSave() returns \c true then \c WriteMetadata() clones the file, writes the clone, flushes it
+			 * to permanent storage, and renames it over the original so an interrupted write cannot corrupt the file.
+			 * Cloning is nearly free on file systems supporting copy-on-write (APFS); on other file systems the metadata
+			 * is written in place instead.
+			 *
+			 * Safe saving is disabled by default because replacing the file gives it a new file ID, which invalidates
+			 * references to the file held by other applications such as open file descriptors and file ID based lookups,
+			 * and because each save also flushes the file to permanent storage.
+			 */
+			//@{
+
+			/*! @brief Query whether metadata is written using safe saves */
+			static inline bool UsesSafeSave()							{ return sUsesSafeSave.load(); }
+
+			/*! @brief Set whether metadata is written using safe saves */
+			static inline void SetUsesSafeSave(bool flag)				{ sUsesSafeSave.store(flag); }
+
 			//@}
 
 
@@ -213,10 +257,21 @@ namespace SFB {
 
 			/*!
 			 * @brief Copy the metadata and artwork values contained in this object to a dictionary
+			 * @note The returned dictionary must be released by the caller
 			 * @return A dictionary containing this object's metadata and artwork
+			 * @see CreateSnapshot()
 			 */
 			CFDictionaryRef CreateDictionaryRepresentation() const;
 
+			/*!
+			 * @brief Create an immutable snapshot of the metadata and artwork values contained in this object
+			 *
+			 * Saved metadata is shared between this object and its snapshots until it is next read or written,
+			 * so the cost of creating a snapshot is proportional to the number of unsaved changes.
+			 * @return A snapshot that may be safely read from any thread
+			 */
+			MetadataSnapshot::shared_ptr CreateSnapshot() const;
+
 			/*!
 			 * @brief Set the values contained in this object from a dictionary
 			 * @param dictionary A dictionary containing the desired values
@@ -645,6 +700,13 @@ namespace SFB {
 			explicit Metadata(CFURLRef url);
 
 
+			/*!
+			 * @brief Get the location \c _WriteMetadata() should write to
+			 * @note During a safe save this is a temporary clone of \c Metadata::mURL, otherwise it is \c Metadata::mURL
+			 */
+			inline CFURLRef GetURLForWriting() const				{ return mWriteURL ? (CFURLRef)mWriteURL : (CFURLRef)mURL; }
+
+
 			/*! @name Type-specific access */
 			//@{
 
@@ -697,6 +759,32 @@ namespace SFB {
 			void ClearAllMetadata();
 			void MergeChangedMetadataIntoMetadata();
 
+			// Query whether pictures have been attached, removed, or modified since the last save
+			bool HasUnsavedPictureChanges() const;
+
+			// Discard the cached immutable copies shared by snapshots
+			void InvalidateSnapshotCache();
+
+			// Get an immutable array of attached picture representations, or nullptr if there are none; must be called with mSnapshotCacheMutex locked
+			SFB::CFArray GetPicturesSnapshot() const;
+
+			// Write metadata to a clone of the file and replace the original with it
+			bool SafeWriteMetadata(CFErrorRef *error);
+
+			// The clone being written during a safe save
+			SFB::CFURL						mWriteURL;
+
+			// Immutable copies of mMetadata and the attached picture representations, created on demand
+			// Snapshots may be taken concurrently, so the copies are guarded by mSnapshotCacheMutex
+			mutable std::mutex				mSnapshotCacheMutex;
+			mutable SFB::CFDictionary		mMetadataSnapshot;
+			mutable SFB::CFArray			mPicturesSnapshot;
+			mutable bool					mPicturesSnapshotIsValid;
+
+			// ========================================
+			// Controls whether WriteMetadata() performs safe saves
+			static std::atomic_bool			sUsesSafeSave;
+
 
 			// ========================================
 			// Subclass registration support
@@ -705,9 +793,6 @@ namespace SFB {
 				CFArrayRef (*mCreateSupportedFileExtensions)();
 				CFArrayRef (*mCreateSupportedMIMETypes)();
 
-				bool (*mHandlesFilesWithExtension)(CFStringRef);
-				bool (*mHandlesMIMEType)(CFStringRef);
-
 				unique_ptr (*mCreateMetadata)(CFURLRef);
 
 				int mPriority;
@@ -715,6 +800,12 @@ namespace SFB {
 
 			static std::vector <SubclassInfo> sRegisteredSubclasses;
 
+			// Extension and MIME type lookup tables, built from sRegisteredSubclasses on first use
+			static std::shared_ptr<const SubclassDispatchTable> sDispatchTable;
+
+			static std::shared_ptr<const SubclassDispatchTable> GetDispatchTable();
+			static void InvalidateDispatchTable();
+
 		public:
 
 			/*!
@@ -734,9 +825,6 @@ namespace SFB {
 				.mCreateSupportedFileExtensions = T::CreateSupportedFileExtensions,
 				.mCreateSupportedMIMETypes = T::CreateSupportedMIMETypes,
 
-				.mHandlesFilesWithExtension = T::HandlesFilesWithExtension,
-				.mHandlesMIMEType = T::HandlesMIMEType,
-
 				.mCreateMetadata = T::CreateMetadata,
 
 				.mPriority = priority
@@ -748,6 +836,8 @@ namespace SFB {
 			std::sort(sRegisteredSubclasses.begin(), sRegisteredSubclasses.end(), [](const SubclassInfo& a, const SubclassInfo& b) {
 				return a.mPriority > b.mPriority;
 			});
+
+			InvalidateDispatchTable();
 		}
 
 	}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <sys/stat.h>
+
+#include <Block.h>
+
+#include "LibraryWatcher.h"
+#include "Logger.h"
+
+namespace {
+
+	// ========================================
+	// Create a file URL for a path
+	SFB::CFURL CreateURLForPath(const std::string& path, bool isDirectory)
+	{
+		return SFB::CFURL(CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault, (const UInt8 *)path.c_str(), (CFIndex)path.length(), isDirectory));
+	}
+
+	// ========================================
+	// Determine whether the file at url has an extension handled by Metadata
+	bool IsSupportedFile(CFURLRef url)
+	{
+		SFB::CFString pathExtension(CFURLCopyPathExtension(url));
+		return pathExtension && SFB::Audio::Metadata::HandlesFilesWithExtension(pathExtension);
+	}
+
+	// ========================================
+	// Add the paths of all regular files beneath path to paths
+	void AddFilesInDirectory(const std::string& path, std::set<std::string>& paths)
+	{
+		auto url = CreateURLForPath(path, true);
+		if(!url)
+			return;
+
+		SFB::CFWrapper<CFURLEnumeratorRef> enumerator(CFURLEnumeratorCreateForDirectoryURL(kCFAllocatorDefault, url, kCFURLEnumeratorDescendRecursively, nullptr));
+		if(!enumerator)
+			return;
+
+		CFURLRef childURL = nullptr;
+		CFURLEnumeratorResult result;
+		while(kCFURLEnumeratorEnd != (result = CFURLEnumeratorGetNextURL(enumerator, &childURL, nullptr))) {
+			if(kCFURLEnumeratorSuccess != result || CFURLHasDirectoryPath(childURL))
+				continue;
+
+			UInt8 buf [PATH_MAX];
+			if(CFURLGetFileSystemRepresentation(childURL, false, buf, PATH_MAX))
+				paths.insert((const char *)buf);
+		}
+	}
+
+}
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::LibraryWatcher::LibraryWatcher(CFTimeInterval latency, CFTimeInterval quietInterval)
+	: mRoots(0, &kCFTypeArrayCallBacks), mLatency(latency), mQuietInterval(quietInterval), mStream(nullptr), mLastEventID(kFSEventStreamEventIdSinceNow), mQueue(nullptr), mPendingChangesTimer(nullptr), mChangesBlock(nullptr)
+{
+	mQueue = dispatch_queue_create("org.sbooth.AudioEngine.LibraryWatcher", DISPATCH_QUEUE_SERIAL);
+	if(nullptr == mQueue) {
+		LOGGER_CRIT("org.sbooth.AudioEngine.LibraryWatcher", "dispatch_queue_create failed");
+		throw std::runtime_error("Unable to create the dispatch queue");
+	}
+
+	// The timer is armed only while changes are pending
+	mPendingChangesTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, mQueue);
+	if(nullptr == mPendingChangesTimer) {
+		LOGGER_CRIT("org.sbooth.AudioEngine.LibraryWatcher", "dispatch_source_create failed");
+
+		dispatch_release(mQueue);
+		throw std::runtime_error("Unable to create the pending changes timer");
+	}
+
+	dispatch_source_set_timer(mPendingChangesTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+	dispatch_source_set_event_handler(mPendingChangesTimer, ^{
+		ProcessPendingChanges();
+	});
+
+	dispatch_resume(mPendingChangesTimer);
+}
+
+SFB::Audio::LibraryWatcher::~LibraryWatcher()
+{
+	Stop();
+
+	dispatch_source_cancel(mPendingChangesTimer);
+
+	// Wait for any batch in progress to complete
+	dispatch_sync(mQueue, ^{});
+
+	dispatch_release(mPendingChangesTimer);
+	dispatch_release(mQueue);
+
+	if(mChangesBlock)
+		Block_release(mChangesBlock);
+}
+
+#pragma mark Library roots
+
+bool SFB::Audio::LibraryWatcher::AddRoot(CFURLRef url)
+{
+	if(nullptr == url || !CFURLResourceIsReachable(url, nullptr))
+		return false;
+
+	SFB::CFString path(CFURLCopyFileSystemPath(url, kCFURLPOSIXPathStyle));
+	if(!path)
+		return false;
+
+	if(!CFArrayContainsValue(mRoots, CFRangeMake(0, CFArrayGetCount(mRoots)), path))
+		CFArrayAppendValue(mRoots, path);
+
+	return true;
+}
+
+bool SFB::Audio::LibraryWatcher::RemoveRoot(CFURLRef url)
+{
+	if(nullptr == url)
+		return false;
+
+	SFB::CFString path(CFURLCopyFileSystemPath(url, kCFURLPOSIXPathStyle));
+	if(!path)
+		return false;
+
+	CFIndex index = CFArrayGetFirstIndexOfValue(mRoots, CFRangeMake(0, CFArrayGetCount(mRoots)), path);
+	if(kCFNotFound == index)
+		return false;
+
+	CFArrayRemoveValueAtIndex(mRoots, index);
+
+	return true;
+}
+
+#pragma mark Watching
+
+void SFB::Audio::LibraryWatcher::SetChangesBlock(ChangesBlock block)
+{
+	dispatch_sync(mQueue, ^{
+		if(mChangesBlock) {
+			Block_release(mChangesBlock);
+			mChangesBlock = nullptr;
+		}
+		if(block)
+			mChangesBlock = Block_copy(block);
+	});
+}
+
+bool SFB::Audio::LibraryWatcher::Start()
+{
+	if(IsWatching())
+		return true;
+
+	if(0 == CFArrayGetCount(mRoots)) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.LibraryWatcher", "Start() called with no library roots");
+		return false;
+	}
+
+	FSEventStreamContext context = {
+		.version			= 0,
+		.info				= this,
+		.retain				= nullptr,
+		.release			= nullptr,
+		.copyDescription	= nullptr
+	};
+
+	mStream = FSEventStreamCreate(kCFAllocatorDefault, FSEventsCallback, &context, mRoots, mLastEventID, mLatency, kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagWatchRoot);
+	if(nullptr == mStream) {
+		LOGGER_ERR("org.sbooth.AudioEngine.LibraryWatcher", "FSEventStreamCreate failed");
+		return false;
+	}
+
+	FSEventStreamSetDispatchQueue(mStream, mQueue);
+
+	if(!FSEventStreamStart(mStream)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.LibraryWatcher", "FSEventStreamStart failed");
+
+		FSEventStreamInvalidate(mStream);
+		FSEventStreamRelease(mStream);
+		mStream = nullptr;
+
+		return false;
+	}
+
+	return true;
+}
+
+bool SFB::Audio::LibraryWatcher::Stop()
+{
+	if(!IsWatching())
+		return true;
+
+	FSEventStreamStop(mStream);
+
+	// Resume from this point when restarted
+	SetLastEventID(FSEventStreamGetLatestEventId(mStream));
+
+	FSEventStreamInvalidate(mStream);
+	FSEventStreamRelease(mStream);
+	mStream = nullptr;
+
+	return true;
+}
+
+#pragma mark Event Processing
+
+void SFB::Audio::LibraryWatcher::FSEventsCallback(ConstFSEventStreamRef /*streamRef*/, void *clientCallBackInfo, size_t numEvents, void *eventPaths, const FSEventStreamEventFlags eventFlags[], const FSEventStreamEventId eventIds[])
+{
+	auto watcher = static_cast<LibraryWatcher *>(clientCallBackInfo);
+	watcher->ProcessEvents(numEvents, (const char * const *)eventPaths, eventFlags, eventIds);
+}
+
+void SFB::Audio::LibraryWatcher::ProcessEvents(size_t eventCount, const char * const *eventPaths, const FSEventStreamEventFlags *eventFlags, const FSEventStreamEventId *eventIds)
+{
+	// A file may appear in many events within a batch, so coalesce by path
+	std::set<std::string> changedPaths;
+	std::set<std::string> removedPaths;
+	std::set<std::string> removedDirectories;
+
+	for(size_t i = 0; i < eventCount; ++i) {
+		std::string path(eventPaths[i]);
+		FSEventStreamEventFlags flags = eventFlags[i];
+
+		if(kFSEventStreamEventFlagHistoryDone & flags)
+			continue;
+
+		struct stat sb;
+		bool exists = (0 == stat(path.c_str(), &sb));
+
+		// Events were coalesced or dropped, or a root was moved, so the subtree must be examined in full
+		if((kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagRootChanged) & flags) {
+			if(exists) {
+				LOGGER_INFO("org.sbooth.AudioEngine.LibraryWatcher", "Rescanning " << path.c_str());
+				AddFilesInDirectory(path, changedPaths);
+			}
+			else
+				removedDirectories.insert(path);
+			continue;
+		}
+
+		if(exists) {
+			if(S_ISREG(sb.st_mode)) {
+				removedPaths.erase(path);
+				changedPaths.insert(path);
+			}
+			// Events aren't generated for the contents of a directory moved into a root
+			else if(S_ISDIR(sb.st_mode) && ((kFSEventStreamEventFlagItemCreated | kFSEventStreamEventFlagItemRenamed) & flags))
+				AddFilesInDirectory(path, changedPaths);
+		}
+		else {
+			changedPaths.erase(path);
+			if(kFSEventStreamEventFlagItemIsDir & flags)
+				removedDirectories.insert(path);
+			else
+				removedPaths.insert(path);
+		}
+	}
+
+	if(0 < eventCount)
+		SetLastEventID(eventIds[eventCount - 1]);
+
+	// Removals are reported immediately and supersede pending changes
+	for(const auto& path : removedPaths)
+		mPendingChanges.erase(path);
+
+	for(const auto& path : removedDirectories) {
+		auto prefix = path + "/";
+		for(auto iter = mPendingChanges.lower_bound(prefix); iter != mPendingChanges.end() && 0 == iter->first.compare(0, prefix.length(), prefix); )
+			iter = mPendingChanges.erase(iter);
+	}
+
+	// Changed files wait until they have been quiet for the quiet interval
+	auto now = CFAbsoluteTimeGetCurrent();
+	for(const auto& path : changedPaths) {
+		struct stat sb;
+		if(0 != stat(path.c_str(), &sb))
+			continue;
+
+		mPendingChanges[path] = { sb.st_size, sb.st_mtimespec, now };
+	}
+
+	if(!changedPaths.empty())
+		dispatch_source_set_timer(mPendingChangesTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(mQuietInterval * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+
+	if(!removedPaths.empty() || !removedDirectories.empty())
+		ReportChanges({}, removedPaths, removedDirectories);
+}
+
+void SFB::Audio::LibraryWatcher::ProcessPendingChanges()
+{
+	std::set<std::string> changedPaths;
+	std::set<std::string> removedPaths;
+
+	// A file is quiet once its size and modification time have been stable for the quiet interval
+	auto now = CFAbsoluteTimeGetCurrent();
+	CFAbsoluteTime nextCheck = 0;
+	for(auto iter = mPendingChanges.begin(); iter != mPendingChanges.end(); ) {
+		auto& pending = iter->second;
+
+		struct stat sb;
+		if(0 != stat(iter->first.c_str(), &sb)) {
+			removedPaths.insert(iter->first);
+			iter = mPendingChanges.erase(iter);
+			continue;
+		}
+
+		if(sb.st_size != pending.mSize || sb.st_mtimespec.tv_sec != pending.mModificationTime.tv_sec || sb.st_mtimespec.tv_nsec != pending.mModificationTime.tv_nsec) {
+			pending = { sb.st_size, sb.st_mtimespec, now };
+			LOGGER_DEBUG("org.sbooth.AudioEngine.LibraryWatcher", "Still changing: " << iter->first.c_str());
+		}
+		else if(now - pending.mLastChangeTime >= mQuietInterval) {
+			changedPaths.insert(iter->first);
+			iter = mPendingChanges.erase(iter);
+			continue;
+		}
+
+		auto due = pending.mLastChangeTime + mQuietInterval;
+		if(0 == nextCheck || due < nextCheck)
+			nextCheck = due;
+
+		++iter;
+	}
+
+	if(mPendingChanges.empty())
+		dispatch_source_set_timer(mPendingChangesTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+	else
+		dispatch_source_set_timer(mPendingChangesTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(std::max(nextCheck - now, 0.1) * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+
+	if(!changedPaths.empty() || !removedPaths.empty())
+		ReportChanges(changedPaths, removedPaths, {});
+}
+
+void SFB::Audio::LibraryWatcher::ReportChanges(const std::set<std::string>& changedPaths, const std::set<std::string>& removedPaths, const std::set<std::string>& removedDirectories)
+{
+	if(!mChangesBlock)
+		return;
+
+	// Read metadata only for changed files
+	std::vector<Metadata::unique_ptr> changedMetadata;
+	for(const auto& path : changedPaths) {
+		auto url = CreateURLForPath(path, false);
+		if(!url || !IsSupportedFile(url))
+			continue;
+
+		SFB::CFError error;
+		auto metadata = Metadata::CreateMetadataForURL(url, &error);
+		if(metadata)
+			changedMetadata.push_back(std::move(metadata));
+		else
+			LOGGER_NOTICE("org.sbooth.AudioEngine.LibraryWatcher", "Unable to read metadata for " << url << ": " << error);
+	}
+
+	SFB::CFMutableArray removedURLs(0, &kCFTypeArrayCallBacks);
+	for(const auto& path : removedPaths) {
+		auto url = CreateURLForPath(path, false);
+		if(url && IsSupportedFile(url))
+			CFArrayAppendValue(removedURLs, url);
+	}
+
+	for(const auto& path : removedDirectories) {
+		auto url = CreateURLForPath(path, true);
+		if(url)
+			CFArrayAppendValue(removedURLs, url);
+	}
+
+	if(changedMetadata.empty() && 0 == CFArrayGetCount(removedURLs))
+		return;
+
+	mChangesBlock(changedMetadata, removedURLs);
+}
+
+void SFB::Audio::LibraryWatcher::SetLastEventID(FSEventStreamEventId eventID)
+{
+	// Stop() and the event queue both record event IDs, so never move backwards
+	auto lastEventID = mLastEventID.load();
+	while((kFSEventStreamEventIdSinceNow == lastEventID || eventID > lastEventID) && !mLastEventID.compare_exchange_weak(lastEventID, eventID))
+		;
+}
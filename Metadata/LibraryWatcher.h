@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <CoreServices/CoreServices.h>
+#include <dispatch/dispatch.h>
+
+#include "AudioMetadata.h"
+#include "CFWrapper.h"
+
+/*! @file LibraryWatcher.h @brief Incremental metadata rescanning driven by file system events */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief Watches a set of library roots and re-reads metadata only for files that change
+		 *
+		 * File system events are delivered by FSEvents, which coalesces bursts of changes occurring within the
+		 * latency interval into a single batch. For each batch the metadata of added or modified files supported by
+		 * \c Metadata is read and the URLs of deleted or moved-away files are reported, so keeping a catalog current
+		 * costs work proportional to the number of changes rather than the size of the library.
+		 *
+		 * When FSEvents reports that a subtree must be rescanned (for example after events were dropped) every
+		 * supported file in that subtree is reported as changed. Removal of a directory is reported as the directory's URL.
+		 *
+		 * A changed file is not read until it has been quiet for the quiet interval: no events for it have arrived and its
+		 * size and modification time have not changed. This keeps files that are still being copied or written from being
+		 * read, and reported, more than once. Removals are reported immediately.
+		 *
+		 * Callbacks are performed on a private serial queue.
+		 */
+		class LibraryWatcher
+		{
+
+		public:
+			// ========================================
+			/*! @name Block callback types */
+			//@{
+
+			/*!
+			 * @brief A block called with a batch of library changes
+			 * @param changedMetadata Metadata for files that were added or modified
+			 * @param removedURLs The URLs of files or directories that no longer exist
+			 */
+			using ChangesBlock = void (^)(const std::vector<Metadata::unique_ptr>& changedMetadata, CFArrayRef removedURLs);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*! @brief A \c std::unique_ptr for \c LibraryWatcher objects */
+			using unique_ptr = std::unique_ptr<LibraryWatcher>;
+
+			/*!
+			 * @brief Create a new \c LibraryWatcher
+			 * @param latency The interval, in seconds, over which file system events are coalesced into a single batch
+			 * @param quietInterval The interval, in seconds, a changed file must remain unchanged before it is read
+			 * @throws std::runtime_error
+			 */
+			explicit LibraryWatcher(CFTimeInterval latency = 2, CFTimeInterval quietInterval = 2);
+
+			/*! @brief Destroy this \c LibraryWatcher */
+			~LibraryWatcher();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			LibraryWatcher(const LibraryWatcher& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			LibraryWatcher& operator=(const LibraryWatcher& rhs) = delete;
+
+			/*! @endcond */
+			//@}
+
+
+			// ========================================
+			/*! @name Library roots */
+			//@{
+
+			/*!
+			 * @brief Add a directory to be watched
+			 * @note Changes to the watched roots take effect the next time watching is started
+			 * @param url The file URL of the directory to watch
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool AddRoot(CFURLRef url);
+
+			/*!
+			 * @brief Stop watching a directory
+			 * @note Changes to the watched roots take effect the next time watching is started
+			 * @param url The file URL of the directory
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool RemoveRoot(CFURLRef url);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Watching */
+			//@{
+
+			/*! @brief Set the block called with each batch of library changes */
+			void SetChangesBlock(ChangesBlock block);
+
+			/*!
+			 * @brief Start watching the library roots
+			 * @note Events that occurred since the last call to \c Stop() are delivered, so no changes are missed across restarts
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool Start();
+
+			/*!
+			 * @brief Stop watching the library roots
+			 * @note Changed files that have not yet been quiet for the quiet interval are still reported once they are
+			 */
+			bool Stop();
+
+			/*! @brief Determine whether the library roots are being watched */
+			inline bool IsWatching() const								{ return nullptr != mStream; }
+
+			//@}
+
+		private:
+
+			// A changed file waiting to be quiet for the quiet interval
+			struct PendingChange
+			{
+				off_t				mSize;
+				struct timespec		mModificationTime;
+				CFAbsoluteTime		mLastChangeTime;
+			};
+
+			// Process a batch of events from FSEvents
+			void ProcessEvents(size_t eventCount, const char * const *eventPaths, const FSEventStreamEventFlags *eventFlags, const FSEventStreamEventId *eventIds);
+
+			// Report the changed files that have been quiet for the quiet interval
+			void ProcessPendingChanges();
+
+			// Read metadata for the changed files and call the changes block
+			void ReportChanges(const std::set<std::string>& changedPaths, const std::set<std::string>& removedPaths, const std::set<std::string>& removedDirectories);
+
+			// Record the ID of the most recent event processed
+			void SetLastEventID(FSEventStreamEventId eventID);
+
+			// FSEvents callback
+			static void FSEventsCallback(ConstFSEventStreamRef streamRef, void *clientCallBackInfo, size_t numEvents, void *eventPaths, const FSEventStreamEventFlags eventFlags[], const FSEventStreamEventId eventIds[]);
+
+			// Data members
+			SFB::CFMutableArray						mRoots;
+			CFTimeInterval							mLatency;
+			CFTimeInterval							mQuietInterval;
+			FSEventStreamRef						mStream;
+			std::atomic<FSEventStreamEventId>		mLastEventID;
+			dispatch_queue_t						mQueue;
+			dispatch_source_t						mPendingChangesTimer;
+			std::map<std::string, PendingChange>	mPendingChanges;	// Only accessed on mQueue
+			ChangesBlock							mChangesBlock;
+		};
+
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include "MetadataSnapshot.h"
+#include "AudioMetadata.h"
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::MetadataSnapshot::MetadataSnapshot(const SFB::CFURL& url, const SFB::CFDictionary& metadata, SFB::CFDictionary&& changedMetadata, const SFB::CFArray& pictures)
+	: mURL(url), mMetadata(metadata), mChangedMetadata(std::move(changedMetadata)), mPictures(pictures), mDictionaryRepresentation(nullptr)
+{}
+
+SFB::Audio::MetadataSnapshot::~MetadataSnapshot()
+{
+	CFDictionaryRef dictionaryRepresentation = mDictionaryRepresentation.load();
+	if(dictionaryRepresentation)
+		CFRelease(dictionaryRepresentation);
+}
+
+#pragma mark Access
+
+CFTypeRef SFB::Audio::MetadataSnapshot::GetValue(CFStringRef key) const
+{
+	if(nullptr == key)
+		return nullptr;
+
+	if(mChangedMetadata) {
+		CFTypeRef value;
+		if(CFDictionaryGetValueIfPresent(mChangedMetadata, key, &value))
+			return (kCFNull == value ? nullptr : value);
+	}
+
+	return CFDictionaryGetValue(mMetadata, key);
+}
+
+CFDictionaryRef SFB::Audio::MetadataSnapshot::CreateDictionaryRepresentation() const
+{
+	CFDictionaryRef dictionaryRepresentation = mDictionaryRepresentation.load();
+	if(dictionaryRepresentation)
+		return (CFDictionaryRef)CFRetain(dictionaryRepresentation);
+
+	// Without changes or pictures the shared metadata is the representation
+	if(!mChangedMetadata && !mPictures)
+		return (CFDictionaryRef)CFRetain(mMetadata);
+
+	CFMutableDictionaryRef mergedRepresentation = CFDictionaryCreateMutableCopy(kCFAllocatorDefault, 0, mMetadata);
+
+	if(mChangedMetadata) {
+		CFIndex count = CFDictionaryGetCount(mChangedMetadata);
+
+		CFTypeRef *keys = (CFTypeRef *)malloc(sizeof(CFTypeRef) * (size_t)count);
+		CFTypeRef *values = (CFTypeRef *)malloc(sizeof(CFTypeRef) * (size_t)count);
+
+		CFDictionaryGetKeysAndValues(mChangedMetadata, keys, values);
+
+		for(CFIndex i = 0; i < count; ++i) {
+			if(kCFNull == values[i])
+				CFDictionaryRemoveValue(mergedRepresentation, keys[i]);
+			else
+				CFDictionarySetValue(mergedRepresentation, keys[i], values[i]);
+		}
+
+		free(keys);
+		keys = nullptr;
+		free(values);
+		values = nullptr;
+	}
+
+	if(mPictures)
+		CFDictionarySetValue(mergedRepresentation, Metadata::kAttachedPicturesKey, mPictures);
+
+	// Publish the merged representation; if another thread won the race use its result instead
+	CFDictionaryRef expected = nullptr;
+	if(!mDictionaryRepresentation.compare_exchange_strong(expected, mergedRepresentation)) {
+		CFRelease(mergedRepresentation);
+		return (CFDictionaryRef)CFRetain(expected);
+	}
+
+	return (CFDictionaryRef)CFRetain(mergedRepresentation);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <atomic>
+#include <memory>
+
+#include "CFWrapper.h"
+
+/*! @file MetadataSnapshot.h @brief Immutable point-in-time views of metadata */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief An immutable snapshot of a \c Metadata object's values and attached pictures
+		 *
+		 * A snapshot shares the saved metadata with the \c Metadata object that created it and with
+		 * every other snapshot taken before the saved metadata next changes; only unsaved changes are
+		 * copied.  Because a snapshot never changes after creation it may be read from any thread
+		 * without locking.
+		 * @see Metadata::CreateSnapshot()
+		 */
+		class MetadataSnapshot
+		{
+
+			friend class Metadata;
+
+		public:
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*! @brief A \c std::shared_ptr for \c MetadataSnapshot objects */
+			using shared_ptr = std::shared_ptr<const MetadataSnapshot>;
+
+			/*! @brief Destroy this \c MetadataSnapshot */
+			~MetadataSnapshot();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			MetadataSnapshot(const MetadataSnapshot& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			MetadataSnapshot& operator=(const MetadataSnapshot& rhs) = delete;
+
+			/*! @endcond */
+			//@}
+
+
+			// ========================================
+			/*! @name Access */
+			//@{
+
+			/*! @brief Get the URL of the file the snapshot was taken from */
+			inline CFURLRef GetURL() const							{ return mURL; }
+
+			/*!
+			 * @brief Get the value for a key
+			 * @param key The key to retrieve
+			 * @return The value associated with \c key, or \c nullptr if none
+			 */
+			CFTypeRef GetValue(CFStringRef key) const;
+
+			/*!
+			 * @brief Get the dictionary representations of the attached pictures
+			 * @return An array of dictionaries as returned by \c AttachedPicture::CreateDictionaryRepresentation()
+			 */
+			inline CFArrayRef GetAttachedPictures() const			{ return mPictures; }
+
+			/*!
+			 * @brief Copy the metadata and artwork values contained in this snapshot to a dictionary
+			 * @note The returned dictionary must be released by the caller
+			 * @return A dictionary in the format returned by \c Metadata::CreateDictionaryRepresentation()
+			 */
+			CFDictionaryRef CreateDictionaryRepresentation() const;
+
+			//@}
+
+		private:
+
+			MetadataSnapshot(const SFB::CFURL& url, const SFB::CFDictionary& metadata, SFB::CFDictionary&& changedMetadata, const SFB::CFArray& pictures);
+
+			// Data members
+			SFB::CFURL								mURL;
+			SFB::CFDictionary						mMetadata;				// Shared with the creating Metadata object
+			SFB::CFDictionary						mChangedMetadata;		// Unsaved changes, with kCFNull marking removals
+			SFB::CFArray							mPictures;
+
+			// The merged dictionary representation, created on first use
+			mutable std::atomic<CFDictionaryRef>	mDictionaryRepresentation;
+		};
+
+	}
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <Block.h>
+#include <dispatch/dispatch.h>
+
+#include "MetadataWriteQueue.h"
+#include "CFWrapper.h"
+#include "Logger.h"
+#include "TaskExecutor.h"
+
+const double SFB::Audio::MetadataWriteQueue::kDefaultCoalescingInterval = 2;
+const double SFB::Audio::MetadataWriteQueue::kDefaultMinimumWriteInterval = 0.1;
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	// A file whose changes keep arriving is written after at most this many coalescing intervals
+	const int kMaximumCoalescingIntervals = 10;
+
+	Clock::duration DurationFromSeconds(double seconds)
+	{
+		return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(std::max(seconds, 0.)));
+	}
+
+}
+
+// ========================================
+// The pending changes, shared with write tasks
+// ========================================
+class SFB::Audio::MetadataWriteQueue::State : public std::enable_shared_from_this<State>
+{
+
+public:
+
+	State(double coalescingInterval, double minimumWriteInterval)
+		: mCoalescingInterval(DurationFromSeconds(coalescingInterval)), mMinimumWriteInterval(DurationFromSeconds(minimumWriteInterval)), mIsWriting(false), mIsTimerScheduled(false), mCompletionBlock(nullptr), mErrorBlock(nullptr)
+	{}
+
+	~State()
+	{
+		if(mCompletionBlock)
+			Block_release(mCompletionBlock);
+		if(mErrorBlock)
+			Block_release(mErrorBlock);
+	}
+
+	State(const State& rhs) = delete;
+	State& operator=(const State& rhs) = delete;
+
+	// The changes pending for a single file
+	struct Entry
+	{
+		explicit Entry(CFURLRef url)
+			: mURL((CFURLRef)CFRetain(url)), mChangedMetadata(0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks), mReplacesPictures(false)
+		{}
+
+		SFB::CFURL						mURL;
+		SFB::CFMutableDictionary		mChangedMetadata;		// kCFNull marks removals, as in Metadata::mChangedMetadata
+		bool							mReplacesPictures;		// Whether mPictures replaces the file's attached pictures
+		Metadata::picture_vector		mPictures;
+		Clock::time_point				mFirstChangeTime;
+		Clock::time_point				mWriteTime;				// The time after which the file may be written
+	};
+
+	using EntryPointer = std::shared_ptr<Entry>;
+
+	// Find the entry pending for url; must be called with mMutex locked
+	EntryPointer FindPending(CFURLRef url) const
+	{
+		auto iter = std::find_if(std::begin(mPending), std::end(mPending), [url](const EntryPointer& entry) {
+			return CFEqual(entry->mURL, url);
+		});
+		return iter != std::end(mPending) ? *iter : nullptr;
+	}
+
+	// Merge the unsaved changes in metadata into entry
+	static void Merge(Entry& entry, const Metadata& metadata)
+	{
+		CFDictionaryRef changedMetadata = GetUnsavedChanges(metadata);
+		CFIndex count = CFDictionaryGetCount(changedMetadata);
+		if(count) {
+			std::vector<CFTypeRef> keys((size_t)count);
+			std::vector<CFTypeRef> values((size_t)count);
+			CFDictionaryGetKeysAndValues(changedMetadata, keys.data(), values.data());
+			for(CFIndex i = 0; i < count; ++i)
+				CFDictionarySetValue(entry.mChangedMetadata, keys[(size_t)i], values[(size_t)i]);
+		}
+
+		if(HasUnsavedPictureChanges(metadata)) {
+			entry.mReplacesPictures = true;
+			entry.mPictures.clear();
+			for(auto picture : metadata.GetAttachedPictures())
+				entry.mPictures.push_back(std::make_shared<AttachedPicture>(picture->GetData(), picture->GetType(), picture->GetDescription()));
+		}
+	}
+
+	// Apply the changes in entry to metadata as unsaved changes
+	static void Apply(const Entry& entry, Metadata& metadata)
+	{
+		CFIndex count = CFDictionaryGetCount(entry.mChangedMetadata);
+		if(count) {
+			std::vector<CFTypeRef> keys((size_t)count);
+			std::vector<CFTypeRef> values((size_t)count);
+			CFDictionaryGetKeysAndValues(entry.mChangedMetadata, keys.data(), values.data());
+			for(CFIndex i = 0; i < count; ++i)
+				SetValue(metadata, (CFStringRef)keys[(size_t)i], kCFNull == values[(size_t)i] ? nullptr : values[(size_t)i]);
+		}
+
+		// Attaching a picture changes its state, so each Metadata object receives its own copies
+		if(entry.mReplacesPictures) {
+			metadata.RemoveAllAttachedPictures();
+			for(auto picture : entry.mPictures)
+				metadata.AttachPicture(std::make_shared<AttachedPicture>(picture->GetData(), picture->GetType(), picture->GetDescription()));
+		}
+	}
+
+	// Copy the changes being written and pending for url, in the order they must be applied
+	std::vector<EntryPointer> CopyChanges(CFURLRef url) const
+	{
+		std::vector<EntryPointer> changes;
+
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		// Entries are never modified once they are being written
+		if(mWriting && CFEqual(mWriting->mURL, url))
+			changes.push_back(mWriting);
+
+		auto pending = FindPending(url);
+		if(pending) {
+			auto copy = std::make_shared<Entry>(url);
+			copy->mChangedMetadata = CFDictionaryCreateMutableCopy(kCFAllocatorDefault, 0, pending->mChangedMetadata);
+			copy->mReplacesPictures = pending->mReplacesPictures;
+			copy->mPictures = pending->mPictures;
+			changes.push_back(copy);
+		}
+
+		return changes;
+	}
+
+	// Start writing the next file if one is due, or arrange to be called again when one is; must be called with mMutex locked
+	void ScheduleWrite()
+	{
+		if(mIsWriting || mPending.empty())
+			return;
+
+		auto next = std::min_element(std::begin(mPending), std::end(mPending), [](const EntryPointer& lhs, const EntryPointer& rhs) {
+			return lhs->mWriteTime < rhs->mWriteTime;
+		});
+
+		auto writeTime = std::max((*next)->mWriteTime, mLastWriteTime + mMinimumWriteInterval);
+		auto now = Clock::now();
+
+		auto self = shared_from_this();
+		if(writeTime <= now) {
+			mIsWriting = true;
+			TaskExecutor::GetSharedExecutor().Submit(TaskExecutor::TaskClass::Maintenance, ^{
+				self->WriteNext();
+			});
+		}
+		else if(!mIsTimerScheduled) {
+			mIsTimerScheduled = true;
+			auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(writeTime - now).count();
+			dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delay), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+				std::lock_guard<std::mutex> lock(self->mMutex);
+				self->mIsTimerScheduled = false;
+				self->ScheduleWrite();
+			});
+		}
+	}
+
+	// Write the pending changes for the file that is due first
+	void WriteNext()
+	{
+		EntryPointer entry;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+
+			auto now = Clock::now();
+			auto iter = std::min_element(std::begin(mPending), std::end(mPending), [](const EntryPointer& lhs, const EntryPointer& rhs) {
+				return lhs->mWriteTime < rhs->mWriteTime;
+			});
+
+			// Further changes may have postponed the write
+			if(iter == std::end(mPending) || now < (*iter)->mWriteTime) {
+				mIsWriting = false;
+				ScheduleWrite();
+				return;
+			}
+
+			entry = *iter;
+			mPending.erase(iter);
+			mWriting = entry;
+			mLastWriteTime = now;
+		}
+
+		// Apply the changes to the file's current metadata so changes made by others since it was enqueued are preserved
+		SFB::CFError error;
+		auto metadata = Metadata::CreateMetadataForURL(entry->mURL, &error);
+		bool success = false;
+		if(metadata) {
+			Apply(*entry, *metadata);
+			success = !metadata->HasUnsavedChanges() || metadata->WriteMetadata(&error);
+		}
+
+		if(success)
+			LOGGER_DEBUG("org.sbooth.AudioEngine.MetadataWriteQueue", "Wrote pending changes to " << (CFURLRef)entry->mURL);
+		else
+			LOGGER_ERR("org.sbooth.AudioEngine.MetadataWriteQueue", "Unable to write pending changes to " << (CFURLRef)entry->mURL << ": " << error);
+
+		CompletionBlock completionBlock = nullptr;
+		ErrorBlock errorBlock = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+
+			mWriting = nullptr;
+			mIsWriting = false;
+
+			if(success && mCompletionBlock)
+				completionBlock = Block_copy(mCompletionBlock);
+			else if(!success && mErrorBlock)
+				errorBlock = Block_copy(mErrorBlock);
+
+			ScheduleWrite();
+		}
+
+		mIdle.notify_all();
+
+		if(completionBlock) {
+			completionBlock(entry->mURL);
+			Block_release(completionBlock);
+		}
+
+		if(errorBlock) {
+			errorBlock(entry->mURL, error);
+			Block_release(errorBlock);
+		}
+	}
+
+	mutable std::mutex					mMutex;
+	std::condition_variable				mIdle;				// Signaled when a write completes
+
+	Clock::duration						mCoalescingInterval;
+	Clock::duration						mMinimumWriteInterval;
+
+	std::vector<EntryPointer>			mPending;
+	EntryPointer						mWriting;			// The entry being written, if any
+	bool								mIsWriting;			// Whether a write task has been submitted
+	bool								mIsTimerScheduled;
+	Clock::time_point					mLastWriteTime;
+
+	CompletionBlock						mCompletionBlock;
+	ErrorBlock							mErrorBlock;
+};
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::MetadataWriteQueue::MetadataWriteQueue(double coalescingInterval, double minimumWriteInterval)
+	: mState(std::make_shared<State>(coalescingInterval, minimumWriteInterval))
+{}
+
+SFB::Audio::MetadataWriteQueue::~MetadataWriteQueue()
+{
+	Flush();
+}
+
+#pragma mark Callbacks
+
+void SFB::Audio::MetadataWriteQueue::SetCompletionBlock(CompletionBlock block)
+{
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+
+	if(mState->mCompletionBlock) {
+		Block_release(mState->mCompletionBlock);
+		mState->mCompletionBlock = nullptr;
+	}
+	if(block)
+		mState->mCompletionBlock = Block_copy(block);
+}
+
+void SFB::Audio::MetadataWriteQueue::SetErrorBlock(ErrorBlock block)
+{
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+
+	if(mState->mErrorBlock) {
+		Block_release(mState->mErrorBlock);
+		mState->mErrorBlock = nullptr;
+	}
+	if(block)
+		mState->mErrorBlock = Block_copy(block);
+}
+
+#pragma mark Writing
+
+bool SFB::Audio::MetadataWriteQueue::Enqueue(const Metadata& metadata)
+{
+	CFURLRef url = metadata.GetURL();
+	if(nullptr == url || !metadata.HasUnsavedChanges())
+		return false;
+
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+
+	auto now = Clock::now();
+	auto entry = mState->FindPending(url);
+	if(!entry) {
+		entry = std::make_shared<State::Entry>(url);
+		entry->mFirstChangeTime = now;
+		mState->mPending.push_back(entry);
+	}
+
+	State::Merge(*entry, metadata);
+
+	// Postpone the write while changes keep arriving, but not indefinitely
+	entry->mWriteTime = std::min(now + mState->mCoalescingInterval, entry->mFirstChangeTime + kMaximumCoalescingIntervals * mState->mCoalescingInterval);
+
+	mState->ScheduleWrite();
+
+	return true;
+}
+
+void SFB::Audio::MetadataWriteQueue::Flush()
+{
+	std::unique_lock<std::mutex> lock(mState->mMutex);
+
+	auto now = Clock::now();
+	for(auto entry : mState->mPending)
+		entry->mWriteTime = std::min(entry->mWriteTime, now);
+
+	mState->ScheduleWrite();
+
+	mState->mIdle.wait(lock, [this]() {
+		return mState->mPending.empty() && !mState->mWriting && !mState->mIsWriting;
+	});
+}
+
+#pragma mark Reading
+
+bool SFB::Audio::MetadataWriteQueue::HasPendingChanges(CFURLRef url) const
+{
+	if(nullptr == url)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+	return (mState->mWriting && CFEqual(mState->mWriting->mURL, url)) || mState->FindPending(url);
+}
+
+bool SFB::Audio::MetadataWriteQueue::ApplyPendingChanges(Metadata& metadata) const
+{
+	if(nullptr == metadata.GetURL())
+		return false;
+
+	auto changes = mState->CopyChanges(metadata.GetURL());
+	for(auto entry : changes)
+		State::Apply(*entry, metadata);
+
+	return !changes.empty();
+}
+
+SFB::Audio::Metadata::unique_ptr SFB::Audio::MetadataWriteQueue::CreateMetadataForURL(CFURLRef url, CFErrorRef *error) const
+{
+	if(nullptr == url)
+		return nullptr;
+
+	// If a write completes after the changes are copied, the file contains them and applying them again has no effect
+	auto changes = mState->CopyChanges(url);
+
+	auto metadata = Metadata::CreateMetadataForURL(url, error);
+	if(metadata) {
+		for(auto entry : changes)
+			State::Apply(*entry, *metadata);
+	}
+
+	return metadata;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include "AudioMetadata.h"
+
+/*! @file MetadataWriteQueue.h @brief Deferred, coalesced metadata writes */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A queue that writes metadata changes in the background, coalescing changes to the same file
+		 *
+		 * Enqueueing a \c Metadata object records its unsaved changes as pending changes for its file,
+		 * merged with any changes already pending for that file with the most recent value for each key
+		 * taking precedence.  A file is written once no changes to it have been enqueued for the
+		 * coalescing interval, so a burst of edits to a file results in a single rewrite.
+		 *
+		 * Files are written one at a time using the shared \c TaskExecutor, with at least the minimum
+		 * write interval between the start of consecutive writes.  Each write reads the file's current
+		 * metadata, applies the pending changes, and writes the result.
+		 *
+		 * Until a file has been written its pending changes are not visible in the file itself; use
+		 * \c CreateMetadataForURL() to read metadata that includes them.
+		 *
+		 * Callbacks are performed on the thread that wrote the file.
+		 */
+		class MetadataWriteQueue
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Block callback types */
+			//@{
+
+			/*!
+			 * @brief A block called when pending changes have been written to a file
+			 * @param url The URL of the file
+			 */
+			using CompletionBlock = void (^)(CFURLRef url);
+
+			/*!
+			 * @brief A block called when pending changes could not be written to a file
+			 * @note The pending changes are discarded
+			 * @param url The URL of the file
+			 * @param error The error
+			 */
+			using ErrorBlock = void (^)(CFURLRef url, CFErrorRef error);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*! @brief A \c std::unique_ptr for \c MetadataWriteQueue objects */
+			using unique_ptr = std::unique_ptr<MetadataWriteQueue>;
+
+			/*! @brief The default interval without changes after which a file is written, in seconds */
+			static const double kDefaultCoalescingInterval;
+
+			/*! @brief The default minimum interval between the start of consecutive writes, in seconds */
+			static const double kDefaultMinimumWriteInterval;
+
+			/*!
+			 * @brief Create a new \c MetadataWriteQueue
+			 * @param coalescingInterval The interval without changes to a file after which it is written, in seconds
+			 * @param minimumWriteInterval The minimum interval between the start of consecutive writes, in seconds
+			 */
+			explicit MetadataWriteQueue(double coalescingInterval = kDefaultCoalescingInterval, double minimumWriteInterval = kDefaultMinimumWriteInterval);
+
+			/*!
+			 * @brief Destroy this \c MetadataWriteQueue
+			 * @note Pending changes are written before returning
+			 */
+			~MetadataWriteQueue();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			MetadataWriteQueue(const MetadataWriteQueue& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			MetadataWriteQueue& operator=(const MetadataWriteQueue& rhs) = delete;
+
+			/*! @endcond */
+			//@}
+
+
+			// ========================================
+			/*! @name Callbacks */
+			//@{
+
+			/*! @brief Set the block called when pending changes have been written to a file */
+			void SetCompletionBlock(CompletionBlock block);
+
+			/*! @brief Set the block called when pending changes could not be written to a file */
+			void SetErrorBlock(ErrorBlock block);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Writing */
+			//@{
+
+			/*!
+			 * @brief Enqueue the unsaved changes in \c metadata to be written to its file
+			 * @note \c metadata is not modified and its changes remain unsaved
+			 * @param metadata The metadata
+			 * @return \c true if changes were enqueued, \c false if \c metadata has no URL or no unsaved changes
+			 */
+			bool Enqueue(const Metadata& metadata);
+
+			/*!
+			 * @brief Write all pending changes
+			 * @note Blocks until all pending changes have been written
+			 */
+			void Flush();
+
+			//@}
+
+
+			// ========================================
+			/*! @name Reading */
+			//@{
+
+			/*!
+			 * @brief Query whether a file has changes that have not yet been written
+			 * @param url The URL of the file
+			 * @return \c true if changes to the file are pending or being written, \c false otherwise
+			 */
+			bool HasPendingChanges(CFURLRef url) const;
+
+			/*!
+			 * @brief Apply the pending changes for the file containing \c metadata as unsaved changes
+			 * @param metadata The metadata
+			 * @return \c true if pending changes were applied, \c false otherwise
+			 */
+			bool ApplyPendingChanges(Metadata& metadata) const;
+
+			/*!
+			 * @brief Read the metadata for the specified URL and apply its pending changes
+			 *
+			 * The pending changes are captured before the file is read so the result is consistent
+			 * even if a write of the file completes in the meantime.
+			 * @param url The URL
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c Metadata object with pending changes applied as unsaved changes, or \c nullptr on failure
+			 */
+			Metadata::unique_ptr CreateMetadataForURL(CFURLRef url, CFErrorRef *error = nullptr) const;
+
+			//@}
+
+		private:
+
+			// The pending changes, shared with write tasks
+			class State;
+
+			// Access to the unsaved changes of Metadata objects, for use by State
+			inline static CFDictionaryRef GetUnsavedChanges(const Metadata& metadata)							{ return metadata.mChangedMetadata; }
+			inline static bool HasUnsavedPictureChanges(const Metadata& metadata)								{ return metadata.HasUnsavedPictureChanges(); }
+			inline static void SetValue(Metadata& metadata, CFStringRef key, CFTypeRef value)					{ metadata.SetValue(key, value); }
+
+			std::shared_ptr<State>		mState;
+		};
+
+	}
+}
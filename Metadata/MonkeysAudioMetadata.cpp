@@ -134,7 +134,7 @@ bool SFB::Audio::MonkeysAudioMetadata::_ReadMetadata(CFErrorRef *error)
 bool SFB::Audio::MonkeysAudioMetadata::_WriteMetadata(CFErrorRef *error)
 {
 	UInt8 buf [PATH_MAX];
-	if(!CFURLGetFileSystemRepresentation(mURL, false, buf, PATH_MAX))
+	if(!CFURLGetFileSystemRepresentation(GetURLForWriting(), false, buf, PATH_MAX))
 		return false;
 
 	std::unique_ptr<TagLib::FileStream> stream(new TagLib::FileStream((const char *)buf));
@@ -113,6 +113,11 @@ bool SFB::Audio::Output::SetupForDecoder(const Decoder& decoder)
 	return _SetupForDecoder(decoder);
 }
 
+bool SFB::Audio::Output::GetFormatForDecoder(const Decoder& decoder, AudioFormat& format) const
+{
+	return _GetFormatForDecoder(decoder, format);
+}
+
 #pragma mark -
 
 bool SFB::Audio::Output::CreateDeviceUID(CFStringRef& deviceUID) const
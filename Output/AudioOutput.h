@@ -168,6 +168,14 @@ namespace SFB {
 			/*! @brief Set up the output for use with decoder, adjusting format and channel layout accordingly */
 			bool SetupForDecoder(const Decoder& decoder);
 
+			/*!
+			 * @brief Determine the format \c SetupForDecoder() would select for decoder without changing the output
+			 * @param decoder The decoder
+			 * @param format An \c AudioFormat to receive the format
+			 * @return \c true if the format could be determined, \c false otherwise
+			 */
+			bool GetFormatForDecoder(const Decoder& decoder, AudioFormat& format) const;
+
 			/*! @brief Get the preferred buffer size, or 0 if none */
 			size_t GetPreferredBufferSize() const;
 
@@ -222,6 +230,8 @@ namespace SFB {
 			virtual bool _SetDeviceSampleRate(Float64 /*sampleRate*/)			{ return false; }
 
 			virtual size_t _GetPreferredBufferSize() const						{ return 0; }
+
+			virtual bool _GetFormatForDecoder(const Decoder& /*decoder*/, AudioFormat& /*format*/) const	{ return false; }
 		};
 	}
 }
@@ -1981,6 +1981,22 @@ bool SFB::Audio::CoreAudioOutput::_SetupForDecoder(const Decoder& decoder)
 	return true;
 }
 
+bool SFB::Audio::CoreAudioOutput::_GetFormatForDecoder(const Decoder& decoder, AudioFormat& format) const
+{
+	const AudioFormat& decoderFormat = decoder.GetFormat();
+	if(!_SupportsFormat(decoderFormat))
+		return false;
+
+	// This matches the format requested of the AUGraph in _SetupForDecoder()
+	format = mFormat;
+
+	format.mFormatID			= decoderFormat.mFormatID;
+	format.mChannelsPerFrame	= decoderFormat.mChannelsPerFrame;
+	format.mSampleRate			= decoderFormat.mSampleRate;
+
+	return true;
+}
+
 #if !TARGET_OS_IPHONE
 
 bool SFB::Audio::CoreAudioOutput::_CreateDeviceUID(CFStringRef& deviceUID) const
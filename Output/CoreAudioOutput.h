@@ -491,6 +491,7 @@ namespace SFB {
 			virtual bool _SupportsFormat(const AudioFormat& format) const;
 
 			virtual bool _SetupForDecoder(const Decoder& decoder);
+			virtual bool _GetFormatForDecoder(const Decoder& decoder, AudioFormat& format) const;
 
 #if !TARGET_OS_IPHONE
 			virtual bool _CreateDeviceUID(CFStringRef& deviceUID) const;
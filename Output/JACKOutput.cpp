@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <jack/jack.h>
+
+#include "JACKOutput.h"
+#include "AudioPlayer.h"
+#include "AudioFormat.h"
+#include "Logger.h"
+
+namespace {
+
+	// ========================================
+	// Possible event queue event types
+	enum eMessageQueueEvents : uint32_t {
+		eMessageQueueEventStopPlayback			= 'stop',
+		eMessageQueueEventBufferSizeChanged		= 'bsiz',
+		eMessageQueueEventSampleRateChanged		= 'srat',
+		eMessageQueueEventServerShutdown		= 'shut'
+	};
+
+	const char * const kDefaultClientName = "SFBAudioEngine";
+
+	// ========================================
+	// JACK callbacks
+	int ProcessCallback(jack_nframes_t nframes, void *arg)
+	{
+		return static_cast<SFB::Audio::JACKOutput *>(arg)->Process(nframes);
+	}
+
+	int BufferSizeCallback(jack_nframes_t nframes, void *arg)
+	{
+		return static_cast<SFB::Audio::JACKOutput *>(arg)->BufferSizeChanged(nframes);
+	}
+
+	int SampleRateCallback(jack_nframes_t nframes, void *arg)
+	{
+		return static_cast<SFB::Audio::JACKOutput *>(arg)->SampleRateChanged(nframes);
+	}
+
+	void ShutdownCallback(void *arg)
+	{
+		static_cast<SFB::Audio::JACKOutput *>(arg)->ServerShutdown();
+	}
+
+	void FreeBufferList(AudioBufferList *bufferList)
+	{
+		free(bufferList);
+	}
+
+}
+
+#pragma mark Server discovery
+
+bool SFB::Audio::JACKOutput::IsAvailable()
+{
+	jack_status_t status;
+	jack_client_t *client = jack_client_open(kDefaultClientName, JackNoStartServer, &status);
+	if(nullptr == client)
+		return false;
+
+	jack_client_close(client);
+	return true;
+}
+
+SFB::Audio::Output::unique_ptr SFB::Audio::JACKOutput::CreateInstance(CFStringRef clientName)
+{
+	return unique_ptr(new JACKOutput(clientName));
+}
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::JACKOutput::JACKOutput(CFStringRef clientName)
+	: mClient(nullptr), mBufferList(nullptr, FreeBufferList), mIsRunning(false), mBufferSize(0), mSampleRate(0), mAutomaticallyConnectsPorts(true), mEventQueue(new SFB::RingBuffer)
+{
+	if(clientName)
+		mClientName = (CFStringRef)CFRetain(clientName);
+
+	mEventQueue->Allocate(512);
+
+	// Setup the event dispatch timer
+	mEventQueueTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0));
+	if(nullptr == mEventQueueTimer) {
+		LOGGER_CRIT("org.sbooth.AudioEngine.Output.JACK", "dispatch_source_create failed");
+		throw std::runtime_error("Unable to create the event dispatch timer");
+	}
+
+	dispatch_source_set_timer(mEventQueueTimer, DISPATCH_TIME_NOW, NSEC_PER_SEC / 5, NSEC_PER_SEC / 3);
+
+	dispatch_source_set_event_handler(mEventQueueTimer, ^{
+
+		// Process JACK events
+		while(mEventQueue->GetBytesAvailableToRead()) {
+			uint32_t eventCode;
+			auto bytesRead = mEventQueue->Read(&eventCode, sizeof(eventCode));
+			if(bytesRead != sizeof(eventCode)) {
+				LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "Error reading event from queue");
+				break;
+			}
+
+			switch(eventCode) {
+				case eMessageQueueEventStopPlayback:
+					Stop();
+					break;
+
+				case eMessageQueueEventBufferSizeChanged:
+				{
+					// Ensure the ring buffer is large enough for the new period size
+					auto bufferSize = mBufferSize.load();
+					LOGGER_INFO("org.sbooth.AudioEngine.Output.JACK", "JACK buffer size changed to " << bufferSize);
+					if(mPlayer && 8 * bufferSize > mPlayer->GetRingBufferCapacity())
+						mPlayer->SetRingBufferCapacity(8 * bufferSize);
+					break;
+				}
+
+				case eMessageQueueEventSampleRateChanged:
+					// The format is owned by the player's decoding thread, which compares it to the new rate
+					LOGGER_NOTICE("org.sbooth.AudioEngine.Output.JACK", "JACK sample rate changed to " << mSampleRate.load());
+					if(mPlayer)
+						mPlayer->OutputSampleRateChanged();
+					break;
+
+				case eMessageQueueEventServerShutdown:
+					LOGGER_CRIT("org.sbooth.AudioEngine.Output.JACK", "JACK server shut down");
+					mIsRunning.store(false);
+					Close();
+					break;
+			}
+		}
+
+	});
+
+	// Start the timer
+	dispatch_resume(mEventQueueTimer);
+}
+
+SFB::Audio::JACKOutput::~JACKOutput()
+{
+	dispatch_source_cancel(mEventQueueTimer);
+	dispatch_release(mEventQueueTimer);
+
+	if(mClient)
+		_Close();
+}
+
+#pragma mark -
+
+bool SFB::Audio::JACKOutput::_GetDeviceSampleRate(Float64& sampleRate) const
+{
+	if(nullptr == mClient)
+		return false;
+
+	sampleRate = mSampleRate.load();
+	return true;
+}
+
+size_t SFB::Audio::JACKOutput::_GetPreferredBufferSize() const
+{
+	if(nullptr == mClient)
+		return 0;
+
+	return jack_get_buffer_size(mClient);
+}
+
+#pragma mark -
+
+bool SFB::Audio::JACKOutput::_Open()
+{
+	std::vector<char> clientName;
+	if(mClientName) {
+		clientName.resize((size_t)jack_client_name_size());
+		if(!CFStringGetCString(mClientName, clientName.data(), (CFIndex)clientName.size(), kCFStringEncodingUTF8)) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "Invalid JACK client name: " << mClientName);
+			return false;
+		}
+	}
+
+	jack_status_t status;
+	mClient = jack_client_open(mClientName ? clientName.data() : kDefaultClientName, JackNoStartServer, &status);
+	if(nullptr == mClient) {
+		LOGGER_CRIT("org.sbooth.AudioEngine.Output.JACK", "Unable to open JACK client: " << status);
+		return false;
+	}
+
+	if(jack_set_process_callback(mClient, ProcessCallback, this) || jack_set_buffer_size_callback(mClient, BufferSizeCallback, this) || jack_set_sample_rate_callback(mClient, SampleRateCallback, this)) {
+		LOGGER_CRIT("org.sbooth.AudioEngine.Output.JACK", "Unable to set JACK callbacks");
+		jack_client_close(mClient);
+		mClient = nullptr;
+		return false;
+	}
+
+	jack_on_shutdown(mClient, ShutdownCallback, this);
+
+	mBufferSize.store(jack_get_buffer_size(mClient));
+	mSampleRate.store(jack_get_sample_rate(mClient));
+
+	LOGGER_INFO("org.sbooth.AudioEngine.Output.JACK", "Opened JACK client \"" << jack_get_client_name(mClient) << "\" at " << mSampleRate.load() << " Hz with " << mBufferSize.load() << " frame buffers");
+
+	return true;
+}
+
+bool SFB::Audio::JACKOutput::_Close()
+{
+	mIsRunning.store(false);
+
+	// Closing the client deactivates it and unregisters its ports
+	auto result = jack_client_close(mClient);
+	if(result)
+		LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "jack_client_close failed: " << result);
+
+	mClient = nullptr;
+	mPorts.clear();
+	mBufferList.reset();
+
+	return 0 == result;
+}
+
+bool SFB::Audio::JACKOutput::_Start()
+{
+	if(!Activate())
+		return false;
+
+	if(mAutomaticallyConnectsPorts)
+		ConnectPorts();
+
+	return true;
+}
+
+bool SFB::Audio::JACKOutput::_Stop()
+{
+	auto result = jack_deactivate(mClient);
+	if(result) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "jack_deactivate failed: " << result);
+		return false;
+	}
+
+	mIsRunning.store(false);
+
+	return true;
+}
+
+bool SFB::Audio::JACKOutput::_RequestStop()
+{
+	uint32_t event = eMessageQueueEventStopPlayback;
+	mEventQueue->Write(&event, sizeof(event));
+	return true;
+}
+
+bool SFB::Audio::JACKOutput::_IsOpen() const
+{
+	return nullptr != mClient;
+}
+
+bool SFB::Audio::JACKOutput::_IsRunning() const
+{
+	return mIsRunning.load();
+}
+
+bool SFB::Audio::JACKOutput::_Reset()
+{
+	return true;
+}
+
+bool SFB::Audio::JACKOutput::_SupportsFormat(const AudioFormat& format) const
+{
+	// The player counts frames at the decoder's sample rate, so audio isn't resampled for the server
+	return format.IsPCM() && (nullptr == mClient || format.mSampleRate == mSampleRate.load());
+}
+
+bool SFB::Audio::JACKOutput::_SetupForDecoder(const Decoder& decoder)
+{
+	const AudioFormat& decoderFormat = decoder.GetFormat();
+	if(!_SupportsFormat(decoderFormat)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "JACK unsupported format at " << mSampleRate.load() << " Hz: " << decoderFormat);
+		return false;
+	}
+
+	// The process callback must not see the ports change, but deactivating the client disconnects
+	// every port so it is only done when the number of ports changes and the connections are restored
+	size_t previousPortCount = mPorts.size();
+	bool restart = _IsRunning() && previousPortCount != decoderFormat.mChannelsPerFrame;
+
+	std::vector<std::vector<std::string>> connections;
+	if(restart) {
+		connections = GetPortConnections();
+		if(!_Stop())
+			return false;
+	}
+
+	if(!SetPortCount(decoderFormat.mChannelsPerFrame))
+		return false;
+
+	_GetFormatForDecoder(decoder, mFormat);
+
+	mChannelLayout = decoder.GetChannelLayout();
+
+	// Ensure the ring buffer is large enough
+	auto bufferSize = jack_get_buffer_size(mClient);
+	mBufferSize.store(bufferSize);
+	if(8 * bufferSize > mPlayer->GetRingBufferCapacity())
+		mPlayer->SetRingBufferCapacity(8 * bufferSize);
+
+	if(restart) {
+		if(!Activate())
+			return false;
+
+		RestorePortConnections(connections);
+
+		// Only ports added for the new channel count are connected automatically
+		if(mAutomaticallyConnectsPorts)
+			ConnectPorts(previousPortCount);
+	}
+
+	return true;
+}
+
+bool SFB::Audio::JACKOutput::_GetFormatForDecoder(const Decoder& decoder, AudioFormat& format) const
+{
+	const AudioFormat& decoderFormat = decoder.GetFormat();
+	if(nullptr == mClient || !_SupportsFormat(decoderFormat))
+		return false;
+
+	// JACK ports carry deinterleaved native float; the decoder's sample rate matches the server's
+	format.mFormatID			= kAudioFormatLinearPCM;
+	format.mFormatFlags			= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+
+	format.mSampleRate			= decoderFormat.mSampleRate;
+	format.mChannelsPerFrame	= decoderFormat.mChannelsPerFrame;
+	format.mBitsPerChannel		= 32;
+
+	format.mBytesPerPacket		= (format.mBitsPerChannel / 8);
+	format.mFramesPerPacket		= 1;
+	format.mBytesPerFrame		= format.mBytesPerPacket * format.mFramesPerPacket;
+
+	format.mReserved			= 0;
+
+	return true;
+}
+
+#pragma mark -
+
+bool SFB::Audio::JACKOutput::Activate()
+{
+	if(mPorts.empty()) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "No JACK output ports registered");
+		return false;
+	}
+
+	auto result = jack_activate(mClient);
+	if(result) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "jack_activate failed: " << result);
+		return false;
+	}
+
+	mIsRunning.store(true);
+
+	return true;
+}
+
+bool SFB::Audio::JACKOutput::SetPortCount(UInt32 portCount)
+{
+	while(mPorts.size() > portCount) {
+		auto result = jack_port_unregister(mClient, mPorts.back());
+		if(result)
+			LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "jack_port_unregister failed: " << result);
+		mPorts.pop_back();
+	}
+
+	while(mPorts.size() < portCount) {
+		char portName [32];
+		snprintf(portName, sizeof(portName), "out_%zu", mPorts.size() + 1);
+
+		jack_port_t *port = jack_port_register(mClient, portName, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput | JackPortIsTerminal, 0);
+		if(nullptr == port) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "Unable to register JACK port " << portName);
+			return false;
+		}
+
+		mPorts.push_back(port);
+	}
+
+	// The buffer list's data pointers are set to the port buffers each cycle
+	if(!mBufferList || mBufferList->mNumberBuffers != portCount) {
+		mBufferList.reset((AudioBufferList *)calloc(1, offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) * portCount)));
+		if(!mBufferList) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Output.JACK", "Unable to allocate memory");
+			return false;
+		}
+
+		mBufferList->mNumberBuffers = portCount;
+		for(UInt32 i = 0; i < portCount; ++i)
+			mBufferList->mBuffers[i].mNumberChannels = 1;
+	}
+
+	return true;
+}
+
+void SFB::Audio::JACKOutput::ConnectPorts(size_t firstPort)
+{
+	if(firstPort >= mPorts.size())
+		return;
+
+	const char **physicalPorts = jack_get_ports(mClient, nullptr, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+	if(nullptr == physicalPorts) {
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Output.JACK", "No physical playback ports found");
+		return;
+	}
+
+	// Port i is connected to physical port i, so skip the physical ports of ports not being connected
+	size_t i = 0;
+	while(i < firstPort && physicalPorts[i])
+		++i;
+
+	for(; i < mPorts.size() && physicalPorts[i]; ++i) {
+		auto result = jack_connect(mClient, jack_port_name(mPorts[i]), physicalPorts[i]);
+		if(result && EEXIST != result)
+			LOGGER_WARNING("org.sbooth.AudioEngine.Output.JACK", "Unable to connect " << jack_port_name(mPorts[i]) << " to " << physicalPorts[i] << ": " << result);
+	}
+
+	jack_free(physicalPorts);
+}
+
+std::vector<std::vector<std::string>> SFB::Audio::JACKOutput::GetPortConnections() const
+{
+	std::vector<std::vector<std::string>> connections;
+
+	for(auto port : mPorts) {
+		std::vector<std::string> portConnections;
+
+		const char **connectedPorts = jack_port_get_connections(port);
+		if(connectedPorts) {
+			for(size_t i = 0; connectedPorts[i]; ++i)
+				portConnections.push_back(connectedPorts[i]);
+			jack_free(connectedPorts);
+		}
+
+		connections.push_back(std::move(portConnections));
+	}
+
+	return connections;
+}
+
+void SFB::Audio::JACKOutput::RestorePortConnections(const std::vector<std::vector<std::string>>& connections)
+{
+	for(size_t i = 0; i < mPorts.size() && i < connections.size(); ++i) {
+		for(const auto& destination : connections[i]) {
+			auto result = jack_connect(mClient, jack_port_name(mPorts[i]), destination.c_str());
+			if(result && EEXIST != result)
+				LOGGER_WARNING("org.sbooth.AudioEngine.Output.JACK", "Unable to reconnect " << jack_port_name(mPorts[i]) << " to " << destination << ": " << result);
+		}
+	}
+}
+
+#pragma mark Callbacks
+
+int SFB::Audio::JACKOutput::Process(jack_nframes_t frameCount)
+{
+	// Render directly into the port buffers
+	auto byteCount = (UInt32)(frameCount * sizeof(jack_default_audio_sample_t));
+	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
+		mBufferList->mBuffers[i].mData = jack_port_get_buffer(mPorts[i], frameCount);
+		mBufferList->mBuffers[i].mDataByteSize = byteCount;
+	}
+
+	mPlayer->ProvideAudio(mBufferList.get(), frameCount);
+
+	return 0;
+}
+
+int SFB::Audio::JACKOutput::BufferSizeChanged(jack_nframes_t bufferSize)
+{
+	mBufferSize.store(bufferSize);
+
+	uint32_t event = eMessageQueueEventBufferSizeChanged;
+	mEventQueue->Write(&event, sizeof(event));
+
+	return 0;
+}
+
+int SFB::Audio::JACKOutput::SampleRateChanged(jack_nframes_t sampleRate)
+{
+	mSampleRate.store(sampleRate);
+
+	uint32_t event = eMessageQueueEventSampleRateChanged;
+	mEventQueue->Write(&event, sizeof(event));
+
+	return 0;
+}
+
+void SFB::Audio::JACKOutput::ServerShutdown()
+{
+	uint32_t event = eMessageQueueEventServerShutdown;
+	mEventQueue->Write(&event, sizeof(event));
+}
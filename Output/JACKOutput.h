@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <jack/types.h>
+
+#include "AudioOutput.h"
+#include "RingBuffer.h"
+
+/*! @file JACKOutput.h @brief JACK output functionality */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief Output subclass supporting the JACK Audio Connection Kit
+		 *
+		 * Audio is rendered from the JACK process callback directly into the output port
+		 * buffers, without intermediate copies.  One output port is registered for each channel
+		 * of the current decoder; the output format is always deinterleaved native-endian
+		 * 32-bit float.  Audio is not resampled, so only decoders at the JACK server's sample
+		 * rate are supported.  Connections made to the output ports are preserved when the
+		 * number of ports changes, and a change in the server's sample rate is passed to the
+		 * player, which stops playback if the current format no longer matches.
+		 */
+		class JACKOutput : public Output
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Server discovery */
+			//@{
+
+			/*! @brief Query whether a JACK server is running */
+			static bool IsAvailable();
+
+			/*!
+			 * @brief Create a \c JACKOutput
+			 * @param clientName The name of the JACK client or \c nullptr to use the default
+			 */
+			static unique_ptr CreateInstance(CFStringRef clientName = nullptr);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			// @{
+
+			/*!
+			 * @brief Create a \c JACKOutput
+			 * @param clientName The name of the JACK client or \c nullptr to use the default
+			 */
+			explicit JACKOutput(CFStringRef clientName = nullptr);
+
+			/*! @brief Destroy this \c JACKOutput */
+			virtual ~JACKOutput();
+
+			//@}
+
+
+			// ========================================
+			/*! @name Port connections */
+			//@{
+
+			/*! @brief Query whether output ports are connected to the physical playback ports when started */
+			inline bool GetAutomaticallyConnectsPorts() const			{ return mAutomaticallyConnectsPorts; }
+
+			/*! @brief Set whether output ports are connected to the physical playback ports when started */
+			inline void SetAutomaticallyConnectsPorts(bool connectPorts)	{ mAutomaticallyConnectsPorts = connectPorts; }
+
+			//@}
+
+		private:
+
+			virtual bool _Open();
+			virtual bool _Close();
+
+			virtual bool _Start();
+			virtual bool _Stop();
+			virtual bool _RequestStop();
+
+			virtual bool _IsOpen() const;
+			virtual bool _IsRunning() const;
+
+			virtual bool _Reset();
+
+			virtual bool _SupportsFormat(const AudioFormat& format) const;
+			virtual bool _SetupForDecoder(const Decoder& decoder);
+			virtual bool _GetFormatForDecoder(const Decoder& decoder, AudioFormat& format) const;
+
+			virtual bool _GetDeviceSampleRate(Float64& sampleRate) const;
+
+			virtual size_t _GetPreferredBufferSize() const;
+
+			// Activate the client without connecting its ports
+			bool Activate();
+
+			// Register or unregister output ports until there is one per channel
+			bool SetPortCount(UInt32 portCount);
+
+			// Connect the output ports starting at firstPort to the physical playback ports
+			void ConnectPorts(size_t firstPort = 0);
+
+			// Get the names of the ports each output port is connected to
+			std::vector<std::vector<std::string>> GetPortConnections() const;
+
+			// Reconnect the output ports to the ports they were connected to
+			void RestorePortConnections(const std::vector<std::vector<std::string>>& connections);
+
+			SFB::CFString							mClientName;					/*!< Requested JACK client name */
+			jack_client_t							*mClient;						/*!< The JACK client */
+			std::vector<jack_port_t *>				mPorts;							/*!< Output ports, one per channel */
+			std::unique_ptr<AudioBufferList, void (*)(AudioBufferList *)>	mBufferList;		/*!< Aliases the port buffers during rendering */
+			std::atomic_bool						mIsRunning;						/*!< Whether the client is active */
+			std::atomic<jack_nframes_t>				mBufferSize;					/*!< The server's current period size */
+			std::atomic<jack_nframes_t>				mSampleRate;					/*!< The server's current sample rate */
+			bool									mAutomaticallyConnectsPorts;	/*!< Whether to connect to physical ports */
+			SFB::RingBuffer::unique_ptr				mEventQueue;					/*!< JACK event queue */
+			dispatch_source_t						mEventQueueTimer;				/*!< JACK event queue timer */
+
+		public:
+
+			// ========================================
+			/*! @cond */
+
+			/*! @internal JACK process callback */
+			int Process(jack_nframes_t frameCount);
+
+			/*! @internal JACK buffer size callback */
+			int BufferSizeChanged(jack_nframes_t bufferSize);
+
+			/*! @internal JACK sample rate callback */
+			int SampleRateChanged(jack_nframes_t sampleRate);
+
+			/*! @internal JACK shutdown callback */
+			void ServerShutdown();
+
+			/*! @endcond */
+		};
+
+	}
+}
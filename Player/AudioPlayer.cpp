@@ -8,9 +8,11 @@
 #include <mach/thread_act.h>
 #include <mach/mach_error.h>
 #include <mach/sync_policy.h>
+#include <mach/mach_time.h>
 #include <stdexcept>
 #include <new>
 #include <algorithm>
+#include <cstring>
 
 #include "AudioPlayer.h"
 #include "CoreAudioOutput.h"
@@ -18,6 +20,10 @@
 #include "CFErrorUtilities.h"
 #include "Logger.h"
 #include "CreateStringForOSType.h"
+#include "TaskExecutor.h"
+#include "ReplayGainAnalyzer.h"
+#include "SharedStreamDecoder.h"
+#include "ProcessMemoryUsage.h"
 
 // ========================================
 // Macros
@@ -25,6 +31,8 @@
 #define RING_BUFFER_CAPACITY_FRAMES				16384
 #define RING_BUFFER_WRITE_CHUNK_SIZE_FRAMES		2048
 #define DECODER_THREAD_IMPORTANCE				6
+#define OVERLOAD_THRESHOLD_SECONDS				0.1
+#define LOUDNESS_ANALYSIS_BACKLOG_SECONDS		30
 
 namespace {
 
@@ -62,11 +70,136 @@ namespace {
 		eAudioPlayerFlagRequestMute				= 1u << 2,
 		eAudioPlayerFlagRingBufferNeedsReset	= 1u << 3,
 		eAudioPlayerFlagStartPlayback			= 1u << 4,
+		eAudioPlayerFlagOutputSampleRateChanged	= 1u << 5,
+		eAudioPlayerFlagSpliceDecoder			= 1u << 6,
 
 		eAudioPlayerFlagStopDecoding			= 1u << 10,
 		eAudioPlayerFlagStopCollecting			= 1u << 11
 	};
 
+
+	// ========================================
+	// Replay gain analysis of a track performed on a background worker as the track is decoded
+	class LoudnessAnalysis : public std::enable_shared_from_this<LoudnessAnalysis>
+	{
+
+	public:
+
+		using shared_ptr = std::shared_ptr<LoudnessAnalysis>;
+
+		// Returns nullptr if audio in format can't be analyzed
+		static shared_ptr CreateForURL(CFURLRef url, const SFB::Audio::AudioFormat& format, SFB::Audio::Player::LoudnessAnalysisBlock block)
+		{
+			if(nullptr == url || nullptr == block || !format.IsPCM() || !(kAudioFormatFlagIsFloat & format.mFormatFlags) || format.IsInterleaved() || 32 != format.mBitsPerChannel || !format.IsNativeEndian())
+				return nullptr;
+
+			if(!(1 == format.mChannelsPerFrame || 2 == format.mChannelsPerFrame) || !SFB::Audio::ReplayGainAnalyzer::SampleRateIsSupported((int32_t)format.mSampleRate))
+				return nullptr;
+
+			auto analysis = std::make_shared<LoudnessAnalysis>(url, format, block);
+			analysis->Start();
+			return analysis;
+		}
+
+		LoudnessAnalysis(CFURLRef url, const SFB::Audio::AudioFormat& format, SFB::Audio::Player::LoudnessAnalysisBlock block)
+			: mURL((CFURLRef)CFRetain(url)), mFormat(format), mBlock(Block_copy(block)), mIsValid(true), mPendingFrames(0)
+		{
+			mQueue = dispatch_queue_create("org.sbooth.AudioEngine.Player.LoudnessAnalysis", DISPATCH_QUEUE_SERIAL);
+			dispatch_set_target_queue(mQueue, SFB::TaskExecutor::GetSharedExecutor().GetQueue(SFB::TaskExecutor::TaskClass::Analysis));
+		}
+
+		~LoudnessAnalysis()
+		{
+			dispatch_release(mQueue);
+			Block_release(mBlock);
+		}
+
+		LoudnessAnalysis(const LoudnessAnalysis& rhs) = delete;
+		LoudnessAnalysis& operator=(const LoudnessAnalysis& rhs) = delete;
+
+		inline bool IsValid() const			{ return mIsValid.load(); }
+
+		// Abandon the analysis, for example after a seek leaves a gap in the analyzed audio
+		void Invalidate()
+		{
+			if(mIsValid.exchange(false))
+				LOGGER_DEBUG("org.sbooth.AudioEngine.Player", "Loudness analysis abandoned for \"" << mURL << "\"");
+		}
+
+		// Called from the decoding thread with the next block of the track's audio
+		void AnalyzeAudio(const AudioBufferList *bufferList, UInt32 frameCount)
+		{
+			if(!mIsValid.load() || nullptr == bufferList || 0 == frameCount)
+				return;
+
+			// Give up rather than queue unbounded amounts of audio if analysis can't keep up
+			if(mPendingFrames.load() > LOUDNESS_ANALYSIS_BACKLOG_SECONDS * mFormat.mSampleRate) {
+				LOGGER_NOTICE("org.sbooth.AudioEngine.Player", "Loudness analysis can't keep up with decoding");
+				Invalidate();
+				return;
+			}
+
+			auto copy = new SFB::Audio::BufferList(mFormat, frameCount);
+			UInt32 byteCount = (UInt32)mFormat.FrameCountToByteCount(frameCount);
+			for(UInt32 i = 0; i < mFormat.mChannelsPerFrame; ++i) {
+				memcpy((*copy)->mBuffers[i].mData, bufferList->mBuffers[i].mData, byteCount);
+				(*copy)->mBuffers[i].mDataByteSize = byteCount;
+			}
+
+			mPendingFrames.fetch_add(frameCount);
+
+			auto self = shared_from_this();
+			dispatch_async(mQueue, ^{
+				if(self->mIsValid.load() && !self->mAnalyzer.AnalyzeAudio(*copy, frameCount))
+					self->Invalidate();
+				self->mPendingFrames.fetch_sub(frameCount);
+				delete copy;
+			});
+		}
+
+		// Called after the entire track has been decoded and rendered
+		void Finish()
+		{
+			auto self = shared_from_this();
+			dispatch_async(mQueue, ^{
+				if(!self->mIsValid.load())
+					return;
+
+				self->mAnalyzer.EndTrack();
+
+				float trackGain, trackPeak;
+				if(!self->mAnalyzer.GetTrackGain(trackGain) || !self->mAnalyzer.GetTrackPeak(trackPeak)) {
+					LOGGER_WARNING("org.sbooth.AudioEngine.Player", "Unable to calculate replay gain for \"" << self->mURL << "\"");
+					return;
+				}
+
+				LOGGER_INFO("org.sbooth.AudioEngine.Player", "Replay gain for \"" << self->mURL << "\": " << trackGain << " dB, peak " << trackPeak);
+
+				// Persisting the results is left to the client, which keeps the player independent of metadata support
+				self->mBlock(self->mURL, SFB::Audio::ReplayGainAnalyzer::GetReferenceLoudness(), trackGain, trackPeak);
+			});
+		}
+
+	private:
+
+		void Start()
+		{
+			auto self = shared_from_this();
+			dispatch_async(mQueue, ^{
+				if(!self->mAnalyzer.BeginTrack((int32_t)self->mFormat.mSampleRate))
+					self->mIsValid.store(false);
+			});
+		}
+
+		SFB::CFURL							mURL;
+		SFB::Audio::AudioFormat				mFormat;
+		SFB::Audio::Player::LoudnessAnalysisBlock	mBlock;
+		SFB::Audio::ReplayGainAnalyzer		mAnalyzer;		// Only accessed from mQueue
+		dispatch_queue_t					mQueue;
+		std::atomic_bool					mIsValid;
+		std::atomic_llong					mPendingFrames;
+	};
+
 }
 
 
@@ -91,6 +224,11 @@ public:
 		mTotalFrames = mDecoder->GetTotalFrames();
 	}
 
+	~DecoderStateData()
+	{
+		sInstanceCount.fetch_sub(1);
+	}
+
 	DecoderStateData(const DecoderStateData& rhs) = delete;
 	DecoderStateData& operator=(const DecoderStateData& rhs) = delete;
 
@@ -102,7 +240,15 @@ public:
 	UInt32 ReadAudio(UInt32 frameCount)
 	{
 		mBufferList.Reset();
-		return mDecoder->ReadAudio(mBufferList, std::min(frameCount, mBufferList.GetCapacityFrames()));
+
+		auto startTicks = mach_absolute_time();
+		auto framesRead = mDecoder->ReadAudio(mBufferList, std::min(frameCount, mBufferList.GetCapacityFrames()));
+
+		// Accumulate decoding time separately since ReadAudio() may be called from within an AudioConverter
+		mReadTicks += mach_absolute_time() - startTicks;
+		mReadFrames += framesRead;
+
+		return framesRead;
 	}
 
 	std::unique_ptr<Decoder>	mDecoder;
@@ -115,17 +261,32 @@ public:
 
 	std::atomic_llong			mFramesRendered;
 	std::atomic_llong			mFrameToSeek;
+	std::atomic<Decoder::SeekMode>	mSeekMode;
 
 	std::atomic_uint			mFlags;
 
+	// Only accessed from the decoding thread
+	uint64_t					mReadTicks;
+	uint64_t					mReadFrames;
+
+	// Set before the decoder state becomes active
+	LoudnessAnalysis::shared_ptr	mLoudnessAnalysis;
+
+	// The number of instances alive in the process, for detecting leaks
+	static std::atomic_llong	sInstanceCount;
+
 private:
 
 	DecoderStateData()
-		: mDecoder(nullptr), mTimeStamp(0), mTotalFrames(0), mFramesRendered(0), mFrameToSeek(-1), mFlags(0)
-	{}
+		: mDecoder(nullptr), mTimeStamp(0), mTotalFrames(0), mFramesRendered(0), mFrameToSeek(-1), mSeekMode(Decoder::SeekMode::Exact), mFlags(0), mReadTicks(0), mReadFrames(0)
+	{
+		sInstanceCount.fetch_add(1);
+	}
 
 };
 
+std::atomic_llong SFB::Audio::Player::DecoderStateData::sInstanceCount(0);
+
 namespace {
 
 	// ========================================
@@ -162,6 +323,50 @@ namespace {
 
 		return true;
 	}
+
+	// ========================================
+	// Determine the sample format a decoder should produce to avoid an unnecessary conversion to the output's format
+	SFB::Audio::Decoder::SampleFormat PreferredSampleFormatForOutputFormat(const SFB::Audio::AudioFormat& format)
+	{
+		if(!format.IsPCM())
+			return SFB::Audio::Decoder::SampleFormat::Default;
+
+		if(kAudioFormatFlagIsFloat & format.mFormatFlags)
+			return SFB::Audio::Decoder::SampleFormat::Float;
+
+		if(kAudioFormatFlagIsSignedInteger & format.mFormatFlags)
+			return (16 >= format.mBitsPerChannel) ? SFB::Audio::Decoder::SampleFormat::Int16 : SFB::Audio::Decoder::SampleFormat::Int32;
+
+		return SFB::Audio::Decoder::SampleFormat::Default;
+	}
+
+	// ========================================
+	// Whether the first byteCount bytes of any buffer in bufferList are nonzero
+	bool ContainsNonZeroBytes(const AudioBufferList *bufferList, size_t byteCount)
+	{
+		for(UInt32 bufferIndex = 0; bufferIndex < bufferList->mNumberBuffers; ++bufferIndex) {
+			auto bytes = static_cast<const uint8_t *>(bufferList->mBuffers[bufferIndex].mData);
+			for(size_t i = 0; i < byteCount; ++i) {
+				if(bytes[i])
+					return true;
+			}
+		}
+
+		return false;
+	}
+
+	// ========================================
+	// Create an AudioConverter between two formats, treating DoP as the PCM it masquerades as
+	OSStatus CreateAudioConverter(SFB::Audio::AudioFormat decoderFormat, SFB::Audio::AudioFormat outputFormat, AudioConverterRef *audioConverter)
+	{
+		if(decoderFormat.IsDoP())
+			decoderFormat.mFormatID = kAudioFormatLinearPCM;
+
+		if(outputFormat.IsDoP())
+			outputFormat.mFormatID = kAudioFormatLinearPCM;
+
+		return AudioConverterNew(&decoderFormat, &outputFormat, audioConverter);
+	}
 }
 
 namespace {
@@ -199,11 +404,16 @@ namespace {
 #pragma mark Creation/Destruction
 
 SFB::Audio::Player::Player()
-	: mRingBuffer(new RingBuffer), mRingBufferCapacity(RING_BUFFER_CAPACITY_FRAMES), mRingBufferWriteChunkSize(RING_BUFFER_WRITE_CHUNK_SIZE_FRAMES), mFlags(0), mQueue(nullptr), mFramesDecoded(0), mFramesRendered(0), mOutput(new CoreAudioOutput), mDecoderErrorBlock(nullptr), mFormatMismatchBlock(nullptr), mErrorBlock(nullptr)
+	: mRingBuffer(new RingBuffer), mRingBufferCapacity(RING_BUFFER_CAPACITY_FRAMES), mRingBufferWriteChunkSize(RING_BUFFER_WRITE_CHUNK_SIZE_FRAMES), mFlags(0), mQueue(nullptr), mFramesDecoded(0), mFramesRendered(0), mOutput(new CoreAudioOutput), mCollectsPerformanceStatistics(false), mStartupTraceStartTicks(0), mProcessorMaximumFrameCount(0), mOverloadProtectionEnabled(true), mOverloadThreshold(OVERLOAD_THRESHOLD_SECONDS), mLoadSheddingLevel(0), mDecodingSpeed(0), mLoadSheddingLevelChangedTicks(0), mAnalyzesLoudness(false), mSharesDecodedStreams(false), mDecoderErrorBlock(nullptr), mFormatMismatchBlock(nullptr), mErrorBlock(nullptr), mLoudnessAnalysisBlock(nullptr)
 {
 	memset(&mDecoderEventBlocks, 0, sizeof(mDecoderEventBlocks));
 	memset(&mRenderEventBlocks, 0, sizeof(mRenderEventBlocks));
 
+	ResetPerformanceStatistics();
+
+	for(auto& ticks : mStartupStageTicks)
+		ticks.store(0);
+
 	// ========================================
 	// Initialize the decoder array
 	for(UInt32 bufferIndex = 0; bufferIndex < kActiveDecoderArraySize; ++bufferIndex)
@@ -229,10 +439,13 @@ SFB::Audio::Player::Player()
 
 	// ========================================
 	// Setup the collector
-	mCollector = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_global_queue(QOS_CLASS_BACKGROUND, 0));
+	mCollector = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, TaskExecutor::GetSharedExecutor().GetQueue(TaskExecutor::TaskClass::Maintenance));
 	dispatch_source_set_timer(mCollector, DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC, 1 * NSEC_PER_SEC);
 
 	dispatch_source_set_event_handler(mCollector, ^{
+		// Decoder states may be inspected by CreateMemoryUsageDictionary() while this lock is held
+		std::lock_guard<std::mutex> lock(mCollectorMutex);
+
 		for(UInt32 bufferIndex = 0; bufferIndex < kActiveDecoderArraySize; ++bufferIndex) {
 			DecoderStateData *decoderState = mActiveDecoders[bufferIndex].load();
 
@@ -248,6 +461,11 @@ SFB::Audio::Player::Player()
 
 			if(swapSucceeded) {
 				LOGGER_DEBUG("org.sbooth.AudioEngine.Player", "Collecting decoder: \"" << decoderState->mDecoder->GetURL() << "\"");
+
+				// Loudness analysis results are only saved if the entire track was played
+				if(decoderState->mLoudnessAnalysis && decoderState->mFramesRendered.load() == decoderState->mTotalFrames)
+					decoderState->mLoudnessAnalysis->Finish();
+
 				delete decoderState;
 				decoderState = nullptr;
 			}
@@ -340,6 +558,11 @@ SFB::Audio::Player::~Player()
 		Block_release(mErrorBlock);
 		mErrorBlock = nullptr;
 	}
+
+	if(mLoudnessAnalysisBlock) {
+		Block_release(mLoudnessAnalysisBlock);
+		mLoudnessAnalysisBlock = nullptr;
+	}
 }
 
 #pragma mark Playback Control
@@ -523,6 +746,16 @@ void SFB::Audio::Player::SetUnsupportedFormatBlock(ErrorBlock block)
 		mErrorBlock = Block_copy(block);
 }
 
+void SFB::Audio::Player::SetLoudnessAnalysisFinishedBlock(LoudnessAnalysisBlock block)
+{
+	if(mLoudnessAnalysisBlock) {
+		Block_release(mLoudnessAnalysisBlock);
+		mLoudnessAnalysisBlock = nullptr;
+	}
+	if(block)
+		mLoudnessAnalysisBlock = Block_copy(block);
+}
+
 #pragma mark Playback Properties
 
 bool SFB::Audio::Player::GetCurrentFrame(SInt64& currentFrame) const
@@ -605,7 +838,7 @@ bool SFB::Audio::Player::GetPlaybackPositionAndTime(SInt64& currentFrame, SInt64
 
 #pragma mark Seeking
 
-bool SFB::Audio::Player::SeekForward(CFTimeInterval secondsToSkip)
+bool SFB::Audio::Player::SeekForward(CFTimeInterval secondsToSkip, Decoder::SeekMode mode)
 {
 	if(0 > secondsToSkip)
 		return false;
@@ -624,10 +857,10 @@ bool SFB::Audio::Player::SeekForward(CFTimeInterval secondsToSkip)
 	SInt64 desiredFrame		= currentFrame + frameCount;
 	SInt64 totalFrames		= currentDecoderState->mTotalFrames;
 
-	return SeekToFrame(std::min(desiredFrame, totalFrames - 1));
+	return SeekToFrame(std::min(desiredFrame, totalFrames - 1), mode);
 }
 
-bool SFB::Audio::Player::SeekBackward(CFTimeInterval secondsToSkip)
+bool SFB::Audio::Player::SeekBackward(CFTimeInterval secondsToSkip, Decoder::SeekMode mode)
 {
 	if(0 > secondsToSkip)
 		return false;
@@ -645,10 +878,10 @@ bool SFB::Audio::Player::SeekBackward(CFTimeInterval secondsToSkip)
 	SInt64 currentFrame		= (-1 == frameToSeek ? framesRendered : frameToSeek);
 	SInt64 desiredFrame		= currentFrame - frameCount;
 
-	return SeekToFrame(std::max(0LL, desiredFrame));
+	return SeekToFrame(std::max(0LL, desiredFrame), mode);
 }
 
-bool SFB::Audio::Player::SeekToTime(CFTimeInterval timeInSeconds)
+bool SFB::Audio::Player::SeekToTime(CFTimeInterval timeInSeconds, Decoder::SeekMode mode)
 {
 	if(0 > timeInSeconds)
 		return false;
@@ -661,10 +894,10 @@ bool SFB::Audio::Player::SeekToTime(CFTimeInterval timeInSeconds)
 	SInt64 desiredFrame		= (SInt64)(timeInSeconds * currentDecoderState->mDecoder->GetFormat().mSampleRate);
 	SInt64 totalFrames		= currentDecoderState->mTotalFrames;
 
-	return SeekToFrame(std::max(0LL, std::min(desiredFrame, totalFrames - 1)));
+	return SeekToFrame(std::max(0LL, std::min(desiredFrame, totalFrames - 1)), mode);
 }
 
-bool SFB::Audio::Player::SeekToPosition(float position)
+bool SFB::Audio::Player::SeekToPosition(float position, Decoder::SeekMode mode)
 {
 	if(0 > position || 1 < position)
 		return false;
@@ -677,10 +910,10 @@ bool SFB::Audio::Player::SeekToPosition(float position)
 	SInt64 totalFrames		= currentDecoderState->mTotalFrames;
 	SInt64 desiredFrame		= (SInt64)(position * totalFrames);
 
-	return SeekToFrame(std::max(0LL, std::min(desiredFrame, totalFrames - 1)));
+	return SeekToFrame(std::max(0LL, std::min(desiredFrame, totalFrames - 1)), mode);
 }
 
-bool SFB::Audio::Player::SeekToFrame(SInt64 frame)
+bool SFB::Audio::Player::SeekToFrame(SInt64 frame, Decoder::SeekMode mode)
 {
 	DecoderStateData *currentDecoderState = GetCurrentDecoderState();
 
@@ -693,8 +926,17 @@ bool SFB::Audio::Player::SeekToFrame(SInt64 frame)
 	if(0 > frame || frame >= currentDecoderState->mTotalFrames)
 		return false;
 
+	// Audio skipped by the seek can't be analyzed
+	if(currentDecoderState->mLoudnessAnalysis)
+		currentDecoderState->mLoudnessAnalysis->Invalidate();
+
+	// The mode must be visible before the frame because the decoding thread keys off mFrameToSeek
+	currentDecoderState->mSeekMode.store(mode);
 	currentDecoderState->mFrameToSeek.store(frame);
 
+	// The decoding thread may be waiting for a growing input to be appended to
+	currentDecoderState->mDecoder->GetInputSource().InterruptWaitForGrowth();
+
 	// Force a flush of the ring buffer to prevent audible seek artifacts
 	if(!mOutput->IsRunning())
 		mFlags.fetch_or(eAudioPlayerFlagRingBufferNeedsReset);
@@ -721,11 +963,29 @@ bool SFB::Audio::Player::Play(CFURLRef url)
 	if(nullptr == url)
 		return false;
 
-	auto decoder = Decoder::CreateForURL(url);
-	return Play(decoder);
+	auto startTicks = mach_absolute_time();
+
+	auto decoder = mSharesDecodedStreams.load() ? SharedStreamDecoder::CreateForURL(url) : Decoder::CreateForURL(url);
+	if(!decoder)
+		return false;
+
+	// The decoder was created before the trace was reset
+	auto decoderCreatedTicks = mach_absolute_time();
+
+	if(!StartPlayback(decoder, startTicks))
+		return false;
+
+	RecordStartupStage(eStartupStageDecoderCreated, decoderCreatedTicks);
+
+	return true;
 }
 
 bool SFB::Audio::Player::Play(Decoder::unique_ptr& decoder)
+{
+	return StartPlayback(decoder, mach_absolute_time());
+}
+
+bool SFB::Audio::Player::StartPlayback(Decoder::unique_ptr& decoder, uint64_t startTicks)
 {
 	if(!decoder)
 		return false;
@@ -736,6 +996,9 @@ bool SFB::Audio::Player::Play(Decoder::unique_ptr& decoder)
 	if(!Stop())
 		return false;
 
+	// Begin tracing once the previous decoders are stopped so they can't record milestones
+	ResetStartupTrace(startTicks);
+
 	if(!Enqueue(decoder))
 		return false;
 
@@ -747,12 +1010,35 @@ bool SFB::Audio::Player::Play(Decoder::unique_ptr& decoder)
 	return true;
 }
 
+bool SFB::Audio::Player::Splice(Decoder::unique_ptr& decoder)
+{
+	if(!decoder)
+		return false;
+
+	if(!mOutput->IsRunning() || nullptr == GetCurrentDecoderState())
+		return Play(decoder);
+
+	LOGGER_INFO("org.sbooth.AudioEngine.Player", "Splicing \"" << decoder->GetURL() << "\"");
+
+	// The decoding thread ends the current decoder when it sees the flag and then takes the head of the queue
+	// The flag is cleared whenever a decoder is taken from the queue, so a decoder that already finished isn't affected
+	dispatch_sync(mQueue, ^{
+		mDecoderQueue.clear();
+		mDecoderQueue.push_back(std::move(decoder));
+		mFlags.fetch_or(eAudioPlayerFlagSpliceDecoder);
+	});
+
+	mDecoderSemaphore.Signal();
+
+	return true;
+}
+
 bool SFB::Audio::Player::Enqueue(CFURLRef url)
 {
 	if(nullptr == url)
 		return false;
 
-	auto decoder = Decoder::CreateForURL(url);
+	auto decoder = mSharesDecodedStreams.load() ? SharedStreamDecoder::CreateForURL(url) : Decoder::CreateForURL(url);
 	return Enqueue(decoder);
 }
 
@@ -816,6 +1102,7 @@ bool SFB::Audio::Player::SkipToNextTrack()
 		mFlags.fetch_or(eAudioPlayerFlagMuteOutput);
 
 	currentDecoderState->mFlags.fetch_or(eDecoderStateDataFlagStopDecoding);
+	currentDecoderState->mDecoder->GetInputSource().InterruptWaitForGrowth();
 
 	// Signal the decoding thread that decoding should stop (inner loop)
 	mDecoderSemaphore.Signal();
@@ -867,6 +1154,393 @@ bool SFB::Audio::Player::SetRingBufferWriteChunkSize(uint32_t chunkSize)
 	return true;
 }
 
+#pragma mark Effects Processing
+
+bool SFB::Audio::Player::AddProcessor(Processor::shared_ptr processor)
+{
+	if(!processor)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mProcessorsMutex);
+
+	if(std::find(mProcessors.begin(), mProcessors.end(), processor) != mProcessors.end())
+		return false;
+
+	// Prepare the processor for the audio currently being decoded
+	if(0 != mProcessorFormat.mFormatID)
+		processor->Prepare(mProcessorFormat, mProcessorMaximumFrameCount);
+
+	if(LoadSheddingLevel::ReduceQuality <= GetLoadSheddingLevel())
+		processor->SetQualityReduced(true);
+
+	mProcessors.push_back(processor);
+	return true;
+}
+
+bool SFB::Audio::Player::RemoveProcessor(const Processor::shared_ptr& processor)
+{
+	std::lock_guard<std::mutex> lock(mProcessorsMutex);
+
+	auto iter = std::find(mProcessors.begin(), mProcessors.end(), processor);
+	if(iter == mProcessors.end())
+		return false;
+
+	mProcessors.erase(iter);
+	return true;
+}
+
+void SFB::Audio::Player::RemoveAllProcessors()
+{
+	std::lock_guard<std::mutex> lock(mProcessorsMutex);
+	mProcessors.clear();
+}
+
+void SFB::Audio::Player::PrepareProcessors(const AudioFormat& format, UInt32 maximumFrameCount)
+{
+	std::lock_guard<std::mutex> lock(mProcessorsMutex);
+
+	mProcessorFormat = format;
+	mProcessorMaximumFrameCount = maximumFrameCount;
+
+	for(auto& processor : mProcessors)
+		processor->Prepare(format, maximumFrameCount);
+}
+
+void SFB::Audio::Player::ProcessAudio(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	auto loadSheddingLevel = GetLoadSheddingLevel();
+	if(LoadSheddingLevel::BypassProcessors <= loadSheddingLevel)
+		return;
+
+	std::lock_guard<std::mutex> lock(mProcessorsMutex);
+
+	// The write chunk size may have grown since the processors were prepared
+	if(frameCount > mProcessorMaximumFrameCount) {
+		mProcessorMaximumFrameCount = frameCount;
+		for(auto& processor : mProcessors)
+			processor->Prepare(mProcessorFormat, frameCount);
+	}
+
+	for(auto& processor : mProcessors) {
+		if(LoadSheddingLevel::SkipAnalysis <= loadSheddingLevel && Processor::Role::Analysis == processor->GetRole())
+			continue;
+		processor->Process(bufferList, frameCount);
+	}
+}
+
+void SFB::Audio::Player::ResetProcessors()
+{
+	std::lock_guard<std::mutex> lock(mProcessorsMutex);
+
+	for(auto& processor : mProcessors)
+		processor->Reset();
+}
+
+#pragma mark Overload Protection
+
+void SFB::Audio::Player::SetOverloadProtectionEnabled(bool enabled)
+{
+	mOverloadProtectionEnabled.store(enabled);
+	if(!enabled)
+		SetLoadSheddingLevel(LoadSheddingLevel::None);
+}
+
+bool SFB::Audio::Player::SetOverloadThreshold(double threshold)
+{
+	if(0 >= threshold)
+		return false;
+
+	LOGGER_INFO("org.sbooth.AudioEngine.Player", "Setting overload threshold to " << threshold << " sec");
+
+	mOverloadThreshold.store(threshold);
+	return true;
+}
+
+void SFB::Audio::Player::UpdateLoadShedding(UInt32 framesDecoded, uint64_t ticks)
+{
+	// Decoding must stay this much faster than real time for the ring buffer to refill
+	const double kMinimumDecodingSpeed = 1.5;
+	const double kRestoreDecodingSpeed = 3;
+
+	// Give each change time to take effect, and restore more slowly than shedding to avoid oscillation
+	const double kShedInterval = 0.5;
+	const double kRestoreInterval = 5;
+
+	if(!mOverloadProtectionEnabled.load() || !mOutput->IsRunning() || 0 == framesDecoded || 0 == ticks)
+		return;
+
+	Float64 sampleRate = mOutput->GetFormat().mSampleRate;
+	if(0 >= sampleRate)
+		return;
+
+	mach_timebase_info_data_t timebaseInfo;
+	mach_timebase_info(&timebaseInfo);
+
+	// Smooth the speed so a single slow read, such as a network stall, doesn't cause shedding
+	double seconds = (double)(ticks * timebaseInfo.numer / timebaseInfo.denom) / NSEC_PER_SEC;
+	double speed = (framesDecoded / sampleRate) / seconds;
+	mDecodingSpeed = 0 == mDecodingSpeed ? speed : (0.8 * mDecodingSpeed) + (0.2 * speed);
+
+	double threshold = std::min(mOverloadThreshold.load(), (mRingBufferCapacity.load() / sampleRate) / 2);
+	double timeToUnderrun = mRingBuffer->GetFramesAvailableToRead() / sampleRate;
+
+	double secondsSinceChange = (double)((mach_absolute_time() - mLoadSheddingLevelChangedTicks.load()) * timebaseInfo.numer / timebaseInfo.denom) / NSEC_PER_SEC;
+
+	auto level = mLoadSheddingLevel.load();
+
+	if(timeToUnderrun < threshold && kMinimumDecodingSpeed > mDecodingSpeed && (unsigned int)LoadSheddingLevel::BypassProcessors > level && kShedInterval <= secondsSinceChange)
+		SetLoadSheddingLevel((LoadSheddingLevel)(level + 1));
+	else if(timeToUnderrun > 2 * threshold && kRestoreDecodingSpeed < mDecodingSpeed && (unsigned int)LoadSheddingLevel::None < level && kRestoreInterval <= secondsSinceChange)
+		SetLoadSheddingLevel((LoadSheddingLevel)(level - 1));
+}
+
+void SFB::Audio::Player::SetLoadSheddingLevel(LoadSheddingLevel level)
+{
+	auto previousLevel = (LoadSheddingLevel)mLoadSheddingLevel.exchange((unsigned int)level);
+	if(previousLevel == level)
+		return;
+
+	mLoadSheddingLevelChangedTicks.store(mach_absolute_time());
+
+	if(previousLevel < level)
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Player", "Overload: shedding work (level " << (unsigned int)level << ")");
+	else
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Player", "Headroom recovered: restoring work (level " << (unsigned int)level << ")");
+
+	bool reduceQuality = LoadSheddingLevel::ReduceQuality <= level;
+	if(reduceQuality != (LoadSheddingLevel::ReduceQuality <= previousLevel)) {
+		std::lock_guard<std::mutex> lock(mProcessorsMutex);
+		for(auto& processor : mProcessors)
+			processor->SetQualityReduced(reduceQuality);
+	}
+}
+
+#pragma mark Performance Statistics
+
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsDecodeKey			= CFSTR("decode");
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsConvertKey			= CFSTR("convert");
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsProcessKey			= CFSTR("process");
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsRingBufferWriteKey	= CFSTR("ringBufferWrite");
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsRenderReadKey		= CFSTR("renderRead");
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsFormatChangeKey		= CFSTR("formatChange");
+
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsInvocationsKey		= CFSTR("invocations");
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsFramesKey			= CFSTR("frames");
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsNanosecondsKey		= CFSTR("nanoseconds");
+const CFStringRef SFB::Audio::Player::kPerformanceStatisticsMaxNanosecondsKey	= CFSTR("maxNanoseconds");
+
+void SFB::Audio::Player::ResetPerformanceStatistics()
+{
+	for(auto& statistics : mPipelineStageStatistics) {
+		statistics.mInvocations.store(0);
+		statistics.mFrames.store(0);
+		statistics.mTicks.store(0);
+		statistics.mMaxTicks.store(0);
+	}
+}
+
+CFDictionaryRef SFB::Audio::Player::CreatePerformanceStatisticsDictionary() const
+{
+	mach_timebase_info_data_t timebaseInfo;
+	mach_timebase_info(&timebaseInfo);
+
+	const CFStringRef stageKeys [ePipelineStageCount] = {
+		kPerformanceStatisticsDecodeKey,
+		kPerformanceStatisticsConvertKey,
+		kPerformanceStatisticsProcessKey,
+		kPerformanceStatisticsRingBufferWriteKey,
+		kPerformanceStatisticsRenderReadKey,
+		kPerformanceStatisticsFormatChangeKey
+	};
+
+	CFMutableDictionaryRef dictionary = CFDictionaryCreateMutable(kCFAllocatorDefault, ePipelineStageCount, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+	for(unsigned int stage = 0; stage < ePipelineStageCount; ++stage) {
+		const auto& statistics = mPipelineStageStatistics[stage];
+
+		long long invocations = (long long)statistics.mInvocations.load(std::memory_order_relaxed);
+		long long frames = (long long)statistics.mFrames.load(std::memory_order_relaxed);
+		long long nanoseconds = (long long)(statistics.mTicks.load(std::memory_order_relaxed) * timebaseInfo.numer / timebaseInfo.denom);
+		long long maxNanoseconds = (long long)(statistics.mMaxTicks.load(std::memory_order_relaxed) * timebaseInfo.numer / timebaseInfo.denom);
+
+		CFMutableDictionary stageDictionary(4, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+		CFNumber number(kCFNumberLongLongType, &invocations);
+		CFDictionarySetValue(stageDictionary, kPerformanceStatisticsInvocationsKey, number);
+
+		number = CFNumberCreate(kCFAllocatorDefault, kCFNumberLongLongType, &frames);
+		CFDictionarySetValue(stageDictionary, kPerformanceStatisticsFramesKey, number);
+
+		number = CFNumberCreate(kCFAllocatorDefault, kCFNumberLongLongType, &nanoseconds);
+		CFDictionarySetValue(stageDictionary, kPerformanceStatisticsNanosecondsKey, number);
+
+		number = CFNumberCreate(kCFAllocatorDefault, kCFNumberLongLongType, &maxNanoseconds);
+		CFDictionarySetValue(stageDictionary, kPerformanceStatisticsMaxNanosecondsKey, number);
+
+		CFDictionarySetValue(dictionary, stageKeys[stage], stageDictionary);
+	}
+
+	return dictionary;
+}
+
+void SFB::Audio::Player::RecordPipelineStage(PipelineStage stage, uint64_t ticks, UInt32 frameCount)
+{
+	auto& statistics = mPipelineStageStatistics[stage];
+
+	statistics.mInvocations.fetch_add(1, std::memory_order_relaxed);
+	statistics.mFrames.fetch_add(frameCount, std::memory_order_relaxed);
+	statistics.mTicks.fetch_add(ticks, std::memory_order_relaxed);
+
+	auto maxTicks = statistics.mMaxTicks.load(std::memory_order_relaxed);
+	while(ticks > maxTicks && !statistics.mMaxTicks.compare_exchange_weak(maxTicks, ticks, std::memory_order_relaxed))
+		;
+}
+
+#pragma mark Startup Trace
+
+const CFStringRef SFB::Audio::Player::kStartupTraceDecoderCreatedKey		= CFSTR("decoderCreated");
+const CFStringRef SFB::Audio::Player::kStartupTraceInputSourceOpenedKey		= CFSTR("inputSourceOpened");
+const CFStringRef SFB::Audio::Player::kStartupTraceDecoderOpenedKey			= CFSTR("decoderOpened");
+const CFStringRef SFB::Audio::Player::kStartupTraceOutputConfiguredKey		= CFSTR("outputConfigured");
+const CFStringRef SFB::Audio::Player::kStartupTraceConverterCreatedKey		= CFSTR("converterCreated");
+const CFStringRef SFB::Audio::Player::kStartupTraceRingBufferWriteKey		= CFSTR("ringBufferWrite");
+const CFStringRef SFB::Audio::Player::kStartupTraceOutputStartedKey			= CFSTR("outputStarted");
+const CFStringRef SFB::Audio::Player::kStartupTraceFirstRenderKey			= CFSTR("firstRender");
+const CFStringRef SFB::Audio::Player::kStartupTraceFirstAudibleFrameKey		= CFSTR("firstAudibleFrame");
+
+CFDictionaryRef SFB::Audio::Player::CreateStartupTraceDictionary() const
+{
+	mach_timebase_info_data_t timebaseInfo;
+	mach_timebase_info(&timebaseInfo);
+
+	const CFStringRef stageKeys [eStartupStageCount] = {
+		kStartupTraceDecoderCreatedKey,
+		kStartupTraceInputSourceOpenedKey,
+		kStartupTraceDecoderOpenedKey,
+		kStartupTraceOutputConfiguredKey,
+		kStartupTraceConverterCreatedKey,
+		kStartupTraceRingBufferWriteKey,
+		kStartupTraceOutputStartedKey,
+		kStartupTraceFirstRenderKey,
+		kStartupTraceFirstAudibleFrameKey
+	};
+
+	CFMutableDictionaryRef dictionary = CFDictionaryCreateMutable(kCFAllocatorDefault, eStartupStageCount, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+	auto startTicks = mStartupTraceStartTicks.load(std::memory_order_acquire);
+	if(0 == startTicks)
+		return dictionary;
+
+	for(unsigned int stage = 0; stage < eStartupStageCount; ++stage) {
+		auto ticks = mStartupStageTicks[stage].load(std::memory_order_relaxed);
+		if(ticks < startTicks)
+			continue;
+
+		long long nanoseconds = (long long)((ticks - startTicks) * timebaseInfo.numer / timebaseInfo.denom);
+
+		CFNumber number(kCFNumberLongLongType, &nanoseconds);
+		CFDictionarySetValue(dictionary, stageKeys[stage], number);
+	}
+
+	return dictionary;
+}
+
+void SFB::Audio::Player::ResetStartupTrace(uint64_t startTicks)
+{
+	mStartupTraceStartTicks.store(0, std::memory_order_relaxed);
+
+	for(auto& ticks : mStartupStageTicks)
+		ticks.store(0, std::memory_order_relaxed);
+
+	mStartupTraceStartTicks.store(startTicks, std::memory_order_release);
+}
+
+void SFB::Audio::Player::RecordStartupStage(StartupStage stage, uint64_t ticks)
+{
+	if(0 == mStartupTraceStartTicks.load(std::memory_order_relaxed))
+		return;
+
+	// Only the first occurrence of each milestone is recorded
+	unsigned long long expected = 0;
+	mStartupStageTicks[stage].compare_exchange_strong(expected, ticks, std::memory_order_relaxed);
+}
+
+#pragma mark Memory Usage
+
+const CFStringRef SFB::Audio::Player::kMemoryUsageRingBufferKey				= CFSTR("ringBuffer");
+const CFStringRef SFB::Audio::Player::kMemoryUsageDecoderStateKey			= CFSTR("decoderState");
+const CFStringRef SFB::Audio::Player::kMemoryUsageDecodersKey				= CFSTR("decoders");
+const CFStringRef SFB::Audio::Player::kMemoryUsageActiveDecoderCountKey		= CFSTR("activeDecoderCount");
+const CFStringRef SFB::Audio::Player::kMemoryUsageQueuedDecoderCountKey		= CFSTR("queuedDecoderCount");
+const CFStringRef SFB::Audio::Player::kMemoryUsageDecoderStateInstancesKey	= CFSTR("decoderStateInstances");
+
+const CFStringRef SFB::Audio::Player::kMemoryUsageResidentKey				= CFSTR("resident");
+const CFStringRef SFB::Audio::Player::kMemoryUsagePhysicalFootprintKey		= CFSTR("physicalFootprint");
+const CFStringRef SFB::Audio::Player::kMemoryUsageMallocInUseKey			= CFSTR("mallocInUse");
+const CFStringRef SFB::Audio::Player::kMemoryUsageMallocReservedKey			= CFSTR("mallocReserved");
+
+CFDictionaryRef SFB::Audio::Player::CreateMemoryUsageDictionary() const
+{
+	__block long long ringBufferBytes = 0;
+	__block long long decoderBytes = 0;
+	__block long long queuedDecoderCount = 0;
+
+	// The ring buffer is only replaced and the queue only modified on mQueue
+	dispatch_sync(mQueue, ^{
+		ringBufferBytes = (long long)mRingBuffer->GetAllocatedByteCount();
+
+		for(const auto& decoder : mDecoderQueue)
+			decoderBytes += (long long)decoder->GetMemoryUsage();
+		queuedDecoderCount = (long long)mDecoderQueue.size();
+	});
+
+	// Decoder states that have finished rendering are awaiting collection so they are skipped,
+	// and the collector is locked out so none are deleted while being examined
+	long long decoderStateBytes = 0;
+	long long activeDecoderCount = 0;
+	std::unique_lock<std::mutex> collectorLock(mCollectorMutex);
+	for(UInt32 bufferIndex = 0; bufferIndex < kActiveDecoderArraySize; ++bufferIndex) {
+		DecoderStateData *decoderState = mActiveDecoders[bufferIndex].load();
+
+		if(nullptr == decoderState)
+			continue;
+
+		if(eDecoderStateDataFlagRenderingFinished & decoderState->mFlags.load())
+			continue;
+
+		decoderStateBytes += (long long)(sizeof(DecoderStateData) + decoderState->mBufferList.GetAllocatedByteCount());
+		decoderBytes += (long long)decoderState->mDecoder->GetMemoryUsage();
+		++activeDecoderCount;
+	}
+	collectorLock.unlock();
+
+	long long decoderStateInstances = DecoderStateData::sInstanceCount.load();
+
+	CFMutableDictionaryRef dictionary = CFDictionaryCreateMutable(kCFAllocatorDefault, 10, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+	auto setValue = [dictionary](CFStringRef key, long long value) {
+		CFNumber number(kCFNumberLongLongType, &value);
+		CFDictionarySetValue(dictionary, key, number);
+	};
+
+	setValue(kMemoryUsageRingBufferKey, ringBufferBytes);
+	setValue(kMemoryUsageDecoderStateKey, decoderStateBytes);
+	setValue(kMemoryUsageDecodersKey, decoderBytes);
+	setValue(kMemoryUsageActiveDecoderCountKey, activeDecoderCount);
+	setValue(kMemoryUsageQueuedDecoderCountKey, queuedDecoderCount);
+	setValue(kMemoryUsageDecoderStateInstancesKey, decoderStateInstances);
+
+	ProcessMemoryUsage usage;
+	if(GetProcessMemoryUsage(usage)) {
+		setValue(kMemoryUsageResidentKey, (long long)usage.mResidentBytes);
+		setValue(kMemoryUsagePhysicalFootprintKey, (long long)usage.mPhysicalFootprintBytes);
+		setValue(kMemoryUsageMallocInUseKey, (long long)usage.mMallocBytesInUse);
+		setValue(kMemoryUsageMallocReservedKey, (long long)usage.mMallocBytesReserved);
+	}
+
+	return dictionary;
+}
+
 #pragma mark Thread Entry Points
 
 void * SFB::Audio::Player::DecoderThreadEntry()
@@ -884,6 +1558,10 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 
 		__block DecoderStateData *decoderState = nullptr;
 
+		// State built ahead of a format change
+		AudioConverterRef preparedConverter = nullptr;
+		AudioFormat preparedConverterFormat;
+
 		// ========================================
 		// Lock the queue and remove the head element that contains the next decoder to use
 		__block Decoder::unique_ptr decoder;
@@ -893,13 +1571,25 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 				decoder = std::move(*iter);
 				mDecoderQueue.erase(iter);
 			}
+
+			// A spliced decoder is at the head of the queue, so taking it completes the splice
+			mFlags.fetch_and(~eAudioPlayerFlagSpliceDecoder);
 		});
 
 		// ========================================
 		// Open the decoder if necessary
 		if(decoder && !decoder->IsOpen()) {
+			decoder->SetPreferredSampleFormat(PreferredSampleFormatForOutputFormat(mOutput->GetFormat()));
+
+			// The input source is opened separately so its latency can be distinguished from the decoder's
 			SFB::CFError error;
-			if(!decoder->Open(&error))  {
+			bool opened = decoder->GetInputSource().IsOpen();
+			if(!opened && (opened = decoder->GetInputSource().Open(&error)))
+				RecordStartupStage(eStartupStageInputSourceOpened, mach_absolute_time());
+
+			if(opened && decoder->Open(&error))
+				RecordStartupStage(eStartupStageDecoderOpened, mach_absolute_time());
+			else {
 				if(mDecoderErrorBlock)
 					mDecoderErrorBlock(*decoder, error);
 
@@ -961,6 +1651,31 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 
 			// If the formats don't match, the decoder can't be used with the current ring buffer format
 			if(!formatsMatch) {
+				// While the current decoder's audio drains, build the ring buffer, converter, and effects
+				// state for the format the output will select so the gap between decoders is only the
+				// output reconfiguration and a ring buffer swap
+				RingBuffer::unique_ptr preparedRingBuffer;
+				AudioFormat preparedFormat;
+				if(mOutput->GetFormatForDecoder(*decoderState->mDecoder, preparedFormat)) {
+					preparedRingBuffer = RingBuffer::unique_ptr(new RingBuffer);
+					if(preparedRingBuffer->Allocate(preparedFormat, mRingBufferCapacity)) {
+						if(preparedFormat.IsPCM() || preparedFormat.IsDoP()) {
+							OSStatus result = CreateAudioConverter(decoderState->mDecoder->GetFormat(), preparedFormat, &preparedConverter);
+							if(noErr == result)
+								preparedConverterFormat = preparedFormat;
+							else {
+								LOGGER_INFO("org.sbooth.AudioEngine.Player", "AudioConverterNew failed: " << result);
+								preparedConverter = nullptr;
+							}
+						}
+
+						// Decoding for the current decoder has finished so the processors are idle
+						PrepareProcessors(preparedFormat, mRingBufferWriteChunkSize);
+					}
+					else
+						preparedRingBuffer.reset();
+				}
+
 				// Ensure output is muted before performing operations that aren't thread safe
 				if(mOutput->IsRunning()) {
 					mFlags.fetch_or(eAudioPlayerFlagFormatMismatch);
@@ -971,12 +1686,15 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 						mSemaphore.TimedWait(dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC / 100));
 				}
 
+				auto gapStartTicks = mach_absolute_time();
+
 				if(mFormatMismatchBlock)
 					mFormatMismatchBlock(outputFormat, nextFormat);
 
 				// Adjust the formats
+				auto preparedRingBufferPointer = &preparedRingBuffer;
 				dispatch_sync(mQueue, ^{
-					if(!SetupOutputAndRingBufferForDecoder(*decoderState->mDecoder)) {
+					if(!SetupOutputAndRingBufferForDecoder(*decoderState->mDecoder, preparedRingBufferPointer)) {
 						delete decoderState;
 						decoderState = nullptr;
 					}
@@ -984,9 +1702,25 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 
 				// Clear the mute flag that was set in the rendering thread so output will resume
 				mFlags.fetch_and(~eAudioPlayerFlagMuteOutput);
+
+				if(mCollectsPerformanceStatistics.load())
+					RecordPipelineStage(ePipelineStageFormatChange, mach_absolute_time() - gapStartTicks, 0);
+
+				// Release the ring buffer that was replaced, or the prepared one if it went unused
+				preparedRingBuffer.reset();
+
+				if(!decoderState && preparedConverter) {
+					AudioConverterDispose(preparedConverter);
+					preparedConverter = nullptr;
+				}
 			}
 		}
 
+		// ========================================
+		// Analyze the loudness of tracks played from the beginning
+		if(decoderState && mAnalyzesLoudness.load() && 0 == decoderState->mDecoder->GetCurrentFrame())
+			decoderState->mLoudnessAnalysis = LoudnessAnalysis::CreateForURL(decoderState->mDecoder->GetURL(), mOutput->GetFormat(), mLoudnessAnalysisBlock);
+
 		// ========================================
 		// Append the decoder state to the list of active decoders
 		if(decoderState) {
@@ -1016,21 +1750,27 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 			// ========================================
 			// Create the AudioConverter which will convert from the decoder's format to the output format (for PCM and DoP output)
 			AudioConverterRef audioConverter = nullptr;
+			UInt32 sampleRateConverterQuality = kAudioConverterQuality_High;
+			bool sampleRateConverterQualityReduced = false;
 			BufferList bufferList;
 			if(mOutput->GetFormat().IsPCM() || mOutput->GetFormat().IsDoP()) {
-				auto outputFormat = mOutput->GetFormat();
+				const auto& outputFormat = mOutput->GetFormat();
 
-				// DoP masquerades as PCM
-				bool decoderIsDoP = decoderFormat.IsDoP();
-				bool outputIsDoP = outputFormat.IsDoP();
-
-				if(decoderIsDoP)
-					decoderFormat.mFormatID = kAudioFormatLinearPCM;
+				// Use the converter built while the previous decoder drained if the output selected the expected format
+				OSStatus result = noErr;
+				if(preparedConverter && preparedConverterFormat == outputFormat) {
+					audioConverter = preparedConverter;
+					preparedConverter = nullptr;
+				}
+				else {
+					if(preparedConverter) {
+						AudioConverterDispose(preparedConverter);
+						preparedConverter = nullptr;
+					}
 
-				if(outputIsDoP)
-					outputFormat.mFormatID = kAudioFormatLinearPCM;
+					result = CreateAudioConverter(decoderFormat, outputFormat, &audioConverter);
+				}
 
-				OSStatus result = AudioConverterNew(&decoderFormat, &outputFormat, &audioConverter);
 				if(noErr != result) {
 					LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterNew failed: " << result);
 
@@ -1051,12 +1791,6 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 					continue;
 				}
 
-				if(decoderIsDoP)
-					decoderFormat.mFormatID = kAudioFormatDoP;
-
-				if(outputIsDoP)
-					outputFormat.mFormatID = kAudioFormatDoP;
-
 				// Handle channel mapping
 //				auto& decoderChannelLayout = decoderState->mDecoder->GetChannelLayout();
 //				if(decoderChannelLayout) {
@@ -1074,10 +1808,16 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 //						LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterSetProperty (kAudioConverterOutputChannelLayout) failed: " << result);
 //				}
 
+				// Save the sample rate converter quality so it can be restored after overload protection reduces it
+				UInt32 dataSize = sizeof(sampleRateConverterQuality);
+				result = AudioConverterGetProperty(audioConverter, kAudioConverterSampleRateConverterQuality, &dataSize, &sampleRateConverterQuality);
+				if(noErr != result)
+					LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterGetProperty (kAudioConverterSampleRateConverterQuality) failed: " << result);
+
 				// ========================================
 				// Allocate the buffer lists which will serve as the transport between the decoder and the ring buffer
 				UInt32 inputBufferSize = mRingBufferWriteChunkSize * mOutput->GetFormat().mBytesPerFrame;
-				UInt32 dataSize = sizeof(inputBufferSize);
+				dataSize = sizeof(inputBufferSize);
 				result = AudioConverterGetProperty(audioConverter, kAudioConverterPropertyCalculateInputBufferSize, &dataSize, &inputBufferSize);
 				if(noErr != result)
 					LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterGetProperty (kAudioConverterPropertyCalculateInputBufferSize) failed: " << result);
@@ -1092,6 +1832,23 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 				decoderState->AllocateBufferList(preferredSize ?: 512);
 			}
 
+			RecordStartupStage(eStartupStageConverterCreated, mach_absolute_time());
+
+			if(preparedConverter) {
+				AudioConverterDispose(preparedConverter);
+				preparedConverter = nullptr;
+			}
+
+			// Preparing discards the processors' history, which must carry across seamless joins in the same format
+			bool processorsPrepared;
+			{
+				std::lock_guard<std::mutex> lock(mProcessorsMutex);
+				processorsPrepared = mProcessorFormat == mOutput->GetFormat();
+			}
+
+			if(!processorsPrepared)
+				PrepareProcessors(mOutput->GetFormat(), mRingBufferWriteChunkSize);
+
 
 			// ========================================
 			// Decode the audio file in the ring buffer until finished or cancelled
@@ -1100,6 +1857,55 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 				// Fill the ring buffer with as much data as possible
 				for(;;) {
 
+					// The output's format no longer matches the device, so playback of this decoder can't continue
+					// Frame positions are counted at the decoder's sample rate, so the audio is not resampled to follow the device
+					if(eAudioPlayerFlagOutputSampleRateChanged & mFlags.load()) {
+						mFlags.fetch_and(~eAudioPlayerFlagOutputSampleRateChanged);
+
+						Float64 deviceSampleRate;
+						if(mOutput->GetDeviceSampleRate(deviceSampleRate) && deviceSampleRate != mOutput->GetFormat().mSampleRate) {
+							LOGGER_ERR("org.sbooth.AudioEngine.Player", "Output sample rate changed from " << mOutput->GetFormat().mSampleRate << " Hz to " << deviceSampleRate << " Hz");
+
+							if(mErrorBlock) {
+								SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” could not be played because the output device's sample rate changed."), ""));
+								SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Sample rate changed"), ""));
+								SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The file may be played again if its sample rate is supported by the output device."), ""));
+
+								SFB::CFError error(CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, decoderState->mDecoder->GetURL(), failureReason, recoverySuggestion));
+
+								mErrorBlock(error);
+							}
+
+							// Stopping discards the audio in the ring buffer and ends decoding for the active decoders
+							Stop();
+							break;
+						}
+					}
+
+					// End decoding where this decoder's audio ends in the ring buffer so the spliced decoder follows it
+					if(eAudioPlayerFlagSpliceDecoder & mFlags.load()) {
+						mFlags.fetch_and(~eAudioPlayerFlagSpliceDecoder);
+
+						SInt64 currentFrame = decoderState->mDecoder->GetCurrentFrame();
+						if(-1 != currentFrame) {
+							LOGGER_INFO("org.sbooth.AudioEngine.Player", "Decoding spliced for \"" << decoderState->mDecoder->GetURL() << "\" at frame " << currentFrame);
+
+							// Rendering of this decoder finishes when the frames already written have been rendered
+							decoderState->mTotalFrames = currentFrame;
+
+							// Call the decoding finished block
+							if(mDecoderEventBlocks[1])
+								mDecoderEventBlocks[1](*decoderState->mDecoder);
+
+							decoderState->mFlags.fetch_or(eDecoderStateDataFlagDecodingFinished);
+							decoderState = nullptr;
+
+							break;
+						}
+						else
+							LOGGER_ERR("org.sbooth.AudioEngine.Player", "Unable to determine frame for splice");
+					}
+
 					// Reset the ring buffer if required
 					if(eAudioPlayerFlagRingBufferNeedsReset & mFlags.load()) {
 
@@ -1123,6 +1929,8 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 								LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterReset failed: " << result);
 						}
 
+						ResetProcessors();
+
 						// Reset() is not thread safe but the rendering thread is outputting silence
 						mRingBuffer->Reset();
 
@@ -1153,9 +1961,11 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 							else
 								mFlags.fetch_or(eAudioPlayerFlagMuteOutput);
 
-							SInt64 newFrame = decoderState->mDecoder->SeekToFrame(frameToSeek);
+							auto seekMode = decoderState->mSeekMode.load();
+							SInt64 newFrame = decoderState->mDecoder->SeekToFrame(frameToSeek, seekMode);
 
-							if(newFrame != frameToSeek)
+							// Inexact seek modes are expected to miss the requested frame
+							if(newFrame != frameToSeek && Decoder::SeekMode::Exact == seekMode)
 								LOGGER_NOTICE("org.sbooth.AudioEngine.Player", "Inaccurate seek to frame  " << frameToSeek << ", got frame " << newFrame);
 
 							// Update the seek request
@@ -1174,6 +1984,8 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 										LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterReset failed: " << result);
 								}
 
+								ResetProcessors();
+
 								// Reset the ring buffer and output
 								mRingBuffer->Reset();
 								mOutput->Reset();
@@ -1201,6 +2013,13 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 						// Read the input chunk, converting from the decoder's format to the AUGraph's format
 						UInt32 framesDecoded = mRingBufferWriteChunkSize;
 
+						auto chunkStartTicks = mach_absolute_time();
+
+						bool collectStatistics = mCollectsPerformanceStatistics.load();
+						auto startTicks = collectStatistics ? mach_absolute_time() : 0;
+						decoderState->mReadTicks = 0;
+						decoderState->mReadFrames = 0;
+
 						if(audioConverter) {
 							auto result = AudioConverterFillComplexBuffer(audioConverter, myAudioConverterComplexInputDataProc, decoderState, &framesDecoded, bufferList, nullptr);
 							if(noErr != result)
@@ -1224,13 +2043,79 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 							}
 						}
 
+						if(collectStatistics) {
+							RecordPipelineStage(ePipelineStageDecode, decoderState->mReadTicks, (UInt32)decoderState->mReadFrames);
+							RecordPipelineStage(ePipelineStageConvert, mach_absolute_time() - startTicks - decoderState->mReadTicks, framesDecoded);
+						}
+
 						// Store the decoded audio
 						if(0 != framesDecoded) {
-							UInt32 framesWritten = (UInt32)mRingBuffer->WriteAudio(audioConverter ? bufferList : decoderState->mBufferList, framesDecoded);
+							AudioBufferList *decodedAudio = audioConverter ? bufferList : decoderState->mBufferList;
+
+							// Loudness is analyzed before the effects chain alters the audio
+							// Analysis is the first work shed under load and can't resume after a gap
+							if(decoderState->mLoudnessAnalysis) {
+								if(LoadSheddingLevel::SkipAnalysis <= GetLoadSheddingLevel())
+									decoderState->mLoudnessAnalysis->Invalidate();
+								else
+									decoderState->mLoudnessAnalysis->AnalyzeAudio(decodedAudio, framesDecoded);
+							}
+
+							// Run the effects chain
+							startTicks = collectStatistics ? mach_absolute_time() : 0;
+
+							ProcessAudio(decodedAudio, framesDecoded);
+
+							if(collectStatistics)
+								RecordPipelineStage(ePipelineStageProcess, mach_absolute_time() - startTicks, framesDecoded);
+
+							startTicks = collectStatistics ? mach_absolute_time() : 0;
+
+							UInt32 framesWritten = (UInt32)mRingBuffer->WriteAudio(decodedAudio, framesDecoded);
 							if(framesWritten != framesDecoded)
 								LOGGER_ERR("org.sbooth.AudioEngine.Player", "RingBuffer::Store failed");
 
+							if(collectStatistics)
+								RecordPipelineStage(ePipelineStageRingBufferWrite, mach_absolute_time() - startTicks, framesWritten);
+
+							if(framesWritten)
+								RecordStartupStage(eStartupStageRingBufferWrite, mach_absolute_time());
+
 							mFramesDecoded.fetch_add(framesWritten);
+
+							// The total frames of an input that is still being written increase as it grows
+							if(decoderState->mDecoder->GetInputSource().IsGrowing())
+								decoderState->mTotalFrames = std::max(decoderState->mDecoder->GetTotalFrames(), decoderState->mDecoder->GetCurrentFrame());
+
+							UpdateLoadShedding(framesWritten, mach_absolute_time() - chunkStartTicks);
+
+							// Trade sample rate conversion quality for speed while overloaded
+							// The converter is reset after changing quality since its filter state belongs to the previous
+							// quality; this discards the few frames it holds, a brief glitch at a moment output is already at risk
+							bool reduceQuality = LoadSheddingLevel::ReduceQuality <= GetLoadSheddingLevel();
+							if(audioConverter && reduceQuality != sampleRateConverterQualityReduced) {
+								UInt32 quality = reduceQuality ? kAudioConverterQuality_Min : sampleRateConverterQuality;
+								auto result = AudioConverterSetProperty(audioConverter, kAudioConverterSampleRateConverterQuality, sizeof(quality), &quality);
+								if(noErr != result)
+									LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterSetProperty (kAudioConverterSampleRateConverterQuality) failed: " << result);
+								else {
+									result = AudioConverterReset(audioConverter);
+									if(noErr != result)
+										LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterReset failed: " << result);
+								}
+								sampleRateConverterQualityReduced = reduceQuality;
+							}
+						}
+
+						// A growing input returns no frames without ending when a wait for more data is interrupted
+						if(0 == framesDecoded && decoderState->mDecoder->GetInputSource().IsGrowing()) {
+							// The converter treats an empty read as the end of its input
+							if(audioConverter) {
+								auto result = AudioConverterReset(audioConverter);
+								if(noErr != result)
+									LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterReset failed: " << result);
+							}
+							break;
 						}
 
 						// If no frames were returned, this is the end of stream
@@ -1268,6 +2153,8 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 						dispatch_sync(mQueue, ^{
 							if(!mOutput->Start())
 								LOGGER_ERR("org.sbooth.AudioEngine.Player", "Unable to start output");
+							else
+								RecordStartupStage(eStartupStageOutputStarted, mach_absolute_time());
 						});
 					}
 				}
@@ -1362,6 +2249,7 @@ void SFB::Audio::Player::StopActiveDecoders()
 			continue;
 
 		decoderState->mFlags.fetch_or(eDecoderStateDataFlagStopDecoding);
+		decoderState->mDecoder->GetInputSource().InterruptWaitForGrowth();
 	}
 
 	mDecoderSemaphore.Signal();
@@ -1376,18 +2264,30 @@ void SFB::Audio::Player::StopActiveDecoders()
 	}
 }
 
-bool SFB::Audio::Player::SetupOutputAndRingBufferForDecoder(Decoder& decoder)
+bool SFB::Audio::Player::SetupOutputAndRingBufferForDecoder(Decoder& decoder, RingBuffer::unique_ptr *preparedRingBuffer)
 {
-	// Open the decoder if necessary
+	// Open the decoder if necessary, asking for samples in the output's format
+	if(!decoder.IsOpen())
+		decoder.SetPreferredSampleFormat(PreferredSampleFormatForOutputFormat(mOutput->GetFormat()));
+
+	// The input source is opened separately so its latency can be distinguished from the decoder's
 	SFB::CFError error;
-	if(!decoder.IsOpen() && !decoder.Open(&error)) {
-		if(mDecoderErrorBlock)
-			mDecoderErrorBlock(decoder, error);
+	if(!decoder.IsOpen()) {
+		bool opened = decoder.GetInputSource().IsOpen();
+		if(!opened && (opened = decoder.GetInputSource().Open(&error)))
+			RecordStartupStage(eStartupStageInputSourceOpened, mach_absolute_time());
 
-		if(error)
-			LOGGER_ERR("org.sbooth.AudioEngine.Player", "Error opening decoder: " << error);
+		if(!opened || !decoder.Open(&error)) {
+			if(mDecoderErrorBlock)
+				mDecoderErrorBlock(decoder, error);
 
-		return false;
+			if(error)
+				LOGGER_ERR("org.sbooth.AudioEngine.Player", "Error opening decoder: " << error);
+
+			return false;
+		}
+
+		RecordStartupStage(eStartupStageDecoderOpened, mach_absolute_time());
 	}
 
 	if(!mOutput->SupportsFormat(decoder.GetFormat())) {
@@ -1410,12 +2310,16 @@ bool SFB::Audio::Player::SetupOutputAndRingBufferForDecoder(Decoder& decoder)
 	if(!mOutput->SetupForDecoder(decoder))
 		return false;
 
-	// Allocate enough space in the ring buffer for the new format
-	if(!mRingBuffer->Allocate(mOutput->GetFormat(), mRingBufferCapacity)) {
+	// Swap in the prepared ring buffer if it matches the new format, otherwise allocate enough space in the ring buffer for the new format
+	if(preparedRingBuffer && *preparedRingBuffer && (*preparedRingBuffer)->GetFormat() == mOutput->GetFormat() && (*preparedRingBuffer)->GetCapacityFrames() == mRingBufferCapacity)
+		mRingBuffer.swap(*preparedRingBuffer);
+	else if(!mRingBuffer->Allocate(mOutput->GetFormat(), mRingBufferCapacity)) {
 		LOGGER_ERR("org.sbooth.AudioEngine.Player", "Unable to allocate ring buffer");
 		return false;
 	}
 
+	RecordStartupStage(eStartupStageOutputConfigured, mach_absolute_time());
+
 	return true;
 }
 
@@ -1446,6 +2350,12 @@ bool SFB::Audio::Player::SetOutput(Output::unique_ptr output)
 	return true;
 }
 
+void SFB::Audio::Player::OutputSampleRateChanged()
+{
+	mFlags.fetch_or(eAudioPlayerFlagOutputSampleRateChanged);
+	mDecoderSemaphore.Signal();
+}
+
 bool SFB::Audio::Player::ProvideAudio(AudioBufferList *bufferList, UInt32 frameCount)
 {
 	// ========================================
@@ -1466,11 +2376,14 @@ bool SFB::Audio::Player::ProvideAudio(AudioBufferList *bufferList, UInt32 frameC
 
 	// ========================================
 	// Rendering
-	size_t framesAvailableToRead = mRingBuffer->GetFramesAvailableToRead();
+
+	// The ring buffer may be replaced while output is muted, so don't touch it
+	bool muted = eAudioPlayerFlagMuteOutput & mFlags.load();
+	size_t framesAvailableToRead = muted ? 0 : mRingBuffer->GetFramesAvailableToRead();
 
 	// Output silence if muted or the ring buffer is empty
 	auto outputFormat = mOutput->GetFormat();
-	if(eAudioPlayerFlagMuteOutput & mFlags.load() || 0 == framesAvailableToRead) {
+	if(0 == framesAvailableToRead) {
 		size_t byteCountToZero = outputFormat.FrameCountToByteCount(frameCount);
 		for(UInt32 bufferIndex = 0; bufferIndex < bufferList->mNumberBuffers; ++bufferIndex) {
 			memset(bufferList->mBuffers[bufferIndex].mData, outputFormat.IsDSD() ? 0xF : 0, byteCountToZero);
@@ -1482,7 +2395,15 @@ bool SFB::Audio::Player::ProvideAudio(AudioBufferList *bufferList, UInt32 frameC
 
 	// Restrict reads to valid decoded audio
 	size_t framesToRead = std::min((UInt32)framesAvailableToRead, frameCount);
+
+	bool collectStatistics = mCollectsPerformanceStatistics.load();
+	auto startTicks = collectStatistics ? mach_absolute_time() : 0;
+
 	UInt32 framesRead = (UInt32)mRingBuffer->ReadAudio(bufferList, framesToRead);
+
+	if(collectStatistics)
+		RecordPipelineStage(ePipelineStageRenderRead, mach_absolute_time() - startTicks, framesRead);
+
 	if(framesRead != framesToRead) {
 		LOGGER_ERR("org.sbooth.AudioEngine.Player", "RingBuffer::ReadAudio failed: Requested " << framesToRead << " frames, got " << framesRead);
 		return false;
@@ -1490,6 +2411,15 @@ bool SFB::Audio::Player::ProvideAudio(AudioBufferList *bufferList, UInt32 frameC
 
 	mFramesRendered.fetch_add(framesRead);
 
+	if(IsStartupStagePending(eStartupStageFirstAudibleFrame)) {
+		auto ticks = mach_absolute_time();
+		RecordStartupStage(eStartupStageFirstRender, ticks);
+
+		// DSD has no digital silence that can be detected reliably
+		if(outputFormat.IsDSD() || outputFormat.IsDoP() || ContainsNonZeroBytes(bufferList, outputFormat.FrameCountToByteCount(framesRead)))
+			RecordStartupStage(eStartupStageFirstAudibleFrame, ticks);
+	}
+
 	// If the ring buffer didn't contain as many frames as were requested, fill the remainder with silence
 	if(framesRead != frameCount) {
 		LOGGER_WARNING("org.sbooth.AudioEngine.Player", "Insufficient audio in ring buffer: " << framesRead << " frames available, " << frameCount << " requested");
@@ -9,6 +9,7 @@
 
 #include <memory>
 #include <atomic>
+#include <mutex>
 #include <thread>
 #include <vector>
 #include <utility>
@@ -19,6 +20,7 @@
 #include "AudioDecoder.h"
 #include "AudioRingBuffer.h"
 #include "AudioChannelLayout.h"
+#include "AudioProcessor.h"
 #include "Semaphore.h"
 
 /*! @file AudioPlayer.h @brief Audio playback functionality */
@@ -106,6 +108,15 @@ namespace SFB {
 			 */
 			using ErrorBlock = void (^)(CFErrorRef error);
 
+			/*!
+			 * @brief A block called with the results of loudness analysis of a track
+			 * @param url The URL of the track
+			 * @param referenceLoudness The replay gain reference loudness, in dB SPL
+			 * @param trackGain The track gain, in dB
+			 * @param trackPeak The track peak, from \c 0 to \c 1
+			 */
+			using LoudnessAnalysisBlock = void (^)(CFURLRef url, float referenceLoudness, float trackGain, float trackPeak);
+
 			//@}
 
 
@@ -328,23 +339,25 @@ namespace SFB {
 			/*!
 			 * @name Seeking
 			 * The \c Seek() methods return \c true on success, \c false otherwise.
+			 * Use \c Decoder::SeekMode::Fast or \c Decoder::SeekMode::Approximate for scrubbing and previews
+			 * where landing exactly on the requested frame is less important than responsiveness.
 			 */
 			//@{
 
 			/*! @brief Seek forward in the active \c Decoder by the specified number of seconds */
-			bool SeekForward(CFTimeInterval secondsToSkip = 3);
+			bool SeekForward(CFTimeInterval secondsToSkip = 3, Decoder::SeekMode mode = Decoder::SeekMode::Exact);
 
 			/*! @brief Seek backward in the active \c Decoder by the specified number of seconds */
-			bool SeekBackward(CFTimeInterval secondsToSkip = 3);
+			bool SeekBackward(CFTimeInterval secondsToSkip = 3, Decoder::SeekMode mode = Decoder::SeekMode::Exact);
 
 			/*! @brief Seek to the specified time in the active \c Decoder */
-			bool SeekToTime(CFTimeInterval timeInSeconds);
+			bool SeekToTime(CFTimeInterval timeInSeconds, Decoder::SeekMode mode = Decoder::SeekMode::Exact);
 
 			/*! @brief Seek to the specified position in the active \c Decoder */
-			bool SeekToPosition(float position);
+			bool SeekToPosition(float position, Decoder::SeekMode mode = Decoder::SeekMode::Exact);
 
 			/*! @brief Seek to the specified frame in the active \c Decoder */
-			bool SeekToFrame(SInt64 frame);
+			bool SeekToFrame(SInt64 frame, Decoder::SeekMode mode = Decoder::SeekMode::Exact);
 
 			/*! @brief Determine whether the active \c Decoder supports seeking */
 			bool SupportsSeeking() const;
@@ -373,6 +386,20 @@ namespace SFB {
 			 */
 			bool Play(Decoder::unique_ptr& decoder);
 
+			/*!
+			 * @brief Continue playback with a \c Decoder after the audio already buffered
+			 *
+			 * Decoding of the current decoder ends and the decoder's audio is written to the ring buffer
+			 * immediately after it, without stopping output or discarding buffered audio.  If the
+			 * formats match the join is seamless; otherwise the output is reconfigured as for any
+			 * other change in format.  If the player is not playing this is equivalent to \c Play().
+			 * @note This will clear any enqueued decoders
+			 * @note The player will take ownership of the decoder on success and may take ownership on failure
+			 * @param decoder The \c Decoder to play
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool Splice(Decoder::unique_ptr& decoder);
+
 
 			/*!
 			 * @brief Enqueue a URL for playback
@@ -403,6 +430,22 @@ namespace SFB {
 			 */
 			bool ClearQueuedDecoders();
 
+
+			/*!
+			 * @brief Query whether URLs passed to \c Play() and \c Enqueue() share decoded audio with other players
+			 * @see SharedStreamDecoder
+			 */
+			inline bool SharesDecodedStreams() const					{ return mSharesDecodedStreams.load(); }
+
+			/*!
+			 * @brief Set whether URLs passed to \c Play() and \c Enqueue() share decoded audio with other players
+			 *
+			 * When enabled a URL already being decoded for another player is read from the same
+			 * decoded stream instead of being decoded again.
+			 * @see SharedStreamDecoder
+			 */
+			inline void SetSharesDecodedStreams(bool flag)				{ mSharesDecodedStreams.store(flag); }
+
 			//@}
 
 
@@ -457,6 +500,236 @@ namespace SFB {
 			//@}
 
 
+			// ========================================
+			/*!
+			 * @name Effects Processing
+			 * Processors run in order on the decoding thread, after audio is converted to the output
+			 * format and before it is written to the ring buffer.  Because the ring buffer holds
+			 * decoded audio well ahead of rendering, processing is not bound by the output's render
+			 * deadline and is independent of the output in use.  Processors receive blocks of up to
+			 * the ring buffer write chunk size; larger chunks reduce per-block overhead at the cost
+			 * of slower response to parameter changes.
+			 */
+			//@{
+
+			/*!
+			 * @brief Append a processor to the effects chain
+			 * @param processor The processor to add
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool AddProcessor(Processor::shared_ptr processor);
+
+			/*!
+			 * @brief Remove a processor from the effects chain
+			 * @param processor The processor to remove
+			 * @return \c true on success, \c false if \c processor is not in the chain
+			 */
+			bool RemoveProcessor(const Processor::shared_ptr& processor);
+
+			/*! @brief Remove all processors from the effects chain */
+			void RemoveAllProcessors();
+
+			//@}
+
+
+			// ========================================
+			/*!
+			 * @name Overload Protection
+			 * When the host cannot decode and process audio as fast as it is rendered the ring buffer
+			 * drains and output underruns.  With overload protection enabled the player monitors the
+			 * time remaining until the ring buffer empties and the speed of decoding relative to real
+			 * time, and when an underrun is imminent sheds optional work one level at a time.  Full
+			 * quality is restored one level at a time once headroom recovers.
+			 */
+			//@{
+
+			/*! @brief Levels of work shed to prevent underruns, in the order they are applied */
+			enum class LoadSheddingLevel : unsigned int {
+				None				= 0,	/*!< All work is performed at full quality */
+				SkipAnalysis		= 1,	/*!< Analysis processors are skipped */
+				ReduceQuality		= 2,	/*!< Sample rate conversion and processors use reduced quality */
+				BypassProcessors	= 3		/*!< All processors are bypassed */
+			};
+
+			/*! @brief Query whether overload protection is enabled */
+			inline bool IsOverloadProtectionEnabled() const				{ return mOverloadProtectionEnabled.load(); }
+
+			/*!
+			 * @brief Set whether overload protection is enabled
+			 * @note Disabling overload protection immediately restores full quality
+			 */
+			void SetOverloadProtectionEnabled(bool enabled);
+
+			/*! @brief Get the time remaining until the ring buffer empties, in seconds, below which work is shed */
+			inline double GetOverloadThreshold() const					{ return mOverloadThreshold.load(); }
+
+			/*!
+			 * @brief Set the time remaining until the ring buffer empties, in seconds, below which work is shed
+			 * @note The threshold is limited to half the ring buffer's duration
+			 * @param threshold The threshold in seconds
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool SetOverloadThreshold(double threshold);
+
+			/*! @brief Get the current load shedding level */
+			inline LoadSheddingLevel GetLoadSheddingLevel() const		{ return (LoadSheddingLevel)mLoadSheddingLevel.load(); }
+
+			//@}
+
+
+			// ========================================
+			/*!
+			 * @name Loudness Analysis
+			 * When enabled, tracks are analyzed on a background worker as they play.  If a track plays
+			 * from beginning to end without seeking, its track gain and peak are passed to the block
+			 * set with \c SetLoudnessAnalysisFinishedBlock(), which may for example save them to the
+			 * track's metadata.  Tracks that already have replay gain information may be skipped by
+			 * disabling analysis before they are enqueued.
+			 *
+			 * The decoded audio is analyzed after conversion to the output format and before the
+			 * effects chain, so analysis is only performed for mono or stereo 32-bit float output at
+			 * a sample rate supported by \c ReplayGainAnalyzer.  Analysis of a track is abandoned if
+			 * overload protection skips analysis.
+			 */
+			//@{
+
+			/*! @brief Query whether tracks without replay gain information are analyzed during playback */
+			inline bool AnalyzesLoudness() const						{ return mAnalyzesLoudness.load(); }
+
+			/*!
+			 * @brief Set whether tracks without replay gain information are analyzed during playback
+			 * @note The setting takes effect for decoders that start decoding after it is changed
+			 */
+			inline void SetAnalyzesLoudness(bool flag)					{ mAnalyzesLoudness.store(flag); }
+
+			/*!
+			 * @brief Set the block to be invoked when loudness analysis of a track finishes
+			 * @note The block is invoked from a background worker
+			 * @note The setting takes effect for decoders that start decoding after it is changed
+			 * @param block The block to invoke with the analysis results
+			 */
+			void SetLoudnessAnalysisFinishedBlock(LoudnessAnalysisBlock block);
+
+			//@}
+
+
+			// ========================================
+			/*!
+			 * @name Performance Statistics
+			 * When enabled, the player measures the time spent in each stage of the audio pipeline
+			 * so changes to decoders, converters, and the ring buffer can be evaluated in place.
+			 * Statistics are collected using lock-free counters and are safe to enable during playback.
+			 *
+			 * Only elapsed host time is measured.  Hardware performance counters such as instructions
+			 * retired, cache misses, and branch misses are not collected, so time spent preempted or
+			 * blocked is included and a profiler is needed to attribute costs to the hardware.
+			 */
+			//@{
+
+			static const CFStringRef kPerformanceStatisticsDecodeKey;			/*!< @brief Reading audio from the decoder */
+			static const CFStringRef kPerformanceStatisticsConvertKey;			/*!< @brief Converting decoded audio to the output format, excluding decoding */
+			static const CFStringRef kPerformanceStatisticsProcessKey;			/*!< @brief Running the effects chain */
+			static const CFStringRef kPerformanceStatisticsRingBufferWriteKey;	/*!< @brief Writing converted audio to the ring buffer */
+			static const CFStringRef kPerformanceStatisticsRenderReadKey;		/*!< @brief Reading audio from the ring buffer on the render thread */
+			static const CFStringRef kPerformanceStatisticsFormatChangeKey;		/*!< @brief Reconfiguring the output and ring buffer between decoders with different formats */
+
+			static const CFStringRef kPerformanceStatisticsInvocationsKey;		/*!< @brief The number of times the stage was performed (\c CFNumber) */
+			static const CFStringRef kPerformanceStatisticsFramesKey;			/*!< @brief The number of frames processed by the stage (\c CFNumber) */
+			static const CFStringRef kPerformanceStatisticsNanosecondsKey;		/*!< @brief The total elapsed host time spent in the stage, in nanoseconds (\c CFNumber) */
+			static const CFStringRef kPerformanceStatisticsMaxNanosecondsKey;	/*!< @brief The longest elapsed host time of a single invocation of the stage, in nanoseconds (\c CFNumber) */
+
+			/*! @brief Query whether performance statistics are collected */
+			inline bool CollectsPerformanceStatistics() const			{ return mCollectsPerformanceStatistics.load(); }
+
+			/*! @brief Set whether performance statistics are collected */
+			inline void SetCollectsPerformanceStatistics(bool flag)	{ mCollectsPerformanceStatistics.store(flag); }
+
+			/*! @brief Reset the collected performance statistics to zero */
+			void ResetPerformanceStatistics();
+
+			/*!
+			 * @brief Create a dictionary containing the collected performance statistics
+			 *
+			 * The dictionary is keyed by pipeline stage and each value is a dictionary keyed by
+			 * \c kPerformanceStatisticsInvocationsKey and friends.  The result contains only property
+			 * list types and may be serialized directly to JSON for benchmark reports.
+			 * @note The returned dictionary must be released by the caller
+			 * @return A dictionary containing the collected performance statistics
+			 */
+			CFDictionaryRef CreatePerformanceStatisticsDictionary() const;
+
+			//@}
+
+
+			// ========================================
+			/*!
+			 * @name Startup Trace
+			 * Each call to \c Play() records when playback reaches the milestones between the request
+			 * and the first audible frame at the output, so start latency can be attributed to the
+			 * stage responsible for it.  The trace is always recorded and costs a few atomic operations
+			 * per milestone.
+			 */
+			//@{
+
+			static const CFStringRef kStartupTraceDecoderCreatedKey;			/*!< @brief The decoder was created and its type determined */
+			static const CFStringRef kStartupTraceInputSourceOpenedKey;			/*!< @brief The decoder's input source was opened */
+			static const CFStringRef kStartupTraceDecoderOpenedKey;				/*!< @brief The decoder was opened and its format determined */
+			static const CFStringRef kStartupTraceOutputConfiguredKey;			/*!< @brief The output was configured and the ring buffer allocated */
+			static const CFStringRef kStartupTraceConverterCreatedKey;			/*!< @brief The converter to the output format was created */
+			static const CFStringRef kStartupTraceRingBufferWriteKey;			/*!< @brief The first chunk of audio was written to the ring buffer */
+			static const CFStringRef kStartupTraceOutputStartedKey;				/*!< @brief The output was started */
+			static const CFStringRef kStartupTraceFirstRenderKey;				/*!< @brief Decoded audio was first read on the render thread */
+			static const CFStringRef kStartupTraceFirstAudibleFrameKey;			/*!< @brief A render cycle first contained a non-silent frame */
+
+			/*!
+			 * @brief Create a dictionary containing the startup trace for the most recent call to \c Play()
+			 *
+			 * The dictionary is keyed by milestone and each value is a \c CFNumber containing the
+			 * nanoseconds elapsed between the call to \c Play() and the milestone.  Milestones that
+			 * have not been reached are omitted.  Milestones recorded on the caller's thread appear
+			 * only if \c Play() was passed a URL or an unopened decoder.
+			 * @note The returned dictionary must be released by the caller
+			 * @return A dictionary containing the startup trace
+			 */
+			CFDictionaryRef CreateStartupTraceDictionary() const;
+
+			//@}
+
+
+			// ========================================
+			/*!
+			 * @name Memory Usage
+			 * Long-running players can be monitored for memory growth by periodically sampling the
+			 * memory held by each part of the pipeline together with the process totals.
+			 */
+			//@{
+
+			static const CFStringRef kMemoryUsageRingBufferKey;				/*!< @brief Bytes allocated by the ring buffer */
+			static const CFStringRef kMemoryUsageDecoderStateKey;			/*!< @brief Bytes allocated for the active decoders' read buffers */
+			static const CFStringRef kMemoryUsageDecodersKey;				/*!< @brief Bytes reported by the active and queued decoders using \c Decoder::GetMemoryUsage() */
+			static const CFStringRef kMemoryUsageActiveDecoderCountKey;		/*!< @brief The number of active decoders */
+			static const CFStringRef kMemoryUsageQueuedDecoderCountKey;		/*!< @brief The number of queued decoders */
+			static const CFStringRef kMemoryUsageDecoderStateInstancesKey;	/*!< @brief The number of decoder states alive in the process, including those awaiting collection */
+
+			static const CFStringRef kMemoryUsageResidentKey;				/*!< @brief The process's resident set size */
+			static const CFStringRef kMemoryUsagePhysicalFootprintKey;		/*!< @brief The process's physical footprint */
+			static const CFStringRef kMemoryUsageMallocInUseKey;			/*!< @brief Bytes allocated by \c malloc in the process */
+			static const CFStringRef kMemoryUsageMallocReservedKey;			/*!< @brief Bytes reserved by \c malloc zones in the process */
+
+			/*!
+			 * @brief Create a dictionary describing the memory used by the player and the process
+			 *
+			 * Each value is a \c CFNumber.  Sizes are in bytes and approximate, since memory allocated
+			 * internally by codec libraries is only included when a decoder can determine it.
+			 * @note The returned dictionary must be released by the caller
+			 * @return A dictionary describing the memory usage
+			 * @see GetProcessMemoryUsage()
+			 */
+			CFDictionaryRef CreateMemoryUsageDictionary() const;
+
+			//@}
+
+
 			/*! @cond */
 
 			/*! @internal This class is exposed so it can be used inside C callbacks */
@@ -471,6 +744,13 @@ namespace SFB {
 			 */
 			bool ProvideAudio(AudioBufferList *bufferList, UInt32 frameCount);
 
+			/*!
+			 * @internal
+			 * @brief Called by the output when the sample rate of its device changes
+			 * @note The change is applied on the decoding thread; if the device's sample rate no longer matches the output format playback is stopped and the error block is called
+			 */
+			void OutputSampleRateChanged();
+
 			/*! @endcond */
 
 		private:
@@ -486,7 +766,62 @@ namespace SFB {
 			DecoderStateData * GetCurrentDecoderState() const;
 			DecoderStateData * GetDecoderStateStartingAfterTimeStamp(SInt64 timeStamp) const;
 
-			bool SetupOutputAndRingBufferForDecoder(Decoder& decoder);
+			bool SetupOutputAndRingBufferForDecoder(Decoder& decoder, RingBuffer::unique_ptr *preparedRingBuffer = nullptr);
+
+			// ========================================
+			// Performance statistics
+			enum PipelineStage : unsigned int {
+				ePipelineStageDecode,
+				ePipelineStageConvert,
+				ePipelineStageProcess,
+				ePipelineStageRingBufferWrite,
+				ePipelineStageRenderRead,
+				ePipelineStageFormatChange,
+
+				ePipelineStageCount
+			};
+
+			struct PipelineStageStatistics
+			{
+				std::atomic_ullong	mInvocations;
+				std::atomic_ullong	mFrames;
+				std::atomic_ullong	mTicks;
+				std::atomic_ullong	mMaxTicks;
+			};
+
+			void RecordPipelineStage(PipelineStage stage, uint64_t ticks, UInt32 frameCount);
+
+			// ========================================
+			// Startup trace
+			enum StartupStage : unsigned int {
+				eStartupStageDecoderCreated,
+				eStartupStageInputSourceOpened,
+				eStartupStageDecoderOpened,
+				eStartupStageOutputConfigured,
+				eStartupStageConverterCreated,
+				eStartupStageRingBufferWrite,
+				eStartupStageOutputStarted,
+				eStartupStageFirstRender,
+				eStartupStageFirstAudibleFrame,
+
+				eStartupStageCount
+			};
+
+			bool StartPlayback(Decoder::unique_ptr& decoder, uint64_t startTicks);
+			void ResetStartupTrace(uint64_t startTicks);
+			void RecordStartupStage(StartupStage stage, uint64_t ticks);
+			inline bool IsStartupStagePending(StartupStage stage) const	{ return 0 != mStartupTraceStartTicks.load(std::memory_order_relaxed) && 0 == mStartupStageTicks[stage].load(std::memory_order_relaxed); }
+
+			// ========================================
+			// Effects processing
+			void PrepareProcessors(const AudioFormat& format, UInt32 maximumFrameCount);
+			void ProcessAudio(AudioBufferList *bufferList, UInt32 frameCount);
+			void ResetProcessors();
+
+			// ========================================
+			// Overload protection
+			void UpdateLoadShedding(UInt32 framesDecoded, uint64_t ticks);
+			void SetLoadSheddingLevel(LoadSheddingLevel level);
 
 			// ========================================
 			// Data Members
@@ -506,12 +841,34 @@ namespace SFB {
 			Semaphore								mDecoderSemaphore;
 
 			dispatch_source_t						mCollector;
+			mutable std::mutex						mCollectorMutex;
 
 			std::atomic_llong						mFramesDecoded;
 			std::atomic_llong						mFramesRendered;
 
 			Output::unique_ptr						mOutput;
 
+			std::atomic_bool						mCollectsPerformanceStatistics;
+			PipelineStageStatistics					mPipelineStageStatistics [ePipelineStageCount];
+
+			std::atomic_ullong						mStartupTraceStartTicks;
+			std::atomic_ullong						mStartupStageTicks [eStartupStageCount];
+
+			std::mutex								mProcessorsMutex;
+			std::vector<Processor::shared_ptr>		mProcessors;
+			AudioFormat								mProcessorFormat;
+			UInt32									mProcessorMaximumFrameCount;
+
+			std::atomic_bool						mOverloadProtectionEnabled;
+			std::atomic<double>						mOverloadThreshold;
+			std::atomic_uint						mLoadSheddingLevel;
+			double									mDecodingSpeed;						// Smoothed ratio of audio duration to decoding time
+			std::atomic_ullong						mLoadSheddingLevelChangedTicks;
+
+			std::atomic_bool						mAnalyzesLoudness;
+
+			std::atomic_bool						mSharesDecodedStreams;
+
 			// ========================================
 			// Callbacks
 			DecoderEventBlock						mDecoderEventBlocks [4];
@@ -519,6 +876,7 @@ namespace SFB {
 			RenderEventBlock						mRenderEventBlocks [2];
 			FormatMismatchBlock						mFormatMismatchBlock;
 			ErrorBlock								mErrorBlock;
+			LoudnessAnalysisBlock					mLoudnessAnalysisBlock;
 		};
 
 	}
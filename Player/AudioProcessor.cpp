@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include "AudioProcessor.h"
+#include "Logger.h"
+
+SFB::Audio::Processor::Processor()
+	: mMaximumFrameCount(0), mIsPrepared(false), mIsBypassed(false), mIsQualityReduced(false)
+{}
+
+SFB::Audio::Processor::~Processor()
+{}
+
+#pragma mark Processing
+
+bool SFB::Audio::Processor::SupportsFormat(const AudioFormat& format) const
+{
+	return _SupportsFormat(format);
+}
+
+bool SFB::Audio::Processor::Prepare(const AudioFormat& format, UInt32 maximumFrameCount)
+{
+	mIsPrepared = false;
+
+	if(!_SupportsFormat(format)) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Processor", "Unsupported format: " << format);
+		return false;
+	}
+
+	if(!_Prepare(format, maximumFrameCount)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Processor", "Unable to prepare processor for format: " << format);
+		return false;
+	}
+
+	mFormat = format;
+	mMaximumFrameCount = maximumFrameCount;
+	mIsPrepared = true;
+
+	return true;
+}
+
+void SFB::Audio::Processor::Process(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	if(!mIsPrepared || mIsBypassed.load() || nullptr == bufferList || 0 == frameCount)
+		return;
+
+	if(frameCount > mMaximumFrameCount) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Processor", "Frame count " << frameCount << " exceeds prepared maximum " << mMaximumFrameCount);
+		return;
+	}
+
+	_Process(bufferList, frameCount);
+}
+
+void SFB::Audio::Processor::Reset()
+{
+	if(mIsPrepared)
+		_Reset();
+}
+
+SFB::Audio::Processor::Role SFB::Audio::Processor::GetRole() const
+{
+	return _GetRole();
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <CoreAudio/CoreAudioTypes.h>
+
+#include <atomic>
+#include <memory>
+
+#include "AudioFormat.h"
+
+/*! @file AudioProcessor.h @brief Audio effect processing */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief Base class for an audio effect processor
+		 *
+		 * A processor modifies audio in place.  Processors added to a \c Player run on the decoding
+		 * thread after conversion to the output format and before audio is written to the ring
+		 * buffer, so they are not bound by the render thread's deadline and may allocate, lock, and
+		 * process large blocks.  The ring buffer's depth provides the latency headroom.
+		 *
+		 * Before processing the processor is prepared for a format and a maximum block size.
+		 * If the processor does not support the format it is bypassed until prepared for one it
+		 * does support.
+		 *
+		 * When the player is overloaded it sheds optional work to keep audio continuous: analysis
+		 * processors are skipped first, then processors are asked to reduce their quality, and
+		 * finally all processors are bypassed.
+		 * @note A processor should be added to at most one \c Player
+		 */
+		class Processor
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*! @brief A \c std::shared_ptr for \c Processor objects */
+			using shared_ptr = std::shared_ptr<Processor>;
+
+			/*! @brief The purpose of a processor, which determines when it is shed under load */
+			enum class Role {
+				Effect,			/*!< The processor modifies audio */
+				Analysis		/*!< The processor observes audio without modifying it, such as a meter */
+			};
+
+			/*! @brief Destroy this \c Processor */
+			virtual ~Processor();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			Processor(const Processor& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			Processor& operator=(const Processor& rhs) = delete;
+
+			/*! @endcond */
+			//@}
+
+
+			// ========================================
+			/*! @name Processing */
+			//@{
+
+			/*! @brief Query whether the processor supports audio in \c format */
+			bool SupportsFormat(const AudioFormat& format) const;
+
+			/*!
+			 * @brief Prepare the processor for audio in the specified format
+			 * @param format The format of the audio that will be processed
+			 * @param maximumFrameCount The largest number of frames that will be passed to \c Process()
+			 * @return \c true on success, \c false if the format is not supported or preparation failed
+			 */
+			bool Prepare(const AudioFormat& format, UInt32 maximumFrameCount);
+
+			/*! @brief Query whether the processor has been successfully prepared */
+			inline bool IsPrepared() const							{ return mIsPrepared; }
+
+			/*! @brief Get the format the processor was prepared for */
+			inline const AudioFormat& GetFormat() const				{ return mFormat; }
+
+			/*! @brief Get the maximum number of frames the processor was prepared for */
+			inline UInt32 GetMaximumFrameCount() const				{ return mMaximumFrameCount; }
+
+			/*!
+			 * @brief Process audio in place
+			 * @note Does nothing if the processor is not prepared or is bypassed
+			 * @param bufferList The audio to process
+			 * @param frameCount The number of valid frames in \c bufferList
+			 */
+			void Process(AudioBufferList *bufferList, UInt32 frameCount);
+
+			/*! @brief Discard any internal state, such as filter history, after a discontinuity */
+			void Reset();
+
+			/*! @brief Get the processor's role */
+			Role GetRole() const;
+
+			//@}
+
+
+			// ========================================
+			/*! @name Bypass and Quality */
+			//@{
+
+			/*! @brief Query whether the processor is bypassed */
+			inline bool IsBypassed() const							{ return mIsBypassed.load(); }
+
+			/*! @brief Set whether the processor is bypassed */
+			inline void SetBypassed(bool bypassed)					{ mIsBypassed.store(bypassed); }
+
+			/*! @brief Query whether the processor should trade quality for reduced processing time */
+			inline bool IsQualityReduced() const					{ return mIsQualityReduced.load(); }
+
+			/*!
+			 * @brief Set whether the processor should trade quality for reduced processing time
+			 * @note Subclasses without a cheaper mode may ignore this setting
+			 */
+			inline void SetQualityReduced(bool qualityReduced)		{ mIsQualityReduced.store(qualityReduced); }
+
+			//@}
+
+		protected:
+
+			/*! @brief Create a new \c Processor */
+			Processor();
+
+		private:
+
+			// Subclasses must implement the following methods
+			virtual bool _SupportsFormat(const AudioFormat& format) const = 0;
+			virtual bool _Prepare(const AudioFormat& format, UInt32 maximumFrameCount) = 0;
+			virtual void _Process(AudioBufferList *bufferList, UInt32 frameCount) = 0;
+			virtual void _Reset() = 0;
+
+			// Subclasses may optionally implement the following methods
+			virtual Role _GetRole() const							{ return Role::Effect; }
+
+			// Data members
+			AudioFormat						mFormat;
+			UInt32							mMaximumFrameCount;
+			bool							mIsPrepared;
+			std::atomic_bool				mIsBypassed;
+			std::atomic_bool				mIsQualityReduced;
+		};
+
+	}
+}
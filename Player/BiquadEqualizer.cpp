@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "BiquadEqualizer.h"
+#include "Logger.h"
+
+namespace {
+
+	// Calculate normalized coefficients { b0, b1, b2, a1, a2 } for a band
+	void CalculateCoefficients(const SFB::Audio::BiquadEqualizer::Band& band, Float64 sampleRate, double *coefficients)
+	{
+		using FilterType = SFB::Audio::BiquadEqualizer::FilterType;
+
+		double frequency = std::min(std::max(band.mFrequency, 1.), 0.499 * sampleRate);
+		double Q = std::max(band.mQ, 0.01);
+
+		double A = pow(10, band.mGain / 40);
+		double w0 = 2 * M_PI * frequency / sampleRate;
+		double cosw0 = cos(w0);
+		double alpha = sin(w0) / (2 * Q);
+		double twoSqrtAAlpha = 2 * sqrt(A) * alpha;
+
+		double b0, b1, b2, a0, a1, a2;
+
+		switch(band.mType) {
+			case FilterType::Peak:
+				b0 = 1 + alpha * A;
+				b1 = -2 * cosw0;
+				b2 = 1 - alpha * A;
+				a0 = 1 + alpha / A;
+				a1 = -2 * cosw0;
+				a2 = 1 - alpha / A;
+				break;
+
+			case FilterType::LowShelf:
+				b0 = A * ((A + 1) - (A - 1) * cosw0 + twoSqrtAAlpha);
+				b1 = 2 * A * ((A - 1) - (A + 1) * cosw0);
+				b2 = A * ((A + 1) - (A - 1) * cosw0 - twoSqrtAAlpha);
+				a0 = (A + 1) + (A - 1) * cosw0 + twoSqrtAAlpha;
+				a1 = -2 * ((A - 1) + (A + 1) * cosw0);
+				a2 = (A + 1) + (A - 1) * cosw0 - twoSqrtAAlpha;
+				break;
+
+			case FilterType::HighShelf:
+				b0 = A * ((A + 1) + (A - 1) * cosw0 + twoSqrtAAlpha);
+				b1 = -2 * A * ((A - 1) + (A + 1) * cosw0);
+				b2 = A * ((A + 1) + (A - 1) * cosw0 - twoSqrtAAlpha);
+				a0 = (A + 1) - (A - 1) * cosw0 + twoSqrtAAlpha;
+				a1 = 2 * ((A - 1) - (A + 1) * cosw0);
+				a2 = (A + 1) - (A - 1) * cosw0 - twoSqrtAAlpha;
+				break;
+
+			case FilterType::LowPass:
+				b0 = (1 - cosw0) / 2;
+				b1 = 1 - cosw0;
+				b2 = (1 - cosw0) / 2;
+				a0 = 1 + alpha;
+				a1 = -2 * cosw0;
+				a2 = 1 - alpha;
+				break;
+
+			case FilterType::HighPass:
+				b0 = (1 + cosw0) / 2;
+				b1 = -(1 + cosw0);
+				b2 = (1 + cosw0) / 2;
+				a0 = 1 + alpha;
+				a1 = -2 * cosw0;
+				a2 = 1 - alpha;
+				break;
+		}
+
+		coefficients[0] = b0 / a0;
+		coefficients[1] = b1 / a0;
+		coefficients[2] = b2 / a0;
+		coefficients[3] = a1 / a0;
+		coefficients[4] = a2 / a0;
+	}
+
+}
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::BiquadEqualizer::BiquadEqualizer(size_t bandCount)
+	: mPreamp(0), mParametersChanged(false), mBandCount(bandCount), mSampleRate(0), mSetup(nullptr), mPreampScale(1)
+{
+	if(0 == bandCount)
+		throw std::invalid_argument("bandCount must be greater than zero");
+
+	// Start with flat peaking bands spaced logarithmically across the audible range
+	mBands.reserve(bandCount);
+	for(size_t i = 0; i < bandCount; ++i) {
+		double frequency = 20 * pow(1000, (i + 0.5) / bandCount);
+		mBands.push_back({ FilterType::Peak, frequency, 0, M_SQRT2 });
+	}
+}
+
+SFB::Audio::BiquadEqualizer::~BiquadEqualizer()
+{
+	if(mSetup)
+		vDSP_biquad_DestroySetup(mSetup);
+}
+
+#pragma mark Bands
+
+bool SFB::Audio::BiquadEqualizer::GetBand(size_t bandIndex, Band& band) const
+{
+	if(bandIndex >= mBandCount)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	band = mBands[bandIndex];
+	return true;
+}
+
+bool SFB::Audio::BiquadEqualizer::SetBand(size_t bandIndex, const Band& band)
+{
+	if(bandIndex >= mBandCount || 0 >= band.mFrequency || 0 >= band.mQ)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mBands[bandIndex] = band;
+	mParametersChanged.store(true);
+	return true;
+}
+
+double SFB::Audio::BiquadEqualizer::GetPreamp() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPreamp;
+}
+
+void SFB::Audio::BiquadEqualizer::SetPreamp(double preamp)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPreamp = preamp;
+	mParametersChanged.store(true);
+}
+
+#pragma mark Processing
+
+bool SFB::Audio::BiquadEqualizer::_SupportsFormat(const AudioFormat& format) const
+{
+	return format.IsPCM() && (kAudioFormatFlagIsFloat & format.mFormatFlags) && !format.IsInterleaved() && 32 == format.mBitsPerChannel && format.IsNativeEndian();
+}
+
+bool SFB::Audio::BiquadEqualizer::_Prepare(const AudioFormat& format, UInt32 maximumFrameCount)
+{
+	mSampleRate = format.mSampleRate;
+
+	// vDSP_biquad requires 2 * sections + 2 delay elements per channel
+	mDelays.assign(format.mChannelsPerFrame, std::vector<float>(2 * mBandCount + 2, 0));
+	mScratch.resize(maximumFrameCount);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mParametersChanged.store(false);
+	return CreateSetup();
+}
+
+void SFB::Audio::BiquadEqualizer::_Process(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	if(mParametersChanged.exchange(false)) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		CreateSetup();
+	}
+
+	if(nullptr == mSetup)
+		return;
+
+	UInt32 channelCount = std::min(bufferList->mNumberBuffers, (UInt32)mDelays.size());
+	for(UInt32 i = 0; i < channelCount; ++i) {
+		float *data = (float *)bufferList->mBuffers[i].mData;
+
+		// Filter into the scratch buffer and apply the preamp while copying back
+		vDSP_biquad(mSetup, mDelays[i].data(), data, 1, mScratch.data(), 1, frameCount);
+		vDSP_vsmul(mScratch.data(), 1, &mPreampScale, data, 1, frameCount);
+	}
+}
+
+void SFB::Audio::BiquadEqualizer::_Reset()
+{
+	for(auto& delay : mDelays)
+		std::fill(delay.begin(), delay.end(), 0);
+}
+
+bool SFB::Audio::BiquadEqualizer::CreateSetup()
+{
+	std::vector<double> coefficients(5 * mBandCount);
+	for(size_t i = 0; i < mBandCount; ++i)
+		CalculateCoefficients(mBands[i], mSampleRate, &coefficients[5 * i]);
+
+	auto setup = vDSP_biquad_CreateSetup(coefficients.data(), mBandCount);
+	if(nullptr == setup) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Processor.BiquadEqualizer", "vDSP_biquad_CreateSetup failed");
+		return false;
+	}
+
+	if(mSetup)
+		vDSP_biquad_DestroySetup(mSetup);
+	mSetup = setup;
+
+	mPreampScale = (float)pow(10, mPreamp / 20);
+
+	return true;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <Accelerate/Accelerate.h>
+
+#include "AudioProcessor.h"
+
+/*! @file BiquadEqualizer.h @brief A parametric equalizer built from cascaded biquad filters */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A parametric equalizer built from a cascade of biquad filters
+		 *
+		 * Each band is a second-order section designed using the formulas from Robert
+		 * Bristow-Johnson's Audio EQ Cookbook.  The cascade is evaluated with \c vDSP_biquad,
+		 * which is vectorized.  Bands may be changed from any thread; the new coefficients take
+		 * effect at the start of the next processed block.
+		 *
+		 * Deinterleaved 32-bit native float PCM is supported.
+		 */
+		class BiquadEqualizer : public Processor
+		{
+
+		public:
+
+			/*! @brief The response of an equalizer band */
+			enum class FilterType {
+				Peak,			/*!< Boost or cut around the center frequency */
+				LowShelf,		/*!< Boost or cut below the corner frequency */
+				HighShelf,		/*!< Boost or cut above the corner frequency */
+				LowPass,		/*!< Attenuate above the corner frequency; gain is ignored */
+				HighPass		/*!< Attenuate below the corner frequency; gain is ignored */
+			};
+
+			/*! @brief The parameters of an equalizer band */
+			struct Band
+			{
+				FilterType	mType;			/*!< The filter response */
+				double		mFrequency;		/*!< The center or corner frequency in Hz */
+				double		mGain;			/*!< The gain in dB */
+				double		mQ;				/*!< The quality factor */
+			};
+
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*!
+			 * @brief Create a \c BiquadEqualizer with flat bands
+			 * @param bandCount The number of bands, which must be greater than zero
+			 */
+			explicit BiquadEqualizer(size_t bandCount = 10);
+
+			/*! @brief Destroy this \c BiquadEqualizer */
+			virtual ~BiquadEqualizer();
+
+			//@}
+
+
+			// ========================================
+			/*! @name Bands */
+			//@{
+
+			/*! @brief Get the number of bands */
+			inline size_t GetBandCount() const							{ return mBandCount; }
+
+			/*!
+			 * @brief Get the parameters of a band
+			 * @param bandIndex The index of the band
+			 * @param band A \c Band to receive the parameters
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool GetBand(size_t bandIndex, Band& band) const;
+
+			/*!
+			 * @brief Set the parameters of a band
+			 * @param bandIndex The index of the band
+			 * @param band The band parameters
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool SetBand(size_t bandIndex, const Band& band);
+
+			/*! @brief Get the gain applied before the filters, in dB */
+			double GetPreamp() const;
+
+			/*! @brief Set the gain applied before the filters, in dB */
+			void SetPreamp(double preamp);
+
+			//@}
+
+		private:
+
+			virtual bool _SupportsFormat(const AudioFormat& format) const;
+			virtual bool _Prepare(const AudioFormat& format, UInt32 maximumFrameCount);
+			virtual void _Process(AudioBufferList *bufferList, UInt32 frameCount);
+			virtual void _Reset();
+
+			// Recreate mSetup from mBands; must be called with mMutex locked
+			bool CreateSetup();
+
+			// Parameters shared with other threads
+			mutable std::mutex				mMutex;
+			std::vector<Band>				mBands;
+			double							mPreamp;
+			std::atomic_bool				mParametersChanged;
+
+			// Processing state, accessed only from the processing thread
+			size_t							mBandCount;
+			Float64							mSampleRate;
+			vDSP_biquad_Setup				mSetup;
+			float							mPreampScale;
+			std::vector<std::vector<float>>	mDelays;		// One delay line per channel
+			std::vector<float>				mScratch;
+		};
+
+	}
+}
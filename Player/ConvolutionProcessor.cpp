@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "ConvolutionProcessor.h"
+#include "AudioConverter.h"
+#include "AudioBufferList.h"
+#include "CFErrorUtilities.h"
+#include "TaskExecutor.h"
+#include "Logger.h"
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::ConvolutionProcessor::shared_ptr SFB::Audio::ConvolutionProcessor::CreateForURL(CFURLRef url, UInt32 partitionSize, CFErrorRef *error)
+{
+	auto decoder = Decoder::CreateForURL(url, error);
+	if(!decoder || !decoder->Open(error))
+		return nullptr;
+
+	auto decoderFormat = decoder->GetFormat();
+	if(!decoderFormat.IsPCM()) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Processor.Convolution", "Filter format not supported: " << decoderFormat);
+
+		if(error) {
+			SFB::CFString description(CFCopyLocalizedString(CFSTR("The format of the file “%@” is not supported."), ""));
+			SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Format not supported"), ""));
+			SFB::CFString recoverySuggestion(CFCopyLocalizedString(CFSTR("The filter's impulse response must be stored as PCM audio."), ""));
+
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::FileFormatNotSupportedError, description, url, failureReason, recoverySuggestion);
+		}
+
+		return nullptr;
+	}
+
+	AudioFormat format;
+
+	format.mFormatID			= kAudioFormatLinearPCM;
+	format.mFormatFlags			= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+
+	format.mSampleRate			= decoderFormat.mSampleRate;
+	format.mChannelsPerFrame	= decoderFormat.mChannelsPerFrame;
+	format.mBitsPerChannel		= 32;
+
+	format.mBytesPerPacket		= (format.mBitsPerChannel / 8);
+	format.mFramesPerPacket		= 1;
+	format.mBytesPerFrame		= format.mBytesPerPacket * format.mFramesPerPacket;
+
+	format.mReserved			= 0;
+
+	auto totalFrames = decoder->GetTotalFrames();
+
+	Converter converter(std::move(decoder), format);
+	if(!converter.Open(error))
+		return nullptr;
+
+	std::vector<std::vector<float>> impulseResponses(format.mChannelsPerFrame);
+	if(0 < totalFrames) {
+		for(auto& impulseResponse : impulseResponses)
+			impulseResponse.reserve((size_t)totalFrames);
+	}
+
+	const UInt32 bufferSizeFrames = 4096;
+	BufferList bufferList;
+	if(!bufferList.Allocate(format, bufferSizeFrames))
+		return nullptr;
+
+	for(;;) {
+		bufferList.Reset();
+		auto framesConverted = converter.ConvertAudio(bufferList, bufferSizeFrames);
+		if(0 == framesConverted)
+			break;
+
+		for(UInt32 channel = 0; channel < format.mChannelsPerFrame; ++channel) {
+			auto samples = (const float *)bufferList->mBuffers[channel].mData;
+			impulseResponses[channel].insert(impulseResponses[channel].end(), samples, samples + framesConverted);
+		}
+	}
+
+	try {
+		return std::make_shared<ConvolutionProcessor>(impulseResponses, format.mSampleRate, partitionSize);
+	}
+
+	catch(const std::exception& e) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Processor.Convolution", "Unable to create processor: " << e.what());
+		return nullptr;
+	}
+}
+
+SFB::Audio::ConvolutionProcessor::ConvolutionProcessor(const std::vector<std::vector<float>>& impulseResponses, Float64 sampleRate, UInt32 partitionSize)
+	: mFilterChannelCount((UInt32)impulseResponses.size()), mFilterLength(0), mFilterSampleRate(sampleRate), mPartitionSize(partitionSize), mPartitionCount(0), mLog2FFTSize(0), mFFTSetup(nullptr), mChannelCount(0), mRangeCount(1), mActivePartitionCount(0), mNewestInputSpectrum(0), mBufferedFrameCount(0), mUsesMultipleThreads(false)
+{
+	if(impulseResponses.empty() || impulseResponses[0].empty())
+		throw std::invalid_argument("The impulse response is empty");
+
+	mFilterLength = impulseResponses[0].size();
+	for(const auto& impulseResponse : impulseResponses) {
+		if(impulseResponse.size() != mFilterLength)
+			throw std::invalid_argument("The impulse response channels differ in length");
+	}
+
+	if(16 > partitionSize || (partitionSize & (partitionSize - 1)))
+		throw std::invalid_argument("The partition size must be a power of two no smaller than 16");
+
+	mPartitionCount = (mFilterLength + mPartitionSize - 1) / mPartitionSize;
+
+	// Each partition is transformed as a window of twice the partition size
+	mLog2FFTSize = (vDSP_Length)log2(mPartitionSize) + 1;
+	mFFTSetup = vDSP_create_fftsetup(mLog2FFTSize, kFFTRadix2);
+	if(nullptr == mFFTSetup)
+		throw std::runtime_error("Unable to create the FFT setup");
+
+	// vDSP's forward transform scales by 2 and its inverse by the FFT size, so the
+	// product of two forward transforms is scaled by 4 * N before the inverse
+	float scale = 1.f / (8 * mPartitionSize);
+
+	mFilterSpectra.resize(mFilterChannelCount * mPartitionCount * 2 * mPartitionSize);
+
+	std::vector<float> window(2 * mPartitionSize);
+	for(UInt32 channel = 0; channel < mFilterChannelCount; ++channel) {
+		for(size_t partition = 0; partition < mPartitionCount; ++partition) {
+			auto first = impulseResponses[channel].begin() + (std::ptrdiff_t)(partition * mPartitionSize);
+			auto last = impulseResponses[channel].begin() + (std::ptrdiff_t)std::min(mFilterLength, (partition + 1) * mPartitionSize);
+
+			std::fill(window.begin(), window.end(), 0);
+			std::copy(first, last, window.begin());
+
+			float *spectrum = FilterSpectrum(channel, partition);
+			auto splitComplex = SplitComplex(spectrum);
+
+			vDSP_ctoz((const DSPComplex *)window.data(), 2, &splitComplex, 1, mPartitionSize);
+			vDSP_fft_zrip(mFFTSetup, &splitComplex, 1, mLog2FFTSize, kFFTDirection_Forward);
+			vDSP_vsmul(spectrum, 1, &scale, spectrum, 1, 2 * mPartitionSize);
+		}
+	}
+
+	LOGGER_INFO("org.sbooth.AudioEngine.Processor.Convolution", "Created " << mFilterLength << " tap filter with " << mPartitionCount << " partitions of " << mPartitionSize << " frames");
+}
+
+SFB::Audio::ConvolutionProcessor::~ConvolutionProcessor()
+{
+	if(mFFTSetup)
+		vDSP_destroy_fftsetup(mFFTSetup);
+}
+
+#pragma mark Processing
+
+bool SFB::Audio::ConvolutionProcessor::_SupportsFormat(const AudioFormat& format) const
+{
+	if(!format.IsPCM() || !(kAudioFormatFlagIsFloat & format.mFormatFlags) || format.IsInterleaved() || 32 != format.mBitsPerChannel || !format.IsNativeEndian())
+		return false;
+
+	if(0.5 < fabs(format.mSampleRate - mFilterSampleRate))
+		return false;
+
+	return 1 == mFilterChannelCount || format.mChannelsPerFrame == mFilterChannelCount;
+}
+
+bool SFB::Audio::ConvolutionProcessor::_Prepare(const AudioFormat& format, UInt32 /*maximumFrameCount*/)
+{
+	// Input is buffered into partitions so the block size is irrelevant, and keeping the
+	// existing state when the channel count is unchanged avoids a discontinuity between tracks
+	if(format.mChannelsPerFrame == mChannelCount && !mTimeBuffers.empty())
+		return true;
+
+	mChannelCount = format.mChannelsPerFrame;
+	mRangeCount = std::min(mPartitionCount, (size_t)std::max(1u, std::thread::hardware_concurrency()));
+
+	mInputSpectra.resize(mChannelCount * mPartitionCount * 2 * mPartitionSize);
+	mAccumulators.resize(mChannelCount * mRangeCount * 2 * mPartitionSize);
+	mTimeBuffers.resize(mChannelCount * 2 * mPartitionSize);
+	mOutputBuffers.resize(mChannelCount * mPartitionSize);
+
+	_Reset();
+
+	return true;
+}
+
+void SFB::Audio::ConvolutionProcessor::_Process(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	UInt32 channelCount = std::min(bufferList->mNumberBuffers, mChannelCount);
+
+	UInt32 framesProcessed = 0;
+	while(framesProcessed < frameCount) {
+		UInt32 framesToCopy = std::min(frameCount - framesProcessed, mPartitionSize - mBufferedFrameCount);
+
+		// Buffer the input and replace it with output filtered one partition earlier
+		for(UInt32 channel = 0; channel < channelCount; ++channel) {
+			auto data = (float *)bufferList->mBuffers[channel].mData + framesProcessed;
+			memcpy(&mTimeBuffers[(2 * channel + 1) * mPartitionSize + mBufferedFrameCount], data, framesToCopy * sizeof(float));
+			memcpy(data, &mOutputBuffers[channel * mPartitionSize + mBufferedFrameCount], framesToCopy * sizeof(float));
+		}
+
+		mBufferedFrameCount += framesToCopy;
+		framesProcessed += framesToCopy;
+
+		if(mBufferedFrameCount == mPartitionSize) {
+			ProcessBlock();
+			mBufferedFrameCount = 0;
+		}
+	}
+}
+
+void SFB::Audio::ConvolutionProcessor::_Reset()
+{
+	std::fill(mInputSpectra.begin(), mInputSpectra.end(), 0);
+	std::fill(mTimeBuffers.begin(), mTimeBuffers.end(), 0);
+	std::fill(mOutputBuffers.begin(), mOutputBuffers.end(), 0);
+
+	mNewestInputSpectrum = 0;
+	mBufferedFrameCount = 0;
+}
+
+void SFB::Audio::ConvolutionProcessor::ProcessBlock()
+{
+	// Transform the newest window of each channel into the frequency-domain delay line
+	for(UInt32 channel = 0; channel < mChannelCount; ++channel) {
+		auto splitComplex = SplitComplex(InputSpectrum(channel, mNewestInputSpectrum));
+		vDSP_ctoz((const DSPComplex *)&mTimeBuffers[2 * channel * mPartitionSize], 2, &splitComplex, 1, mPartitionSize);
+		vDSP_fft_zrip(mFFTSetup, &splitComplex, 1, mLog2FFTSize, kFFTDirection_Forward);
+	}
+
+	// Multiply each partition's filter spectrum with the matching input spectrum
+	mActivePartitionCount = IsQualityReduced() ? std::max((size_t)1, mPartitionCount / 4) : mPartitionCount;
+
+	size_t taskCount = mChannelCount * mRangeCount;
+	if(mUsesMultipleThreads.load() && 1 < mRangeCount) {
+		dispatch_apply(taskCount, TaskExecutor::GetSharedExecutor().GetQueue(TaskExecutor::TaskClass::Decode), ^(size_t task) {
+			AccumulatePartitions(task);
+		});
+	}
+	else {
+		for(size_t task = 0; task < taskCount; ++task)
+			AccumulatePartitions(task);
+	}
+
+	for(UInt32 channel = 0; channel < mChannelCount; ++channel) {
+		float *sum = Accumulator(channel, 0);
+		for(size_t range = 1; range < mRangeCount; ++range)
+			vDSP_vadd(sum, 1, Accumulator(channel, range), 1, sum, 1, 2 * mPartitionSize);
+
+		auto splitComplex = SplitComplex(sum);
+		vDSP_fft_zrip(mFFTSetup, &splitComplex, 1, mLog2FFTSize, kFFTDirection_Inverse);
+
+		// Only the second half of the window is free of circular wraparound
+		DSPSplitComplex secondHalf = { splitComplex.realp + mPartitionSize / 2, splitComplex.imagp + mPartitionSize / 2 };
+		vDSP_ztoc(&secondHalf, 1, (DSPComplex *)&mOutputBuffers[channel * mPartitionSize], 2, mPartitionSize / 2);
+
+		// The current input block becomes the first half of the next window
+		float *window = &mTimeBuffers[2 * channel * mPartitionSize];
+		memcpy(window, window + mPartitionSize, mPartitionSize * sizeof(float));
+	}
+
+	mNewestInputSpectrum = (mNewestInputSpectrum + 1) % mPartitionCount;
+}
+
+void SFB::Audio::ConvolutionProcessor::AccumulatePartitions(size_t task)
+{
+	UInt32 channel = (UInt32)(task / mRangeCount);
+	size_t range = task % mRangeCount;
+
+	size_t firstPartition = range * mActivePartitionCount / mRangeCount;
+	size_t lastPartition = (range + 1) * mActivePartitionCount / mRangeCount;
+
+	UInt32 filterChannel = 1 == mFilterChannelCount ? 0 : channel;
+
+	float *accumulator = Accumulator(channel, range);
+	vDSP_vclr(accumulator, 1, 2 * mPartitionSize);
+
+	auto sum = SplitComplex(accumulator);
+	DSPSplitComplex sumAC = { sum.realp + 1, sum.imagp + 1 };
+
+	for(size_t partition = firstPartition; partition < lastPartition; ++partition) {
+		size_t inputSpectrum = (mNewestInputSpectrum + mPartitionCount - partition) % mPartitionCount;
+
+		auto input = SplitComplex(InputSpectrum(channel, inputSpectrum));
+		auto filter = SplitComplex(FilterSpectrum(filterChannel, partition));
+
+		// The DC and Nyquist components are packed into the first element as two real values
+		sum.realp[0] += input.realp[0] * filter.realp[0];
+		sum.imagp[0] += input.imagp[0] * filter.imagp[0];
+
+		DSPSplitComplex inputAC = { input.realp + 1, input.imagp + 1 };
+		DSPSplitComplex filterAC = { filter.realp + 1, filter.imagp + 1 };
+		vDSP_zvma(&inputAC, 1, &filterAC, 1, &sumAC, 1, &sumAC, 1, mPartitionSize - 1);
+	}
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <Accelerate/Accelerate.h>
+
+#include "AudioProcessor.h"
+
+/*! @file ConvolutionProcessor.h @brief FIR filtering using partitioned fast convolution */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A processor that convolves audio with long FIR filters such as room correction filters
+		 *
+		 * Filtering uses uniformly partitioned overlap-save convolution with a frequency-domain
+		 * delay line, so the cost per frame grows with the number of partitions rather than the
+		 * number of taps.  Transforms use the vDSP FFT.  The processor delays audio by one
+		 * partition; larger partitions are cheaper per frame but add latency.
+		 *
+		 * When multiple threads are enabled the partitions of each channel are divided among
+		 * worker threads for each block.
+		 *
+		 * When quality is reduced only the first quarter of the filter's partitions are applied,
+		 * truncating the filter's tail.
+		 *
+		 * Deinterleaved 32-bit native float PCM at the filter's sample rate is supported.  The
+		 * filter must contain either one channel, which is applied to every channel, or the same
+		 * number of channels as the audio.
+		 */
+		class ConvolutionProcessor : public Processor
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*! @brief A \c std::shared_ptr for \c ConvolutionProcessor objects */
+			using shared_ptr = std::shared_ptr<ConvolutionProcessor>;
+
+			/*!
+			 * @brief Create a \c ConvolutionProcessor using the filter contained in an audio file
+			 * @param url The URL of the file containing the filter's impulse response
+			 * @param partitionSize The partition size in frames, which must be a power of two
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c ConvolutionProcessor object, or \c nullptr on failure
+			 */
+			static shared_ptr CreateForURL(CFURLRef url, UInt32 partitionSize = 1024, CFErrorRef *error = nullptr);
+
+			/*!
+			 * @brief Create a \c ConvolutionProcessor
+			 * @throws std::invalid_argument if the filter is empty or \c partitionSize is not a power of two
+			 * @param impulseResponses The filter's impulse response, one vector per channel, each of the same length
+			 * @param sampleRate The sample rate of the filter
+			 * @param partitionSize The partition size in frames, which must be a power of two
+			 */
+			ConvolutionProcessor(const std::vector<std::vector<float>>& impulseResponses, Float64 sampleRate, UInt32 partitionSize = 1024);
+
+			/*! @brief Destroy this \c ConvolutionProcessor */
+			virtual ~ConvolutionProcessor();
+
+			//@}
+
+
+			// ========================================
+			/*! @name Filter information */
+			//@{
+
+			/*! @brief Get the number of channels in the filter */
+			inline UInt32 GetFilterChannelCount() const					{ return mFilterChannelCount; }
+
+			/*! @brief Get the length of the filter in frames */
+			inline size_t GetFilterLength() const						{ return mFilterLength; }
+
+			/*! @brief Get the sample rate of the filter */
+			inline Float64 GetFilterSampleRate() const					{ return mFilterSampleRate; }
+
+			/*! @brief Get the partition size in frames */
+			inline UInt32 GetPartitionSize() const						{ return mPartitionSize; }
+
+			/*! @brief Get the delay, in frames, added by the processor */
+			inline UInt32 GetLatency() const							{ return mPartitionSize; }
+
+			//@}
+
+
+			// ========================================
+			/*! @name Threading */
+			//@{
+
+			/*! @brief Query whether partitions are spread across worker threads */
+			inline bool UsesMultipleThreads() const						{ return mUsesMultipleThreads.load(); }
+
+			/*! @brief Set whether partitions are spread across worker threads */
+			inline void SetUsesMultipleThreads(bool flag)				{ mUsesMultipleThreads.store(flag); }
+
+			//@}
+
+		private:
+
+			virtual bool _SupportsFormat(const AudioFormat& format) const;
+			virtual bool _Prepare(const AudioFormat& format, UInt32 maximumFrameCount);
+			virtual void _Process(AudioBufferList *bufferList, UInt32 frameCount);
+			virtual void _Reset();
+
+			// Filter one partition of buffered input for every channel
+			void ProcessBlock();
+
+			// Multiply and accumulate one range of partitions for one channel
+			void AccumulatePartitions(size_t task);
+
+			// Spectra are stored as split complex data: mPartitionSize real values followed by mPartitionSize imaginary values
+			inline DSPSplitComplex SplitComplex(float *spectrum) const	{ return { spectrum, spectrum + mPartitionSize }; }
+
+			inline float * FilterSpectrum(UInt32 channel, size_t partition)		{ return &mFilterSpectra[(channel * mPartitionCount + partition) * 2 * mPartitionSize]; }
+			inline float * InputSpectrum(UInt32 channel, size_t partition)		{ return &mInputSpectra[(channel * mPartitionCount + partition) * 2 * mPartitionSize]; }
+			inline float * Accumulator(UInt32 channel, size_t range)			{ return &mAccumulators[(channel * mRangeCount + range) * 2 * mPartitionSize]; }
+
+			// Filter
+			UInt32							mFilterChannelCount;
+			size_t							mFilterLength;
+			Float64							mFilterSampleRate;
+			UInt32							mPartitionSize;
+			size_t							mPartitionCount;
+			vDSP_Length						mLog2FFTSize;
+			FFTSetup						mFFTSetup;
+			std::vector<float>				mFilterSpectra;			// Scaled so the inverse transform needs no normalization
+
+			// Processing state
+			UInt32							mChannelCount;
+			size_t							mRangeCount;			// Partition ranges per channel when multithreaded
+			std::vector<float>				mInputSpectra;			// The frequency-domain delay line, one spectrum per partition
+			std::vector<float>				mAccumulators;
+			std::vector<float>				mTimeBuffers;			// The previous and current input blocks for each channel
+			std::vector<float>				mOutputBuffers;			// The most recently filtered block for each channel
+			size_t							mActivePartitionCount;	// Partitions applied to the current block
+			size_t							mNewestInputSpectrum;
+			UInt32							mBufferedFrameCount;
+
+			std::atomic_bool				mUsesMultipleThreads;
+		};
+
+	}
+}
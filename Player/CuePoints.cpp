@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "CuePoints.h"
+#include "AudioPlayer.h"
+#include "CFWrapper.h"
+#include "Logger.h"
+#include "PrerolledDecoder.h"
+#include "TaskExecutor.h"
+
+const double SFB::Audio::CuePoints::kDefaultPrerollDuration = 2;
+
+// ========================================
+// The cues and their prepared decoders, shared with preparation tasks
+// ========================================
+class SFB::Audio::CuePoints::State : public std::enable_shared_from_this<State>
+{
+
+public:
+
+	State(CFURLRef url, size_t memoryBudget, double prerollDuration, unsigned int maximumPreparedCues)
+		: mURL((CFURLRef)CFRetain(url)), mMemoryBudget(memoryBudget), mPrerollDuration(prerollDuration), mMaximumPreparedCues(maximumPreparedCues), mMemoryUsage(0), mNextGeneration(0)
+	{}
+
+	State(const State& rhs) = delete;
+	State& operator=(const State& rhs) = delete;
+
+	struct Cue
+	{
+		SInt64					mFrame = -1;
+		uint64_t				mGeneration = 0;		// Identifies the most recent preparation
+		Decoder::unique_ptr		mDecoder;				// The prepared decoder, or nullptr while preparing
+		size_t					mReservedBytes = 0;		// The portion of the memory budget used by mDecoder
+		bool					mPreparing = false;		// True while a preparation task is outstanding
+	};
+
+	// Get the number of cues holding or opening a decoder; must be called with mMutex locked
+	unsigned int GetPreparedCueCount() const
+	{
+		return (unsigned int)std::count_if(std::begin(mCues), std::end(mCues), [](const std::pair<const unsigned int, Cue>& iter) {
+			return iter.second.mDecoder || iter.second.mPreparing;
+		});
+	}
+
+	// Discard a cue's prepared decoder; must be called with mMutex locked
+	void Release(Cue& cue)
+	{
+		cue.mDecoder.reset();
+		mMemoryUsage -= cue.mReservedBytes;
+		cue.mReservedBytes = 0;
+	}
+
+	// Begin preparing the cue at index in the background; must be called with mMutex locked
+	void Prepare(unsigned int index)
+	{
+		auto& cue = mCues[index];
+		Release(cue);
+
+		SInt64 frame = cue.mFrame;
+		uint64_t generation = cue.mGeneration = ++mNextGeneration;
+
+		// Each prepared decoder holds an open file
+		if(!cue.mPreparing && GetPreparedCueCount() >= mMaximumPreparedCues) {
+			LOGGER_INFO("org.sbooth.AudioEngine.CuePoints", "Deferring preparation of cue " << index << ": " << mMaximumPreparedCues << " cues are already prepared");
+			return;
+		}
+
+		cue.mPreparing = true;
+
+		auto self = shared_from_this();
+		TaskExecutor::GetSharedExecutor().Submit(TaskExecutor::TaskClass::Prefetch, ^{
+			self->Complete(index, frame, generation);
+		}, mToken);
+	}
+
+	// Begin preparing cues deferred by the limit on prepared cues; must be called with mMutex locked
+	void PrepareDeferred()
+	{
+		for(auto& iter : mCues) {
+			if(GetPreparedCueCount() >= mMaximumPreparedCues)
+				break;
+			if(!iter.second.mDecoder && !iter.second.mPreparing)
+				Prepare(iter.first);
+		}
+	}
+
+	// Finish a preparation task for the cue at index, unless the cue changed in the meantime; must be called with mMutex locked
+	Cue * Finish(unsigned int index, uint64_t generation)
+	{
+		auto iter = mCues.find(index);
+		if(iter == std::end(mCues) || iter->second.mGeneration != generation)
+			return nullptr;
+
+		iter->second.mPreparing = false;
+		return &iter->second;
+	}
+
+	// Prepare a decoder for the cue at index, discarding it if the cue changed in the meantime
+	void Complete(unsigned int index, SInt64 frame, uint64_t generation)
+	{
+		SFB::CFError error;
+		auto decoder = Decoder::CreateForInputSource(InputSource::CreateForURL(mURL, InputSource::RandomAccess, &error), &error);
+		if(!decoder || (!decoder->IsOpen() && !decoder->Open(&error))) {
+			LOGGER_WARNING("org.sbooth.AudioEngine.CuePoints", "Unable to open decoder for cue " << index << " of " << (CFURLRef)mURL << ": " << error);
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			Finish(index, generation);
+			return;
+		}
+
+		// The open decoder counts against the budget, and the preroll is sized to what remains
+		UInt32 prerollFrameCount = 0;
+		size_t reservedBytes = decoder->GetMemoryUsage();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+
+			auto iter = mCues.find(index);
+			if(iter == std::end(mCues) || iter->second.mGeneration != generation)
+				return;
+
+			size_t availableBytes = mMemoryBudget - std::min(mMemoryBudget, mMemoryUsage);
+			if(reservedBytes > availableBytes) {
+				LOGGER_INFO("org.sbooth.AudioEngine.CuePoints", "Not preparing cue " << index << " of " << (CFURLRef)mURL << ": memory budget exhausted");
+				Finish(index, generation);
+				return;
+			}
+
+			availableBytes -= reservedBytes;
+
+			const auto& format = decoder->GetFormat();
+			size_t bytesPerFrame = format.FrameCountToByteCount(1) * (format.IsInterleaved() ? 1 : format.mChannelsPerFrame);
+			if(format.IsPCM() && bytesPerFrame) {
+				prerollFrameCount = (UInt32)std::min((size_t)(mPrerollDuration * format.mSampleRate), availableBytes / bytesPerFrame);
+				reservedBytes += prerollFrameCount * bytesPerFrame;
+			}
+
+			mMemoryUsage += reservedBytes;
+		}
+
+		auto prerolledDecoder = PrerolledDecoder::CreateForDecoder(std::move(decoder), frame, prerollFrameCount, &error);
+		bool opened = prerolledDecoder && prerolledDecoder->Open(&error);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto cue = Finish(index, generation);
+		if(!opened || !cue) {
+			mMemoryUsage -= reservedBytes;
+			if(!opened)
+				LOGGER_WARNING("org.sbooth.AudioEngine.CuePoints", "Unable to prepare cue " << index << " of " << (CFURLRef)mURL << ": " << error);
+			return;
+		}
+
+		// Charge what the prepared decoder actually holds, which may differ from the estimate
+		mMemoryUsage -= reservedBytes;
+		reservedBytes = prerolledDecoder->GetMemoryUsage();
+		mMemoryUsage += reservedBytes;
+
+		cue->mDecoder = std::move(prerolledDecoder);
+		cue->mReservedBytes = reservedBytes;
+
+		LOGGER_DEBUG("org.sbooth.AudioEngine.CuePoints", "Prepared cue " << index << " at frame " << frame << " of " << (CFURLRef)mURL);
+	}
+
+	mutable std::mutex					mMutex;
+	SFB::CFURL							mURL;
+	size_t								mMemoryBudget;
+	double								mPrerollDuration;
+	unsigned int						mMaximumPreparedCues;
+	size_t								mMemoryUsage;
+	std::map<unsigned int, Cue>			mCues;
+	uint64_t							mNextGeneration;
+	TaskExecutor::CancellationToken		mToken;
+};
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::CuePoints::CuePoints(CFURLRef url, size_t memoryBudget, double prerollDuration, unsigned int maximumPreparedCues)
+	: mState(std::make_shared<State>(url, memoryBudget, std::max(prerollDuration, 0.), maximumPreparedCues))
+{}
+
+SFB::Audio::CuePoints::~CuePoints()
+{
+	// Tasks that have started hold a reference to the state, and their results are discarded
+	mState->mToken.Cancel();
+	RemoveAllCues();
+}
+
+#pragma mark Cue Management
+
+CFURLRef SFB::Audio::CuePoints::GetURL() const
+{
+	return mState->mURL;
+}
+
+bool SFB::Audio::CuePoints::SetCue(unsigned int index, SInt64 frame)
+{
+	if(0 > frame)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+
+	mState->mCues[index].mFrame = frame;
+	mState->Prepare(index);
+
+	return true;
+}
+
+void SFB::Audio::CuePoints::RemoveCue(unsigned int index)
+{
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+
+	auto iter = mState->mCues.find(index);
+	if(iter == std::end(mState->mCues))
+		return;
+
+	mState->Release(iter->second);
+	mState->mCues.erase(iter);
+
+	mState->PrepareDeferred();
+}
+
+void SFB::Audio::CuePoints::RemoveAllCues()
+{
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+
+	for(auto& iter : mState->mCues)
+		mState->Release(iter.second);
+	mState->mCues.clear();
+}
+
+SInt64 SFB::Audio::CuePoints::GetCueFrame(unsigned int index) const
+{
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+
+	auto iter = mState->mCues.find(index);
+	if(iter == std::end(mState->mCues))
+		return -1;
+
+	return iter->second.mFrame;
+}
+
+bool SFB::Audio::CuePoints::IsCuePrepared(unsigned int index) const
+{
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+
+	auto iter = mState->mCues.find(index);
+	if(iter == std::end(mState->mCues))
+		return false;
+
+	return (bool)iter->second.mDecoder;
+}
+
+size_t SFB::Audio::CuePoints::GetMemoryUsage() const
+{
+	std::lock_guard<std::mutex> lock(mState->mMutex);
+	return mState->mMemoryUsage;
+}
+
+#pragma mark Triggering
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::CuePoints::TakeCue(unsigned int index, CFErrorRef *error)
+{
+	Decoder::unique_ptr decoder;
+	SInt64 frame;
+
+	{
+		std::lock_guard<std::mutex> lock(mState->mMutex);
+
+		auto iter = mState->mCues.find(index);
+		if(iter == std::end(mState->mCues)) {
+			LOGGER_NOTICE("org.sbooth.AudioEngine.CuePoints", "Cue " << index << " is not set");
+			return nullptr;
+		}
+
+		// The taken decoder's preroll no longer counts against the budget
+		auto& cue = iter->second;
+		frame = cue.mFrame;
+		decoder = std::move(cue.mDecoder);
+		mState->Release(cue);
+
+		// Prepare a replacement so the cue may be triggered again
+		mState->Prepare(index);
+	}
+
+	if(!decoder) {
+		LOGGER_INFO("org.sbooth.AudioEngine.CuePoints", "Cue " << index << " is not prepared");
+
+		decoder = PrerolledDecoder::CreateForURL(mState->mURL, frame, 0, error);
+		if(!decoder || !decoder->Open(error))
+			return nullptr;
+	}
+
+	return decoder;
+}
+
+bool SFB::Audio::CuePoints::TriggerCue(unsigned int index, Player& player, CFErrorRef *error)
+{
+	auto decoder = TakeCue(index, error);
+	if(!decoder)
+		return false;
+
+	return player.Splice(decoder);
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include "AudioDecoder.h"
+
+/*! @file CuePoints.h @brief Prepared positions for starting playback instantly */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		class Player;
+
+		/*!
+		 * @brief A set of cue points in a track, each prepared ahead of time for instant playback
+		 *
+		 * For each cue a decoder is opened, positioned at the cue's frame, and a short preroll of
+		 * audio is decoded in the background using the shared \c TaskExecutor.  Triggering a cue
+		 * hands its prepared decoder to a \c Player with \c Player::Splice(), which writes the
+		 * prerolled audio to its ring buffer immediately after the audio already buffered while
+		 * the decoder continues from where the preroll ends, and a replacement is prepared so the
+		 * cue may be triggered again.
+		 *
+		 * The prepared decoders for all cues, including their prerolled audio and the memory reported
+		 * by \c Decoder::GetMemoryUsage(), are limited to a memory budget.  When the budget is
+		 * exhausted cues are prepared with shorter prerolls, or not at all.  The number of prepared
+		 * decoders, each of which holds an open file, is also limited; cues beyond the limit are
+		 * prepared when a prepared cue is removed.  Triggering a cue that is not prepared positions
+		 * a decoder synchronously.
+		 *
+		 * Output is not stopped and buffered audio is not discarded, so the cue's audio starts
+		 * once the audio already in the ring buffer has been rendered.  The join is seamless if
+		 * the cue's format matches the output format.  If the player is not playing, triggering
+		 * a cue starts playback.
+		 * @see PrerolledDecoder
+		 */
+		class CuePoints
+		{
+
+		public:
+
+			/*! @brief A \c std::unique_ptr for \c CuePoints objects */
+			using unique_ptr = std::unique_ptr<CuePoints>;
+
+			/*! @brief The default memory budget for prepared decoders, in bytes */
+			static const size_t kDefaultMemoryBudget = 32 * 1024 * 1024;
+
+			/*! @brief The default maximum number of prepared decoders */
+			static const unsigned int kDefaultMaximumPreparedCues = 16;
+
+			/*! @brief The default duration of audio prerolled for each cue, in seconds */
+			static const double kDefaultPrerollDuration;
+
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*!
+			 * @brief Create a new \c CuePoints for the specified URL
+			 * @param url The URL of the track
+			 * @param memoryBudget The maximum number of bytes held by the prepared decoders for all cues
+			 * @param prerollDuration The duration of audio to preroll for each cue, in seconds
+			 * @param maximumPreparedCues The maximum number of cues with prepared decoders
+			 */
+			explicit CuePoints(CFURLRef url, size_t memoryBudget = kDefaultMemoryBudget, double prerollDuration = kDefaultPrerollDuration, unsigned int maximumPreparedCues = kDefaultMaximumPreparedCues);
+
+			/*!
+			 * @brief Destroy this \c CuePoints
+			 * @note Pending preparations are cancelled
+			 */
+			~CuePoints();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			CuePoints(const CuePoints& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			CuePoints& operator=(const CuePoints& rhs) = delete;
+
+			/*! @endcond */
+			//@}
+
+
+			// ========================================
+			/*! @name Cue Management */
+			//@{
+
+			/*! @brief Get the URL of the track */
+			CFURLRef GetURL() const;
+
+			/*!
+			 * @brief Set a cue and begin preparing it in the background
+			 * @note Any existing cue with the same index is replaced
+			 * @param index The cue's index
+			 * @param frame The frame at which playback of the cue starts
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool SetCue(unsigned int index, SInt64 frame);
+
+			/*!
+			 * @brief Remove a cue and release its prepared decoder
+			 * @param index The cue's index
+			 */
+			void RemoveCue(unsigned int index);
+
+			/*! @brief Remove all cues and release their prepared decoders */
+			void RemoveAllCues();
+
+			/*!
+			 * @brief Get the frame at which playback of a cue starts
+			 * @param index The cue's index
+			 * @return The cue's frame, or \c -1 if the cue is not set
+			 */
+			SInt64 GetCueFrame(unsigned int index) const;
+
+			/*!
+			 * @brief Query whether a cue has been prepared
+			 * @param index The cue's index
+			 * @return \c true if triggering the cue will use a prepared decoder, \c false otherwise
+			 */
+			bool IsCuePrepared(unsigned int index) const;
+
+			/*! @brief Get the number of bytes held by the prepared decoders for all cues */
+			size_t GetMemoryUsage() const;
+
+			//@}
+
+
+			// ========================================
+			/*! @name Triggering */
+			//@{
+
+			/*!
+			 * @brief Take the prepared decoder for a cue and begin preparing a replacement
+			 * @note If the cue has not finished preparing, a decoder is positioned at the cue synchronously
+			 * @param index The cue's index
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return An open \c Decoder positioned at the cue, or \c nullptr on failure
+			 */
+			Decoder::unique_ptr TakeCue(unsigned int index, CFErrorRef *error = nullptr);
+
+			/*!
+			 * @brief Start playback of a cue
+			 * @note This will clear any decoders enqueued in \c player
+			 * @note The cue's audio follows the audio already buffered by \c player; see \c Player::Splice()
+			 * @param index The cue's index
+			 * @param player The player
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return \c true on success, \c false otherwise
+			 */
+			bool TriggerCue(unsigned int index, Player& player, CFErrorRef *error = nullptr);
+
+			//@}
+
+		private:
+
+			// The cues and their prepared decoders, shared with preparation tasks
+			class State;
+
+			std::shared_ptr<State>		mState;
+		};
+
+	}
+}
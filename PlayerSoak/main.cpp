@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+// A soak driver for Player's memory accounting.
+//
+// Synthetic tracks with varying sample rates and channel counts are played, enqueued, skipped, and
+// seeked in a pseudo-random but reproducible sequence while the player's memory usage is sampled.
+// Rendering is driven by a headless output that pulls audio from the player in real time, so no
+// audio device is needed.  The driver fails if the process's physical footprint grows past the
+// threshold over the baseline taken after a warm-up period, or if decoder states are still alive
+// once playback has stopped and the collector has run.
+//
+// Usage: PlayerSoak [duration-seconds [growth-threshold-bytes [operation-interval-ms]]]
+//
+// Build against the framework, for example:
+//   clang++ -std=c++14 -F <products dir> -framework SFBAudioEngine -framework CoreFoundation PlayerSoak/main.cpp -o PlayerSoak
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <SFBAudioEngine/AudioBufferList.h>
+#include <SFBAudioEngine/AudioOutput.h>
+#include <SFBAudioEngine/AudioPlayer.h>
+#include <SFBAudioEngine/CFWrapper.h>
+#include <SFBAudioEngine/SignalGeneratorDecoder.h>
+
+namespace {
+
+	const double kDefaultDuration				= 600;
+	const long long kDefaultGrowthThreshold		= 16 * 1024 * 1024;
+	const double kWarmupFraction				= 0.1;
+	const long kDefaultOperationInterval		= 0;
+	const auto kSampleInterval					= std::chrono::seconds(5);
+	const auto kCollectionWait					= std::chrono::seconds(12);
+	const size_t kMaximumQueuedDecoders			= 4;
+	const UInt32 kRenderFrameCount				= 512;
+
+	const Float64 kSampleRates []				= { 44100, 48000, 88200, 96000 };
+	const UInt32 kChannelCounts []				= { 1, 2, 6 };
+
+	// An output without a device that pulls audio from the player in real time on its own thread
+	class NullOutput : public SFB::Audio::Output
+	{
+
+	public:
+
+		NullOutput()
+			: mIsOpen(false), mIsRunning(false)
+		{}
+
+		virtual ~NullOutput()
+		{
+			_Close();
+		}
+
+	private:
+
+		virtual bool _Open()
+		{
+			mIsOpen = true;
+			return true;
+		}
+
+		virtual bool _Close()
+		{
+			_Stop();
+			mIsOpen = false;
+			return true;
+		}
+
+		virtual bool _Start()
+		{
+			if(mIsRunning.load())
+				return true;
+
+			// A thread that ended because of a stop request may not have been joined
+			if(mRenderThread.joinable())
+				mRenderThread.join();
+
+			mIsRunning.store(true);
+			mRenderThread = std::thread(&NullOutput::Render, this);
+			return true;
+		}
+
+		virtual bool _Stop()
+		{
+			mIsRunning.store(false);
+			if(mRenderThread.joinable())
+				mRenderThread.join();
+			return true;
+		}
+
+		// Called from the render thread, which can't join itself
+		virtual bool _RequestStop()
+		{
+			mIsRunning.store(false);
+			return true;
+		}
+
+		virtual bool _IsOpen() const								{ return mIsOpen; }
+		virtual bool _IsRunning() const								{ return mIsRunning.load(); }
+
+		virtual bool _Reset()										{ return true; }
+
+		virtual bool _SupportsFormat(const SFB::Audio::AudioFormat& format) const
+		{
+			return format.IsPCM();
+		}
+
+		virtual bool _SetupForDecoder(const SFB::Audio::Decoder& decoder)
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if(!_GetFormatForDecoder(decoder, mFormat))
+				return false;
+			mChannelLayout = decoder.GetChannelLayout();
+			return true;
+		}
+
+		virtual bool _GetFormatForDecoder(const SFB::Audio::Decoder& decoder, SFB::Audio::AudioFormat& format) const
+		{
+			const auto& decoderFormat = decoder.GetFormat();
+			if(!_SupportsFormat(decoderFormat))
+				return false;
+
+			format.mFormatID			= kAudioFormatLinearPCM;
+			format.mFormatFlags			= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+
+			format.mSampleRate			= decoderFormat.mSampleRate;
+			format.mChannelsPerFrame	= decoderFormat.mChannelsPerFrame;
+			format.mBitsPerChannel		= 32;
+
+			format.mBytesPerPacket		= (format.mBitsPerChannel / 8);
+			format.mFramesPerPacket		= 1;
+			format.mBytesPerFrame		= format.mBytesPerPacket * format.mFramesPerPacket;
+
+			format.mReserved			= 0;
+
+			return true;
+		}
+
+		virtual size_t _GetPreferredBufferSize() const				{ return kRenderFrameCount; }
+
+		void Render()
+		{
+			SFB::Audio::BufferList bufferList;
+			auto next = std::chrono::steady_clock::now();
+
+			while(mIsRunning.load()) {
+				Float64 sampleRate;
+				{
+					// The format only changes between render cycles
+					std::lock_guard<std::mutex> lock(mMutex);
+					sampleRate = mFormat.mSampleRate;
+					if(0 < sampleRate) {
+						if(bufferList.GetFormat() != mFormat && !bufferList.Allocate(mFormat, kRenderFrameCount))
+							break;
+						bufferList.Reset();
+						mPlayer->ProvideAudio(bufferList, kRenderFrameCount);
+					}
+				}
+
+				next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(kRenderFrameCount / (0 < sampleRate ? sampleRate : 44100)));
+				std::this_thread::sleep_until(next);
+			}
+		}
+
+		bool						mIsOpen;
+		std::atomic_bool			mIsRunning;
+		std::thread					mRenderThread;
+		std::mutex					mMutex;
+	};
+
+	long long GetValue(CFDictionaryRef dictionary, CFStringRef key)
+	{
+		long long value = 0;
+		auto number = (CFNumberRef)CFDictionaryGetValue(dictionary, key);
+		if(number)
+			CFNumberGetValue(number, kCFNumberLongLongType, &value);
+		return value;
+	}
+
+	SFB::Audio::Decoder::unique_ptr CreateDecoder(std::mt19937& generator)
+	{
+		SFB::Audio::SignalGeneratorDecoder::Parameters parameters;
+
+		// Changing formats exercises output reconfiguration and ring buffer reallocation
+		// The default format is deinterleaved, so only the sample rate and channel count need changing
+		parameters.mFormat.mSampleRate = kSampleRates[std::uniform_int_distribution<size_t>(0, std::end(kSampleRates) - std::begin(kSampleRates) - 1)(generator)];
+		parameters.mFormat.mChannelsPerFrame = kChannelCounts[std::uniform_int_distribution<size_t>(0, std::end(kChannelCounts) - std::begin(kChannelCounts) - 1)(generator)];
+
+		parameters.mFrequency = std::uniform_real_distribution<double>(110, 1760)(generator);
+		parameters.mTotalFrames = std::uniform_int_distribution<SInt64>(1, 5)(generator) * (SInt64)parameters.mFormat.mSampleRate;
+		return SFB::Audio::SignalGeneratorDecoder::CreateWithParameters(parameters);
+	}
+
+}
+
+int main(int argc, const char *argv [])
+{
+	double duration = 1 < argc ? std::atof(argv[1]) : kDefaultDuration;
+	long long growthThreshold = 2 < argc ? std::atoll(argv[2]) : kDefaultGrowthThreshold;
+	auto operationInterval = std::chrono::milliseconds(3 < argc ? std::atol(argv[3]) : kDefaultOperationInterval);
+
+	std::mt19937 generator(1);
+
+	try {
+		SFB::Audio::Player player;
+		if(!player.SetOutput(SFB::Audio::Output::unique_ptr(new NullOutput))) {
+			std::cerr << "FAIL: unable to set the output" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(duration));
+		auto warmupEnd = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(duration * kWarmupFraction));
+		auto nextSample = start;
+
+		long long baselineFootprint = -1;
+		unsigned long long operations = 0;
+
+		while(std::chrono::steady_clock::now() < end) {
+			switch(std::uniform_int_distribution<int>(0, 3)(generator)) {
+				case 0: {
+					auto decoder = CreateDecoder(generator);
+					player.Play(decoder);
+					break;
+				}
+
+				case 1: {
+					SFB::CFDictionary usage(player.CreateMemoryUsageDictionary());
+					if(GetValue(usage, SFB::Audio::Player::kMemoryUsageQueuedDecoderCountKey) < (long long)kMaximumQueuedDecoders) {
+						auto decoder = CreateDecoder(generator);
+						player.Enqueue(decoder);
+					}
+					break;
+				}
+
+				case 2:
+					player.SkipToNextTrack();
+					break;
+
+				case 3: {
+					SInt64 totalFrames;
+					if(player.GetTotalFrames(totalFrames) && 0 < totalFrames)
+						player.SeekToFrame(std::uniform_int_distribution<SInt64>(0, totalFrames - 1)(generator));
+					break;
+				}
+			}
+
+			++operations;
+
+			auto now = std::chrono::steady_clock::now();
+			if(now >= nextSample) {
+				nextSample = now + kSampleInterval;
+
+				SFB::CFDictionary usage(player.CreateMemoryUsageDictionary());
+				long long footprint = GetValue(usage, SFB::Audio::Player::kMemoryUsagePhysicalFootprintKey);
+
+				std::cout << std::chrono::duration_cast<std::chrono::seconds>(now - start).count() << "s: "
+				<< operations << " operations, footprint " << footprint
+				<< ", ring buffer " << GetValue(usage, SFB::Audio::Player::kMemoryUsageRingBufferKey)
+				<< ", decoder state " << GetValue(usage, SFB::Audio::Player::kMemoryUsageDecoderStateKey)
+				<< ", decoders " << GetValue(usage, SFB::Audio::Player::kMemoryUsageDecodersKey)
+				<< ", decoder state instances " << GetValue(usage, SFB::Audio::Player::kMemoryUsageDecoderStateInstancesKey) << std::endl;
+
+				if(now >= warmupEnd) {
+					if(0 > baselineFootprint)
+						baselineFootprint = footprint;
+					else if(footprint - baselineFootprint > growthThreshold) {
+						std::cerr << "FAIL: physical footprint grew by " << (footprint - baselineFootprint) << " bytes, exceeding the threshold of " << growthThreshold << std::endl;
+						return EXIT_FAILURE;
+					}
+				}
+			}
+
+			if(operationInterval.count())
+				std::this_thread::sleep_for(operationInterval);
+		}
+
+		// Every decoder state should be collected once playback has stopped
+		player.ClearQueuedDecoders();
+		player.Stop();
+		std::this_thread::sleep_for(kCollectionWait);
+
+		SFB::CFDictionary usage(player.CreateMemoryUsageDictionary());
+		long long instances = GetValue(usage, SFB::Audio::Player::kMemoryUsageDecoderStateInstancesKey);
+		if(0 != instances) {
+			std::cerr << "FAIL: " << instances << " decoder states alive after stopping" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	catch(const std::exception& e) {
+		std::cerr << "FAIL: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "PASS" << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+
+#include "ProcessMemoryUsage.h"
+#include "Logger.h"
+
+bool SFB::GetProcessMemoryUsage(ProcessMemoryUsage& usage)
+{
+	task_vm_info_data_t vmInfo;
+	mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+	kern_return_t result = task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&vmInfo, &count);
+	if(KERN_SUCCESS != result) {
+		LOGGER_ERR("org.sbooth.AudioEngine", "task_info failed: " << mach_error_string(result));
+		return false;
+	}
+
+	// Passing nullptr sums the statistics for all zones
+	malloc_statistics_t mallocStatistics;
+	malloc_zone_statistics(nullptr, &mallocStatistics);
+
+	usage.mResidentBytes			= (size_t)vmInfo.resident_size;
+	usage.mPhysicalFootprintBytes	= (size_t)vmInfo.phys_footprint;
+	usage.mMallocBytesInUse			= mallocStatistics.size_in_use;
+	usage.mMallocBytesReserved		= mallocStatistics.size_allocated;
+
+	return true;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/*! @file ProcessMemoryUsage.h @brief Sampling the memory usage of the current process */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*!
+	 * @brief A snapshot of the memory usage of the current process
+	 *
+	 * Sampled periodically, the resident size and physical footprint reveal growth while the
+	 * difference between the bytes reserved by \c malloc and the bytes in use reveals fragmentation.
+	 */
+	struct ProcessMemoryUsage
+	{
+		size_t		mResidentBytes;				/*!< @brief The resident set size */
+		size_t		mPhysicalFootprintBytes;	/*!< @brief The physical footprint, including compressed memory */
+		size_t		mMallocBytesInUse;			/*!< @brief The bytes allocated by \c malloc and not yet freed */
+		size_t		mMallocBytesReserved;		/*!< @brief The bytes reserved by \c malloc zones to satisfy allocations */
+	};
+
+	/*!
+	 * @brief Sample the memory usage of the current process
+	 * @note Summing the statistics of every \c malloc zone takes the zone locks, so this should not be called on a real-time thread
+	 * @param usage A \c ProcessMemoryUsage to receive the sample
+	 * @return \c true on success, \c false otherwise
+	 */
+	bool GetProcessMemoryUsage(ProcessMemoryUsage& usage);
+
+}
@@ -423,7 +423,7 @@ bool SFB::Audio::ReplayGainAnalyzer::AnalyzeURL(CFURLRef url, CFErrorRef *error)
 		.mFramesPerPacket		= 1
 	};
 
-	if(!SetSampleRate((int32_t)outputFormat.mSampleRate)) {
+	if(!BeginTrack((int32_t)outputFormat.mSampleRate)) {
 		if(error) {
 			SFB::CFString description(CFCopyLocalizedString(CFSTR("The file “%@” does not contain audio at a supported sample rate."), ""));
 			SFB::CFString failureReason(CFCopyLocalizedString(CFSTR("Only sample rates of 8.0 KHz, 11.025 KHz, 12.0 KHz, 16.0 KHz, 22.05 KHz, 24.0 KHz, 32.0 KHz, 44.1 KHz, 48 KHz and multiples are supported."), ""));
@@ -443,39 +443,71 @@ bool SFB::Audio::ReplayGainAnalyzer::AnalyzeURL(CFURLRef url, CFErrorRef *error)
 	const UInt32 bufferSizeFrames = 512;
 	BufferList outputBuffer(outputFormat, bufferSizeFrames);
 
-	bool isStereo = (2 == outputFormat.mChannelsPerFrame);
-
 	for(;;) {
 		UInt32 frameCount = converter.ConvertAudio(outputBuffer, bufferSizeFrames);
 		if(0 == frameCount)
 			break;
 
-		// Find the peak sample magnitude
-		float lpeak, rpeak;
-		vDSP_maxmgv((const float *)outputBuffer->mBuffers[0].mData, 1, &lpeak, frameCount);
-		if(isStereo) {
-			vDSP_maxmgv((const float *)outputBuffer->mBuffers[1].mData, 1, &rpeak, frameCount);
-			priv->trackPeak = std::max(priv->trackPeak, std::max(lpeak, rpeak));
-		}
-		else
-			priv->trackPeak = std::max(priv->trackPeak, lpeak);
-
-		// The replay gain analyzer expects 16-bit sample size passed as floats
-		const float scale = 1u << 15;
-		vDSP_vsmul((const float *)outputBuffer->mBuffers[0].mData, 1, &scale, (float *)outputBuffer->mBuffers[0].mData, 1, frameCount);
-		if(isStereo) {
-			vDSP_vsmul((const float *)outputBuffer->mBuffers[1].mData, 1, &scale, (float *)outputBuffer->mBuffers[1].mData, 1, frameCount);
-			AnalyzeSamples((const float *)outputBuffer->mBuffers[0].mData, (const float *)outputBuffer->mBuffers[1].mData, frameCount, true);
-		}
-		else
-			AnalyzeSamples((const float *)outputBuffer->mBuffers[0].mData, nullptr, frameCount, false);
+		AnalyzeAudio(outputBuffer, frameCount);
 	}
 
-	priv->albumPeak = std::max(priv->albumPeak, priv->trackPeak);
+	EndTrack();
+
+	return true;
+}
+
+bool SFB::Audio::ReplayGainAnalyzer::BeginTrack(int32_t sampleRate)
+{
+	return SetSampleRate(sampleRate);
+}
+
+bool SFB::Audio::ReplayGainAnalyzer::AnalyzeAudio(const AudioBufferList *bufferList, UInt32 frameCount)
+{
+	if(nullptr == bufferList || !(1 == bufferList->mNumberBuffers || 2 == bufferList->mNumberBuffers))
+		return false;
+
+	bool isStereo = (2 == bufferList->mNumberBuffers);
+
+	const float *left = (const float *)bufferList->mBuffers[0].mData;
+	const float *right = isStereo ? (const float *)bufferList->mBuffers[1].mData : nullptr;
+
+	// Find the peak sample magnitude
+	float lpeak, rpeak;
+	vDSP_maxmgv(left, 1, &lpeak, frameCount);
+	if(isStereo) {
+		vDSP_maxmgv(right, 1, &rpeak, frameCount);
+		priv->trackPeak = std::max(priv->trackPeak, std::max(lpeak, rpeak));
+	}
+	else
+		priv->trackPeak = std::max(priv->trackPeak, lpeak);
+
+	// The replay gain analyzer expects 16-bit sample size passed as floats
+	const float scale = 1u << 15;
+	const UInt32 chunkSizeFrames = 512;
+	float lchunk [chunkSizeFrames];
+	float rchunk [chunkSizeFrames];
+
+	for(UInt32 framesAnalyzed = 0; framesAnalyzed < frameCount; ) {
+		UInt32 chunkFrames = std::min(chunkSizeFrames, frameCount - framesAnalyzed);
+
+		vDSP_vsmul(left + framesAnalyzed, 1, &scale, lchunk, 1, chunkFrames);
+		if(isStereo)
+			vDSP_vsmul(right + framesAnalyzed, 1, &scale, rchunk, 1, chunkFrames);
+
+		if(!AnalyzeSamples(lchunk, isStereo ? rchunk : nullptr, chunkFrames, isStereo))
+			return false;
+
+		framesAnalyzed += chunkFrames;
+	}
 
 	return true;
 }
 
+void SFB::Audio::ReplayGainAnalyzer::EndTrack()
+{
+	priv->albumPeak = std::max(priv->albumPeak, priv->trackPeak);
+}
+
 bool SFB::Audio::ReplayGainAnalyzer::GetTrackGain(float& trackGain)
 {
 	if(!analyzeResult(priv->A, sizeof(priv->A) / sizeof(*(priv->A)), trackGain))
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <CoreFoundation/CoreFoundation.h>
+#include <CoreAudio/CoreAudioTypes.h>
 #include <memory>
 
 /*! @file ReplayGainAnalyzer.h @brief Support for replay gain calculation */
@@ -97,6 +98,24 @@ namespace SFB {
 			 */
 			bool AnalyzeURL(CFURLRef url, CFErrorRef *error = nullptr);
 
+			/*!
+			 * @brief Begin analyzing a track whose audio will be supplied using \c ReplayGainAnalyzer::AnalyzeAudio()
+			 * @param sampleRate The sample rate of the audio, which must be natively supported
+			 * @return \c true on success, false otherwise
+			 */
+			bool BeginTrack(int32_t sampleRate);
+
+			/*!
+			 * @brief Analyze a block of audio from the track begun with \c ReplayGainAnalyzer::BeginTrack()
+			 * @param bufferList Mono or stereo deinterleaved 32-bit float audio normalized to [-1, 1)
+			 * @param frameCount The number of valid frames in \c bufferList
+			 * @return \c true on success, false otherwise
+			 */
+			bool AnalyzeAudio(const AudioBufferList *bufferList, UInt32 frameCount);
+
+			/*! @brief Finish the track begun with \c ReplayGainAnalyzer::BeginTrack() and include its peak in the album peak */
+			void EndTrack();
+
 			//@}
 
 
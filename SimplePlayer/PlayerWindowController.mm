@@ -160,7 +160,8 @@ enum ePlayerFlags : unsigned int {
 - (IBAction) seek:(id)sender
 {
 #pragma unused(sender)
-	_player->SeekToPosition([sender floatValue]);
+	// The slider is used for scrubbing, so favor responsiveness over accuracy
+	_player->SeekToPosition([sender floatValue], SFB::Audio::Decoder::SeekMode::Fast);
 }
 
 - (IBAction) skipToNextTrack:(id)sender
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+// A benchmark for Player's time to first audio.
+//
+// Each file is played repeatedly, once through Player::Play() with its URL and once for each
+// kind of file input source, and the player's startup trace is collected after every start.
+// The minimum, median, and maximum time to each milestone is reported per file and input
+// source so start latency can be attributed to the stage responsible for it.  Decoders for
+// explicit input sources are created before Play() is called, so their creation time is
+// measured separately.  URLs that aren't files are only played through their URL.
+//
+// Usage: StartupBenchmark [-n iterations] file-or-url ...
+//
+// Build against the framework, for example:
+//   clang++ -std=c++14 -F <products dir> -framework SFBAudioEngine -framework CoreFoundation StartupBenchmark/main.cpp -o StartupBenchmark
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SFBAudioEngine/AudioDecoder.h>
+#include <SFBAudioEngine/AudioPlayer.h>
+#include <SFBAudioEngine/CFWrapper.h>
+#include <SFBAudioEngine/InputSource.h>
+
+namespace {
+
+	const int kDefaultIterations				= 10;
+	const auto kStartupTimeout					= std::chrono::seconds(10);
+	const auto kPollInterval					= std::chrono::milliseconds(1);
+
+	// How a decoder's input is opened
+	struct Source
+	{
+		const char	*mName;
+		int			mFlags;
+		bool		mUsesURL;		// Whether Play() is passed the URL instead of a decoder
+	};
+
+	const Source kSources [] = {
+		{ "url",		0,										true },
+		{ "file",		0,										false },
+		{ "mmap",		SFB::InputSource::MemoryMapFiles,		false },
+		{ "memory",		SFB::InputSource::LoadFilesInMemory,	false },
+	};
+
+	// Decoders for explicit input sources are created before the trace starts
+	const char * const kDecoderCreationLabel = "decoder created (before Play)";
+
+	// Milestones in the order playback reaches them
+	const std::pair<CFStringRef, const char *> kMilestones [] = {
+		{ SFB::Audio::Player::kStartupTraceDecoderCreatedKey,		"decoder created" },
+		{ SFB::Audio::Player::kStartupTraceInputSourceOpenedKey,	"input source opened" },
+		{ SFB::Audio::Player::kStartupTraceDecoderOpenedKey,		"decoder opened" },
+		{ SFB::Audio::Player::kStartupTraceOutputConfiguredKey,		"output configured" },
+		{ SFB::Audio::Player::kStartupTraceConverterCreatedKey,		"converter created" },
+		{ SFB::Audio::Player::kStartupTraceRingBufferWriteKey,		"ring buffer written" },
+		{ SFB::Audio::Player::kStartupTraceOutputStartedKey,		"output started" },
+		{ SFB::Audio::Player::kStartupTraceFirstRenderKey,			"first render" },
+		{ SFB::Audio::Player::kStartupTraceFirstAudibleFrameKey,	"first audible frame" },
+	};
+
+	// Nanoseconds to each milestone, one sample per start
+	using Samples = std::map<std::string, std::vector<long long>>;
+
+	CFURLRef CreateURLForArgument(const char *argument)
+	{
+		if(strstr(argument, "://"))
+			return CFURLCreateWithBytes(kCFAllocatorDefault, (const UInt8 *)argument, (CFIndex)strlen(argument), kCFStringEncodingUTF8, nullptr);
+		return CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault, (const UInt8 *)argument, (CFIndex)strlen(argument), false);
+	}
+
+	// Wait for the first audible frame, returning the trace for the start
+	CFDictionaryRef WaitForStartupTrace(const SFB::Audio::Player& player)
+	{
+		auto timeout = std::chrono::steady_clock::now() + kStartupTimeout;
+		for(;;) {
+			auto trace = player.CreateStartupTraceDictionary();
+			if(trace && (CFDictionaryContainsKey(trace, SFB::Audio::Player::kStartupTraceFirstAudibleFrameKey) || std::chrono::steady_clock::now() >= timeout))
+				return trace;
+			if(trace)
+				CFRelease(trace);
+			std::this_thread::sleep_for(kPollInterval);
+		}
+	}
+
+	bool Start(SFB::Audio::Player& player, CFURLRef url, const Source& source, Samples& samples)
+	{
+		if(source.mUsesURL) {
+			if(!player.Play(url))
+				return false;
+		}
+		else {
+			auto startTime = std::chrono::steady_clock::now();
+			auto decoder = SFB::Audio::Decoder::CreateForInputSource(SFB::InputSource::CreateForURL(url, source.mFlags));
+			if(!decoder)
+				return false;
+			samples[kDecoderCreationLabel].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count());
+
+			if(!player.Play(decoder))
+				return false;
+		}
+
+		SFB::CFDictionary trace(WaitForStartupTrace(player));
+		if(!trace)
+			return false;
+
+		for(const auto& milestone : kMilestones) {
+			auto number = (CFNumberRef)CFDictionaryGetValue(trace, milestone.first);
+			long long nanoseconds;
+			if(number && CFNumberGetValue(number, kCFNumberLongLongType, &nanoseconds))
+				samples[milestone.second].push_back(nanoseconds);
+		}
+
+		return player.Stop();
+	}
+
+	void PrintRow(const char *label, std::vector<long long>& values)
+	{
+		if(values.empty())
+			return;
+
+		std::sort(std::begin(values), std::end(values));
+		std::cout << "    " << std::left << std::setw(32) << label << std::right << std::fixed << std::setprecision(3)
+		<< std::setw(10) << values.front() / 1e6
+		<< std::setw(10) << values[values.size() / 2] / 1e6
+		<< std::setw(10) << values.back() / 1e6
+		<< "  (" << values.size() << ")" << std::endl;
+	}
+
+	void PrintSamples(const char *argument, const Source& source, Samples& samples)
+	{
+		std::cout << argument << " [" << source.mName << "]" << std::endl;
+		std::cout << "    " << std::left << std::setw(32) << "milestone (ms)" << std::right << std::setw(10) << "min" << std::setw(10) << "median" << std::setw(10) << "max" << std::endl;
+
+		PrintRow(kDecoderCreationLabel, samples[kDecoderCreationLabel]);
+		for(const auto& milestone : kMilestones)
+			PrintRow(milestone.second, samples[milestone.second]);
+	}
+
+}
+
+int main(int argc, const char *argv [])
+{
+	int iterations = kDefaultIterations;
+	int firstArgument = 1;
+	if(3 <= argc && 0 == strcmp(argv[1], "-n")) {
+		iterations = std::max(std::atoi(argv[2]), 1);
+		firstArgument = 3;
+	}
+
+	if(firstArgument >= argc) {
+		std::cerr << "Usage: " << argv[0] << " [-n iterations] file-or-url ..." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	bool failed = false;
+
+	try {
+		SFB::Audio::Player player;
+
+		for(int i = firstArgument; i < argc; ++i) {
+			SFB::CFURL url(CreateURLForArgument(argv[i]));
+			if(!url) {
+				std::cerr << "Invalid URL: " << argv[i] << std::endl;
+				failed = true;
+				continue;
+			}
+
+			SFB::CFString scheme(CFURLCopyScheme(url));
+			bool isFile = scheme && kCFCompareEqualTo == CFStringCompare(scheme, CFSTR("file"), kCFCompareCaseInsensitive);
+
+			for(const auto& source : kSources) {
+				if(!source.mUsesURL && !isFile)
+					continue;
+
+				Samples samples;
+				for(int iteration = 0; iteration < iterations; ++iteration) {
+					if(!Start(player, url, source, samples)) {
+						std::cerr << "Unable to play " << argv[i] << " [" << source.mName << "]" << std::endl;
+						failed = true;
+						break;
+					}
+				}
+
+				PrintSamples(argv[i], source, samples);
+			}
+		}
+	}
+
+	catch(const std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+
+#include "SubclassDispatchTable.h"
+
+namespace {
+
+	// Extensions and MIME types are short, so most keys fold without allocating
+	const CFIndex kStackKeyLength = 64;
+
+}
+
+void SFB::SubclassDispatchTable::Add(Table& table, CFMutableArrayRef supportedTypes, CFArrayRef keys, size_t index)
+{
+	if(nullptr == keys)
+		return;
+
+	CFArrayAppendArray(supportedTypes, keys, CFRangeMake(0, CFArrayGetCount(keys)));
+
+	std::string folded;
+	for(CFIndex i = 0; i < CFArrayGetCount(keys); ++i) {
+		auto key = (CFStringRef)CFArrayGetValueAtIndex(keys, i);
+		if(!FoldKey(key, folded))
+			continue;
+
+		// A subclass may list the same type more than once
+		auto& subclasses = table.mEntries[folded];
+		if(subclasses.empty() || subclasses.back() != index)
+			subclasses.push_back(index);
+
+		table.mMaximumKeyLength = std::max(table.mMaximumKeyLength, CFStringGetLength(key));
+	}
+}
+
+const std::vector<size_t> * SFB::SubclassDispatchTable::Find(const Table& table, CFStringRef key)
+{
+	// Keys longer than any registered key can't match
+	if(nullptr == key || CFStringGetLength(key) > table.mMaximumKeyLength)
+		return nullptr;
+
+	std::string folded;
+	if(!FoldKey(key, folded))
+		return nullptr;
+
+	auto iter = table.mEntries.find(folded);
+	if(iter == table.mEntries.end())
+		return nullptr;
+
+	return &iter->second;
+}
+
+bool SFB::SubclassDispatchTable::FoldKey(CFStringRef key, std::string& folded)
+{
+	if(nullptr == key)
+		return false;
+
+	// ASCII keys are folded in place
+	char buf [kStackKeyLength];
+	if(CFStringGetCString(key, buf, kStackKeyLength, kCFStringEncodingASCII)) {
+		folded.assign(buf);
+		std::transform(folded.begin(), folded.end(), folded.begin(), [](char c) {
+			return ('A' <= c && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+		});
+		return true;
+	}
+
+	// Other keys are folded by CFString
+	SFB::CFMutableString mutableKey(CFStringCreateMutableCopy(kCFAllocatorDefault, 0, key));
+	if(!mutableKey)
+		return false;
+
+	CFStringFold(mutableKey, kCFCompareCaseInsensitive, nullptr);
+
+	CFIndex length = CFStringGetLength(mutableKey);
+	CFIndex byteCount = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+	std::vector<char> utf8(byteCount + 1);
+	if(!CFStringGetCString(mutableKey, utf8.data(), byteCount + 1, kCFStringEncodingUTF8))
+		return false;
+
+	folded.assign(utf8.data());
+	return true;
+}
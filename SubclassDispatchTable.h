@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include "CFWrapper.h"
+
+/*! @file SubclassDispatchTable.h @brief Fast lookup of registered subclasses by file extension and MIME type */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*!
+	 * @brief An immutable mapping from file extensions and MIME types to registered subclasses
+	 *
+	 * The table is built once from a list of registered subclasses, which must be sorted by
+	 * priority.  Keys are case folded, so lookups are a single hash table probe rather than a
+	 * case-insensitive comparison against every type supported by every subclass.  Lookups return
+	 * the indexes of the matching subclasses in priority order, or \c nullptr if no subclass
+	 * handles the type.
+	 */
+	class SubclassDispatchTable
+	{
+
+	public:
+
+		// ========================================
+		/*! @name Creation */
+		//@{
+
+		/*! @brief A \c std::shared_ptr for \c SubclassDispatchTable objects */
+		using shared_ptr = std::shared_ptr<const SubclassDispatchTable>;
+
+		/*!
+		 * @brief Create a \c SubclassDispatchTable
+		 * @tparam T The subclass registration type, which must provide \c mCreateSupportedFileExtensions and \c mCreateSupportedMIMETypes
+		 * @param subclasses The registered subclasses, sorted by priority
+		 */
+		template <typename T> static shared_ptr Create(const std::vector<T>& subclasses);
+
+		//@}
+
+
+		// ========================================
+		/*! @name Lookup */
+		//@{
+
+		/*! @brief Get the indexes of the subclasses handling \c extension in priority order, or \c nullptr if none */
+		inline const std::vector<size_t> * SubclassesForExtension(CFStringRef extension) const		{ return Find(mExtensions, extension); }
+
+		/*! @brief Get the indexes of the subclasses handling \c mimeType in priority order, or \c nullptr if none */
+		inline const std::vector<size_t> * SubclassesForMIMEType(CFStringRef mimeType) const		{ return Find(mMIMETypes, mimeType); }
+
+		/*! @brief Get all supported file extensions */
+		inline CFArrayRef GetSupportedFileExtensions() const										{ return mSupportedFileExtensions; }
+
+		/*! @brief Get all supported MIME types */
+		inline CFArrayRef GetSupportedMIMETypes() const												{ return mSupportedMIMETypes; }
+
+		//@}
+
+	private:
+
+		struct Table
+		{
+			std::unordered_map<std::string, std::vector<size_t>> mEntries;
+			CFIndex mMaximumKeyLength = 0;
+		};
+
+		SubclassDispatchTable() = default;
+
+		// Add the types in keys, handled by the subclass at index, to table and supportedTypes
+		static void Add(Table& table, CFMutableArrayRef supportedTypes, CFArrayRef keys, size_t index);
+		static const std::vector<size_t> * Find(const Table& table, CFStringRef key);
+
+		// Convert key to its case folded UTF-8 representation
+		static bool FoldKey(CFStringRef key, std::string& folded);
+
+		Table							mExtensions;
+		Table							mMIMETypes;
+		SFB::CFArray					mSupportedFileExtensions;
+		SFB::CFArray					mSupportedMIMETypes;
+	};
+
+	// ========================================
+	// Template implementation
+	template <typename T> SubclassDispatchTable::shared_ptr SubclassDispatchTable::Create(const std::vector<T>& subclasses)
+	{
+		auto dispatchTable = std::shared_ptr<SubclassDispatchTable>(new SubclassDispatchTable);
+
+		SFB::CFMutableArray supportedFileExtensions(CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks));
+		SFB::CFMutableArray supportedMIMETypes(CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks));
+
+		for(size_t i = 0; i < subclasses.size(); ++i) {
+			SFB::CFArray fileExtensions(subclasses[i].mCreateSupportedFileExtensions());
+			Add(dispatchTable->mExtensions, supportedFileExtensions, fileExtensions, i);
+
+			SFB::CFArray mimeTypes(subclasses[i].mCreateSupportedMIMETypes());
+			Add(dispatchTable->mMIMETypes, supportedMIMETypes, mimeTypes, i);
+		}
+
+		dispatchTable->mSupportedFileExtensions = CFArrayCreateCopy(kCFAllocatorDefault, supportedFileExtensions);
+		dispatchTable->mSupportedMIMETypes = CFArrayCreateCopy(kCFAllocatorDefault, supportedMIMETypes);
+
+		return dispatchTable;
+	}
+
+}
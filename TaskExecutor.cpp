@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include <Block.h>
+
+#include "TaskExecutor.h"
+#include "Logger.h"
+
+namespace {
+
+	const qos_class_t sQualityOfServiceClasses [] = {
+		QOS_CLASS_USER_INTERACTIVE,		// Decode
+		QOS_CLASS_USER_INITIATED,		// Prefetch
+		QOS_CLASS_UTILITY,				// Analysis
+		QOS_CLASS_UTILITY				// Maintenance; background QoS may be deferred indefinitely
+	};
+
+	// How long destruction waits for executing tasks
+	const int64_t kShutdownTimeout = 2 * NSEC_PER_SEC;
+
+}
+
+SFB::TaskExecutor::CancellationToken::CancellationToken()
+	: mCancelled(std::make_shared<std::atomic_bool>(false))
+{}
+
+#pragma mark Creation and Destruction
+
+SFB::TaskExecutor& SFB::TaskExecutor::GetSharedExecutor()
+{
+	static TaskExecutor sSharedExecutor;
+	return sSharedExecutor;
+}
+
+SFB::TaskExecutor::TaskExecutor()
+	: mNextSequenceNumber(0), mExecutingTasks(nullptr), mLifetime(std::make_shared<Lifetime>())
+{
+	mExecutingTasks = dispatch_group_create();
+	if(nullptr == mExecutingTasks) {
+		LOGGER_CRIT("org.sbooth.AudioEngine.TaskExecutor", "dispatch_group_create failed");
+		throw std::runtime_error("Unable to create the dispatch group");
+	}
+
+	unsigned int processorCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// Leave processors free for the audio path by limiting lower-priority work
+	const unsigned int maximumConcurrency [] = {
+		processorCount,						// Decode
+		4,									// Prefetch
+		std::max(1u, processorCount / 2),	// Analysis
+		1									// Maintenance
+	};
+
+	for(size_t i = 0; i < kTaskClassCount; ++i) {
+		mTaskClasses[i].mQueue = dispatch_get_global_queue(sQualityOfServiceClasses[i], 0);
+		mTaskClasses[i].mMaximumConcurrency = maximumConcurrency[i];
+		mTaskClasses[i].mExecutingTaskCount = 0;
+	}
+}
+
+SFB::TaskExecutor::~TaskExecutor()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for(auto& state : mTaskClasses) {
+			while(!state.mPendingTasks.empty()) {
+				Block_release(state.mPendingTasks.top().mBlock);
+				state.mPendingTasks.pop();
+			}
+		}
+
+		// Ask long-running tasks to return early
+		for(auto& iter : mExecutingTaskTokens)
+			iter.second.Cancel();
+	}
+
+	if(0 != dispatch_group_wait(mExecutingTasks, dispatch_time(DISPATCH_TIME_NOW, kShutdownTimeout)))
+		LOGGER_WARNING("org.sbooth.AudioEngine.TaskExecutor", "Executing tasks did not finish before destruction");
+
+	// Tasks still executing must not touch the executor when they complete
+	{
+		std::lock_guard<std::mutex> lock(mLifetime->mMutex);
+		mLifetime->mIsExecutorAlive = false;
+	}
+
+	dispatch_release(mExecutingTasks);
+}
+
+#pragma mark Task submission
+
+void SFB::TaskExecutor::Submit(TaskClass taskClass, TaskBlock block, CancellationToken token, dispatch_time_t deadline)
+{
+	if(nullptr == block)
+		return;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto& state = mTaskClasses[(size_t)taskClass];
+	state.mPendingTasks.push({ deadline, mNextSequenceNumber++, Block_copy(block), token });
+
+	StartPendingTasks(state);
+}
+
+dispatch_queue_t SFB::TaskExecutor::GetQueue(TaskClass taskClass) const
+{
+	return mTaskClasses[(size_t)taskClass].mQueue;
+}
+
+#pragma mark Concurrency limits
+
+unsigned int SFB::TaskExecutor::GetMaximumConcurrency(TaskClass taskClass) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mTaskClasses[(size_t)taskClass].mMaximumConcurrency;
+}
+
+bool SFB::TaskExecutor::SetMaximumConcurrency(TaskClass taskClass, unsigned int maximumConcurrency)
+{
+	if(0 == maximumConcurrency)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto& state = mTaskClasses[(size_t)taskClass];
+	state.mMaximumConcurrency = maximumConcurrency;
+
+	// Raising the limit may allow pending tasks to start
+	StartPendingTasks(state);
+
+	return true;
+}
+
+#pragma mark Task execution
+
+void SFB::TaskExecutor::StartPendingTasks(TaskClassState& state)
+{
+	auto classIndex = (size_t)(&state - mTaskClasses);
+
+	while(state.mExecutingTaskCount < state.mMaximumConcurrency && !state.mPendingTasks.empty()) {
+		auto task = state.mPendingTasks.top();
+		state.mPendingTasks.pop();
+
+		if(task.mToken.IsCancelled()) {
+			Block_release(task.mBlock);
+			continue;
+		}
+
+		if(DISPATCH_TIME_FOREVER != task.mDeadline && dispatch_time(DISPATCH_TIME_NOW, 0) > task.mDeadline) {
+			LOGGER_INFO("org.sbooth.AudioEngine.TaskExecutor", "Discarding task that missed its deadline");
+			Block_release(task.mBlock);
+			continue;
+		}
+
+		++state.mExecutingTaskCount;
+		mExecutingTaskTokens.emplace(task.mSequenceNumber, task.mToken);
+
+		TaskBlock block = task.mBlock;
+		uint64_t sequenceNumber = task.mSequenceNumber;
+		std::shared_ptr<Lifetime> lifetime = mLifetime;
+		dispatch_group_async(mExecutingTasks, state.mQueue, ^{
+			block();
+			Block_release(block);
+
+			std::lock_guard<std::mutex> lifetimeLock(lifetime->mMutex);
+			if(!lifetime->mIsExecutorAlive)
+				return;
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			mExecutingTaskTokens.erase(sequenceNumber);
+			auto& taskClassState = mTaskClasses[classIndex];
+			--taskClassState.mExecutingTaskCount;
+			StartPendingTasks(taskClassState);
+		});
+	}
+}
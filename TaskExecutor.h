@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2017 Stephen F. Booth <me@sbooth.org>
+ * See https://github.com/sbooth/SFBAudioEngine/blob/master/LICENSE.txt for license information
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include <dispatch/dispatch.h>
+
+/*! @file TaskExecutor.h @brief A prioritized executor for background work */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*!
+	 * @brief An engine-wide executor for background work
+	 *
+	 * Work is divided into task classes, each mapped to a libdispatch quality of service class and
+	 * limited to a maximum number of concurrently executing tasks so that lower-priority work
+	 * cannot oversubscribe the processors and starve the audio path.  Tasks execute on the
+	 * libdispatch worker pool, which balances threads across processors.
+	 *
+	 * Within a class pending tasks are started in order of their deadlines, earliest first; tasks
+	 * without a deadline start after all tasks with one, in submission order.  A task that has not
+	 * started by its deadline, or whose cancellation token has been cancelled, is discarded.
+	 */
+	class TaskExecutor
+	{
+
+	public:
+
+		/*! @brief Classes of work, in decreasing order of priority */
+		enum class TaskClass : unsigned int {
+			Decode			= 0,	/*!< Decoding that feeds audio output */
+			Prefetch		= 1,	/*!< Reading data that will be needed soon */
+			Analysis		= 2,	/*!< Long-running computation such as replay gain analysis */
+			Maintenance		= 3		/*!< Housekeeping such as releasing finished decoders */
+		};
+
+		/*! @brief A block executed by the executor */
+		using TaskBlock = void (^)();
+
+		/*!
+		 * @brief A token used to cancel submitted tasks
+		 *
+		 * Copies of a token share state, so cancelling any copy cancels them all. Long-running
+		 * tasks should periodically call \c IsCancelled() and return early if it returns \c true.
+		 */
+		class CancellationToken
+		{
+
+		public:
+
+			/*! @brief Create a new \c CancellationToken */
+			CancellationToken();
+
+			/*! @brief Cancel all tasks associated with this token */
+			inline void Cancel()								{ mCancelled->store(true); }
+
+			/*! @brief Query whether this token has been cancelled */
+			inline bool IsCancelled() const						{ return mCancelled->load(); }
+
+		private:
+			std::shared_ptr<std::atomic_bool> mCancelled;
+		};
+
+
+		// ========================================
+		/*! @name Creation and Destruction */
+		//@{
+
+		/*! @brief Get the shared \c TaskExecutor used by the engine */
+		static TaskExecutor& GetSharedExecutor();
+
+		/*! @brief Create a new \c TaskExecutor with default concurrency limits */
+		TaskExecutor();
+
+		/*!
+		 * @brief Destroy this \c TaskExecutor
+		 * @note Pending tasks are discarded and the tokens of executing tasks are cancelled.  Executing
+		 * tasks are waited for, but only briefly so a blocked task can't prevent the process from exiting.
+		 */
+		~TaskExecutor();
+
+		/*! @cond */
+
+		/*! @internal This class is non-copyable */
+		TaskExecutor(const TaskExecutor& rhs) = delete;
+
+		/*! @internal This class is non-assignable */
+		TaskExecutor& operator=(const TaskExecutor& rhs) = delete;
+
+		/*! @endcond */
+		//@}
+
+
+		// ========================================
+		/*! @name Task submission */
+		//@{
+
+		/*!
+		 * @brief Submit a task for asynchronous execution
+		 * @param taskClass The class of work performed by \c block
+		 * @param block The block to execute
+		 * @param token An optional token used to cancel the task before it starts
+		 * @param deadline The time by which the task must start, created using \c dispatch_time(), or \c DISPATCH_TIME_FOREVER
+		 */
+		void Submit(TaskClass taskClass, TaskBlock block, CancellationToken token = CancellationToken(), dispatch_time_t deadline = DISPATCH_TIME_FOREVER);
+
+		/*!
+		 * @brief Get the libdispatch queue used for a task class
+		 * @note Work submitted directly to the queue, for example by a dispatch source, is not subject to the class's concurrency limit
+		 * @param taskClass The task class
+		 * @return A global concurrent queue with the quality of service for \c taskClass
+		 */
+		dispatch_queue_t GetQueue(TaskClass taskClass) const;
+
+		//@}
+
+
+		// ========================================
+		/*! @name Concurrency limits */
+		//@{
+
+		/*! @brief Get the maximum number of tasks of \c taskClass that may execute concurrently */
+		unsigned int GetMaximumConcurrency(TaskClass taskClass) const;
+
+		/*!
+		 * @brief Set the maximum number of tasks of \c taskClass that may execute concurrently
+		 * @param taskClass The task class
+		 * @param maximumConcurrency The maximum number of concurrent tasks, which must be greater than zero
+		 * @return \c true on success, \c false otherwise
+		 */
+		bool SetMaximumConcurrency(TaskClass taskClass, unsigned int maximumConcurrency);
+
+		//@}
+
+	private:
+
+		static const size_t kTaskClassCount = 4;
+
+		// A task waiting for a free slot in its class
+		struct PendingTask
+		{
+			dispatch_time_t		mDeadline;
+			uint64_t			mSequenceNumber;
+			TaskBlock			mBlock;
+			CancellationToken	mToken;
+
+			// Inverted so std::priority_queue yields the earliest deadline, then the earliest submission
+			inline bool operator<(const PendingTask& rhs) const
+			{
+				if(mDeadline != rhs.mDeadline)
+					return mDeadline > rhs.mDeadline;
+				return mSequenceNumber > rhs.mSequenceNumber;
+			}
+		};
+
+		struct TaskClassState
+		{
+			dispatch_queue_t						mQueue;
+			std::priority_queue<PendingTask>		mPendingTasks;
+			unsigned int							mMaximumConcurrency;
+			unsigned int							mExecutingTaskCount;
+		};
+
+		// Shared with executing tasks, which may outlive the executor if it is destroyed while they run
+		struct Lifetime
+		{
+			std::mutex		mMutex;
+			bool			mIsExecutorAlive = true;
+		};
+
+		// Start as many pending tasks as the class's limit allows; must be called with mMutex locked
+		void StartPendingTasks(TaskClassState& state);
+
+		// Data members
+		mutable std::mutex							mMutex;
+		TaskClassState								mTaskClasses [kTaskClassCount];
+		uint64_t									mNextSequenceNumber;
+		std::map<uint64_t, CancellationToken>		mExecutingTaskTokens;
+		dispatch_group_t							mExecutingTasks;
+		std::shared_ptr<Lifetime>					mLifetime;
+	};
+
+}